@@ -0,0 +1,109 @@
+#include "chip8_env.h"
+
+#include <exception>
+#include <string>
+
+#include "EnvironmentBatch.h"
+
+static_assert(CHIP8_ENV_WIDTH == GRAPHIC_WIDTH && CHIP8_ENV_HEIGHT == GRAPHIC_HEIGHT);
+static_assert(CHIP8_ENV_WAIT_KEY == static_cast<int>(WaitReason::Key) &&
+  CHIP8_ENV_WAIT_DELAY_TIMER == static_cast<int>(WaitReason::DelayTimer) &&
+  CHIP8_ENV_WAIT_HALT == static_cast<int>(WaitReason::Halt));
+
+struct chip8_batch
+{
+  EnvironmentBatch batch;
+};
+
+namespace
+{
+  thread_local std::string lastError;
+
+  // nothing may be thrown across the C boundary
+  template <typename Function>
+  int guard(Function function)
+  {
+    try
+    {
+      function();
+      lastError.clear();
+      return 0;
+    }
+    catch (const std::exception& e)
+    {
+      lastError = e.what();
+    }
+    catch (...)
+    {
+      lastError = "unknown error";
+    }
+    return -1;
+  }
+}
+
+uint32_t chip8_api_version(void)
+{
+  return CHIP8_ENV_API_VERSION;
+}
+
+const char* chip8_last_error(void)
+{
+  return lastError.c_str();
+}
+
+chip8_batch* chip8_create_batch(const uint8_t* rom, const size_t rom_size, const size_t n, const size_t threads)
+{
+  chip8_batch* batch = nullptr;
+
+  guard([&]
+  {
+    if (rom == nullptr && rom_size != 0) throw std::invalid_argument("chip8_create_batch: rom is NULL");
+    batch = new chip8_batch{EnvironmentBatch(RomImage{rom, rom_size}, n, threads)};
+  });
+
+  return batch;
+}
+
+void chip8_destroy_batch(chip8_batch* batch)
+{
+  delete batch;
+}
+
+size_t chip8_batch_size(const chip8_batch* batch)
+{
+  return batch->batch.size();
+}
+
+int chip8_step(chip8_batch* batch, const uint16_t* actions, const unsigned int frames)
+{
+  return guard([&]
+  {
+    if (actions == nullptr) throw std::invalid_argument("chip8_step: actions is NULL");
+    batch->batch.step(actions, frames);
+  });
+}
+
+int chip8_reset(chip8_batch* batch, const uint8_t* mask)
+{
+  return guard([&] { batch->batch.reset(mask); });
+}
+
+int chip8_seed(chip8_batch* batch, const uint64_t seed)
+{
+  return guard([&] { batch->batch.seed(seed); });
+}
+
+const uint8_t* chip8_observations(const chip8_batch* batch)
+{
+  return batch->batch.getObservations();
+}
+
+const uint8_t* chip8_faulted(const chip8_batch* batch)
+{
+  return batch->batch.getFaulted();
+}
+
+const uint8_t* chip8_waiting(const chip8_batch* batch)
+{
+  return batch->batch.getWaiting();
+}
@@ -0,0 +1,370 @@
+// Python extension over the C API in include/chip8_env.h.
+//
+//   import chip8env, numpy
+//   batch = chip8env.create_batch(open("pong.ch8", "rb").read(), 1024, threads=8)
+//   observations = numpy.asarray(batch)        # (1024, 32, 64) uint8, a view, updated by every step
+//   batch.step(numpy.zeros(1024, numpy.uint16), frames=4)
+//   batch.reset(batch.faulted)
+//
+// A Batch exports its observations through the buffer protocol, so numpy.asarray / memoryview wrap them without a
+// copy. step() releases the GIL while the instances run. The C API does not allow two threads on one batch, so
+// until the step returns any other use of its Batch from Python raises RuntimeError (BufferError for a new view).
+// Views taken before keep pointing at the screens being written.
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cstring>
+#include <vector>
+
+#include "chip8_env.h"
+
+namespace
+{
+  struct Batch
+  {
+    PyObject_HEAD
+    chip8_batch* batch;
+    size_t size;
+    Py_ssize_t shape[3];
+    Py_ssize_t strides[3];
+    // used when the actions are not a uint16 buffer already
+    std::vector<uint16_t> actions;
+    // set by step() from before it reads the actions until it returns, read and written with the GIL held
+    bool busy;
+  };
+
+  bool checkIdle(const Batch* self, PyObject* exception = PyExc_RuntimeError)
+  {
+    if (!self->busy) return true;
+    PyErr_SetString(exception, "the batch is being stepped by another thread");
+    return false;
+  }
+
+  PyObject* raiseLastError()
+  {
+    PyErr_SetString(PyExc_RuntimeError, chip8_last_error());
+    return nullptr;
+  }
+
+  // Points actions at n uint16 values taken from obj: a C-contiguous buffer of uint16 (numpy, array('H')) is used in
+  // place, anything else is read as a sequence of ints.
+  bool readActions(Batch* self, PyObject* obj, Py_buffer& view, const uint16_t*& actions)
+  {
+    if (PyObject_CheckBuffer(obj) && PyObject_GetBuffer(obj, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == 0)
+    {
+      const bool uint16 = view.itemsize == 2 && view.format != nullptr &&
+        (strcmp(view.format, "H") == 0 || strcmp(view.format, "=H") == 0 || strcmp(view.format, "<H") == 0);
+      if (uint16 && static_cast<size_t>(view.len / 2) == self->size)
+      {
+        actions = static_cast<const uint16_t*>(view.buf);
+        return true;
+      }
+      PyBuffer_Release(&view);
+    }
+    PyErr_Clear();
+    view.obj = nullptr;
+
+    PyObject* sequence = PySequence_Fast(obj, "actions must be a uint16 buffer or a sequence of ints");
+    if (sequence == nullptr) return false;
+
+    if (static_cast<size_t>(PySequence_Fast_GET_SIZE(sequence)) != self->size)
+    {
+      Py_DECREF(sequence);
+      PyErr_SetString(PyExc_ValueError, "one action per instance is needed");
+      return false;
+    }
+
+    self->actions.resize(self->size);
+    for (size_t i = 0; i < self->size; ++i)
+    {
+      const unsigned long value = PyLong_AsUnsignedLong(PySequence_Fast_GET_ITEM(sequence, i));
+      if (PyErr_Occurred() || value > 0xFFFFu)
+      {
+        Py_DECREF(sequence);
+        if (!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "actions are 16-bit key masks");
+        return false;
+      }
+      self->actions[i] = static_cast<uint16_t>(value);
+    }
+    Py_DECREF(sequence);
+
+    actions = self->actions.data();
+    return true;
+  }
+
+  void Batch_dealloc(Batch* self)
+  {
+    if (self->batch != nullptr) chip8_destroy_batch(self->batch);
+    self->actions.~vector();
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+  }
+
+  PyObject* Batch_step(Batch* self, PyObject* args, PyObject* kwargs)
+  {
+    static const char* keywords[] = {"actions", "frames", nullptr};
+    PyObject* actionsObject;
+    unsigned int frames = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|I", const_cast<char**>(keywords), &actionsObject, &frames))
+    {
+      return nullptr;
+    }
+
+    if (!checkIdle(self)) return nullptr;
+    // reading a sequence of actions may run Python code, which may switch threads
+    self->busy = true;
+    Py_buffer view{};
+    const uint16_t* actions = nullptr;
+    if (!readActions(self, actionsObject, view, actions))
+    {
+      self->busy = false;
+      return nullptr;
+    }
+
+    int result;
+    Py_BEGIN_ALLOW_THREADS
+    result = chip8_step(self->batch, actions, frames);
+    Py_END_ALLOW_THREADS
+
+    if (view.obj != nullptr) PyBuffer_Release(&view);
+    self->busy = false;
+    if (result != 0) return raiseLastError();
+    Py_RETURN_NONE;
+  }
+
+  PyObject* Batch_reset(Batch* self, PyObject* args, PyObject* kwargs)
+  {
+    static const char* keywords[] = {"mask", nullptr};
+    PyObject* maskObject = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", const_cast<char**>(keywords), &maskObject)) return nullptr;
+    if (!checkIdle(self)) return nullptr;
+
+    if (maskObject == Py_None)
+    {
+      if (chip8_reset(self->batch, nullptr) != 0) return raiseLastError();
+      Py_RETURN_NONE;
+    }
+
+    // any truthy value per instance, a bytes/bool array is read directly
+    std::vector<uint8_t> mask(self->size);
+    Py_buffer view{};
+    if (PyObject_CheckBuffer(maskObject) && PyObject_GetBuffer(maskObject, &view, PyBUF_C_CONTIGUOUS) == 0 &&
+      static_cast<size_t>(view.len) == self->size)
+    {
+      memcpy(mask.data(), view.buf, self->size);
+      PyBuffer_Release(&view);
+    }
+    else
+    {
+      if (view.obj != nullptr) PyBuffer_Release(&view);
+      PyErr_Clear();
+
+      PyObject* sequence = PySequence_Fast(maskObject, "mask must be None, a bytes-like object or a sequence");
+      if (sequence == nullptr) return nullptr;
+      if (static_cast<size_t>(PySequence_Fast_GET_SIZE(sequence)) != self->size)
+      {
+        Py_DECREF(sequence);
+        PyErr_SetString(PyExc_ValueError, "one mask entry per instance is needed");
+        return nullptr;
+      }
+      for (size_t i = 0; i < self->size; ++i)
+      {
+        const int truth = PyObject_IsTrue(PySequence_Fast_GET_ITEM(sequence, i));
+        if (truth < 0)
+        {
+          Py_DECREF(sequence);
+          return nullptr;
+        }
+        mask[i] = static_cast<uint8_t>(truth);
+      }
+      Py_DECREF(sequence);
+    }
+
+    // the mask may have run Python code that started a step
+    if (!checkIdle(self)) return nullptr;
+    if (chip8_reset(self->batch, mask.data()) != 0) return raiseLastError();
+    Py_RETURN_NONE;
+  }
+
+  PyObject* Batch_seed(Batch* self, PyObject* args)
+  {
+    unsigned long long seed;
+    if (!PyArg_ParseTuple(args, "K", &seed)) return nullptr;
+    if (!checkIdle(self)) return nullptr;
+    if (chip8_seed(self->batch, seed) != 0) return raiseLastError();
+    Py_RETURN_NONE;
+  }
+
+  PyObject* Batch_getObservations(Batch* self, void*)
+  {
+    return PyMemoryView_FromObject(reinterpret_cast<PyObject*>(self));
+  }
+
+  // small, copied so that it does not outlive the batch
+  PyObject* Batch_getFaulted(Batch* self, void*)
+  {
+    if (!checkIdle(self)) return nullptr;
+    return PyBytes_FromStringAndSize(reinterpret_cast<const char*>(chip8_faulted(self->batch)),
+                                     static_cast<Py_ssize_t>(self->size));
+  }
+
+  PyObject* Batch_getWaiting(Batch* self, void*)
+  {
+    if (!checkIdle(self)) return nullptr;
+    return PyBytes_FromStringAndSize(reinterpret_cast<const char*>(chip8_waiting(self->batch)),
+                                     static_cast<Py_ssize_t>(self->size));
+  }
+
+  Py_ssize_t Batch_length(Batch* self)
+  {
+    return static_cast<Py_ssize_t>(self->size);
+  }
+
+  int Batch_getBuffer(Batch* self, Py_buffer* view, const int flags)
+  {
+    if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
+    {
+      PyErr_SetString(PyExc_BufferError, "observations are read-only");
+      return -1;
+    }
+    if (!checkIdle(self, PyExc_BufferError)) return -1;
+
+    view->buf = const_cast<uint8_t*>(chip8_observations(self->batch));
+    view->obj = reinterpret_cast<PyObject*>(self);
+    Py_INCREF(self);
+    view->len = self->shape[0] * self->shape[1] * self->shape[2];
+    view->readonly = 1;
+    view->itemsize = 1;
+    view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>("B") : nullptr;
+    view->ndim = 3;
+    view->shape = (flags & PyBUF_ND) ? self->shape : nullptr;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+    return 0;
+  }
+
+  PyMethodDef batchMethods[] = {
+    {
+      "step", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)()>(Batch_step)), METH_VARARGS | METH_KEYWORDS,
+      "step(actions, frames=1)\n\nHold the keys of actions[i] (bit k for key k) on instance i and run every "
+      "instance for the given number of frames."
+    },
+    {
+      "reset", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)()>(Batch_reset)), METH_VARARGS | METH_KEYWORDS,
+      "reset(mask=None)\n\nRestart the instances whose mask entry is true, all of them without a mask."
+    },
+    {
+      "seed", reinterpret_cast<PyCFunction>(Batch_seed), METH_VARARGS,
+      "seed(value)\n\nInstance i draws its random numbers from value + i."
+    },
+    {nullptr, nullptr, 0, nullptr}
+  };
+
+  PyGetSetDef batchGetters[] = {
+    {
+      "observations", reinterpret_cast<getter>(Batch_getObservations), nullptr,
+      "(n, 32, 64) uint8 view of the screens, updated in place", nullptr
+    },
+    {
+      "faulted", reinterpret_cast<getter>(Batch_getFaulted), nullptr,
+      "bytes, 1 for the instances that stopped on an error", nullptr
+    },
+    {
+      "waiting", reinterpret_cast<getter>(Batch_getWaiting), nullptr,
+      "bytes, what every instance is parked on: 0 none, 1 a key, 2 the delay timer, 3 a halt", nullptr
+    },
+    {nullptr, nullptr, nullptr, nullptr, nullptr}
+  };
+
+  PySequenceMethods batchSequence = {reinterpret_cast<lenfunc>(Batch_length)};
+
+  PyBufferProcs batchBuffer = {reinterpret_cast<getbufferproc>(Batch_getBuffer), nullptr};
+
+  PyTypeObject BatchType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+  PyObject* createBatch(PyObject*, PyObject* args, PyObject* kwargs)
+  {
+    static const char* keywords[] = {"rom", "n", "threads", nullptr};
+    Py_buffer rom{};
+    Py_ssize_t n;
+    Py_ssize_t threads = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*n|n", const_cast<char**>(keywords), &rom, &n, &threads))
+    {
+      return nullptr;
+    }
+    if (n <= 0 || threads < 0)
+    {
+      PyBuffer_Release(&rom);
+      PyErr_SetString(PyExc_ValueError, "n must be positive and threads not negative");
+      return nullptr;
+    }
+
+    chip8_batch* batch;
+    Py_BEGIN_ALLOW_THREADS
+    batch = chip8_create_batch(static_cast<const uint8_t*>(rom.buf), static_cast<size_t>(rom.len),
+                               static_cast<size_t>(n), static_cast<size_t>(threads));
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&rom);
+    if (batch == nullptr) return raiseLastError();
+
+    auto* self = reinterpret_cast<Batch*>(BatchType.tp_alloc(&BatchType, 0));
+    if (self == nullptr)
+    {
+      chip8_destroy_batch(batch);
+      return nullptr;
+    }
+    new(&self->actions) std::vector<uint16_t>();
+    self->batch = batch;
+    self->busy = false;
+    self->size = static_cast<size_t>(n);
+    self->shape[0] = n;
+    self->shape[1] = CHIP8_ENV_HEIGHT;
+    self->shape[2] = CHIP8_ENV_WIDTH;
+    self->strides[0] = CHIP8_ENV_HEIGHT * CHIP8_ENV_WIDTH;
+    self->strides[1] = CHIP8_ENV_WIDTH;
+    self->strides[2] = 1;
+    return reinterpret_cast<PyObject*>(self);
+  }
+
+  PyMethodDef moduleMethods[] = {
+    {
+      "create_batch", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)()>(createBatch)),
+      METH_VARARGS | METH_KEYWORDS,
+      "create_batch(rom, n, threads=1)\n\nn instances of the rom (a bytes-like object), stepped by threads threads."
+    },
+    {nullptr, nullptr, 0, nullptr}
+  };
+
+  PyModuleDef module = {
+    PyModuleDef_HEAD_INIT, "chip8env", "Batched CHIP-8 environments.", -1, moduleMethods
+  };
+}
+
+PyMODINIT_FUNC PyInit_chip8env()
+{
+  BatchType.tp_name = "chip8env.Batch";
+  BatchType.tp_basicsize = sizeof(Batch);
+  BatchType.tp_dealloc = reinterpret_cast<destructor>(Batch_dealloc);
+  BatchType.tp_flags = Py_TPFLAGS_DEFAULT;
+  BatchType.tp_doc = "n CHIP-8 instances of one rom, stepped together. Create with create_batch().";
+  BatchType.tp_methods = batchMethods;
+  BatchType.tp_getset = batchGetters;
+  BatchType.tp_as_sequence = &batchSequence;
+  BatchType.tp_as_buffer = &batchBuffer;
+  if (PyType_Ready(&BatchType) < 0) return nullptr;
+
+  PyObject* chip8env = PyModule_Create(&module);
+  if (chip8env == nullptr) return nullptr;
+
+  Py_INCREF(&BatchType);
+  if (PyModule_AddObject(chip8env, "Batch", reinterpret_cast<PyObject*>(&BatchType)) < 0)
+  {
+    Py_DECREF(&BatchType);
+    Py_DECREF(chip8env);
+    return nullptr;
+  }
+  PyModule_AddIntConstant(chip8env, "WIDTH", CHIP8_ENV_WIDTH);
+  PyModule_AddIntConstant(chip8env, "HEIGHT", CHIP8_ENV_HEIGHT);
+
+  return chip8env;
+}
@@ -0,0 +1,80 @@
+#ifndef CHIP8_ENV_H
+#define CHIP8_ENV_H
+
+/*
+ * C API to run batches of CHIP-8 instances as environments, for use from other languages.
+ *
+ * A batch is n instances of one rom. Each step sets the keys of every instance from its action, runs a number of
+ * frames and writes every screen into one contiguous n x CHIP8_ENV_HEIGHT x CHIP8_ENV_WIDTH uint8 array (1 for a lit
+ * pixel, 0 otherwise). In SUPER-CHIP hi-res mode an observation pixel stands for 2x2 screen pixels and is lit when
+ * any of them is. The array returned by chip8_observations() is updated in place and stays valid until the batch
+ * is destroyed, so a caller can wrap it once and read it after every step.
+ *
+ * Functions returning int return 0 on success and -1 on failure, chip8_last_error() then describes the failure.
+ * A batch must not be used from two threads at the same time.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define CHIP8_ENV_API __declspec(dllexport)
+#else
+#define CHIP8_ENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHIP8_ENV_API_VERSION 1
+#define CHIP8_ENV_WIDTH 64
+#define CHIP8_ENV_HEIGHT 32
+#define CHIP8_ENV_KEY_COUNT 16
+
+typedef struct chip8_batch chip8_batch;
+
+CHIP8_ENV_API uint32_t chip8_api_version(void);
+
+/* message of the last failure on the calling thread, empty if there was none */
+CHIP8_ENV_API const char* chip8_last_error(void);
+
+/* threads is the number of threads stepping the batch, 0 or 1 to step on the calling thread only.
+ * Returns NULL on failure. */
+CHIP8_ENV_API chip8_batch* chip8_create_batch(const uint8_t* rom, size_t rom_size, size_t n, size_t threads);
+
+CHIP8_ENV_API void chip8_destroy_batch(chip8_batch* batch);
+
+CHIP8_ENV_API size_t chip8_batch_size(const chip8_batch* batch);
+
+/* actions[i] is the mask of keys held by instance i, bit k for key k. One frame is a 30th of a second of
+ * emulated time. */
+CHIP8_ENV_API int chip8_step(chip8_batch* batch, const uint16_t* actions, unsigned int frames);
+
+/* restarts the instances whose mask byte is not 0, all of them if mask is NULL */
+CHIP8_ENV_API int chip8_reset(chip8_batch* batch, const uint8_t* mask);
+
+/* instance i draws its random numbers from seed + i, batches start with seed 0 */
+CHIP8_ENV_API int chip8_seed(chip8_batch* batch, uint64_t seed);
+
+CHIP8_ENV_API const uint8_t* chip8_observations(const chip8_batch* batch);
+
+/* n bytes, 1 for an instance that stopped on an error (stack overflow, address out of range...) until it is reset */
+CHIP8_ENV_API const uint8_t* chip8_faulted(const chip8_batch* batch);
+
+#define CHIP8_ENV_WAIT_NONE 0
+#define CHIP8_ENV_WAIT_KEY 1
+#define CHIP8_ENV_WAIT_DELAY_TIMER 2
+#define CHIP8_ENV_WAIT_HALT 3
+
+/* n bytes, what every instance was blocked on at the end of the last step: CHIP8_ENV_WAIT_KEY for an instance waiting
+ * for a key (it only moves again once its action holds one), CHIP8_ENV_WAIT_DELAY_TIMER, CHIP8_ENV_WAIT_HALT for one
+ * that jumps to itself until it is reset, CHIP8_ENV_WAIT_NONE otherwise. Blocked instances are parked and cost next to
+ * nothing to step. */
+CHIP8_ENV_API const uint8_t* chip8_waiting(const chip8_batch* batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
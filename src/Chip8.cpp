@@ -1,11 +1,113 @@
 #include "Chip8.h"
 
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
 
+#include "Debugger.h"
+#include "GuestProfiler.h"
+#include "Hash.h"
+#include "StaticProgram.h"
+#include "TranslationCache.h"
 
-Chip8::Chip8(const std::string& filePath):
+
+// one entry per OpcodeId, in the order of the enum
+template <typename Quirks>
+constexpr std::array<Chip8::Chip8Function, OPCODE_COUNT> Chip8::makeHandlers()
+{
+  return {
+    &Chip8::OP_NULL,
+    &Chip8::OP_00E0,
+    &Chip8::OP_00EE,
+    &Chip8::OP_00Cn,
+    &Chip8::OP_00Dn,
+    &Chip8::OP_00FB,
+    &Chip8::OP_00FC,
+    &Chip8::OP_00FE,
+    &Chip8::OP_00FF,
+    &Chip8::OP_1nnn,
+    &Chip8::OP_2nnn,
+    &Chip8::OP_3xkk,
+    &Chip8::OP_4xkk,
+    &Chip8::OP_5xy0,
+    &Chip8::OP_5xy2,
+    &Chip8::OP_5xy3,
+    &Chip8::OP_6xkk,
+    &Chip8::OP_7xkk,
+    &Chip8::OP_8xy0,
+    &Chip8::OP_8xy1<Quirks>,
+    &Chip8::OP_8xy2<Quirks>,
+    &Chip8::OP_8xy3<Quirks>,
+    &Chip8::OP_8xy4,
+    &Chip8::OP_8xy5,
+    &Chip8::OP_8xy6<Quirks>,
+    &Chip8::OP_8xy7,
+    &Chip8::OP_8xyE<Quirks>,
+    &Chip8::OP_9xy0,
+    &Chip8::OP_Annn,
+    &Chip8::OP_Bnnn,
+    &Chip8::OP_Cxkk,
+    &Chip8::OP_Dxyn<Quirks>,
+    &Chip8::OP_Ex9E,
+    &Chip8::OP_ExA1,
+    &Chip8::OP_F000,
+    &Chip8::OP_Fn01,
+    &Chip8::OP_F002,
+    &Chip8::OP_Fx07,
+    &Chip8::OP_Fx0A,
+    &Chip8::OP_Fx15,
+    &Chip8::OP_Fx18,
+    &Chip8::OP_Fx1E,
+    &Chip8::OP_Fx29,
+    &Chip8::OP_Fx30,
+    &Chip8::OP_Fx3A,
+    &Chip8::OP_Fx33,
+    &Chip8::OP_Fx55<Quirks>,
+    &Chip8::OP_Fx65<Quirks>,
+    &Chip8::OP_TRAP
+  };
+}
+
+// one table per QuirkPreset, in the order of the enum
+const std::array<std::array<Chip8::Chip8Function, OPCODE_COUNT>, QUIRK_PRESET_COUNT> Chip8::handlers =
+{
+  makeHandlers<OriginalQuirks>(),
+  makeHandlers<CosmacVipQuirks>(),
+  makeHandlers<SuperChipQuirks>(),
+  makeHandlers<XoChipQuirks>()
+};
+
+template <typename Quirks, size_t... Patterns>
+constexpr std::array<Chip8::Chip8Function, FUSED_COUNT> Chip8::makeFusedHandlers(std::index_sequence<Patterns...>)
+{
+  return {&Chip8::OP_fused<Quirks, Patterns>...};
+}
+
+const std::array<std::array<Chip8::Chip8Function, FUSED_COUNT>, QUIRK_PRESET_COUNT> Chip8::fusedHandlers =
+{
+  makeFusedHandlers<OriginalQuirks>(std::make_index_sequence<FUSED_COUNT>()),
+  makeFusedHandlers<CosmacVipQuirks>(std::make_index_sequence<FUSED_COUNT>()),
+  makeFusedHandlers<SuperChipQuirks>(std::make_index_sequence<FUSED_COUNT>()),
+  makeFusedHandlers<XoChipQuirks>(std::make_index_sequence<FUSED_COUNT>())
+};
+
+Chip8::Chip8(const std::string& filePath, const TranslationCache* cache, const PlatformVariant variant,
+             const QuirkPreset quirks):
+  Chip8(mapRom(filePath), cache, variant, quirks)
+{
+}
+
+// the mapping is a temporary of the delegating constructor above, it stays alive until the rom is in ram
+Chip8::Chip8(const MappedFile& file, const TranslationCache* cache, const PlatformVariant variant,
+             const QuirkPreset quirks):
+  Chip8(RomImage(file.data(), file.size()), cache, variant, quirks)
+{
+}
+
+Chip8::Chip8(const RomImage& rom, const TranslationCache* cache, const PlatformVariant variant,
+             const QuirkPreset quirks):
+  variant(variant),
   registers({
     Register<uint8_t>("CPU register", 0x0u), Register<uint8_t>("CPU register", 0x0u),
     Register<uint8_t>("CPU register", 0x0u), Register<uint8_t>("CPU register", 0x0u),
@@ -16,81 +118,80 @@ Chip8::Chip8(const std::string& filePath):
     Register<uint8_t>("CPU register", 0x0u), Register<uint8_t>("CPU register", 0x0u),
     Register<uint8_t>("CPU register", 0x0u), Register<uint8_t>("CPU register", 0x0u)
   }), //sry for this bs
-  memory(RAM_SIZE),
-  graphic(GRAPHIC_WIDTH, GRAPHIC_HEIGHT),
+  memory(variant == PlatformVariant::XoChip ? XO_CHIP_RAM_SIZE : RAM_SIZE),
+  graphic(GRAPHIC_WIDTH, GRAPHIC_HEIGHT, HIRES_GRAPHIC_WIDTH, HIRES_GRAPHIC_HEIGHT),
   programCounter("Program counter", STARTING_ADDRESS),
   index("Index register", 0),
   delayTimer("Delay timer", 0),
   soundTimer("Sound Timer", 0),
   stack(STACK_SIZE),
   random(0, 255),
-  opcode(0)
+  opcode(0),
+  quirks(quirks),
+  handlerTable(handlers.at(static_cast<size_t>(quirks)).data()),
+  fusedTable(fusedHandlers.at(static_cast<size_t>(quirks)).data()),
+  decoded(memory.getSize(), OPCODE_NULL),
+  fused(memory.getSize(), FUSED_NONE)
 {
-  loadRom(filePath);
   loadFont();
-  // Set up function pointer table
-  table[0x0] = &Chip8::Table0;
-  table[0x1] = &Chip8::OP_1nnn;
-  table[0x2] = &Chip8::OP_2nnn;
-  table[0x3] = &Chip8::OP_3xkk;
-  table[0x4] = &Chip8::OP_4xkk;
-  table[0x5] = &Chip8::OP_5xy0;
-  table[0x6] = &Chip8::OP_6xkk;
-  table[0x7] = &Chip8::OP_7xkk;
-  table[0x8] = &Chip8::Table8;
-  table[0x9] = &Chip8::OP_9xy0;
-  table[0xA] = &Chip8::OP_Annn;
-  table[0xB] = &Chip8::OP_Bnnn;
-  table[0xC] = &Chip8::OP_Cxkk;
-  table[0xD] = &Chip8::OP_Dxyn;
-  table[0xE] = &Chip8::TableE;
-  table[0xF] = &Chip8::TableF;
-
-  // initializing sub-tables with null opcode
-  for (size_t i = 0; i < 0xE + 1; ++i)
+  loadRom(rom);
+
+  predecode(rom, cache);
+  setStaticProgram(StaticProgram::find(rom, variant, quirks));
+}
+
+Chip8::~Chip8()
+= default;
+
+std::unique_ptr<Chip8> Chip8::clone() const
+{
+  // the copy constructor is private, so no make_unique
+  std::unique_ptr<Chip8> copy(new Chip8(*this));
+  // the debugger stays with this instance, the copy gets the real instructions back
+  if (debugger != nullptr)
   {
-    table0[i] = &Chip8::OP_NULL;
-    table8[i] = &Chip8::OP_NULL;
-    tableE[i] = &Chip8::OP_NULL;
-    tableF[i] = &Chip8::OP_NULL;
+    debugger->unpatch(copy->decoded);
+    copy->debugger = nullptr;
   }
+  copy->profiler = nullptr;
+  return copy;
+}
 
-  for (size_t i = 0xE + 2; i < 0x65 + 1; ++i)
+void Chip8::reset(const RomImage& rom)
+{
+  for (Register<uint8_t>& V : registers)
   {
-    tableF[i] = &Chip8::OP_NULL;
+    V = 0;
   }
+  memory.clear();
+  graphic.setResolution(GRAPHIC_WIDTH, GRAPHIC_HEIGHT);
+  programCounter = STARTING_ADDRESS;
+  index = 0;
+  delayTimer = 0;
+  soundTimer = 0;
+  stack.clear();
+  keypad = Keypad();
+  opcode = 0;
+  planeMask = 0x1u;
+  audioPattern.fill(0);
+  audioPitch = 64;
+  frameCycle = 0;
+  translation.reset();
 
-  table0[0x0] = &Chip8::OP_00E0;
-  table0[0xE] = &Chip8::OP_00EE;
-
-  table8[0x0] = &Chip8::OP_8xy0;
-  table8[0x1] = &Chip8::OP_8xy1;
-  table8[0x2] = &Chip8::OP_8xy2;
-  table8[0x3] = &Chip8::OP_8xy3;
-  table8[0x4] = &Chip8::OP_8xy4;
-  table8[0x5] = &Chip8::OP_8xy5;
-  table8[0x6] = &Chip8::OP_8xy6;
-  table8[0x7] = &Chip8::OP_8xy7;
-  table8[0xE] = &Chip8::OP_8xyE;
-
-  tableE[0x1] = &Chip8::OP_ExA1;
-  tableE[0xE] = &Chip8::OP_Ex9E;
-
-  tableF[0x07] = &Chip8::OP_Fx07;
-  tableF[0x0A] = &Chip8::OP_Fx0A;
-  tableF[0x15] = &Chip8::OP_Fx15;
-  tableF[0x18] = &Chip8::OP_Fx18;
-  tableF[0x1E] = &Chip8::OP_Fx1E;
-  tableF[0x29] = &Chip8::OP_Fx29;
-  tableF[0x33] = &Chip8::OP_Fx33;
-  tableF[0x55] = &Chip8::OP_Fx55;
-  tableF[0x65] = &Chip8::OP_Fx65;
+  loadFont();
+  loadRom(rom);
+
+  // everything after the rom is zeroes again, which all decode the same
+  const size_t romEnd = STARTING_ADDRESS + rom.size;
+  redecode(0, romEnd);
+  if (romEnd < memory.getSize() - 1) std::fill(decoded.begin() + romEnd, decoded.end() - 1, decodeOpcode(0x0000u));
+  fuse(romEnd > 4 ? romEnd - 4 : 0, decoded.size());
+  setStaticProgram(StaticProgram::find(rom, variant, quirks));
+  if (debugger != nullptr) debugger->patch(romEnd, decoded.size());
+  if (profiler != nullptr) profiler->synchronize(*this);
 }
 
-Chip8::~Chip8()
-= default;
-
-void Chip8::loadRom(const std::string& filePath) const
+MappedFile Chip8::mapRom(const std::string& filePath)
 {
   // set file path
   const std::filesystem::path path = filePath;
@@ -98,52 +199,221 @@ void Chip8::loadRom(const std::string& filePath) const
   // check if file exists
   if (!exists(path)) throw std::runtime_error("Chip8::loadRom: File does not exist");
 
+  try
+  {
+    return MappedFile(filePath);
+  }
+  catch (const std::exception&)
+  {
+    throw std::runtime_error("Chip8::loadRom: Failed to open file");
+  }
+}
+
+void Chip8::restore(const Chip8& state, const RomImage* rom)
+{
+  if (state.variant != variant) throw std::invalid_argument("Chip8::restore: State of another variant");
+  if (rom != nullptr && rom->size > memory.getSize() - STARTING_ADDRESS)
+    throw std::runtime_error("Chip8::loadRom: File too large");
+
+  registers = state.registers;
+  // the page table only, the pages stay shared until written
+  memory = state.memory;
+  graphic = state.graphic;
+  programCounter = state.programCounter;
+  index = state.index;
+  delayTimer = state.delayTimer;
+  soundTimer = state.soundTimer;
+  stack = state.stack;
+  random = state.random;
+  opcode = state.opcode;
+  planeMask = state.planeMask;
+  audioPattern = state.audioPattern;
+  audioPitch = state.audioPitch;
+  quirks = state.quirks;
+  handlerTable = state.handlerTable;
+  fusedTable = state.fusedTable;
+  frameCycle = state.frameCycle;
+  decoded = state.decoded;
+  fused = state.fused;
+  translation = state.translation;
+  staticProgram = state.staticProgram;
+  staticBlocks = state.staticBlocks;
+  // the traps of the debugger attached to state, if any
+  if (state.debugger != nullptr) state.debugger->unpatch(decoded);
+
+  if (rom != nullptr)
+  {
+    loadRom(*rom);
+    redecode(STARTING_ADDRESS, rom->size);
+    translation.reset();
+    setStaticProgram(StaticProgram::find(*rom, variant, quirks));
+  }
+  if (debugger != nullptr) debugger->patch(0, decoded.size());
+  if (profiler != nullptr) profiler->synchronize(*this);
+}
+
+void Chip8::loadRom(const RomImage& rom)
+{
   // The rom loads to the ram, check if (vacuous) rom is small enough to fit
-  const std::uintmax_t fileSize = file_size(path);
-  if (fileSize > RAM_SIZE - STARTING_ADDRESS) throw std::runtime_error("Chip8::loadRom: File too large");
+  if (rom.size > memory.getSize() - STARTING_ADDRESS) throw std::runtime_error("Chip8::loadRom: File too large");
 
-  // open file
-  std::ifstream file(path, std::ios::binary | std::ios::beg);
+  // a single copy straight from the mapping (or wherever the image lives) into ram
+  memory.writeBytes(STARTING_ADDRESS, rom.data, rom.size);
+}
 
-  if (!file.is_open()) throw std::runtime_error("Chip8::loadRom: Failed to open file");
+void Chip8::predecode(const RomImage& rom, const TranslationCache* cache)
+{
+  // the cache only holds CHIP-8 decodings
+  if (cache == nullptr || variant == PlatformVariant::XoChip)
+  {
+    // the font and the empty ram around the rom are decoded too, nothing stops a rom from jumping there
+    redecode(0, memory.getSize());
+    return;
+  }
 
-  // reading rom bytes and transferring it to ram
-  std::vector<uint8_t> bytes(fileSize);
-  file.read(reinterpret_cast<std::istream::char_type*>(bytes.data()), static_cast<long>(fileSize));
-  memory.writeBytes(STARTING_ADDRESS, bytes);
+  translation = cache->load(rom, STARTING_ADDRESS);
+  std::copy_n(translation->getDecoded(), translation->getRomSize(), decoded.begin() + STARTING_ADDRESS);
+  fuse(STARTING_ADDRESS, STARTING_ADDRESS + translation->getRomSize());
 
-  file.close();
+  // only what is around the rom is left, this also redoes the last rom byte which pairs up with the byte after it
+  const size_t romEnd = STARTING_ADDRESS + rom.size;
+  redecode(0, STARTING_ADDRESS);
+  redecode(romEnd, memory.getSize() - romEnd);
 }
 
-void Chip8::loadFont() const
+void Chip8::redecode(const size_t address, const size_t length)
 {
-  // 16 char at 5 bytes each
-  const std::vector<uint8_t> fontSet =
+  // the instruction starting one byte before the write overlaps it as well
+  const size_t first = address > 0 ? address - 1 : 0;
+  const size_t last = std::min<size_t>(address + length, memory.getSize() - 1);
+
+  if (variant == PlatformVariant::XoChip)
   {
-    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-    0x20, 0x60, 0x20, 0x20, 0x70, // 1
-    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-    0xF0, 0x80, 0xF0, 0x80, 0x80 // F
-  };
+    for (size_t i = first; i < last; ++i)
+    {
+      decoded[i] = decodeXoChipOpcode(memory.readWord(i));
+    }
+  }
+  else
+  {
+    for (size_t i = first; i < last; ++i)
+    {
+      decoded[i] = decodeOpcode(memory.readWord(i));
+    }
+  }
+
+  // a superinstruction starting up to two instructions before the write may cover it
+  fuse(first > 2 * (FUSED_MAX_LENGTH - 1) ? first - 2 * (FUSED_MAX_LENGTH - 1) : 0, last);
+
+  // the translated blocks the write went over are not the code in ram anymore
+  if (staticProgram != nullptr)
+  {
+    for (size_t i = 0; i < staticProgram->blockCount; ++i)
+    {
+      const StaticBlock& block = staticProgram->blocks[i];
+      if (block.start < last && block.end > first) staticBlocks[block.start] = 0;
+    }
+  }
+
+  // breakpoints on code the rom just rewrote are kept
+  if (debugger != nullptr) debugger->patch(first, last);
+}
+
+void Chip8::fuse(const size_t first, const size_t last)
+{
+  for (size_t i = first; i < last; ++i)
+  {
+    fused[i] = matchFused(decoded.data() + i, decoded.size() - 1 - i);
+  }
+}
 
-  memory.writeBytes(FONT_SET_START_ADDRESS, fontSet);
+void Chip8::bindStaticBlocks()
+{
+  staticBlocks.assign(staticProgram == nullptr ? 0 : memory.getSize(), 0);
+  if (staticProgram == nullptr) return;
+
+  for (size_t i = 0; i < staticProgram->blockCount; ++i)
+  {
+    const StaticBlock& block = staticProgram->blocks[i];
+    bool translated = block.end <= memory.getSize();
+    for (size_t address = block.start; address < block.end && translated; ++address)
+    {
+      translated = memory.readByte(address) == staticProgram->rom[address - STARTING_ADDRESS];
+    }
+    if (translated) staticBlocks[block.start] = static_cast<uint16_t>(i + 1);
+  }
+}
+
+size_t Chip8::findDelayLoop(const size_t address) const
+{
+  // the loop starts at the instruction or one of the two before it
+  for (size_t back = 0; back <= 4 && back <= address; back += 2)
+  {
+    const size_t head = address - back;
+    if (head + 5 >= memory.getSize() || decoded[head] != OPCODE_Fx07 || decoded[head + 2] != OPCODE_3xkk ||
+      decoded[head + 4] != OPCODE_1nnn)
+      continue;
+
+    // the skip tests the register just read against 0 and the jump goes back to the read
+    const uint16_t read = memory.readWord(head);
+    const uint16_t test = memory.readWord(head + 2);
+    if ((test & 0x0FFFu) == (read & 0x0F00u) && (memory.readWord(head + 4) & 0x0FFFu) == head) return head;
+  }
+  return 0;
+}
+
+unsigned int Chip8::skipWait(const unsigned int cycles)
+{
+  const uint16_t address = programCounter.getAddress();
+  unsigned int skipped = cycles;
+
+  switch (getWait().reason)
+  {
+  case WaitReason::None:
+    return 0;
+  case WaitReason::Key:
+  case WaitReason::Halt:
+    // the same instruction over and over
+    opcode = memory.readWord(address);
+    break;
+  case WaitReason::DelayTimer:
+    {
+      // whole passes from the Fx07 that read something other than 0, the rest of the loop runs as usual
+      const unsigned int passes = std::min((delayTimer.getAddress() + 2u) / 3u, cycles / 3u);
+      if (decoded[address] != OPCODE_Fx07 || passes == 0) return 0;
+      const uint16_t read = memory.readWord(address);
+      registers[(read & 0x0F00u) >> 8u] = static_cast<uint8_t>(delayTimer.getAddress() - 3 * (passes - 1));
+      opcode = memory.readWord(address + 4);
+      skipped = 3 * passes;
+      break;
+    }
+  }
+
+  frameCycle = (frameCycle + skipped) % CYCLES_PER_FRAME;
+  const unsigned int delay = delayTimer.getAddress();
+  const unsigned int sound = soundTimer.getAddress();
+  delayTimer = static_cast<uint8_t>(delay > skipped ? delay - skipped : 0);
+  soundTimer = static_cast<uint8_t>(sound > skipped ? sound - skipped : 0);
+  return skipped;
+}
+
+void Chip8::skipNextInstruction()
+{
+  const bool longInstruction = variant == PlatformVariant::XoChip &&
+    programCounter.getAddress() + 1u < memory.getSize() && memory.readWord(programCounter.getAddress()) == 0xF000u;
+
+  programCounter.incrementBy(longInstruction ? 4 : 2);
+}
+
+void Chip8::loadFont()
+{
+  memory.writeBytes(FONT_SET_START_ADDRESS, FONT_SET, sizeof(FONT_SET));
+  memory.writeBytes(LARGE_FONT_SET_START_ADDRESS, LARGE_FONT_SET, sizeof(LARGE_FONT_SET));
 }
 
 void Chip8::OP_00E0()
 {
-  graphic.Clear();
+  graphic.Clear(planeMask);
 }
 
 void Chip8::OP_00EE()
@@ -151,6 +421,36 @@ void Chip8::OP_00EE()
   programCounter = stack.pop();
 }
 
+void Chip8::OP_00Cn()
+{
+  graphic.scrollDown(opcode & 0x000Fu, planeMask);
+}
+
+void Chip8::OP_00Dn()
+{
+  graphic.scrollUp(opcode & 0x000Fu, planeMask);
+}
+
+void Chip8::OP_00FB()
+{
+  graphic.scrollRight(4, planeMask);
+}
+
+void Chip8::OP_00FC()
+{
+  graphic.scrollLeft(4, planeMask);
+}
+
+void Chip8::OP_00FE()
+{
+  graphic.setResolution(GRAPHIC_WIDTH, GRAPHIC_HEIGHT);
+}
+
+void Chip8::OP_00FF()
+{
+  graphic.setResolution(HIRES_GRAPHIC_WIDTH, HIRES_GRAPHIC_HEIGHT);
+}
+
 void Chip8::OP_1nnn()
 {
   programCounter = opcode & 0x0FFFu;
@@ -167,7 +467,7 @@ void Chip8::OP_3xkk()
   const Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
   const uint8_t kk = opcode & 0x00FFu;
 
-  if (Vx == kk) programCounter.incrementBy(2);
+  if (Vx == kk) skipNextInstruction();
 }
 
 void Chip8::OP_4xkk()
@@ -175,7 +475,7 @@ void Chip8::OP_4xkk()
   const Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
   const uint8_t kk = opcode & 0x00FFu;
 
-  if (Vx != kk) programCounter.incrementBy(2);
+  if (Vx != kk) skipNextInstruction();
 }
 
 void Chip8::OP_5xy0()
@@ -183,7 +483,35 @@ void Chip8::OP_5xy0()
   const Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
   const Register<uint8_t>& Vy = registers[(opcode & 0x00F0u) >> 4u];
 
-  if (Vx == Vy) programCounter.incrementBy(2);
+  if (Vx == Vy) skipNextInstruction();
+}
+
+void Chip8::OP_5xy2()
+{
+  const uint8_t x = (opcode & 0x0F00u) >> 8u;
+  const uint8_t y = (opcode & 0x00F0u) >> 4u;
+  const size_t count = (x > y ? x - y : y - x) + 1;
+  const int step = x > y ? -1 : 1;
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    memory.writeByte(index.getAddress() + i, registers[x + step * static_cast<int>(i)].getAddress());
+  }
+
+  redecode(index.getAddress(), count);
+}
+
+void Chip8::OP_5xy3()
+{
+  const uint8_t x = (opcode & 0x0F00u) >> 8u;
+  const uint8_t y = (opcode & 0x00F0u) >> 4u;
+  const size_t count = (x > y ? x - y : y - x) + 1;
+  const int step = x > y ? -1 : 1;
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    registers[x + step * static_cast<int>(i)] = memory.readByte(index.getAddress() + i);
+  }
 }
 
 void Chip8::OP_6xkk()
@@ -210,28 +538,37 @@ void Chip8::OP_8xy0()
   Vx = Vy;
 }
 
+template <typename Quirks>
 void Chip8::OP_8xy1()
 {
   Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
   const Register<uint8_t>& Vy = registers[(opcode & 0x00F0u) >> 4u];
 
   Vx |= Vy;
+
+  if constexpr (Quirks::resetFlag) registers[0xFu] = 0;
 }
 
+template <typename Quirks>
 void Chip8::OP_8xy2()
 {
   Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
   const Register<uint8_t>& Vy = registers[(opcode & 0x00F0u) >> 4u];
 
   Vx &= Vy;
+
+  if constexpr (Quirks::resetFlag) registers[0xFu] = 0;
 }
 
+template <typename Quirks>
 void Chip8::OP_8xy3()
 {
   Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
   const Register<uint8_t>& Vy = registers[(opcode & 0x00F0u) >> 4u];
 
   Vx ^= Vy;
+
+  if constexpr (Quirks::resetFlag) registers[0xFu] = 0;
 }
 
 void Chip8::OP_8xy4()
@@ -255,10 +592,13 @@ void Chip8::OP_8xy5()
   Vx -= Vy;
 }
 
+template <typename Quirks>
 void Chip8::OP_8xy6()
 {
   Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
 
+  if constexpr (Quirks::shiftVy) Vx = registers[(opcode & 0x00F0u) >> 4u];
+
   registers[0xFu] = Vx.getAddress() & 0x1u;
 
   Vx >>= 1;
@@ -274,10 +614,13 @@ void Chip8::OP_8xy7()
   Vx -= Vy;
 }
 
+template <typename Quirks>
 void Chip8::OP_8xyE()
 {
   Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
 
+  if constexpr (Quirks::shiftVy) Vx = registers[(opcode & 0x00F0u) >> 4u];
+
   registers[0xFu] = (Vx.getAddress() & 0x80u) >> 7u;
 
   Vx <<= 1;
@@ -288,7 +631,7 @@ void Chip8::OP_9xy0()
   const Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
   const Register<uint8_t>& Vy = registers[(opcode & 0x00F0u) >> 4u];
 
-  if (Vx != Vy) programCounter.incrementBy(2);
+  if (Vx != Vy) skipNextInstruction();
 }
 
 void Chip8::OP_Annn()
@@ -309,28 +652,66 @@ void Chip8::OP_Cxkk()
   Vx = kk & random.generateRandomValue();
 }
 
+template <typename Quirks>
 void Chip8::OP_Dxyn()
 {
+  // drawing only happens on the first cycle of a frame, until then the instruction is run again
+  if constexpr (Quirks::displayWait)
+  {
+    if (frameCycle != 0)
+    {
+      programCounter.decrementBy(2);
+      return;
+    }
+  }
+
   const Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
   const Register<uint8_t>& Vy = registers[(opcode & 0x00F0u) >> 4u];
   const uint8_t height = opcode & 0x000Fu;
 
-  std::vector<uint8_t> sprite = memory.readBytes(index.getAddress(), height);
-  graphic.drawSprite(Vx.getAddress(), Vy.getAddress(), sprite, registers[15]);
+  // n = 0 is a SUPER-CHIP 16x16 sprite, two bytes per row. XO-CHIP reads one sprite per selected plane back to back.
+  const size_t rows = height == 0 ? 16 : height;
+  const size_t width = height == 0 ? 16 : 8;
+  const size_t planes = (planeMask & 0x1u) + ((planeMask >> 1u) & 0x1u);
+  if (planes == 0) return;
+
+  std::array<uint8_t, 16 * 2 * decltype(graphic)::PLANE_COUNT> sprite{};
+  memory.readBytes(index.getAddress(), sprite.data(), rows * width / 8 * planes);
+  const bool collision = graphic.GetWidth() == GRAPHIC_WIDTH
+    ? graphic.drawSprite<Quirks::loresEdge>(Vx.getAddress(), Vy.getAddress(), sprite.data(), rows, width, planeMask)
+    : graphic.drawSprite<Quirks::hiresEdge>(Vx.getAddress(), Vy.getAddress(), sprite.data(), rows, width, planeMask);
+  if (collision) registers[15] = 1;
 }
 
 void Chip8::OP_Ex9E()
 {
   const Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
 
-  if (keypad.isPressed(Vx.getAddress())) programCounter.incrementBy(2);
+  if (keypad.isPressed(Vx.getAddress())) skipNextInstruction();
 }
 
 void Chip8::OP_ExA1()
 {
   const Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
 
-  if (!keypad.isPressed(Vx.getAddress())) programCounter.incrementBy(2);
+  if (!keypad.isPressed(Vx.getAddress())) skipNextInstruction();
+}
+
+void Chip8::OP_F000()
+{
+  // the address is the next word, which is then stepped over
+  index = memory.readWord(programCounter.getAddress());
+  programCounter.incrementBy(2);
+}
+
+void Chip8::OP_Fn01()
+{
+  planeMask = ((opcode & 0x0F00u) >> 8u) & decltype(graphic)::ALL_PLANES;
+}
+
+void Chip8::OP_F002()
+{
+  memory.readBytes(index.getAddress(), audioPattern.data(), audioPattern.size());
 }
 
 void Chip8::OP_Fx07()
@@ -384,6 +765,21 @@ void Chip8::OP_Fx29()
   index = FONT_SET_START_ADDRESS + 5 * Vx.getAddress();
 }
 
+void Chip8::OP_Fx30()
+{
+  const Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
+
+  // each digit sprite is 10 bytes
+  index = LARGE_FONT_SET_START_ADDRESS + 10 * Vx.getAddress();
+}
+
+void Chip8::OP_Fx3A()
+{
+  const Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
+
+  audioPitch = Vx.getAddress();
+}
+
 void Chip8::OP_Fx33()
 {
   const Register<uint8_t>& Vx = registers[(opcode & 0x0F00u) >> 8u];
@@ -395,8 +791,11 @@ void Chip8::OP_Fx33()
   memory.writeByte(index.getAddress() + 0x1u, value % 10);
   value /= 10;
   memory.writeByte(index.getAddress(), value % 10);
+
+  redecode(index.getAddress(), 3);
 }
 
+template <typename Quirks>
 void Chip8::OP_Fx55()
 {
   const uint8_t x = (opcode & 0x0F00u) >> 8u;
@@ -404,8 +803,13 @@ void Chip8::OP_Fx55()
   {
     memory.writeByte(index.getAddress() + i, registers[i].getAddress());
   }
+
+  redecode(index.getAddress(), x + 1);
+
+  if constexpr (Quirks::advanceIndex) index += x + 1;
 }
 
+template <typename Quirks>
 void Chip8::OP_Fx65()
 {
   const uint8_t x = (opcode & 0x0F00u) >> 8u;
@@ -413,35 +817,135 @@ void Chip8::OP_Fx65()
   {
     registers[i] = memory.readByte(index.getAddress() + i);
   }
+
+  if constexpr (Quirks::advanceIndex) index += x + 1;
 }
 
-void Chip8::Table0()
+void Chip8::OP_TRAP()
 {
-  (this->*table0[opcode & 0x000Fu])();
+  const uint16_t address = programCounter.getAddress() - 2;
+  if (const uint8_t id = debugger->trap(address); id != OPCODE_TRAP)
+  {
+    (this->*handlerTable[id])();
+    return;
+  }
+
+  // Stopped before the instruction ran. Cycle() still counts the cycle and ticks the timers once this returns, so
+  // that is undone in advance: a timer above 0 is never above 254 between cycles, it cannot wrap.
+  programCounter = address;
+  frameCycle = (frameCycle == 0 ? CYCLES_PER_FRAME : frameCycle) - 1;
+  if (delayTimer > 0) delayTimer.increment();
+  if (soundTimer > 0) soundTimer.increment();
+}
+
+void Chip8::Cycle()
+{
+  const uint16_t address = programCounter.getAddress();
+  opcode = memory.readWord(address);
+  programCounter.incrementBy(2);
+
+  // Decode and Execute, decoding was already done in predecode
+  const uint8_t id = decoded[address];
+  (this->*handlerTable[id])();
+
+  if (coverage != nullptr) coverage->record(address, id, programCounter.getAddress());
+  if (profiler != nullptr) profiler->record(stack.getDepth(), programCounter.getAddress());
+
+  endCycle();
+}
+
+void Chip8::Run(unsigned int cycles)
+{
+  if (coverage != nullptr || debugger != nullptr || profiler != nullptr)
+  {
+    for (; cycles > 0; --cycles)
+    {
+      Cycle();
+    }
+    return;
+  }
+  cycles -= skipWait(cycles);
+  if (staticProgram != nullptr)
+  {
+    StaticProgram::run(*this, cycles);
+    return;
+  }
+
+  while (cycles > 0)
+  {
+    // a superinstruction only runs when all of it fits, the cycle count stays exact. A program counter past ram is left
+    // to Cycle(), which throws for it
+    const uint16_t start = programCounter.getAddress();
+    const uint8_t pattern = start < fused.size() ? fused[start] : FUSED_NONE;
+    if (const uint8_t length = FUSED_PATTERNS[pattern].length; length > 0 && length <= cycles)
+    {
+      (this->*fusedTable[pattern])();
+      cycles -= length;
+    }
+    else
+    {
+      Cycle();
+      --cycles;
+      // a wait starts with an instruction running again or a jump back, to an Fx0A, a halt or a delay loop
+      if (const uint16_t next = programCounter.getAddress(); next <= start &&
+        (decoded[next] == OPCODE_Fx0A || decoded[next] == OPCODE_1nnn || decoded[next] == OPCODE_Fx07))
+        cycles -= skipWait(cycles);
+    }
+  }
 }
 
-void Chip8::Table8()
+Wait Chip8::getWait() const
 {
-  (this->*table8[opcode & 0x000Fu])();
+  const uint16_t address = programCounter.getAddress();
+  if (address + 1u >= memory.getSize()) return {WaitReason::None, 0};
+
+  if (decoded[address] == OPCODE_Fx0A)
+  {
+    for (uint8_t key = 0; key < 16; ++key)
+    {
+      if (keypad.isPressed(key)) return {WaitReason::None, 0};
+    }
+    return {WaitReason::Key, 0};
+  }
+  if (decoded[address] == OPCODE_1nnn && (memory.readWord(address) & 0x0FFFu) == address)
+    return {WaitReason::Halt, 0};
+
+  const size_t head = findDelayLoop(address);
+  if (head == 0) return {WaitReason::None, 0};
+  // on the 3x00 right after reading 0, it leaves
+  if (address == head + 2 && registers[(memory.readWord(head) & 0x0F00u) >> 8u] == 0) return {WaitReason::None, 0};
+
+  // back to the Fx07, then a pass of 3 cycles for every read other than 0 and 2 cycles to leave after reading 0
+  const unsigned int back = address == head ? 0 : address == head + 2 ? 2 : 1;
+  const unsigned int delay = delayTimer.getAddress() > back ? delayTimer.getAddress() - back : 0;
+  return {WaitReason::DelayTimer, back + 3 * ((delay + 2) / 3) + 2};
 }
 
-void Chip8::TableE()
+template <typename Quirks, size_t Pattern>
+void Chip8::OP_fused()
 {
-  (this->*tableE[opcode & 0x000Fu])();
+  runFused<Quirks, Pattern>(std::make_index_sequence<FUSED_PATTERNS[Pattern].length>());
 }
 
-void Chip8::TableF()
+template <typename Quirks, size_t Pattern, size_t... Steps>
+void Chip8::runFused(std::index_sequence<Steps...>)
 {
-  (this->*tableF[opcode & 0x00FFu])();
+  (runFusedStep<makeHandlers<Quirks>()[FUSED_PATTERNS[Pattern].ids[Steps]]>(), ...);
 }
 
-void Chip8::Cycle()
+// Cycle() without the table lookup and the indirect call, the handler is known at compile time
+template <Chip8::Chip8Function Handler>
+void Chip8::runFusedStep()
 {
   opcode = memory.readWord(programCounter.getAddress());
   programCounter.incrementBy(2);
+  (this->*Handler)();
+  endCycle();
+}
 
-  // Decode and Execute
-  (this->*table[(opcode & 0xF000u) >> 12u])();
+void Chip8::endCycle()
+{
+  if (++frameCycle == CYCLES_PER_FRAME) frameCycle = 0;
 
   // Decrement the delay timer if it's been set
   if (delayTimer > 0)
@@ -461,7 +965,135 @@ Keypad& Chip8::getKeypad()
   return keypad;
 }
 
+void Chip8::seedRandom(const unsigned long seed)
+{
+  random.seed(seed);
+}
+
+void Chip8::setCoverage(GuestCoverage* coverage)
+{
+  this->coverage = coverage;
+}
+
+void Chip8::setProfiler(GuestProfiler* profiler)
+{
+  this->profiler = profiler;
+  if (profiler != nullptr) profiler->synchronize(*this);
+}
+
+void Chip8::setStaticProgram(const StaticProgram* program)
+{
+  if (program != nullptr && (program->variant != variant || program->quirks != quirks))
+    throw std::invalid_argument("Chip8::setStaticProgram: Program of another variant or quirk preset");
+
+  staticProgram = program;
+  bindStaticBlocks();
+}
+
+const StaticProgram* Chip8::getStaticProgram() const
+{
+  return staticProgram;
+}
+
 const uint32_t* Chip8::getBuffer() const
 {
   return graphic.getBuffer();
 }
+
+size_t Chip8::getWidth() const
+{
+  return graphic.GetWidth();
+}
+
+size_t Chip8::getHeight() const
+{
+  return graphic.GetHeight();
+}
+
+PlatformVariant Chip8::getVariant() const
+{
+  return variant;
+}
+
+QuirkPreset Chip8::getQuirkPreset() const
+{
+  return quirks;
+}
+
+const std::array<uint8_t, 16>& Chip8::getAudioPattern() const
+{
+  return audioPattern;
+}
+
+double Chip8::getAudioSampleRate() const
+{
+  return 4000.0 * std::pow(2.0, (static_cast<double>(audioPitch) - 64.0) / 48.0);
+}
+
+uint8_t Chip8::getRegister(const size_t x) const
+{
+  return registers[x].getAddress();
+}
+
+uint16_t Chip8::getIndex() const
+{
+  return index.getAddress();
+}
+
+uint16_t Chip8::getProgramCounter() const
+{
+  return programCounter.getAddress();
+}
+
+OpcodeId Chip8::getOpcodeId(const size_t address) const
+{
+  return static_cast<OpcodeId>(decoded.at(address));
+}
+
+uint8_t Chip8::getDelayTimer() const
+{
+  return delayTimer.getAddress();
+}
+
+uint8_t Chip8::getSoundTimer() const
+{
+  return soundTimer.getAddress();
+}
+
+uint64_t Chip8::getStateHash() const
+{
+  std::array<uint8_t, 128> state{};
+  size_t size = 0;
+  const auto append = [&](const uint64_t value, const size_t bytes)
+  {
+    for (size_t byte = 0; byte < bytes; ++byte)
+    {
+      state[size++] = static_cast<uint8_t>(value >> (8 * byte));
+    }
+  };
+
+  for (const Register<uint8_t>& V : registers) append(V.getAddress(), 1);
+  append(index.getAddress(), 2);
+  append(programCounter.getAddress(), 2);
+  append(delayTimer.getAddress(), 1);
+  append(soundTimer.getAddress(), 1);
+  // the display wait depends on it
+  append(frameCycle, 1);
+  append(graphic.GetWidth(), 2);
+  append(graphic.GetHeight(), 2);
+  append(planeMask, 1);
+  append(audioPitch, 1);
+  for (const uint8_t sample : audioPattern) append(sample, 1);
+  append(stack.getDepth(), 1);
+  for (size_t depth = 0; depth < stack.getDepth(); ++depth) append(stack.get(depth), 2);
+  append(random.getSeed(), 8);
+  append(random.getDraws(), 8);
+
+  // mixed so that a ram byte and a plane word at the same position do not cancel out
+  return fnv1a64(state.data(), size, memory.getHash() ^ mix64(graphic.getHash()));
+}
+
+const std::shared_ptr<const CachedTranslation>& Chip8::getTranslation() const
+{
+  return translation;
+}
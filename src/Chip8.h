@@ -1,23 +1,117 @@
 #pragma once
+#include <array>
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "Graphic.h"
+#include "GuestCoverage.h"
 #include "Keypad.h"
+#include "MappedFile.h"
 #include "Memory.h"
+#include "Opcode.h"
+#include "PlatformVariant.h"
+#include "Quirks.h"
 #include "RandomGenerator.h"
 #include "Register.h"
+#include "RomImage.h"
 #include "Stack.h"
+#include "Superinstruction.h"
 
 constexpr unsigned int RAM_SIZE = 4 * 1024;
+constexpr unsigned int XO_CHIP_RAM_SIZE = 64 * 1024;
 constexpr unsigned int GRAPHIC_WIDTH = 64;
 constexpr unsigned int GRAPHIC_HEIGHT = 32;
+// SUPER-CHIP hi-res mode
+constexpr unsigned int HIRES_GRAPHIC_WIDTH = 128;
+constexpr unsigned int HIRES_GRAPHIC_HEIGHT = 64;
 constexpr unsigned int STACK_SIZE = 16;
 constexpr unsigned int STARTING_ADDRESS = 0x200;
 constexpr unsigned int FONT_SET_START_ADDRESS = 0x50;
+constexpr unsigned int CYCLES_PER_SECOND = 1082; // Emulated CPU cycles per second
+constexpr unsigned int FRAME_RATE = 30;
+constexpr unsigned int CYCLES_PER_FRAME = CYCLES_PER_SECOND / FRAME_RATE;
+// 16 char at 5 bytes each
+constexpr uint8_t FONT_SET[16 * 5] =
+{
+  0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+  0x20, 0x60, 0x20, 0x20, 0x70, // 1
+  0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+  0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+  0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+  0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+  0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+  0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+  0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+  0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+  0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+  0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+  0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+  0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+  0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+  0xF0, 0x80, 0xF0, 0x80, 0x80 // F
+};
+// SUPER-CHIP large font, right after the small one, 16 char at 10 bytes each
+constexpr unsigned int LARGE_FONT_SET_START_ADDRESS = FONT_SET_START_ADDRESS + sizeof(FONT_SET);
+constexpr uint8_t LARGE_FONT_SET[16 * 10] =
+{
+  0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+  0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+  0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+  0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+  0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+  0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+  0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+  0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+  0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+  0x18, 0x3C, 0x66, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+  0xFC, 0xFE, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFE, 0xFC, // B
+  0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, // C
+  0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xFF, 0xFF, // E
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xC0, 0xC0 // F
+};
+
+// part of the translation cache key, bump it with the version in vcpkg.json
+constexpr const char* EMULATOR_VERSION = "1.0.0";
+
+// What an instance that cannot make progress on its own is waiting for, see Chip8::getWait
+enum class WaitReason : uint8_t
+{
+  // it runs
+  None,
+  // Fx0A with no key held, until a key is pressed
+  Key,
+  // spinning on the delay timer (Fx07, 3x00, a jump back to the Fx07) until it reads 0
+  DelayTimer,
+  // a jump to itself, until the host resets or restores the instance
+  Halt
+};
+
+struct Wait
+{
+  WaitReason reason;
+  // cycles before it leaves the wait by itself, only for WaitReason::DelayTimer
+  unsigned int cycles;
+};
+
+class TranslationCache;
+class CachedTranslation;
+class Debugger;
+class GuestProfiler;
+struct StaticProgram;
+struct StaticState;
 
 class Chip8
 {
+  // PlatformVariant::XoChip turns on the XO-CHIP instructions and 64 KB of ram, the other variants run the same
+  // CHIP-8 + SUPER-CHIP interpreter
+  PlatformVariant variant;
   std::array<Register<uint8_t>, 16> registers;
+  // RAM_SIZE, or XO_CHIP_RAM_SIZE for XO-CHIP
   Memory<uint8_t> memory;
   Graphic<uint32_t> graphic;
   Register<uint16_t> programCounter;
@@ -29,9 +123,23 @@ class Chip8
   RandomGenerator<uint8_t> random;
   uint16_t opcode;
 
-  void loadFont() const;
+  // XO-CHIP: planes drawn, cleared and scrolled by the display instructions, bit p for plane p
+  uint8_t planeMask = 0x1u;
+  // XO-CHIP: 128 1-bit samples played while the sound timer runs, at a rate set by the pitch register
+  std::array<uint8_t, 16> audioPattern{};
+  uint8_t audioPitch = 64;
+
+  void loadFont();
+
+  // maps the rom file, the mapping only lives until the image is copied into ram
+  static MappedFile mapRom(const std::string& filePath);
 
-  void loadRom(const std::string& filePath) const;
+  Chip8(const MappedFile& file, const TranslationCache* cache, PlatformVariant variant, QuirkPreset quirks);
+
+  // only through clone(), copying by accident would be far from free with the framebuffer and decoded table
+  Chip8(const Chip8& other) = default;
+
+  void loadRom(const RomImage& rom);
 
   // Clear the display
   void OP_00E0();
@@ -39,6 +147,24 @@ class Chip8
   // Return from a subroutine
   void OP_00EE();
 
+  // SUPER-CHIP: Scroll the display down n lines
+  void OP_00Cn();
+
+  // XO-CHIP: Scroll the display up n lines
+  void OP_00Dn();
+
+  // SUPER-CHIP: Scroll the display right 4 pixels
+  void OP_00FB();
+
+  // SUPER-CHIP: Scroll the display left 4 pixels
+  void OP_00FC();
+
+  // SUPER-CHIP: Switch to the 64x32 low resolution mode, the screen is cleared
+  void OP_00FE();
+
+  // SUPER-CHIP: Switch to the 128x64 high resolution mode, the screen is cleared
+  void OP_00FF();
+
   // Jump to location nnn
   void OP_1nnn();
 
@@ -54,6 +180,12 @@ class Chip8
   // Skip next instruction if Vx = Vy
   void OP_5xy0();
 
+  // XO-CHIP: Store Vx to Vy in memory starting at location I, in reverse order if x > y. I is not changed.
+  void OP_5xy2();
+
+  // XO-CHIP: Read Vx to Vy from memory starting at location I, in reverse order if x > y. I is not changed.
+  void OP_5xy3();
+
   // Set Vx = kk
   void OP_6xkk();
 
@@ -63,13 +195,18 @@ class Chip8
   // Set Vx = Vy
   void OP_8xy0();
 
+  // Quirks is one of the presets of Quirks.h, the handlers that take it are the ones that differ between platforms
+
   // Set Vx = Vx OR Vy
+  template <typename Quirks>
   void OP_8xy1();
 
   // Set Vx = Vx AND Vy
+  template <typename Quirks>
   void OP_8xy2();
 
   // Set Vx = Vx XOR Vy
+  template <typename Quirks>
   void OP_8xy3();
 
   // Set Vx = Vx + Vy, set VF = carry.
@@ -82,6 +219,7 @@ class Chip8
 
   // Set Vx = Vx SHR 1.
   // If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0. Then Vx is divided by 2.
+  template <typename Quirks>
   void OP_8xy6();
 
   // Set Vx = Vy - Vx, set VF = NOT borrow.
@@ -90,6 +228,7 @@ class Chip8
 
   // Set Vx = Vx SHL 1.
   // If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0. Then Vx is multiplied by 2.
+  template <typename Quirks>
   void OP_8xyE();
 
   // Skip next instruction if Vx != Vy
@@ -108,6 +247,8 @@ class Chip8
   // sprites on screen at coordinates (Vx, Vy). Sprites are XORed onto the existing screen. If this causes any pixels to
   // be erased, VF is set to 1, otherwise it is set to 0. If the sprite is positioned so part of it is outside
   // the coordinates of the display, it wraps around to the opposite side of the screen. See instruction 8xy3
+  // SUPER-CHIP: with n = 0 the sprite is 16x16, 32 bytes read as two bytes per row
+  template <typename Quirks>
   void OP_Dxyn();
 
   // Skip next instruction if key with the value of Vx is pressed.
@@ -116,6 +257,15 @@ class Chip8
   // Skip next instruction if key with the value of Vx is not pressed.
   void OP_ExA1();
 
+  // XO-CHIP: Set I = nnnn, the 16-bit word following the instruction
+  void OP_F000();
+
+  // XO-CHIP: Select the planes drawn to, n is a mask of planes
+  void OP_Fn01();
+
+  // XO-CHIP: Load the 16 bytes at location I into the audio pattern buffer
+  void OP_F002();
+
   // Set Vx = delay timer value
   void OP_Fx07();
 
@@ -134,15 +284,27 @@ class Chip8
   // Set I = location of sprite for digit Vx
   void OP_Fx29();
 
+  // SUPER-CHIP: Set I = location of the large (8x10) sprite for digit Vx
+  void OP_Fx30();
+
+  // XO-CHIP: Set the audio pitch register = Vx
+  void OP_Fx3A();
+
   // The interpreter takes the decimal value of Vx, and places the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2
   void OP_Fx33();
 
   // Store registers V0 through Vx in memory starting at location I
+  template <typename Quirks>
   void OP_Fx55();
 
   // Read registers V0 through Vx from memory starting at location I
+  template <typename Quirks>
   void OP_Fx65();
 
+  // An instruction the debugger patched over: asks the debugger whether to stop, and runs the real instruction if not.
+  // Stopping leaves the machine exactly as it was before the cycle.
+  void OP_TRAP();
+
   // cannot be set to static be it won't match type Chip8Function
   void OP_NULL()
   {
@@ -156,74 +318,154 @@ class Chip8
   // we can use std::function, but it is less performant
   typedef void (Chip8::*Chip8Function)();
 
-  /*
-  The entire list of opcodes is divided into 4 categories:
-The entire opcode is unique:
-      $1nnn
-      $2nnn
-      $3xkk
-      $4xkk
-      $5xy0
-      $6xkk
-      $7xkk
-      $9xy0
-      $Annn
-      $Bnnn
-      $Cxkk
-      $Dxyn
-  The first digit repeats but the last digit is unique:
-      $8xy0
-      $8xy1
-      $8xy2
-      $8xy3
-      $8xy4
-      $8xy5
-      $8xy6
-      $8xy7
-      $8xyE
-  The first three digits are $00E but the fourth digit is unique:
-      $00E0
-      $00EE
-  The first digit repeats but the last two digits are unique:
-      $ExA1
-      $Ex9E
-      $Fx07
-      $Fx0A
-      $Fx15
-      $Fx18
-      $Fx1E
-      $Fx29
-      $Fx33
-      $Fx55
-      $Fx65
-
-      this division is useful to index the opcodes inside a table
-      for example the ones that are fully unique can be indexed using the 1st nibble (what a funny word) only
-      so if an opcode starts with 1 then we know it is instruction 0x1nnn
-
-      for the opcodes that are not unique we use sub-tables to further identify the intended opcode
-      the 1st nibble of all opcodes goes from 1 to F, which means we will need an array of size F+1
-      the size of other sub-tables is defined in the same way, for example for tableE the last opcode is 0xFx65 so the size is 0x65 + 1
-
-    */
-  Chip8Function table[0xF + 1]{};
-  Chip8Function table0[0xE + 1]{};
-  Chip8Function table8[0xE + 1]{};
-  Chip8Function tableE[0xE + 1]{};
-  Chip8Function tableF[0x65 + 1]{};
-
-  // if a nibble starts with 0 then we need to access the table called table0
-  // the task of further decoding the rest of the opcode (for example to decide whether to call $00E0 or $00EE is delegated to function Table0 which will use the last digit to call the appropriate method
-  // refer to the classification of opcodes for the implementation of these methods
-  void Table0();
-  void Table8();
-  void TableE();
-  void TableF();
+  // one entry per OpcodeId, see Opcode.h for how opcodes are sorted into ids. Shared by every instance, so creating
+  // or resetting a Chip8 does not rebuild it. There is one table per QuirkPreset, built from the same handlers.
+  static const std::array<std::array<Chip8Function, OPCODE_COUNT>, QUIRK_PRESET_COUNT> handlers;
+
+  template <typename Quirks>
+  static constexpr std::array<Chip8Function, OPCODE_COUNT> makeHandlers();
+
+  // the same for the superinstructions, one entry per FusedId
+  static const std::array<std::array<Chip8Function, FUSED_COUNT>, QUIRK_PRESET_COUNT> fusedHandlers;
+
+  template <typename Quirks, size_t... Patterns>
+  static constexpr std::array<Chip8Function, FUSED_COUNT> makeFusedHandlers(std::index_sequence<Patterns...>);
+
+  // runs the instructions of FUSED_PATTERNS[Pattern], each as one full cycle
+  template <typename Quirks, size_t Pattern>
+  void OP_fused();
+
+  template <typename Quirks, size_t Pattern, size_t... Steps>
+  void runFused(std::index_sequence<Steps...>);
+
+  template <Chip8Function Handler>
+  void runFusedStep();
+
+  // the row of handlers for the preset chosen at construction
+  QuirkPreset quirks;
+  const Chip8Function* handlerTable;
+  const Chip8Function* fusedTable;
+
+  // cycles run since the start of the current frame, for the display wait quirk
+  unsigned int frameCycle = 0;
+
+  // the OpcodeId of the instruction starting at every address of the ram, so that a cycle is a single table lookup
+  // instead of walking the opcode categories each time. Kept up to date when the rom writes to memory.
+  std::vector<uint8_t> decoded;
+
+  // the FusedId of the superinstruction starting at every address, FUSED_NONE mostly. Follows decoded.
+  std::vector<uint8_t> fused;
+
+  // predecoded rom and analysis, shared with every other instance running the same rom
+  std::shared_ptr<const CachedTranslation> translation;
+
+  // not owned, nullptr unless someone wants to know where the rom went
+  GuestCoverage* coverage = nullptr;
+
+  // not owned, set while a Debugger is attached. The debugger patches the decoded table and reads the machine state
+  // directly, so that none of it costs anything while no debugger is there.
+  Debugger* debugger = nullptr;
+  friend class Debugger;
+
+  // not owned, nullptr unless profiling exactly, see GuestProfiler
+  GuestProfiler* profiler = nullptr;
+  friend class GuestProfiler;
+
+  // the ahead-of-time translation of the rom linked into this binary, nullptr for none, see StaticProgram.h
+  const StaticProgram* staticProgram = nullptr;
+  // 1 + the index in staticProgram of the block bound at every address, 0 where the code is not the translated one.
+  // Empty without a program.
+  std::vector<uint16_t> staticBlocks;
+  friend struct StaticProgram;
+  friend struct StaticState;
+
+  void predecode(const RomImage& rom, const TranslationCache* cache);
+
+  // decode again the instructions overlapping [address, address + length) after memory was written
+  void redecode(size_t address, size_t length);
+
+  // match the superinstructions again at the addresses in [first, last)
+  void fuse(size_t first, size_t last);
+
+  // binds every block of staticProgram whose bytes are in ram as they were translated
+  void bindStaticBlocks();
+
+  // what every cycle does after its instruction ran: the frame cycle count and the timers
+  void endCycle();
+
+  // the address of the Fx07, 3x00, 1nnn delay loop the instruction at address is part of, 0 if it is not in one
+  [[nodiscard]] size_t findDelayLoop(size_t address) const;
+  // Counts up to cycles cycles of a wait at once, with the result of running them one by one: the timers and the frame
+  // cycle move, the loop register is left as the last read set it. Returns the cycles counted, 0 when not waiting.
+  unsigned int skipWait(unsigned int cycles);
+
+  // the skip instructions, an XO-CHIP F000 nnnn is four bytes long and skipped as a whole
+  void skipNextInstruction();
 
 public:
-  explicit Chip8(const std::string& filePath);
+  // when a cache is given the predecoded rom is taken from it (or stored into it on the first run), XO-CHIP roms are
+  // always decoded on load
+  // quirks defaults to the behaviour this interpreter always had, quirkPresetFor gives the usual one for a platform
+  explicit Chip8(const std::string& filePath, const TranslationCache* cache = nullptr,
+                 PlatformVariant variant = PlatformVariant::Chip8, QuirkPreset quirks = QuirkPreset::Original);
+  // starts from an image that is already in memory (a RomCatalog entry for example), the only copy is into ram
+  explicit Chip8(const RomImage& rom, const TranslationCache* cache = nullptr,
+                 PlatformVariant variant = PlatformVariant::Chip8, QuirkPreset quirks = QuirkPreset::Original);
   ~Chip8();
+  Chip8& operator=(const Chip8&) = delete;
+  // Forks this instance: the copy continues from exactly the same state, independently of the original. Ram is shared
+  // copy-on-write in Memory::PAGE_SIZE pages, so the font, the rom and whatever neither side writes to are never
+  // copied. The framebuffer and the decoded table are copied, the translation and the attached coverage are shared, an
+  // attached debugger or profiler stays with this instance.
+  [[nodiscard]] std::unique_ptr<Chip8> clone() const;
+  // Puts the machine back in the state a new Chip8 of this rom starts in, without touching the file system or
+  // allocating. The translation from a cache is dropped, the rom is decoded again. Throws like the constructor if the
+  // rom does not fit.
+  void reset(const RomImage& rom);
+  // Puts the machine back in the state of state, a clone() of this instance (or of one of the same variant) taken
+  // earlier: a save state. The keypad is left alone, it belongs to whoever feeds the input, and so are the attached
+  // coverage, debugger and profiler. When rom is given it is written over the ram it occupies, so that a state saved
+  // with an older build of the rom goes on with the new code. Throws std::invalid_argument for another variant.
+  void restore(const Chip8& state, const RomImage* rom = nullptr);
   Keypad& getKeypad();
   void Cycle();
+  // Runs cycles cycles, with the same result as calling Cycle() that many times, but runs of instructions that match
+  // a superinstruction (see Superinstruction.h) are dispatched once for the whole run, and with a static program the
+  // translated blocks run instead. The cycles a wait (see getWait) spends spinning are counted without running them.
+  // While coverage, a debugger or a profiler is attached every instruction goes through Cycle().
+  void Run(unsigned int cycles);
+  // whether the instance is blocked at its program counter, for schedulers to park it until it can make progress
+  [[nodiscard]] Wait getWait() const;
+  void seedRandom(unsigned long seed);
+  // counts every executed opcode and control transfer into coverage from now on, nullptr to stop
+  void setCoverage(GuestCoverage* coverage);
+  // attributes every executed instruction to the guest call stack in profiler from now on, nullptr to stop
+  void setProfiler(GuestProfiler* profiler);
+  // Runs the rom from the blocks of program from now on, nullptr for the interpreter alone. The constructor and
+  // reset() already attach the program registered for the rom, if one is linked in. Throws std::invalid_argument for
+  // a program of another variant or quirk preset.
+  void setStaticProgram(const StaticProgram* program);
+  [[nodiscard]] const StaticProgram* getStaticProgram() const;
+  // getWidth() x getHeight() pixels, the resolution changes with the SUPER-CHIP 00FE/00FF instructions
   [[nodiscard]] const uint32_t* getBuffer() const;
+  [[nodiscard]] size_t getWidth() const;
+  [[nodiscard]] size_t getHeight() const;
+  [[nodiscard]] PlatformVariant getVariant() const;
+  [[nodiscard]] QuirkPreset getQuirkPreset() const;
+  [[nodiscard]] const std::array<uint8_t, 16>& getAudioPattern() const;
+  // samples per second the audio pattern is played at, 4000 * 2 ^ ((pitch - 64) / 48)
+  [[nodiscard]] double getAudioSampleRate() const;
+  [[nodiscard]] uint8_t getRegister(size_t x) const;
+  [[nodiscard]] uint16_t getIndex() const;
+  [[nodiscard]] uint16_t getProgramCounter() const;
+  // the instruction decoded at address, OPCODE_TRAP where a debugger patched it
+  [[nodiscard]] OpcodeId getOpcodeId(size_t address) const;
+  [[nodiscard]] uint8_t getDelayTimer() const;
+  [[nodiscard]] uint8_t getSoundTimer() const;
+  // Identifies the state of the machine: two instances with the same hash go on the same way when given the same keys,
+  // short of a 64-bit collision. Ram and the screen are hashed as they are written (Memory::getHash,
+  // Graphic::getHash). The registers, stack, timers and position of the random generator are hashed here, because
+  // nearly every instruction writes them. The keypad is input and is left out.
+  [[nodiscard]] uint64_t getStateHash() const;
+  [[nodiscard]] const std::shared_ptr<const CachedTranslation>& getTranslation() const;
 };
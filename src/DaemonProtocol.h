@@ -0,0 +1,117 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// The protocol chip8d speaks on its Unix domain socket (see tools/chip8d.cpp, tools/chip8d-client.cpp).
+//
+// Every message is a fixed header followed by payloadSize bytes of payload. Like the translation cache the records
+// are plain structs with explicit sizes in the byte order of the machine: both ends are always on the same host.
+// A client may send any number of requests without waiting; every request gets exactly one response carrying its
+// requestId. Requests to the same session are answered in the order they were sent, requests to different sessions
+// run in parallel and can be answered in any order.
+
+constexpr uint32_t DAEMON_PROTOCOL_VERSION = 1;
+// an XO-CHIP rom fills at most 64 KB, nothing else comes close
+constexpr uint32_t DAEMON_MAX_PAYLOAD = 80 * 1024;
+constexpr const char* DAEMON_DEFAULT_SOCKET = "/tmp/chip8d.sock";
+
+enum class DaemonCommand : uint8_t
+{
+  // payload DaemonCreateRequest then the rom, the response's session is the new session
+  Create = 1,
+  // payload DaemonStepRequest, the response is the screen after the step (DaemonFrameHeader then the bitmap)
+  Step,
+  // payload DaemonInputRequest, changes the keys held without running anything
+  Input,
+  // no payload, the response is a DaemonSnapshot then the screen
+  Snapshot,
+  // no payload
+  Destroy
+};
+
+enum class DaemonStatus : uint8_t
+{
+  Ok,
+  // malformed payload or unknown command
+  BadRequest,
+  // no such session, or one another connection created
+  UnknownSession,
+  // the rom is too large or the variant / quirks are unknown
+  RomRejected,
+  // the session threw from Cycle() (stack overflow and the like), it only answers Snapshot and Destroy from then on
+  Faulted
+};
+
+struct DaemonRequestHeader
+{
+  uint32_t payloadSize;
+  uint32_t requestId;
+  // 0 for Create
+  uint32_t session;
+  uint8_t command;
+  uint8_t padding[3];
+};
+
+struct DaemonResponseHeader
+{
+  uint32_t payloadSize;
+  uint32_t requestId;
+  uint32_t session;
+  uint8_t command;
+  uint8_t status;
+  uint8_t padding[2];
+};
+
+// quirks 0xFF picks the usual preset of the variant (quirkPresetFor)
+constexpr uint8_t DAEMON_DEFAULT_QUIRKS = 0xFF;
+
+struct DaemonCreateRequest
+{
+  uint64_t seed;
+  // a PlatformVariant
+  uint8_t variant;
+  // a QuirkPreset or DAEMON_DEFAULT_QUIRKS
+  uint8_t quirks;
+  uint8_t padding[6];
+};
+
+struct DaemonStepRequest
+{
+  // bit k set while key k is held during the step
+  uint16_t keys;
+  // frames of CYCLES_PER_FRAME cycles to run, 0 only reads the screen
+  uint16_t frames;
+};
+
+struct DaemonInputRequest
+{
+  uint16_t keys;
+  uint16_t padding;
+};
+
+// the screen, 1 bit per pixel (lit when any plane is set), rows of width / 8 bytes, most significant bit leftmost
+struct DaemonFrameHeader
+{
+  uint16_t width;
+  uint16_t height;
+};
+
+struct DaemonSnapshot
+{
+  // frames stepped since the session was created
+  uint64_t frames;
+  uint16_t programCounter;
+  uint16_t index;
+  uint8_t registers[16];
+  uint8_t delayTimer;
+  uint8_t soundTimer;
+  uint8_t variant;
+  uint8_t quirks;
+  uint8_t faulted;
+  uint8_t padding[7];
+};
+
+inline size_t daemonBitmapSize(const size_t width, const size_t height)
+{
+  return width / 8 * height;
+}
@@ -0,0 +1,309 @@
+#include "Debugger.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+namespace
+{
+  bool accessesMemory(const uint8_t id)
+  {
+    switch (id)
+    {
+    case OPCODE_5xy2:
+    case OPCODE_5xy3:
+    case OPCODE_Dxyn:
+    case OPCODE_F002:
+    case OPCODE_Fx33:
+    case OPCODE_Fx55:
+    case OPCODE_Fx65:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  std::string hex(const unsigned int value, const int digits)
+  {
+    char text[8];
+    std::snprintf(text, sizeof(text), "%0*X", digits, value);
+    return text;
+  }
+}
+
+Debugger::Debugger(Chip8& chip8):
+  chip8(chip8),
+  original(chip8.decoded),
+  hasBreakpoint(chip8.decoded.size(), 0)
+{
+  if (chip8.debugger != nullptr) throw std::logic_error("Debugger: A debugger is already attached");
+  chip8.debugger = this;
+}
+
+Debugger::~Debugger()
+{
+  unpatch(chip8.decoded);
+  chip8.debugger = nullptr;
+}
+
+void Debugger::setBreakpoint(const uint16_t address, const std::optional<BreakpointCondition> condition)
+{
+  if (address >= hasBreakpoint.size()) throw std::out_of_range("Debugger::setBreakpoint: Address outside of memory");
+  breakpoints[address] = condition;
+  hasBreakpoint[address] = 1;
+  patch(address, address + 1);
+}
+
+bool Debugger::clearBreakpoint(const uint16_t address)
+{
+  if (breakpoints.erase(address) == 0) return false;
+  hasBreakpoint[address] = 0;
+  patch(address, address + 1);
+  return true;
+}
+
+size_t Debugger::addWatchpoint(const Watchpoint& watchpoint)
+{
+  watchpoints.push_back(watchpoint);
+  // the first watchpoint traps every memory instruction
+  if (watchpoints.size() == 1) patch(0, chip8.decoded.size());
+  return watchpoints.size() - 1;
+}
+
+bool Debugger::removeWatchpoint(const size_t watchpoint)
+{
+  if (watchpoint >= watchpoints.size()) return false;
+  watchpoints.erase(watchpoints.begin() + static_cast<ptrdiff_t>(watchpoint));
+  if (watchpoints.empty()) patch(0, chip8.decoded.size());
+  return true;
+}
+
+void Debugger::patch(const size_t first, const size_t last)
+{
+  std::vector<uint8_t>& decoded = chip8.decoded;
+  for (size_t i = first; i < last; ++i)
+  {
+    // a trap still there means the instruction was not decoded again since
+    const uint8_t id = decoded[i] == OPCODE_TRAP ? original[i] : decoded[i];
+    original[i] = id;
+    const bool trapped = hasBreakpoint[i] || (!watchpoints.empty() && accessesMemory(id));
+    decoded[i] = trapped ? static_cast<uint8_t>(OPCODE_TRAP) : id;
+  }
+}
+
+void Debugger::unpatch(std::vector<uint8_t>& decoded) const
+{
+  for (size_t i = 0; i < decoded.size(); ++i)
+  {
+    if (decoded[i] == OPCODE_TRAP) decoded[i] = original[i];
+  }
+}
+
+uint8_t Debugger::trap(const uint16_t address)
+{
+  const uint8_t id = original[address];
+  if (address == resumeAddress)
+  {
+    resumeAddress = -1;
+    return id;
+  }
+
+  if (hasBreakpoint[address])
+  {
+    const std::optional<BreakpointCondition>& condition = breakpoints.at(address);
+    if (!condition || conditionHolds(*condition))
+    {
+      stopAt(StopReason::Breakpoint, address);
+      return OPCODE_TRAP;
+    }
+  }
+
+  uint16_t start;
+  uint16_t length;
+  if (bool write; !watchpoints.empty() && memoryAccess(id, start, length, write))
+  {
+    for (size_t i = 0; i < watchpoints.size(); ++i)
+    {
+      const Watchpoint& watchpoint = watchpoints[i];
+      if ((write ? watchpoint.write : watchpoint.read) && start < watchpoint.start + watchpoint.length &&
+        watchpoint.start < start + length)
+      {
+        stopAt(StopReason::Watchpoint, address);
+        stop.accessStart = start;
+        stop.accessLength = length;
+        stop.write = write;
+        stop.watchpoint = i;
+        return OPCODE_TRAP;
+      }
+    }
+  }
+
+  return id;
+}
+
+bool Debugger::conditionHolds(const BreakpointCondition& condition) const
+{
+  const uint16_t operand = condition.operand == BREAKPOINT_INDEX
+                             ? chip8.index.getAddress()
+                             : chip8.registers[condition.operand & 0xFu].getAddress();
+  switch (condition.comparison)
+  {
+  case Comparison::Equal:
+    return operand == condition.value;
+  case Comparison::NotEqual:
+    return operand != condition.value;
+  case Comparison::Less:
+    return operand < condition.value;
+  case Comparison::LessEqual:
+    return operand <= condition.value;
+  case Comparison::Greater:
+    return operand > condition.value;
+  default:
+    return operand >= condition.value;
+  }
+}
+
+bool Debugger::memoryAccess(const uint8_t id, uint16_t& start, uint16_t& length, bool& write) const
+{
+  // Cycle() already fetched the instruction into chip8.opcode
+  const uint16_t opcode = chip8.opcode;
+  const uint8_t x = (opcode & 0x0F00u) >> 8u;
+  const uint8_t y = (opcode & 0x00F0u) >> 4u;
+  start = chip8.index.getAddress();
+
+  switch (id)
+  {
+  case OPCODE_5xy2:
+  case OPCODE_5xy3:
+    length = (x > y ? x - y : y - x) + 1;
+    write = id == OPCODE_5xy2;
+    return true;
+  case OPCODE_Dxyn:
+    {
+      const uint8_t planes = (chip8.planeMask & 0x1u) + ((chip8.planeMask >> 1u) & 0x1u);
+      length = ((opcode & 0x000Fu) == 0 ? 32 : opcode & 0x000Fu) * planes;
+      write = false;
+      return planes > 0;
+    }
+  case OPCODE_F002:
+    length = 16;
+    write = false;
+    return true;
+  case OPCODE_Fx33:
+    length = 3;
+    write = true;
+    return true;
+  case OPCODE_Fx55:
+  case OPCODE_Fx65:
+    length = x + 1;
+    write = id == OPCODE_Fx55;
+    return true;
+  default:
+    return false;
+  }
+}
+
+void Debugger::stopAt(const StopReason reason, const uint16_t address)
+{
+  paused = true;
+  stop = DebugStop{};
+  stop.reason = reason;
+  stop.address = address;
+}
+
+unsigned int Debugger::run(const unsigned int cycles)
+{
+  if (paused || cycles == 0) return 0;
+
+  // the first cycle may run the instruction stopped in front of, which must not stop again
+  chip8.Cycle();
+  resumeAddress = -1;
+  // a cycle that stopped did not run
+  if (paused) return 0;
+  unsigned int ran = 1;
+
+  // nothing is trapped, nothing can stop the machine
+  if (breakpoints.empty() && watchpoints.empty())
+  {
+    for (; ran < cycles; ++ran)
+    {
+      chip8.Cycle();
+    }
+    return ran;
+  }
+
+  for (; ran < cycles; ++ran)
+  {
+    chip8.Cycle();
+    if (paused) break;
+  }
+  return ran;
+}
+
+void Debugger::step()
+{
+  resumeAddress = chip8.programCounter.getAddress();
+  paused = false;
+  chip8.Cycle();
+  resumeAddress = -1;
+  // a breakpoint on the next instruction already stopped the machine there
+  if (!paused) stopAt(StopReason::Step, chip8.programCounter.getAddress());
+}
+
+void Debugger::pause()
+{
+  if (!paused) stopAt(StopReason::Pause, chip8.programCounter.getAddress());
+}
+
+void Debugger::resume()
+{
+  if (!paused) return;
+  paused = false;
+  resumeAddress = chip8.programCounter.getAddress();
+}
+
+uint8_t Debugger::readMemory(const size_t address) const
+{
+  return chip8.memory.readByte(address);
+}
+
+size_t Debugger::getMemorySize() const
+{
+  return chip8.memory.getSize();
+}
+
+std::vector<uint16_t> Debugger::getCallStack() const
+{
+  std::vector<uint16_t> calls;
+  for (size_t i = 0; i < chip8.stack.getDepth(); ++i)
+  {
+    calls.push_back(chip8.stack.get(i));
+  }
+  return calls;
+}
+
+std::string Debugger::disassemble(const uint16_t address) const
+{
+  if (address + 1u >= chip8.memory.getSize()) return hex(address, 4) + ": ----";
+  const uint8_t id = chip8.decoded[address] == OPCODE_TRAP ? original[address] : chip8.decoded[address];
+  return hex(address, 4) + ": " + hex(chip8.memory.readWord(address), 4) + ' ' + OPCODE_NAMES[id] +
+    (hasBreakpoint[address] ? " *" : "");
+}
+
+std::string Debugger::describeStop() const
+{
+  if (!paused) return "running";
+
+  switch (stop.reason)
+  {
+  case StopReason::Breakpoint:
+    return "breakpoint at " + hex(stop.address, 4);
+  case StopReason::Watchpoint:
+    return std::string("watchpoint ") + std::to_string(stop.watchpoint) + ": " + (stop.write ? "write " : "read ") +
+      hex(stop.accessStart, 4) + '-' + hex(stop.accessStart + stop.accessLength - 1, 4) + " at " +
+      hex(stop.address, 4);
+  case StopReason::Step:
+    return "stepped to " + hex(stop.address, 4);
+  default:
+    return "paused at " + hex(stop.address, 4);
+  }
+}
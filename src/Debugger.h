@@ -0,0 +1,152 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Chip8.h"
+
+enum class StopReason : uint8_t
+{
+  None,
+  Breakpoint,
+  Watchpoint,
+  Step,
+  // pause() from the frontend
+  Pause
+};
+
+enum class Comparison : uint8_t
+{
+  Equal,
+  NotEqual,
+  Less,
+  LessEqual,
+  Greater,
+  GreaterEqual
+};
+
+// a breakpoint with a condition only stops when operand <comparison> value holds
+struct BreakpointCondition
+{
+  // 0 to 15 for V0 to VF, BREAKPOINT_INDEX for I
+  uint8_t operand;
+  Comparison comparison;
+  uint16_t value;
+};
+
+constexpr uint8_t BREAKPOINT_INDEX = 16;
+
+struct Watchpoint
+{
+  uint16_t start;
+  uint16_t length;
+  bool read;
+  bool write;
+};
+
+struct DebugStop
+{
+  StopReason reason = StopReason::None;
+  // the instruction the machine stopped in front of, it has not run yet
+  uint16_t address = 0;
+  // for watchpoints, the access the instruction is about to make and the index of the watchpoint it touches
+  uint16_t accessStart = 0;
+  uint16_t accessLength = 0;
+  bool write = false;
+  size_t watchpoint = 0;
+};
+
+// Breakpoints, watchpoints and stepping for one Chip8.
+//
+// Nothing is checked on every cycle. The debugger keeps the real OpcodeId of every address and writes OPCODE_TRAP over
+// the decoded instructions it needs to see before they run: the addresses with a breakpoint, and while any watchpoint
+// is set, every instruction that reads or writes memory. Only those instructions go through trap(), all others run
+// exactly as without a debugger; when code is rewritten, Chip8::redecode() calls patch() to keep the traps. With no
+// breakpoint and no watchpoint the decoded table is untouched and run() is the plain loop over Cycle().
+//
+// Stopping happens in front of an instruction, with the machine exactly as it was before that cycle. A coverage
+// attached at the same time counts trapped instructions as OPCODE_TRAP.
+class Debugger
+{
+  Chip8& chip8;
+  // the real OpcodeId of every address, valid where chip8.decoded holds OPCODE_TRAP
+  std::vector<uint8_t> original;
+  std::map<uint16_t, std::optional<BreakpointCondition>> breakpoints;
+  std::vector<uint8_t> hasBreakpoint;
+  std::vector<Watchpoint> watchpoints;
+
+  bool paused = false;
+  DebugStop stop;
+  // the instruction the machine stopped in front of runs without stopping again when resuming
+  int32_t resumeAddress = -1;
+
+  [[nodiscard]] bool conditionHolds(const BreakpointCondition& condition) const;
+  // the memory the instruction at the program counter is about to touch, false if it does not
+  [[nodiscard]] bool memoryAccess(uint8_t id, uint16_t& start, uint16_t& length, bool& write) const;
+  void stopAt(StopReason reason, uint16_t address);
+
+public:
+  // attaches to chip8 until destroyed, only one debugger at a time
+  explicit Debugger(Chip8& chip8);
+  ~Debugger();
+  Debugger(const Debugger&) = delete;
+  Debugger& operator=(const Debugger&) = delete;
+
+  // replaces the breakpoint already at address, if any
+  void setBreakpoint(uint16_t address, std::optional<BreakpointCondition> condition = std::nullopt);
+  bool clearBreakpoint(uint16_t address);
+  [[nodiscard]] const std::map<uint16_t, std::optional<BreakpointCondition>>& getBreakpoints() const
+  {
+    return breakpoints;
+  }
+
+  // returns the index of the watchpoint, indexes of the later ones shift down when one is removed
+  size_t addWatchpoint(const Watchpoint& watchpoint);
+  bool removeWatchpoint(size_t watchpoint);
+  [[nodiscard]] const std::vector<Watchpoint>& getWatchpoints() const
+  {
+    return watchpoints;
+  }
+
+  // runs up to cycles cycles unless something stops the machine first, returns the cycles run (a stop is not one).
+  // Nothing runs while paused.
+  unsigned int run(unsigned int cycles);
+  // runs the next instruction whatever stops there, and stays paused
+  void step();
+  void pause();
+  void resume();
+
+  [[nodiscard]] bool isPaused() const
+  {
+    return paused;
+  }
+
+  [[nodiscard]] const DebugStop& getStop() const
+  {
+    return stop;
+  }
+
+  [[nodiscard]] const Chip8& getChip8() const
+  {
+    return chip8;
+  }
+
+  [[nodiscard]] uint8_t readMemory(size_t address) const;
+  [[nodiscard]] size_t getMemorySize() const;
+  // return addresses, innermost call last
+  [[nodiscard]] std::vector<uint16_t> getCallStack() const;
+  // "0204: D015 Dxyn" for the instruction at address
+  [[nodiscard]] std::string disassemble(uint16_t address) const;
+  // one line about why the machine is stopped
+  [[nodiscard]] std::string describeStop() const;
+
+  // Chip8 side: what the trap at address should run, OPCODE_TRAP to stop there instead
+  uint8_t trap(uint16_t address);
+  // Chip8 side: chip8.decoded was rewritten in [first, last), put the traps back
+  void patch(size_t first, size_t last);
+  // Chip8 side: puts the real instructions back into a copy of the decoded table
+  void unpatch(std::vector<uint8_t>& decoded) const;
+};
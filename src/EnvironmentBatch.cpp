@@ -0,0 +1,299 @@
+#include "EnvironmentBatch.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+  // instances a thread takes at once, enough that claiming costs nothing next to running them
+  constexpr size_t CLAIM_SIZE = 16;
+}
+
+EnvironmentBatch::EnvironmentBatch(const RomImage& rom, const size_t size, const size_t threads):
+  rom(rom.data, rom.data + rom.size),
+  observations(size * GRAPHIC_HEIGHT * GRAPHIC_WIDTH, 0),
+  faulted(size, 0),
+  waiting(size, static_cast<uint8_t>(WaitReason::None)),
+  waits(size, Wait{WaitReason::None, 0})
+{
+  if (size == 0) throw std::invalid_argument("EnvironmentBatch: At least one instance is needed");
+
+  instances.reserve(size);
+  for (size_t i = 0; i < size; ++i)
+  {
+    instances.push_back(std::make_unique<Chip8>(RomImage(this->rom)));
+    instances.back()->seedRandom(baseSeed + i);
+    running.push_back(i);
+  }
+
+  // no point in having more threads than instances
+  const size_t helpers = std::clamp<size_t>(threads, 1, size) - 1;
+  workers.reserve(helpers);
+  for (size_t worker = 0; worker < helpers; ++worker)
+  {
+    workers.emplace_back(&EnvironmentBatch::work, this);
+  }
+}
+
+EnvironmentBatch::~EnvironmentBatch()
+{
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (std::thread& worker : workers)
+  {
+    worker.join();
+  }
+}
+
+void EnvironmentBatch::work()
+{
+  while (true)
+  {
+    std::unique_lock lock(mutex);
+    wake.wait(lock, [this] { return stopping || tokens > 0; });
+    if (stopping) return;
+    --tokens;
+    lock.unlock();
+
+    stepRunning();
+
+    lock.lock();
+    if (--pending == 0) finished.notify_one();
+  }
+}
+
+void EnvironmentBatch::stepRunning()
+{
+  while (true)
+  {
+    const size_t first = claimed.fetch_add(CLAIM_SIZE);
+    if (first >= running.size()) return;
+
+    const size_t last = std::min(first + CLAIM_SIZE, running.size());
+    for (size_t i = first; i < last; ++i)
+    {
+      stepInstance(running[i]);
+    }
+  }
+}
+
+void EnvironmentBatch::stepInstance(const size_t instance)
+{
+  setKeys(instance);
+  try
+  {
+    instances[instance]->Run(frames * CYCLES_PER_FRAME);
+    waits[instance] = instances[instance]->getWait();
+  }
+  catch (const std::exception&)
+  {
+    faulted[instance] = 1;
+  }
+
+  writeObservation(instance);
+}
+
+void EnvironmentBatch::stepParked(const size_t instance)
+{
+  // only the wait runs, which neither draws nor throws
+  setKeys(instance);
+  instances[instance]->Run(frames * CYCLES_PER_FRAME);
+}
+
+void EnvironmentBatch::setKeys(const size_t instance)
+{
+  Keypad& keypad = instances[instance]->getKeypad();
+  for (size_t key = 0; key < 16; ++key)
+  {
+    if ((actions[instance] >> key) & 0x1u) keypad.pressKey(key);
+    else keypad.releaseKey(key);
+  }
+}
+
+void EnvironmentBatch::wakeParked()
+{
+  // a key held ends Fx0A
+  for (size_t i = 0; i < keyQueue.size();)
+  {
+    const size_t instance = keyQueue[i];
+    if (actions[instance] == 0)
+    {
+      ++i;
+      continue;
+    }
+    keyQueue[i] = keyQueue.back();
+    keyQueue.pop_back();
+    waiting[instance] = static_cast<uint8_t>(WaitReason::None);
+    running.push_back(instance);
+  }
+
+  // the delay loops left during this step
+  const auto woken = timerQueue.lower_bound(frame + frames);
+  for (auto entry = timerQueue.begin(); entry != woken; ++entry)
+  {
+    waiting[entry->second] = static_cast<uint8_t>(WaitReason::None);
+    running.push_back(entry->second);
+  }
+  timerQueue.erase(timerQueue.begin(), woken);
+}
+
+void EnvironmentBatch::park()
+{
+  const uint64_t next = frame + frames;
+  size_t kept = 0;
+  for (const size_t instance : running)
+  {
+    if (faulted[instance]) continue;
+
+    const Wait& wait = waits[instance];
+    waiting[instance] = static_cast<uint8_t>(wait.reason);
+    switch (wait.reason)
+    {
+    case WaitReason::None:
+      running[kept++] = instance;
+      break;
+    case WaitReason::Key:
+      keyQueue.push_back(instance);
+      break;
+    case WaitReason::DelayTimer:
+      // steps start on a frame boundary, cycle n from now is in frame n / CYCLES_PER_FRAME from now
+      timerQueue.emplace(next + wait.cycles / CYCLES_PER_FRAME, instance);
+      break;
+    case WaitReason::Halt:
+      haltQueue.push_back(instance);
+      break;
+    }
+  }
+  running.resize(kept);
+}
+
+void EnvironmentBatch::unpark(const size_t instance)
+{
+  switch (static_cast<WaitReason>(waiting[instance]))
+  {
+  case WaitReason::None:
+    return;
+  case WaitReason::Key:
+    keyQueue.erase(std::find(keyQueue.begin(), keyQueue.end(), instance));
+    break;
+  case WaitReason::DelayTimer:
+    for (auto entry = timerQueue.begin(); entry != timerQueue.end(); ++entry)
+    {
+      if (entry->second == instance)
+      {
+        timerQueue.erase(entry);
+        break;
+      }
+    }
+    break;
+  case WaitReason::Halt:
+    haltQueue.erase(std::find(haltQueue.begin(), haltQueue.end(), instance));
+    break;
+  }
+  waiting[instance] = static_cast<uint8_t>(WaitReason::None);
+}
+
+void EnvironmentBatch::writeObservation(const size_t instance)
+{
+  // the screen is 0 or 0xFFFFFFFF per pixel, keep one bit of it
+  const Chip8& chip8 = *instances[instance];
+  const uint32_t* buffer = chip8.getBuffer();
+  uint8_t* observation = observations.data() + instance * GRAPHIC_HEIGHT * GRAPHIC_WIDTH;
+
+  if (chip8.getWidth() == GRAPHIC_WIDTH)
+  {
+    for (size_t pixel = 0; pixel < GRAPHIC_HEIGHT * GRAPHIC_WIDTH; ++pixel)
+    {
+      observation[pixel] = static_cast<uint8_t>(buffer[pixel] & 0x1u);
+    }
+    return;
+  }
+
+  // SUPER-CHIP hi-res, every observation pixel covers 2x2 screen pixels and is lit if any of them is
+  for (size_t y = 0; y < GRAPHIC_HEIGHT; ++y)
+  {
+    const uint32_t* top = buffer + 2 * y * HIRES_GRAPHIC_WIDTH;
+    const uint32_t* bottom = top + HIRES_GRAPHIC_WIDTH;
+    for (size_t x = 0; x < GRAPHIC_WIDTH; ++x)
+    {
+      observation[y * GRAPHIC_WIDTH + x] =
+        static_cast<uint8_t>((top[2 * x] | top[2 * x + 1] | bottom[2 * x] | bottom[2 * x + 1]) & 0x1u);
+    }
+  }
+}
+
+void EnvironmentBatch::step(const uint16_t* actions, const unsigned int frames)
+{
+  this->actions = actions;
+  this->frames = frames;
+  wakeParked();
+  claimed = 0;
+
+  // one thread per CLAIM_SIZE instances that can run, the calling one included
+  const size_t helpers = std::min(workers.size(), running.empty() ? 0 : (running.size() - 1) / CLAIM_SIZE);
+  if (helpers > 0)
+  {
+    {
+      std::lock_guard lock(mutex);
+      tokens = helpers;
+      pending = helpers;
+    }
+    for (size_t helper = 0; helper < helpers; ++helper)
+    {
+      wake.notify_one();
+    }
+  }
+
+  for (const size_t instance : keyQueue)
+  {
+    stepParked(instance);
+  }
+  for (const auto& [wakeFrame, instance] : timerQueue)
+  {
+    stepParked(instance);
+  }
+  for (const size_t instance : haltQueue)
+  {
+    stepParked(instance);
+  }
+  stepRunning();
+
+  if (helpers > 0)
+  {
+    std::unique_lock lock(mutex);
+    finished.wait(lock, [&] { return pending == 0; });
+  }
+
+  park();
+  frame += frames;
+}
+
+void EnvironmentBatch::reset(const uint8_t* mask)
+{
+  for (size_t i = 0; i < instances.size(); ++i)
+  {
+    if (mask != nullptr && mask[i] == 0) continue;
+
+    instances[i]->reset(RomImage(rom));
+    instances[i]->seedRandom(baseSeed + i);
+    // a faulted instance was dropped from running, a parked one goes back to it
+    if (faulted[i] || waiting[i] != static_cast<uint8_t>(WaitReason::None)) running.push_back(i);
+    unpark(i);
+    faulted[i] = 0;
+    writeObservation(i);
+  }
+}
+
+void EnvironmentBatch::seed(const uint64_t seed)
+{
+  baseSeed = seed;
+
+  for (size_t i = 0; i < instances.size(); ++i)
+  {
+    instances[i]->seedRandom(baseSeed + i);
+  }
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Chip8.h"
+
+// A fixed number of independent Chip8 instances running the same rom, stepped together. This is what the C API in
+// include/chip8_env.h drives, one step being: set every instance's keys from its action, run a number of frames
+// (CYCLES_PER_FRAME cycles each, like the SDL frontend) and write every screen into one contiguous
+// size x GRAPHIC_HEIGHT x GRAPHIC_WIDTH array, 1 for a lit pixel and 0 otherwise. That array never moves, so callers
+// can keep a view on it across steps.
+//
+// The instances that can run are shared out over a small pool of threads that lives as long as the batch, a few at a
+// time, and only as many threads as there are instances for are woken. An instance blocked at the end of a step (see
+// Chip8::getWait) is parked in the wait queue of its wake condition instead: Fx0A until its action holds a key, a delay
+// loop until the frame its timer runs out in, a halt until it is reset. Parked instances cost next to nothing, the
+// calling thread counts their cycles without running them and their screens do not change.
+class EnvironmentBatch
+{
+  std::vector<uint8_t> rom;
+  std::vector<std::unique_ptr<Chip8>> instances;
+  std::vector<uint8_t> observations;
+  // 1 once an instance threw from Cycle(), it is not stepped any more until it is reset
+  std::vector<uint8_t> faulted;
+  // instance i uses baseSeed + i, so that a batch is reproducible
+  uint64_t baseSeed = 0;
+
+  // a WaitReason per instance, None for the ones not parked
+  std::vector<uint8_t> waiting;
+  std::vector<size_t> keyQueue;
+  // by the frame the delay loop is left in
+  std::multimap<uint64_t, size_t> timerQueue;
+  std::vector<size_t> haltQueue;
+  // frames stepped since the batch was created
+  uint64_t frame = 0;
+
+  // neither parked nor faulted, claimed by the threads CLAIM_SIZE at a time
+  std::vector<size_t> running;
+  std::atomic<size_t> claimed{0};
+  // what each running instance waits for after its step, written by the thread that stepped it
+  std::vector<Wait> waits;
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  // workers still to start on the step in progress, and the ones that have not finished it
+  size_t tokens = 0;
+  size_t pending = 0;
+  bool stopping = false;
+
+  // arguments of the step in progress
+  const uint16_t* actions = nullptr;
+  unsigned int frames = 0;
+
+  void work();
+  void stepRunning();
+  void stepInstance(size_t instance);
+  void stepParked(size_t instance);
+  void setKeys(size_t instance);
+  // moves the parked instances whose condition is met to running
+  void wakeParked();
+  // moves the running instances that wait to their queue
+  void park();
+  void unpark(size_t instance);
+  void writeObservation(size_t instance);
+
+public:
+  // threads is the total number of threads stepping, the calling one included
+  EnvironmentBatch(const RomImage& rom, size_t size, size_t threads = 1);
+  ~EnvironmentBatch();
+  EnvironmentBatch(const EnvironmentBatch&) = delete;
+  EnvironmentBatch& operator=(const EnvironmentBatch&) = delete;
+
+  // actions[i] is a mask of the keys held by instance i during the step, bit k for key k
+  void step(const uint16_t* actions, unsigned int frames);
+  // restarts the instances whose mask byte is not 0, or all of them when mask is nullptr
+  void reset(const uint8_t* mask);
+  void seed(uint64_t seed);
+
+  [[nodiscard]] size_t size() const
+  {
+    return instances.size();
+  }
+
+  [[nodiscard]] const uint8_t* getObservations() const
+  {
+    return observations.data();
+  }
+
+  [[nodiscard]] const uint8_t* getFaulted() const
+  {
+    return faulted.data();
+  }
+
+  // a WaitReason per instance, what the parked ones wait for
+  [[nodiscard]] const uint8_t* getWaiting() const
+  {
+    return waiting.data();
+  }
+
+  [[nodiscard]] Chip8& getInstance(const size_t instance)
+  {
+    return *instances.at(instance);
+  }
+};
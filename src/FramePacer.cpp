@@ -0,0 +1,129 @@
+#include "FramePacer.h"
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // SDL_Delay can oversleep by about a scheduler tick, the last part of a wait is spun instead
+  constexpr double SPIN_SECONDS = 0.002;
+}
+
+FramePacer::FramePacer(const double cyclesPerSecond, const unsigned int frameRate, const bool vsync):
+  cyclesPerSecond(cyclesPerSecond),
+  frameRate(frameRate),
+  vsync(vsync),
+  frequency(SDL_GetPerformanceFrequency()),
+  period(frequency / frameRate),
+  periodRemainder(frequency % frameRate)
+{
+  samples.reserve(SAMPLE_COUNT);
+}
+
+void FramePacer::advanceDeadline()
+{
+  deadline += period;
+  periodError += periodRemainder;
+  if (periodError >= frameRate)
+  {
+    periodError -= frameRate;
+    ++deadline;
+  }
+}
+
+void FramePacer::waitUntil(const uint64_t target) const
+{
+  const auto spinTicks = static_cast<uint64_t>(SPIN_SECONDS * static_cast<double>(frequency));
+
+  for (uint64_t now = SDL_GetPerformanceCounter(); now < target; now = SDL_GetPerformanceCounter())
+  {
+    if (target - now > spinTicks)
+    {
+      SDL_Delay(static_cast<Uint32>((target - now - spinTicks) * 1000 / frequency));
+    }
+  }
+}
+
+unsigned int FramePacer::beginFrame()
+{
+  const uint64_t now = SDL_GetPerformanceCounter();
+
+  if (frames == 0)
+  {
+    lastFrameStart = now;
+    lastFrameEnd = now;
+    deadline = now;
+    advanceDeadline();
+  }
+
+  if (vsync)
+  {
+    // the time since the previous frame, at most MAX_LAG_FRAMES of it so that a stall is not replayed all at once
+    const uint64_t elapsed = std::min<uint64_t>(now - lastFrameStart, MAX_LAG_FRAMES * period);
+    cycleAccumulator += cyclesPerSecond * static_cast<double>(elapsed) / static_cast<double>(frequency);
+    // the first frame has no previous one, give it a nominal frame's worth
+    if (frames == 0) cycleAccumulator = cyclesPerSecond / frameRate;
+  }
+  else
+  {
+    cycleAccumulator += cyclesPerSecond / frameRate;
+  }
+  lastFrameStart = now;
+
+  const double cycles = std::floor(cycleAccumulator);
+  cycleAccumulator -= cycles;
+  return static_cast<unsigned int>(cycles);
+}
+
+void FramePacer::endFrame()
+{
+  if (!vsync)
+  {
+    const uint64_t now = SDL_GetPerformanceCounter();
+    if (now > deadline + MAX_LAG_FRAMES * period)
+    {
+      // too far behind to catch up, start counting again from here
+      deadline = now;
+      ++resyncs;
+    }
+    else
+    {
+      waitUntil(deadline);
+    }
+    advanceDeadline();
+  }
+
+  const uint64_t end = SDL_GetPerformanceCounter();
+  if (frames > 0)
+  {
+    const auto milliseconds = static_cast<float>(static_cast<double>(end - lastFrameEnd) * 1000.0 /
+      static_cast<double>(frequency));
+    if (samples.size() < SAMPLE_COUNT) samples.push_back(milliseconds);
+    else samples[frames % SAMPLE_COUNT] = milliseconds;
+  }
+  lastFrameEnd = end;
+  ++frames;
+}
+
+FramePacer::Statistics FramePacer::getStatistics() const
+{
+  Statistics statistics{};
+  statistics.frames = frames;
+  statistics.resyncs = resyncs;
+  statistics.target = vsync ? 0 : 1000.0 / frameRate;
+  if (samples.empty()) return statistics;
+
+  std::vector<float> sorted = samples;
+  std::sort(sorted.begin(), sorted.end());
+  const auto percentile = [&sorted](const double fraction)
+  {
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * static_cast<double>(sorted.size())))];
+  };
+  statistics.p50 = percentile(0.50);
+  statistics.p90 = percentile(0.90);
+  statistics.p99 = percentile(0.99);
+  statistics.max = sorted.back();
+  return statistics;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Decides how many cycles the frontend runs per frame and when the frame is over, on SDL's performance counter.
+//
+// Without vsync, frames are frameRate per second: every frame runs cyclesPerSecond / frameRate cycles, the fraction
+// carried over to the next frame so no cycle is lost to rounding, and endFrame() sleeps until the frame's deadline.
+// Deadlines follow each other by exactly one period, so a late frame is caught up by the next ones not sleeping;
+// falling more than MAX_LAG_FRAMES behind (the machine is too slow, or the process was stopped) drops the backlog
+// instead of running flat out until it is paid back.
+//
+// With vsync, presenting already blocks until the display refreshes: nothing sleeps, and each frame runs the cycles
+// for the time that actually went by since the previous one, at whatever rate the display refreshes.
+class FramePacer
+{
+public:
+  static constexpr unsigned int MAX_LAG_FRAMES = 3;
+  // frame times kept for the statistics, the oldest are overwritten
+  static constexpr size_t SAMPLE_COUNT = 4096;
+
+  struct Statistics
+  {
+    size_t frames;
+    // frame time percentiles in milliseconds, from the last SAMPLE_COUNT frames
+    double p50;
+    double p90;
+    double p99;
+    double max;
+    // the frame time the pacing aims for (0 with vsync, the display decides)
+    double target;
+    // times the backlog was dropped
+    size_t resyncs;
+  };
+
+private:
+  double cyclesPerSecond;
+  unsigned int frameRate;
+  bool vsync;
+
+  uint64_t frequency;
+  // one frame in counter ticks, the remainder of frequency / frameRate is spread with periodError
+  uint64_t period;
+  uint64_t periodRemainder;
+  uint64_t periodError = 0;
+
+  uint64_t deadline = 0;
+  uint64_t lastFrameStart = 0;
+  uint64_t lastFrameEnd = 0;
+  // cycles owed but not run yet, always below 1 after beginFrame()
+  double cycleAccumulator = 0;
+
+  std::vector<float> samples;
+  size_t frames = 0;
+  size_t resyncs = 0;
+
+  void advanceDeadline();
+  // sleeps most of the way with SDL_Delay, then spins on the counter for the last stretch
+  void waitUntil(uint64_t target) const;
+
+public:
+  FramePacer(double cyclesPerSecond, unsigned int frameRate, bool vsync);
+
+  // number of cycles to run in the frame starting now
+  unsigned int beginFrame();
+  // after the frame was presented, waits for the frame's deadline when not using vsync
+  void endFrame();
+
+  [[nodiscard]] Statistics getStatistics() const;
+};
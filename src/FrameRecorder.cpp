@@ -0,0 +1,201 @@
+#include "FrameRecorder.h"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+  // a capture() racing the writer going to sleep can miss the notification, the writer never sleeps longer than this
+  constexpr std::chrono::milliseconds WRITER_POLL(10);
+  constexpr size_t MAX_RUN = 0xFFFF;
+
+  // the R G B A bytes of an RGBA8888 word, whatever the byte order of the machine
+  uint8_t* storePixel(uint8_t* out, const uint32_t pixel)
+  {
+    out[0] = static_cast<uint8_t>(pixel >> 24);
+    out[1] = static_cast<uint8_t>(pixel >> 16);
+    out[2] = static_cast<uint8_t>(pixel >> 8);
+    out[3] = static_cast<uint8_t>(pixel);
+    return out + 4;
+  }
+}
+
+FrameRecorder::FrameRecorder(const std::string& filePath, const RecordingFormat format, const size_t width,
+                             const size_t height, const unsigned int frameRate, const size_t poolSize):
+  file(filePath, std::ios::binary | std::ios::trunc),
+  format(format),
+  width(width),
+  height(height),
+  pool(poolSize)
+{
+  if (!file.is_open()) throw std::runtime_error("FrameRecorder: Failed to open " + filePath);
+  if (width == 0 || height == 0 || poolSize == 0) throw std::invalid_argument("FrameRecorder: Empty frames or pool");
+
+  for (Frame& frame : pool)
+  {
+    frame.pixels.resize(width * height);
+  }
+  output.reserve(width * height * 6);
+
+  if (format == RecordingFormat::Y4m)
+  {
+    file << "YUV4MPEG2 W" << width << " H" << height << " F" << frameRate << ":1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+  }
+  else if (format == RecordingFormat::RgbaRle)
+  {
+    file << "CHIP8RLE " << width << ' ' << height << ' ' << frameRate << '\n';
+  }
+
+  writer = std::thread(&FrameRecorder::write, this);
+}
+
+FrameRecorder::~FrameRecorder()
+{
+  finish();
+}
+
+void FrameRecorder::finish()
+{
+  if (!writer.joinable()) return;
+  finished.store(true, std::memory_order_relaxed);
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  ready.notify_one();
+  writer.join();
+  file.close();
+  if (file.fail()) failed.store(true, std::memory_order_relaxed);
+}
+
+void FrameRecorder::capture(const uint32_t* pixels, const size_t frameWidth, const size_t frameHeight)
+{
+  const size_t next = head.load(std::memory_order_relaxed);
+  // the pool may hold larger frames than the file, never more pixels than were allocated
+  if (failed.load(std::memory_order_relaxed) || finished.load(std::memory_order_relaxed) ||
+    next - tail.load(std::memory_order_acquire) == pool.size() || frameWidth * frameHeight > width * height)
+  {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  Frame& frame = pool[next % pool.size()];
+  std::memcpy(frame.pixels.data(), pixels, frameWidth * frameHeight * sizeof(uint32_t));
+  frame.width = frameWidth;
+  frame.height = frameHeight;
+  head.store(next + 1, std::memory_order_release);
+  // without the lock, so that capture() never waits for the writer
+  ready.notify_one();
+}
+
+void FrameRecorder::write()
+{
+  while (true)
+  {
+    const size_t next = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == next)
+    {
+      std::unique_lock lock(mutex);
+      if (stopping && head.load(std::memory_order_acquire) == next) break;
+      ready.wait_for(lock, WRITER_POLL,
+                     [&] { return stopping || head.load(std::memory_order_acquire) != next; });
+      continue;
+    }
+
+    encode(pool[next % pool.size()]);
+    file.write(reinterpret_cast<const char*>(output.data()), static_cast<std::streamsize>(output.size()));
+    if (file.fail())
+    {
+      failed.store(true, std::memory_order_relaxed);
+      return;
+    }
+    // the buffer can only be reused once the frame is out of it
+    tail.store(next + 1, std::memory_order_release);
+  }
+}
+
+void FrameRecorder::encode(const Frame& frame)
+{
+  output.clear();
+
+  // the pixel of the frame shown at (x, y) of the file
+  const auto sample = [&](const size_t x, const size_t y)
+  {
+    return frame.pixels[y * frame.height / height * frame.width + x * frame.width / width];
+  };
+
+  switch (format)
+  {
+  case RecordingFormat::Y4m:
+    {
+      static constexpr char FRAME_HEADER[] = "FRAME\n";
+      const size_t planeStart = sizeof(FRAME_HEADER) - 1;
+      const size_t planeSize = width * height;
+      output.resize(planeStart + 3 * planeSize);
+      memcpy(output.data(), FRAME_HEADER, planeStart);
+      uint8_t* luma = output.data() + planeStart;
+      uint8_t* blue = luma + planeSize;
+      uint8_t* red = blue + planeSize;
+
+      for (size_t y = 0; y < height; ++y)
+      {
+        for (size_t x = 0; x < width; ++x)
+        {
+          const uint32_t pixel = sample(x, y);
+          const int r = static_cast<int>(pixel >> 24);
+          const int g = static_cast<int>(pixel >> 16 & 0xFFu);
+          const int b = static_cast<int>(pixel >> 8 & 0xFFu);
+          // BT.601 full range, the gray palette only ever needs the luma
+          const size_t i = y * width + x;
+          luma[i] = static_cast<uint8_t>((77 * r + 150 * g + 29 * b + 128) >> 8);
+          blue[i] = static_cast<uint8_t>(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128);
+          red[i] = static_cast<uint8_t>(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128);
+        }
+      }
+      break;
+    }
+  case RecordingFormat::Rgba:
+    {
+      output.resize(width * height * 4);
+      uint8_t* out = output.data();
+      for (size_t y = 0; y < height; ++y)
+      {
+        for (size_t x = 0; x < width; ++x)
+        {
+          out = storePixel(out, sample(x, y));
+        }
+      }
+      break;
+    }
+  case RecordingFormat::RgbaRle:
+    {
+      uint32_t current = sample(0, 0);
+      size_t run = 0;
+      const auto flush = [&]
+      {
+        uint8_t record[6];
+        record[0] = static_cast<uint8_t>(run);
+        record[1] = static_cast<uint8_t>(run >> 8);
+        storePixel(record + 2, current);
+        output.insert(output.end(), record, record + sizeof(record));
+      };
+
+      for (size_t y = 0; y < height; ++y)
+      {
+        for (size_t x = 0; x < width; ++x)
+        {
+          if (const uint32_t pixel = sample(x, y); pixel != current || run == MAX_RUN)
+          {
+            flush();
+            current = pixel;
+            run = 0;
+          }
+          ++run;
+        }
+      }
+      flush();
+      break;
+    }
+  }
+}
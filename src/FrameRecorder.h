@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class RecordingFormat : uint8_t
+{
+  // YUV4MPEG2, 4:4:4 full range, plays in mpv / ffmpeg as is
+  Y4m,
+  // width x height x 4 bytes per frame, R G B A, no header: ffmpeg -f rawvideo -pix_fmt rgba -s <w>x<h> -r <rate>
+  Rgba,
+  // the same pixels run-length encoded, see below
+  RgbaRle
+};
+
+// Records the presented frames to a file without slowing the frame loop down.
+//
+// capture() only copies the frame into one of a fixed number of buffers allocated up front and returns; a thread of
+// its own converts the frames and writes them. capture() never waits for it: when every buffer still holds a frame
+// that is not written yet, the new frame is dropped and counted instead. The buffers are a single producer / single
+// consumer ring, so capture() must always be called from the same thread.
+//
+// Every frame of the file is width x height, the size given to the constructor. Frames of another size (the screen
+// switched between the 64x32 and 128x64 modes) are scaled to it, nearest neighbour.
+//
+// RgbaRle files start with the line "CHIP8RLE <width> <height> <frame rate>\n", followed by the frames one after
+// another, each being runs of a 16 bit little endian pixel count and the R G B A bytes repeated that many times, until
+// the frame's width x height pixels are covered. Runs do not cross frames.
+class FrameRecorder
+{
+  struct Frame
+  {
+    std::vector<uint32_t> pixels;
+    size_t width = 0;
+    size_t height = 0;
+  };
+
+  std::ofstream file;
+  RecordingFormat format;
+  size_t width;
+  size_t height;
+
+  std::vector<Frame> pool;
+  // frames captured and frames written since the start, the ring holds the frames in between
+  std::atomic<size_t> head = 0;
+  std::atomic<size_t> tail = 0;
+  std::atomic<size_t> dropped = 0;
+  std::atomic<bool> failed = false;
+  std::atomic<bool> finished = false;
+
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable ready;
+  bool stopping = false;
+
+  // the converted frame, reused so the writer does not allocate once running
+  std::vector<uint8_t> output;
+
+  void write();
+  void encode(const Frame& frame);
+
+public:
+  // throws if the file cannot be created, poolSize is the number of frames that can wait to be written
+  FrameRecorder(const std::string& filePath, RecordingFormat format, size_t width, size_t height,
+                unsigned int frameRate, size_t poolSize = 8);
+  ~FrameRecorder();
+  FrameRecorder(const FrameRecorder&) = delete;
+  FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+  // writes the frames still waiting and closes the file, capture() drops every frame after that
+  void finish();
+
+  // pixels is frameWidth x frameHeight RGBA8888 words, as returned by Chip8::getBuffer()
+  void capture(const uint32_t* pixels, size_t frameWidth, size_t frameHeight);
+
+  [[nodiscard]] size_t getWritten() const
+  {
+    return tail.load(std::memory_order_acquire);
+  }
+
+  [[nodiscard]] size_t getDropped() const
+  {
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+  // set once writing to the file failed, every frame captured after that is dropped
+  [[nodiscard]] bool hasFailed() const
+  {
+    return failed.load(std::memory_order_relaxed);
+  }
+};
@@ -1,33 +1,258 @@
 #pragma once
+#include <algorithm>
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <stdexcept>
 #include <vector>
 
-#include "Register.h"
+#include "Hash.h"
 
+// What drawSprite does with the part of a sprite going past the right or bottom edge of the screen
+enum class SpriteEdge : uint8_t
+{
+  // a row carries on at the start of the next screen row, the original behaviour of this interpreter in 64x32
+  Spill,
+  // cut at the edge
+  Clip,
+  // comes back in on the opposite edge
+  Wrap
+};
+
+// The screen, kept as PLANE_COUNT bitplanes: CHIP-8 and SUPER-CHIP only ever use the first one, XO-CHIP draws in
+// colour by selecting several. A plane is packed rows, one bit per pixel with the leftmost pixel in the top bit of the
+// first word of its row, and rows of width / 64 words back to back. Drawing, clearing and scrolling all work on whole
+// words; the planes are only turned into T pixels (through a palette indexed by the plane bits) when getBuffer() is
+// called after something changed. Drawing keeps a hash of the planes up to date as well.
 template <typename T>
 class Graphic
 {
+public:
+  static constexpr size_t PLANE_COUNT = 2;
+  static constexpr uint8_t ALL_PLANES = (1u << PLANE_COUNT) - 1;
+
+private:
   size_t width;
   size_t height;
-  size_t size;
-  T* buffer;
+  // words per row
+  size_t stride;
+  // words per plane, enough for the largest resolution
+  size_t capacity;
+  // PLANE_COUNT planes of capacity words
+  std::vector<uint64_t> planes;
+  // Per plane, the sum of wordWeight(plane * capacity + word) * word value: a word drawn to moves it by one multiply,
+  // where two zobrist() pairs would cost four mixes, and draws are the hot path. A scroll only marks the plane in
+  // staleHashes, the sum is taken again when getHash() is next called rather than after every scroll of a frame.
+  mutable std::array<uint64_t, PLANE_COUNT> hashes{};
+  mutable uint8_t staleHashes = 0;
+  std::array<T, 1u << PLANE_COUNT> palette;
+
+  // the composited image, built by getBuffer() when a plane changed since
+  mutable std::vector<T> pixels;
+  mutable bool dirty = true;
+
+  [[nodiscard]] uint64_t* plane(const size_t index)
+  {
+    return planes.data() + index * capacity;
+  }
+
+  [[nodiscard]] const uint64_t* plane(const size_t index) const
+  {
+    return planes.data() + index * capacity;
+  }
+
+  // byte -> its 8 bits as all-ones / all-zeroes T masks, leftmost bit first
+  static const std::array<std::array<T, 8>, 256>& expansion()
+  {
+    static const auto table = []
+    {
+      std::array<std::array<T, 8>, 256> masks{};
+      for (size_t byte = 0; byte < 256; ++byte)
+      {
+        for (size_t bit = 0; bit < 8; ++bit)
+        {
+          masks[byte][bit] = (byte >> (7 - bit)) & 0x1u ? static_cast<T>(~T{0}) : T{0};
+        }
+      }
+      return masks;
+    }();
+    return table;
+  }
+
+  // Every pixel is palette[plane 0 bit | plane 1 bit << 1], done 8 pixels at a time as masks and selects on T so the
+  // compiler turns the inner loop into vector code
+  void compose() const
+  {
+    static_assert(PLANE_COUNT == 2, "compose() combines exactly two planes");
+    const auto& masks = expansion();
+    const T background = palette[0];
+    const T first = palette[1];
+    const T second = palette[2];
+    const T both = palette[3];
+
+    pixels.resize(width * height);
+    for (size_t row = 0; row < height; ++row)
+    {
+      const uint64_t* words0 = plane(0) + row * stride;
+      const uint64_t* words1 = plane(1) + row * stride;
+      T* out = pixels.data() + row * width;
+
+      for (size_t word = 0; word < stride; ++word)
+      {
+        for (size_t byte = 0; byte < 8; ++byte)
+        {
+          const std::array<T, 8>& bits0 = masks[(words0[word] >> (56 - 8 * byte)) & 0xFFu];
+          const std::array<T, 8>& bits1 = masks[(words1[word] >> (56 - 8 * byte)) & 0xFFu];
+          T* target = out + word * 64 + byte * 8;
+          for (size_t i = 0; i < 8; ++i)
+          {
+            target[i] = (background & ~bits0[i] & ~bits1[i]) | (first & bits0[i] & ~bits1[i]) |
+              (second & ~bits0[i] & bits1[i]) | (both & bits0[i] & bits1[i]);
+          }
+        }
+      }
+    }
+    dirty = false;
+  }
+
+  // xors the top bits of row into the plane starting at bit position, which may straddle two words. Returns whether a
+  // lit pixel was turned off.
+  bool xorBits(const size_t index, const size_t position, const uint64_t row)
+  {
+    uint64_t* words = plane(index);
+    const size_t word = position / 64;
+    const size_t offset = position % 64;
+    const uint64_t parts[2] = {row >> offset, offset == 0 ? 0 : row << (64 - offset)};
+    bool collision = false;
+
+    for (size_t part = 0; part < 2; ++part)
+    {
+      // only when spilling, the pixels past the bottom land in the unused part of the plane or nowhere
+      if (parts[part] == 0 || word + part >= capacity) continue;
+      collision |= (words[word + part] & parts[part]) != 0;
+      const uint64_t old = words[word + part];
+      words[word + part] ^= parts[part];
+      if (!(staleHashes & (1u << index)))
+      {
+        hashes[index] += wordWeight(index * capacity + word + part) * (words[word + part] - old);
+      }
+    }
+    return collision;
+  }
+
+  [[nodiscard]] static uint64_t wordWeight(const size_t position)
+  {
+    return mix64(position + 1);
+  }
+
+  void rehash(const size_t index) const
+  {
+    const uint64_t* words = plane(index);
+    hashes[index] = 0;
+    for (size_t word = 0; word < capacity; ++word)
+    {
+      hashes[index] += wordWeight(index * capacity + word) * words[word];
+    }
+    staleHashes &= ~(1u << index);
+  }
+
+  // shifts every row of a plane right (towards higher x) by columns < 64 bits
+  void shiftRowsRight(uint64_t* words, const size_t columns) const
+  {
+    for (size_t row = 0; row < height; ++row)
+    {
+      uint64_t* line = words + row * stride;
+      for (size_t word = stride; word-- > 0;)
+      {
+        line[word] = (line[word] >> columns) | (word > 0 ? line[word - 1] << (64 - columns) : 0);
+      }
+    }
+  }
+
+  void shiftRowsLeft(uint64_t* words, const size_t columns) const
+  {
+    for (size_t row = 0; row < height; ++row)
+    {
+      uint64_t* line = words + row * stride;
+      for (size_t word = 0; word < stride; ++word)
+      {
+        line[word] = (line[word] << columns) | (word + 1 < stride ? line[word + 1] >> (64 - columns) : 0);
+      }
+    }
+  }
 
 public:
-  explicit Graphic(const size_t width, const size_t height) : width(width), height(height), size(width * height),
-                                                              buffer(new T[size])
+  explicit Graphic(const size_t width, const size_t height) : Graphic(width, height, width, height)
+  {
+  }
+
+  // width and maxWidth are multiples of 64
+  Graphic(const size_t width, const size_t height, const size_t maxWidth, const size_t maxHeight) :
+    width(width), height(height), stride(width / 64),
+    capacity(std::max(maxWidth * maxHeight, width * height) / 64),
+    planes(PLANE_COUNT * capacity, 0),
+    // we are using uint32 to make compatible with SDL_UpdateTexture so 0x0 for 0 and 0xFFFFFFFF for 1, the XO-CHIP
+    // colours are greys
+    palette({static_cast<T>(0x00000000u), static_cast<T>(0xFFFFFFFFu), static_cast<T>(0xAAAAAAFFu),
+      static_cast<T>(0x555555FFu)})
+  {
+    if (width % 64 != 0 || maxWidth % 64 != 0) throw std::invalid_argument("Graphic: Width must be a multiple of 64");
+  }
+
+  // the composited image is not copied, the copy builds its own when asked
+  Graphic(const Graphic& other) : width(other.width), height(other.height), stride(other.stride),
+                                  capacity(other.capacity), planes(other.planes), hashes(other.hashes),
+                                  staleHashes(other.staleHashes), palette(other.palette)
+  {
+  }
+
+  Graphic& operator=(const Graphic& other)
   {
-    memset(buffer, 0, sizeof(T) * size);
+    if (this == &other) return *this;
+    width = other.width;
+    height = other.height;
+    stride = other.stride;
+    capacity = other.capacity;
+    planes = other.planes;
+    hashes = other.hashes;
+    staleHashes = other.staleHashes;
+    palette = other.palette;
+    dirty = true;
+
+    return *this;
   }
 
-  ~Graphic()
+  // clears the planes in planeMask, bit p for plane p
+  void Clear(const uint8_t planeMask = ALL_PLANES)
   {
-    delete[] buffer;
+    for (size_t index = 0; index < PLANE_COUNT; ++index)
+    {
+      if (!(planeMask & (1u << index))) continue;
+      std::fill_n(plane(index), capacity, 0);
+      hashes[index] = 0;
+      staleHashes &= ~(1u << index);
+    }
+    dirty = true;
   }
 
-  void Clear() const
+  // Switches resolution (SUPER-CHIP 00FE/00FF) and clears every plane, the pixels would not line up anyway
+  void setResolution(const size_t width, const size_t height)
   {
-    memset(buffer, 0, sizeof(T) * size);
+    if (width % 64 != 0 || width * height > capacity * 64)
+    {
+      throw std::out_of_range("Graphic::setResolution: Unsupported resolution");
+    }
+    this->width = width;
+    this->height = height;
+    this->stride = width / 64;
+    Clear();
+  }
+
+  void setPalette(const size_t index, const T colour)
+  {
+    palette.at(index) = colour;
+    dirty = true;
   }
 
   [[nodiscard]] size_t GetWidth() const
@@ -46,36 +271,150 @@ public:
   // each byte represent a row of 8 pixels (bits) which will be put in video buffer
   // the next byte from memory will be put in the next row.
   // then we set Vf to 1 for collision detection
-  // edit: we are using uint32 to make compatible with SDL_UpdateTexture so 0x0 for 0 and 0xFFFFFFFF for 1
-  void drawSprite(const size_t Vx, const size_t Vy, const std::vector<uint8_t>& sprite, Register<uint8_t>& VF)
+  // SUPER-CHIP 16x16 sprites have a spriteWidth of 16, two bytes per row. With several planes in planeMask, sprite
+  // holds one sprite per plane, back to back, lowest plane first.
+  // Edge is a template parameter so the quirk policies (see Quirks.h) get a drawing loop without the other cases.
+  // Returns whether a lit pixel was turned off, in any plane.
+  template <SpriteEdge Edge>
+  bool drawSprite(const size_t Vx, const size_t Vy, const uint8_t* sprite, const size_t rows,
+                  const size_t spriteWidth = 8, const uint8_t planeMask = 0x1u)
   {
     const size_t posX = Vx % width;
     const size_t posY = Vy % height;
+    const size_t bytesPerRow = spriteWidth / 8;
+    // bits of a row before the right edge, the rest is spilled, cut or wrapped
+    const size_t visible = std::min(spriteWidth, width - posX);
+    const uint64_t visibleMask = ~uint64_t{0} << (64 - visible);
+    bool collision = false;
 
-    for (int spriteRowIndex = 0; spriteRowIndex < sprite.size(); ++spriteRowIndex)
+    for (size_t index = 0; index < PLANE_COUNT; ++index)
     {
-      const uint8_t spriteRow = sprite[spriteRowIndex];
-      for (int pixelIndex = 0; pixelIndex < 8; ++pixelIndex)
+      if (!(planeMask & (1u << index))) continue;
+
+      for (size_t spriteRowIndex = 0; spriteRowIndex < rows; ++spriteRowIndex)
       {
-        // we get the pixel from buffer at coordinates (posX, posY)
-        // that formule convert coordinates (x,y) to an array index
-        // the % to wrap to the other side
-        T& bufferPixel = buffer[(((posY + spriteRowIndex) * width) ) + (posX + pixelIndex)];
-        // for optimization purposes, we are going to skip the off pixel in the sprite
-        if (const uint8_t& spritePixel = (spriteRow >> (7 - pixelIndex)) & 0x1u; spritePixel == 0x1u)
+        size_t y = posY + spriteRowIndex;
+        if constexpr (Edge == SpriteEdge::Clip)
+        {
+          if (y >= height) break;
+        }
+        if constexpr (Edge == SpriteEdge::Wrap) y %= height;
+
+        uint64_t spriteRow = 0;
+        for (size_t byte = 0; byte < bytesPerRow; ++byte)
         {
-          if (bufferPixel == 0xFFFFFFFFu)
+          spriteRow = (spriteRow << 8u) | sprite[spriteRowIndex * bytesPerRow + byte];
+        }
+        // the row in the top bits of a word
+        spriteRow <<= 64 - spriteWidth;
+
+        // positions are counted in bits from the start of the plane, spilling just carries on past the row end
+        if constexpr (Edge == SpriteEdge::Spill)
+        {
+          collision |= xorBits(index, y * width + posX, spriteRow);
+        }
+        else
+        {
+          collision |= xorBits(index, y * width + posX, spriteRow & visibleMask);
+          if constexpr (Edge == SpriteEdge::Wrap)
           {
-            VF.setAddress(1);
+            if (visible < spriteWidth) collision |= xorBits(index, y * width, spriteRow << visible);
           }
-          bufferPixel ^= 0xFFFFFFFFu;
         }
       }
+
+      sprite += rows * bytesPerRow;
     }
+
+    dirty = true;
+    return collision;
+  }
+
+  // Scrolling, on the planes in planeMask. Vertical scrolls move whole rows, horizontal ones shift each row as a
+  // multi-word integer. Pixels coming in are blank.
+
+  void scrollDown(size_t lines, const uint8_t planeMask = ALL_PLANES)
+  {
+    lines = std::min(lines, height);
+    for (size_t index = 0; index < PLANE_COUNT; ++index)
+    {
+      if (!(planeMask & (1u << index))) continue;
+      uint64_t* words = plane(index);
+      std::copy_backward(words, words + (height - lines) * stride, words + height * stride);
+      std::fill_n(words, lines * stride, 0);
+      staleHashes |= 1u << index;
+    }
+    dirty = true;
+  }
+
+  // XO-CHIP
+  void scrollUp(size_t lines, const uint8_t planeMask = ALL_PLANES)
+  {
+    lines = std::min(lines, height);
+    for (size_t index = 0; index < PLANE_COUNT; ++index)
+    {
+      if (!(planeMask & (1u << index))) continue;
+      uint64_t* words = plane(index);
+      std::copy(words + lines * stride, words + height * stride, words);
+      std::fill_n(words + (height - lines) * stride, lines * stride, 0);
+      staleHashes |= 1u << index;
+    }
+    dirty = true;
+  }
+
+  void scrollRight(const size_t columns, const uint8_t planeMask = ALL_PLANES)
+  {
+    if (columns == 0) return;
+    if (columns >= 64) throw std::out_of_range("Graphic::scrollRight: Scroll too large");
+    for (size_t index = 0; index < PLANE_COUNT; ++index)
+    {
+      if (!(planeMask & (1u << index))) continue;
+      shiftRowsRight(plane(index), columns);
+      staleHashes |= 1u << index;
+    }
+    dirty = true;
+  }
+
+  void scrollLeft(const size_t columns, const uint8_t planeMask = ALL_PLANES)
+  {
+    if (columns == 0) return;
+    if (columns >= 64) throw std::out_of_range("Graphic::scrollLeft: Scroll too large");
+    for (size_t index = 0; index < PLANE_COUNT; ++index)
+    {
+      if (!(planeMask & (1u << index))) continue;
+      shiftRowsLeft(plane(index), columns);
+      staleHashes |= 1u << index;
+    }
+    dirty = true;
+  }
+
+  // width x height pixels, composited from the planes if they changed since the last call
+  const T* getBuffer() const
+  {
+    if (dirty) compose();
+    return pixels.data();
+  }
+
+  // identifies what the planes hold, equal for equal planes whatever drew them
+  [[nodiscard]] uint64_t getHash() const
+  {
+    uint64_t hash = 0;
+    for (size_t index = 0; index < PLANE_COUNT; ++index)
+    {
+      if (staleHashes & (1u << index)) rehash(index);
+      hash ^= hashes[index];
+    }
+    return hash;
+  }
+
+  // the raw plane, height rows of getStride() words
+  [[nodiscard]] const uint64_t* getPlane(const size_t index) const
+  {
+    return plane(index);
   }
 
-  T* getBuffer() const
+  [[nodiscard]] size_t getStride() const
   {
-    return buffer;
+    return stride;
   }
 };
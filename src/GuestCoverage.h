@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "Opcode.h"
+
+// Where a rom went, filled in by Chip8::Cycle when attached with setCoverage. The counters are plain byte arrays
+// owned by whoever attached them, so they can live where the consumer needs them (the fuzzer puts them in the section
+// libFuzzer reads its extra counters from).
+//
+// edges counts control transfers: an instruction that left PC anywhere other than on the next instruction (jumps,
+// calls, returns, taken skips, Fx0A waiting for a key), indexed by a hash of the (from, to) pair. Straight-line code
+// only shows up in the opcode counters.
+struct GuestCoverage
+{
+  static constexpr size_t EDGE_COUNT = 1u << 16u;
+
+  // EDGE_COUNT counters
+  uint8_t* edges = nullptr;
+  // OPCODE_COUNT counters, indexed by OpcodeId
+  uint8_t* opcodes = nullptr;
+
+  void record(const uint16_t from, const uint8_t id, const uint16_t to) const
+  {
+    bump(opcodes[id]);
+    if (to != static_cast<uint16_t>(from + 2u)) bump(edges[((static_cast<size_t>(from) << 4u) ^ to) & (EDGE_COUNT - 1)]);
+  }
+
+  // saturating, a wrapped counter would read as "never hit"
+  static void bump(uint8_t& counter)
+  {
+    if (counter != 0xFFu) ++counter;
+  }
+};
@@ -0,0 +1,207 @@
+#include "GuestProfiler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "Chip8.h"
+
+GuestProfiler::GuestProfiler()
+{
+  nodes.push_back(Node{0, STARTING_ADDRESS, 0, 0});
+}
+
+uint32_t GuestProfiler::child(const uint32_t parent, const uint16_t routine)
+{
+  const uint64_t key = static_cast<uint64_t>(parent) << 16u | routine;
+  if (const auto found = children.find(key); found != children.end()) return found->second;
+
+  const auto node = static_cast<uint32_t>(nodes.size());
+  nodes.push_back(Node{parent, routine, 0, 0});
+  children.emplace(key, node);
+  return node;
+}
+
+void GuestProfiler::transfer(const size_t newDepth, const uint16_t programCounter)
+{
+  // a 2nnn is one level deeper, landing on the routine
+  if (newDepth > depth)
+  {
+    current = child(current, programCounter);
+    ++nodes[current].calls;
+  }
+  // a 00EE is one level up, anything else went through synchronize()
+  else
+  {
+    for (size_t level = newDepth; level < depth && current != 0; ++level)
+    {
+      current = nodes[current].parent;
+    }
+  }
+  depth = newDepth;
+}
+
+uint16_t GuestProfiler::callee(const Chip8& chip8, const uint16_t returnAddress)
+{
+  const uint16_t call = returnAddress >= 2 ? chip8.memory.readWord(returnAddress - 2) : 0;
+  return (call & 0xF000u) == 0x2000u ? call & 0x0FFFu : UNKNOWN_ROUTINE;
+}
+
+uint32_t GuestProfiler::locate(const Chip8& chip8)
+{
+  uint32_t node = 0;
+  for (size_t i = 0; i < chip8.stack.getDepth(); ++i)
+  {
+    node = child(node, callee(chip8, chip8.stack.get(i)));
+  }
+  return node;
+}
+
+uint16_t GuestProfiler::getRoutine(const Chip8& chip8)
+{
+  const size_t depth = chip8.stack.getDepth();
+  return depth == 0 ? static_cast<uint16_t>(STARTING_ADDRESS) : callee(chip8, chip8.stack.get(depth - 1));
+}
+
+void GuestProfiler::synchronize(const Chip8& chip8)
+{
+  current = locate(chip8);
+  depth = chip8.stack.getDepth();
+}
+
+void GuestProfiler::sample(const Chip8& chip8, const uint64_t instructions)
+{
+  nodes[locate(chip8)].instructions += instructions;
+}
+
+void GuestProfiler::loadLabels(const std::string& filePath)
+{
+  std::ifstream file(filePath);
+  if (!file) throw std::runtime_error("GuestProfiler: Failed to open " + filePath);
+
+  std::string line;
+  for (size_t number = 1; std::getline(file, line); ++number)
+  {
+    std::istringstream fields(line);
+    std::string address;
+    std::string name;
+    if (!(fields >> address) || address[0] == '#') continue;
+    std::getline(fields >> std::ws, name);
+    while (!name.empty() && std::isspace(static_cast<unsigned char>(name.back()))) name.pop_back();
+
+    size_t parsed = 0;
+    unsigned long value = 0;
+    try
+    {
+      value = std::stoul(address, &parsed, 16);
+    }
+    catch (const std::exception&)
+    {
+      parsed = 0;
+    }
+    if (parsed != address.size() || value > 0xFFFF || name.empty())
+      throw std::runtime_error("GuestProfiler: Bad label on line " + std::to_string(number) + " of " + filePath);
+
+    for (char& character : name)
+    {
+      if (character == ';' || std::isspace(static_cast<unsigned char>(character))) character = '_';
+    }
+    labels[static_cast<uint16_t>(value)] = name;
+  }
+}
+
+std::string GuestProfiler::getName(const uint16_t routine) const
+{
+  if (const auto found = labels.find(routine); found != labels.end()) return found->second;
+  if (routine == STARTING_ADDRESS) return "main";
+  if (routine == UNKNOWN_ROUTINE) return "unknown";
+
+  char name[16];
+  std::snprintf(name, sizeof(name), "sub_%04X", routine);
+  return name;
+}
+
+uint64_t GuestProfiler::getInstructions() const
+{
+  uint64_t total = 0;
+  for (const Node& node : nodes)
+  {
+    total += node.instructions;
+  }
+  return total;
+}
+
+std::vector<RoutineProfile> GuestProfiler::getRoutines() const
+{
+  std::unordered_map<uint16_t, RoutineProfile> routines;
+  std::vector<uint16_t> path;
+
+  for (const Node& node : nodes)
+  {
+    RoutineProfile& leaf = routines.try_emplace(node.routine, RoutineProfile{node.routine, "", 0, 0, 0}).first->second;
+    leaf.exclusive += node.instructions;
+    leaf.calls += node.calls;
+
+    // every routine on the stack includes these instructions, once however deep it recursed
+    path.clear();
+    for (const Node* frame = &node;; frame = &nodes[frame->parent])
+    {
+      path.push_back(frame->routine);
+      if (frame == &nodes[0]) break;
+    }
+    std::sort(path.begin(), path.end());
+    path.erase(std::unique(path.begin(), path.end()), path.end());
+    for (const uint16_t routine : path)
+    {
+      routines.try_emplace(routine, RoutineProfile{routine, "", 0, 0, 0}).first->second.inclusive += node.instructions;
+    }
+  }
+
+  std::vector<RoutineProfile> sorted;
+  for (auto& [address, routine] : routines)
+  {
+    routine.name = getName(address);
+    sorted.push_back(std::move(routine));
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const RoutineProfile& a, const RoutineProfile& b)
+  {
+    return a.exclusive != b.exclusive ? a.exclusive > b.exclusive : a.address < b.address;
+  });
+  return sorted;
+}
+
+void GuestProfiler::writeFolded(std::ostream& out) const
+{
+  std::vector<uint16_t> path;
+  for (const Node& node : nodes)
+  {
+    if (node.instructions == 0) continue;
+
+    path.clear();
+    for (const Node* frame = &node;; frame = &nodes[frame->parent])
+    {
+      path.push_back(frame->routine);
+      if (frame == &nodes[0]) break;
+    }
+
+    // outermost first
+    for (auto routine = path.rbegin(); routine != path.rend(); ++routine)
+    {
+      if (routine != path.rbegin()) out << ';';
+      out << getName(*routine);
+    }
+    out << ' ' << node.instructions << '\n';
+  }
+}
+
+void GuestProfiler::clear()
+{
+  for (Node& node : nodes)
+  {
+    node.instructions = 0;
+    node.calls = 0;
+  }
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Chip8;
+
+// the routine of the calls the profiler cannot tell, a return address that no longer follows a 2nnn
+constexpr uint16_t UNKNOWN_ROUTINE = 0xFFFF;
+
+// instructions attributed to one guest subroutine
+struct RoutineProfile
+{
+  uint16_t address;
+  std::string name;
+  // run in the routine itself
+  uint64_t exclusive;
+  // run in the routine or anything it called, a recursive routine counts once
+  uint64_t inclusive;
+  // only counted by the exact mode
+  uint64_t calls;
+};
+
+// Where the guest spends its instructions, per call stack. A routine is the target of a 2nnn; the code that runs
+// before any call is the root routine at STARTING_ADDRESS, "main" unless a label names it.
+//
+// Exact mode: attached with Chip8::setProfiler, every cycle counts one instruction in the current call stack, and
+// calls and returns are seen from the depth of the guest stack changing. A call counts in the caller and the return
+// in the callee; an instruction an attached Debugger stops in front of counts once more when it runs.
+//
+// Sampling mode: nothing is attached, so the core runs at full speed. Every so often sample() walks the guest stack
+// (the routine of a frame is the nnn of the 2nnn just before its return address) and counts the instructions run
+// since the previous sample in the call stack found. Routines shorter than the sampling period are missed or
+// over-counted, the totals are estimates.
+//
+// Both modes fill the same tree of call stacks, written as folded stacks ("main;sub_0300;sub_0344 1234") for the
+// usual flamegraph tools.
+class GuestProfiler
+{
+  struct Node
+  {
+    uint32_t parent;
+    uint16_t routine;
+    uint64_t instructions;
+    uint64_t calls;
+  };
+
+  // nodes[0] is the root, a node per distinct call stack
+  std::vector<Node> nodes;
+  // (parent << 16 | routine) to node
+  std::unordered_map<uint64_t, uint32_t> children;
+  std::unordered_map<uint16_t, std::string> labels;
+  // exact mode: the call stack the machine is in and its depth
+  uint32_t current = 0;
+  size_t depth = 0;
+
+  uint32_t child(uint32_t parent, uint16_t routine);
+  // the routine the frame of returnAddress is in, the nnn of the 2nnn before it
+  static uint16_t callee(const Chip8& chip8, uint16_t returnAddress);
+  void transfer(size_t newDepth, uint16_t programCounter);
+  // the node of the call stack chip8 is in now, read from its stack and memory
+  uint32_t locate(const Chip8& chip8);
+
+public:
+  GuestProfiler();
+
+  // One "<address> <name>" per line, the address in hexadecimal with or without 0x, blank lines and lines starting
+  // with # are skipped. Names replace sub_XXXX in the output, ';' and spaces in them become '_'. Throws
+  // std::runtime_error on a missing file or a malformed line.
+  void loadLabels(const std::string& filePath);
+  [[nodiscard]] std::string getName(uint16_t routine) const;
+
+  // Chip8 side, exact mode: after every cycle, with the guest stack depth and program counter it left
+  void record(const size_t stackDepth, const uint16_t programCounter)
+  {
+    ++nodes[current].instructions;
+    if (stackDepth != depth) transfer(stackDepth, programCounter);
+  }
+
+  // Chip8 side, exact mode: the guest stack changed other than by a call or a return (attaching, reset)
+  void synchronize(const Chip8& chip8);
+
+  // sampling mode: instructions were run since the last sample, counts them in the call stack chip8 is in now
+  void sample(const Chip8& chip8, uint64_t instructions);
+
+  // the routine chip8 is in now, found like sample() does
+  [[nodiscard]] static uint16_t getRoutine(const Chip8& chip8);
+
+  [[nodiscard]] uint64_t getInstructions() const;
+  // every routine seen, the most exclusive instructions first
+  [[nodiscard]] std::vector<RoutineProfile> getRoutines() const;
+  // one line per call stack that ran instructions
+  void writeFolded(std::ostream& out) const;
+  // forgets the counts, the labels are kept
+  void clear();
+};
@@ -0,0 +1,64 @@
+#include "GuestSampleLog.h"
+
+#include <chrono>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include "Chip8.h"
+#include "GuestProfiler.h"
+
+namespace
+{
+  // records kept before a write, 64 KB
+  constexpr size_t PENDING_RECORDS = 4096;
+}
+
+GuestSampleLog::GuestSampleLog(const std::string& filePath): file(std::fopen(filePath.c_str(), "wb"))
+{
+  if (file == nullptr) throw std::runtime_error("GuestSampleLog: Failed to create " + filePath);
+
+  GuestSampleLogHeader header{};
+  header.magic = GUEST_SAMPLE_LOG_MAGIC;
+  header.version = GUEST_SAMPLE_LOG_VERSION;
+#if !defined(_WIN32)
+  header.pid = static_cast<uint32_t>(getpid());
+#endif
+  header.recordSize = sizeof(GuestSample);
+  failed = std::fwrite(&header, sizeof(header), 1, file) != 1;
+  pending.reserve(PENDING_RECORDS);
+}
+
+GuestSampleLog::~GuestSampleLog()
+{
+  close();
+}
+
+void GuestSampleLog::record(const Chip8& chip8, const uint32_t cycles)
+{
+  const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+  pending.push_back(GuestSample{
+    static_cast<uint64_t>(time), chip8.getProgramCounter(), GuestProfiler::getRoutine(chip8), cycles
+  });
+  if (pending.size() == PENDING_RECORDS) flush();
+}
+
+void GuestSampleLog::flush()
+{
+  if (file != nullptr && !pending.empty() && std::fwrite(pending.data(), sizeof(GuestSample), pending.size(), file) !=
+    pending.size())
+    failed = true;
+  pending.clear();
+}
+
+bool GuestSampleLog::close()
+{
+  if (file == nullptr) return !failed;
+  flush();
+  if (std::fclose(file) != 0) failed = true;
+  file = nullptr;
+  return !failed;
+}
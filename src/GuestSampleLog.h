@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Chip8;
+
+constexpr uint32_t GUEST_SAMPLE_LOG_MAGIC = 0x4C503843; // "C8PL"
+constexpr uint32_t GUEST_SAMPLE_LOG_VERSION = 1;
+
+// Written as is, in native byte order, for tools/perf-guest-report.py on the same machine.
+struct GuestSampleLogHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  // the process the samples come from, to pick its samples out of a perf recording
+  uint32_t pid;
+  uint32_t recordSize;
+};
+
+struct GuestSample
+{
+  // std::chrono::steady_clock, which is CLOCK_MONOTONIC on Linux: the clock of `perf record -k mono`
+  uint64_t time;
+  uint16_t programCounter;
+  // see GuestProfiler::getRoutine
+  uint16_t routine;
+  // cycles run since the previous sample
+  uint32_t cycles;
+};
+
+static_assert(sizeof(GuestSample) == 16, "the report script reads 16 byte records");
+
+// Where the guest was, and when, for joining with host samples from perf: perf tells which host code the time went
+// to, the sample just before each perf sample tells which guest code was running. Sampling every few dozen cycles
+// puts the guest samples far closer together than perf's, at the cost of a clock read each.
+class GuestSampleLog
+{
+  std::FILE* file;
+  std::vector<GuestSample> pending;
+  bool failed = false;
+
+  void flush();
+
+public:
+  // throws std::runtime_error if the file cannot be created
+  explicit GuestSampleLog(const std::string& filePath);
+  ~GuestSampleLog();
+  GuestSampleLog(const GuestSampleLog&) = delete;
+  GuestSampleLog& operator=(const GuestSampleLog&) = delete;
+
+  // chip8 ran cycles cycles since the previous call
+  void record(const Chip8& chip8, uint32_t cycles);
+  // writes what is left, false if anything failed to be written
+  bool close();
+};
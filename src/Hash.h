@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint64_t FNV_OFFSET_BASIS = 0xCBF29CE484222325ull;
+constexpr uint64_t FNV_PRIME = 0x100000001B3ull;
+
+// 64-bit FNV-1a, not cryptographic but cheap and good enough to tell roms and frames apart.
+// Pass the previous result as seed to hash several buffers as if they were one.
+inline uint64_t fnv1a64(const void* data, const size_t size, uint64_t seed = FNV_OFFSET_BASIS)
+{
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i)
+  {
+    seed ^= bytes[i];
+    seed *= FNV_PRIME;
+  }
+  return seed;
+}
+
+// the splitmix64 finalizer, every input bit affects every output bit
+inline uint64_t mix64(uint64_t value)
+{
+  value = (value ^ (value >> 30u)) * 0xBF58476D1CE4E5B9ull;
+  value = (value ^ (value >> 27u)) * 0x94D049BB133111EBull;
+  return value ^ (value >> 31u);
+}
+
+// Zobrist-style contribution of value at position to the xor of all of them: a write updates a hash with
+// hash ^= zobrist(position, old) ^ zobrist(position, new). 0 adds nothing, so a blank buffer hashes to 0.
+inline uint64_t zobrist(const uint64_t position, const uint64_t value)
+{
+  return value == 0 ? 0 : mix64(mix64(position + 1) ^ value);
+}
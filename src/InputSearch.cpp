@@ -0,0 +1,191 @@
+#include "InputSearch.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+  constexpr size_t KEY_COUNT = 16;
+  constexpr uint8_t ROOT_KEY = 0xFF;
+}
+
+InputSearch::InputSearch(const Chip8& state, const unsigned int framesPerInput, const size_t threads):
+  framesPerInput(framesPerInput)
+{
+  std::unique_ptr<Chip8> root = state.clone();
+  // the clones run on several threads, a coverage shared with the original would be written from all of them
+  root->setCoverage(nullptr);
+  const uint64_t hash = root->getStateHash();
+  nodes.push_back(SearchNode{std::move(root), hash, 0, ROOT_KEY, 0});
+  table.insert(hash, 0);
+
+  const size_t helpers = std::max<size_t>(threads, 1) - 1;
+  workers.reserve(helpers);
+  for (size_t worker = 0; worker < helpers; ++worker)
+  {
+    workers.emplace_back(&InputSearch::work, this);
+  }
+}
+
+InputSearch::~InputSearch()
+{
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (std::thread& worker : workers)
+  {
+    worker.join();
+  }
+}
+
+void InputSearch::work()
+{
+  while (true)
+  {
+    std::unique_lock lock(mutex);
+    wake.wait(lock, [this] { return stopping || tokens > 0; });
+    if (stopping) return;
+    --tokens;
+    lock.unlock();
+
+    runJobs();
+
+    lock.lock();
+    if (--pending == 0) finished.notify_one();
+  }
+}
+
+void InputSearch::runJobs()
+{
+  for (size_t job = claimed++; job < children.size(); job = claimed++)
+  {
+    runJob(job);
+  }
+}
+
+void InputSearch::runJob(const size_t job)
+{
+  const SearchNode& parent = nodes[(*parents)[job / KEY_COUNT]];
+  std::unique_ptr<Chip8> child = parent.state->clone();
+
+  Keypad& keypad = child->getKeypad();
+  for (size_t key = 0; key < KEY_COUNT; ++key)
+  {
+    if (key == job % KEY_COUNT) keypad.pressKey(key);
+    else keypad.releaseKey(key);
+  }
+
+  try
+  {
+    child->Run(framesPerInput * CYCLES_PER_FRAME);
+  }
+  catch (const std::exception&)
+  {
+    ++faulted;
+    return;
+  }
+
+  // numbered after every existing node in job order, the smallest number keeps a state reached several times
+  const uint64_t hash = child->getStateHash();
+  hashes[job] = hash;
+  if (table.insert(hash, nodes.size() + job) == nodes.size() + job) children[job] = std::move(child);
+}
+
+std::vector<size_t> InputSearch::expand(const std::vector<size_t>& parents)
+{
+  for (const size_t parent : parents)
+  {
+    if (getNode(parent).state == nullptr)
+      throw std::invalid_argument("InputSearch::expand: Node " + std::to_string(parent) + " was released");
+  }
+
+  const uint64_t faultedBefore = faulted;
+  this->parents = &parents;
+  children.clear();
+  children.resize(parents.size() * KEY_COUNT);
+  hashes.assign(children.size(), 0);
+  claimed = 0;
+
+  const size_t helpers = std::min(workers.size(), children.empty() ? 0 : children.size() - 1);
+  if (helpers > 0)
+  {
+    {
+      std::lock_guard lock(mutex);
+      tokens = helpers;
+      pending = helpers;
+    }
+    for (size_t helper = 0; helper < helpers; ++helper)
+    {
+      wake.notify_one();
+    }
+  }
+
+  runJobs();
+
+  if (helpers > 0)
+  {
+    std::unique_lock lock(mutex);
+    finished.wait(lock, [&] { return pending == 0; });
+  }
+
+  // a child kept by its thread may have lost its state to a sibling with a smaller number since
+  const size_t first = nodes.size();
+  std::vector<size_t> found;
+  for (size_t job = 0; job < children.size(); ++job)
+  {
+    if (children[job] == nullptr || table.find(hashes[job]) != first + job) continue;
+
+    const SearchNode& parent = nodes[parents[job / KEY_COUNT]];
+    const size_t node = nodes.size();
+    nodes.push_back(SearchNode{std::move(children[job]), hashes[job], parents[job / KEY_COUNT],
+      static_cast<uint8_t>(job % KEY_COUNT), parent.depth + 1});
+    table.assign(hashes[job], node);
+    found.push_back(node);
+  }
+
+  pruned += children.size() - found.size() - (faulted - faultedBefore);
+  children.clear();
+  this->parents = nullptr;
+  return found;
+}
+
+void InputSearch::release(const size_t node)
+{
+  nodes.at(node).state.reset();
+}
+
+const SearchNode& InputSearch::getNode(const size_t node) const
+{
+  return nodes.at(node);
+}
+
+size_t InputSearch::getNodeCount() const
+{
+  return nodes.size();
+}
+
+std::vector<uint8_t> InputSearch::getInputs(size_t node) const
+{
+  std::vector<uint8_t> inputs;
+  while (getNode(node).key != ROOT_KEY)
+  {
+    inputs.push_back(nodes[node].key);
+    node = nodes[node].parent;
+  }
+  std::reverse(inputs.begin(), inputs.end());
+  return inputs;
+}
+
+uint64_t InputSearch::getPruned() const
+{
+  return pruned;
+}
+
+uint64_t InputSearch::getFaulted() const
+{
+  return faulted;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Chip8.h"
+#include "TranspositionTable.h"
+
+// Explores what the inputs do from a saved state, for automated play-testing and tool-assisted runs. Every node is a
+// machine state. Expanding one tries the 16 keys, each held alone for framesPerInput frames on a clone of the node,
+// and the children of a whole set of nodes run in parallel on a pool of threads that lives as long as the search.
+//
+// A child whose state is already in the transposition table is dropped as soon as its hash is known, and nothing more
+// is spent on it. Its state was reached before, along another path or by a sibling whose key the rom ignored. Node ids
+// follow the order nodes are found in (parents in the order given, then keys), so the tree does not depend on the
+// threads.
+struct SearchNode
+{
+  // nullptr once released
+  std::unique_ptr<Chip8> state;
+  uint64_t hash;
+  // the root is its own parent
+  size_t parent;
+  // key held from the parent, 0xFF for the root
+  uint8_t key;
+  uint32_t depth;
+};
+
+class InputSearch
+{
+  unsigned int framesPerInput;
+  std::vector<SearchNode> nodes;
+  TranspositionTable table;
+  uint64_t pruned = 0;
+  std::atomic<uint64_t> faulted{0};
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  // workers still to start on the expansion in progress, and the ones that have not finished it
+  size_t tokens = 0;
+  size_t pending = 0;
+  bool stopping = false;
+
+  // the expansion in progress: job j runs key j % 16 from parents[j / 16]
+  const std::vector<size_t>* parents = nullptr;
+  std::vector<std::unique_ptr<Chip8>> children;
+  std::vector<uint64_t> hashes;
+  std::atomic<size_t> claimed{0};
+
+  void work();
+  void runJobs();
+  void runJob(size_t job);
+
+public:
+  // the root is a clone of state, which is left alone. threads is the total number of threads running children, the
+  // calling one included
+  InputSearch(const Chip8& state, unsigned int framesPerInput, size_t threads = 1);
+  ~InputSearch();
+  InputSearch(const InputSearch&) = delete;
+  InputSearch& operator=(const InputSearch&) = delete;
+
+  // Expands every node of parents, returns the new nodes. Throws std::invalid_argument for a node that was released.
+  std::vector<size_t> expand(const std::vector<size_t>& parents);
+  // frees the state of a node that is not going to be expanded, the node stays for getInputs
+  void release(size_t node);
+
+  [[nodiscard]] const SearchNode& getNode(size_t node) const;
+  [[nodiscard]] size_t getNodeCount() const;
+  // the keys held from the root to node, each for framesPerInput frames
+  [[nodiscard]] std::vector<uint8_t> getInputs(size_t node) const;
+  // children dropped because their state had been reached before
+  [[nodiscard]] uint64_t getPruned() const;
+  // children dropped because the machine threw (stack overflow and the like)
+  [[nodiscard]] uint64_t getFaulted() const;
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 
 class Keypad
@@ -16,9 +17,10 @@ public:
     keys[key] = 0;
   }
 
+  // Ex9E/ExA1 pass any register value, only its low nibble names a key as on the original interpreters
   [[nodiscard]] bool isPressed(const size_t key) const
   {
-    return keys[key];
+    return keys[key & 0xFu];
   }
 
   void switchKey(const size_t key)
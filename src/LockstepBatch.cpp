@@ -0,0 +1,655 @@
+#include "LockstepBatch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+  // the arrays are padded to this many lanes whatever the instruction set, so the layout does not depend on the build
+  constexpr size_t LANE_ALIGNMENT = 32;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#define CHIP8_LOCKSTEP_VECTOR 1
+
+  // Thin wrappers so the kernels below read the same for AVX2 (32 lanes of uint8_t / 16 of uint16_t per vector)
+  // and SSE2 (16 / 8). Everything is unaligned loads and stores, std::vector makes no alignment promises.
+#if defined(__AVX2__)
+  using Vector = __m256i;
+  constexpr size_t VECTOR_BYTES = 32;
+
+  inline Vector load(const void* address) { return _mm256_loadu_si256(static_cast<const Vector*>(address)); }
+  inline void store(void* address, const Vector value) { _mm256_storeu_si256(static_cast<Vector*>(address), value); }
+  inline Vector broadcast8(const uint8_t value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+  inline Vector broadcast16(const uint16_t value) { return _mm256_set1_epi16(static_cast<short>(value)); }
+  inline Vector add8(const Vector a, const Vector b) { return _mm256_add_epi8(a, b); }
+  inline Vector sub8(const Vector a, const Vector b) { return _mm256_sub_epi8(a, b); }
+  inline Vector add16(const Vector a, const Vector b) { return _mm256_add_epi16(a, b); }
+  inline Vector bitAnd(const Vector a, const Vector b) { return _mm256_and_si256(a, b); }
+  inline Vector bitOr(const Vector a, const Vector b) { return _mm256_or_si256(a, b); }
+  inline Vector bitXor(const Vector a, const Vector b) { return _mm256_xor_si256(a, b); }
+  // ~a & b
+  inline Vector bitAndNot(const Vector a, const Vector b) { return _mm256_andnot_si256(a, b); }
+  inline Vector equal8(const Vector a, const Vector b) { return _mm256_cmpeq_epi8(a, b); }
+  inline Vector max8(const Vector a, const Vector b) { return _mm256_max_epu8(a, b); }
+  inline Vector saturatingSub8(const Vector a, const Vector b) { return _mm256_subs_epu8(a, b); }
+  template <int shift>
+  Vector shiftRight16(const Vector a) { return _mm256_srli_epi16(a, shift); }
+
+  // VECTOR_BYTES / 2 bytes of uint8_t lanes, zero extended to uint16_t lanes
+  inline Vector widen(const uint8_t* address)
+  {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(address)));
+  }
+
+  // same for 0x00/0xFF masks, which become 0x0000/0xFFFF
+  inline Vector widenMask(const uint8_t* address)
+  {
+    return _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(address)));
+  }
+#else
+  using Vector = __m128i;
+  constexpr size_t VECTOR_BYTES = 16;
+
+  inline Vector load(const void* address) { return _mm_loadu_si128(static_cast<const Vector*>(address)); }
+  inline void store(void* address, const Vector value) { _mm_storeu_si128(static_cast<Vector*>(address), value); }
+  inline Vector broadcast8(const uint8_t value) { return _mm_set1_epi8(static_cast<char>(value)); }
+  inline Vector broadcast16(const uint16_t value) { return _mm_set1_epi16(static_cast<short>(value)); }
+  inline Vector add8(const Vector a, const Vector b) { return _mm_add_epi8(a, b); }
+  inline Vector sub8(const Vector a, const Vector b) { return _mm_sub_epi8(a, b); }
+  inline Vector add16(const Vector a, const Vector b) { return _mm_add_epi16(a, b); }
+  inline Vector bitAnd(const Vector a, const Vector b) { return _mm_and_si128(a, b); }
+  inline Vector bitOr(const Vector a, const Vector b) { return _mm_or_si128(a, b); }
+  inline Vector bitXor(const Vector a, const Vector b) { return _mm_xor_si128(a, b); }
+  inline Vector bitAndNot(const Vector a, const Vector b) { return _mm_andnot_si128(a, b); }
+  inline Vector equal8(const Vector a, const Vector b) { return _mm_cmpeq_epi8(a, b); }
+  inline Vector max8(const Vector a, const Vector b) { return _mm_max_epu8(a, b); }
+  inline Vector saturatingSub8(const Vector a, const Vector b) { return _mm_subs_epu8(a, b); }
+  template <int shift>
+  Vector shiftRight16(const Vector a) { return _mm_srli_epi16(a, shift); }
+
+  inline Vector widen(const uint8_t* address)
+  {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(address)), _mm_setzero_si128());
+  }
+
+  inline Vector widenMask(const uint8_t* address)
+  {
+    const Vector mask = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(address));
+    return _mm_unpacklo_epi8(mask, mask);
+  }
+#endif
+
+  // mask ? a : b, lane by lane
+  inline Vector select(const Vector mask, const Vector a, const Vector b)
+  {
+    return bitOr(bitAnd(mask, a), bitAndNot(mask, b));
+  }
+
+  // 1 where a > b (unsigned), 0 elsewhere
+  inline Vector greaterThan8(const Vector a, const Vector b)
+  {
+    return bitAndNot(equal8(max8(a, b), b), broadcast8(1));
+  }
+
+  // uint8_t has no shift instruction, shift the 16-bit lanes and drop the bits that came from the neighbour byte
+  inline Vector shiftRightOne8(const Vector a)
+  {
+    return bitAnd(shiftRight16<1>(a), broadcast8(0x7Fu));
+  }
+#endif
+}
+
+LockstepBatch::LockstepBatch(const RomImage& rom, const size_t laneCount):
+  laneCount(laneCount),
+  paddedLanes((laneCount + LANE_ALIGNMENT - 1) / LANE_ALIGNMENT * LANE_ALIGNMENT),
+  registers(16 * paddedLanes, 0),
+  index(paddedLanes, 0),
+  programCounter(paddedLanes, STARTING_ADDRESS),
+  delayTimer(paddedLanes, 0),
+  soundTimer(paddedLanes, 0),
+  stack(STACK_SIZE * paddedLanes, 0),
+  stackPointer(paddedLanes, 0),
+  active(paddedLanes, 0),
+  group(paddedLanes, 0),
+  condition(paddedLanes, 0),
+  memory(laneCount * RAM_SIZE, 0),
+  keypads(laneCount),
+  randoms(laneCount, RandomGenerator<uint8_t>(0, 255))
+{
+  if (laneCount == 0) throw std::invalid_argument("LockstepBatch: At least one lane is needed");
+  if (rom.size > RAM_SIZE - STARTING_ADDRESS) throw std::runtime_error("LockstepBatch: Rom too large");
+
+  graphics.reserve(laneCount);
+  for (size_t lane = 0; lane < laneCount; ++lane)
+  {
+    uint8_t* ram = laneMemory(lane);
+    memcpy(ram + FONT_SET_START_ADDRESS, FONT_SET, sizeof(FONT_SET));
+    memcpy(ram + LARGE_FONT_SET_START_ADDRESS, LARGE_FONT_SET, sizeof(LARGE_FONT_SET));
+    memcpy(ram + STARTING_ADDRESS, rom.data, rom.size);
+
+    graphics.push_back(std::make_unique<Graphic<uint32_t>>(GRAPHIC_WIDTH, GRAPHIC_HEIGHT, HIRES_GRAPHIC_WIDTH,
+                                                           HIRES_GRAPHIC_HEIGHT));
+    active[lane] = 0xFFu;
+  }
+}
+
+void LockstepBatch::fault(const size_t lane)
+{
+  active[lane] = 0;
+}
+
+void LockstepBatch::step()
+{
+  // Build the group: every running lane sitting at the leader's PC with the same opcode there. The opcode has to be
+  // compared as well because each lane has its own ram and the rom may have rewritten its code differently.
+  if (!active[leader])
+  {
+    const auto it = std::find(active.begin(), active.begin() + laneCount, 0xFFu);
+    if (it == active.begin() + laneCount) return;
+    leader = it - active.begin();
+  }
+
+  const uint16_t address = programCounter[leader];
+  size_t groupSize = 0;
+  size_t running = 0;
+  uint16_t opcode = 0;
+
+  if (address + 1u < RAM_SIZE)
+  {
+    opcode = (static_cast<uint16_t>(laneMemory(leader)[address]) << 8u) | laneMemory(leader)[address + 1];
+
+    for (size_t lane = 0; lane < laneCount; ++lane)
+    {
+      const bool member = active[lane] && programCounter[lane] == address &&
+        laneMemory(lane)[address] == (opcode >> 8u) && laneMemory(lane)[address + 1] == (opcode & 0xFFu);
+      group[lane] = member ? 0xFFu : 0;
+      groupSize += member;
+      running += active[lane] != 0;
+    }
+  }
+
+  // a group of one is not worth the vector setup
+  if (groupSize < 2 || !stepGroup(opcode))
+  {
+    std::fill(group.begin(), group.end(), 0);
+    groupSize = 0;
+  }
+  else
+  {
+    ++vectorSteps;
+  }
+
+  for (size_t lane = 0; lane < laneCount; ++lane)
+  {
+    if (active[lane] && !group[lane]) stepLane(lane);
+  }
+
+  // Decrement the timers if they've been set, on every lane that got through its instruction
+#if defined(CHIP8_LOCKSTEP_VECTOR)
+  const Vector one = broadcast8(1);
+  for (size_t lane = 0; lane < paddedLanes; lane += VECTOR_BYTES)
+  {
+    const Vector running = load(&active[lane]);
+    store(&delayTimer[lane], select(running, saturatingSub8(load(&delayTimer[lane]), one), load(&delayTimer[lane])));
+    store(&soundTimer[lane], select(running, saturatingSub8(load(&soundTimer[lane]), one), load(&soundTimer[lane])));
+  }
+#else
+  for (size_t lane = 0; lane < laneCount; ++lane)
+  {
+    if (!active[lane]) continue;
+    if (delayTimer[lane] > 0) --delayTimer[lane];
+    if (soundTimer[lane] > 0) --soundTimer[lane];
+  }
+#endif
+
+  // most lanes went elsewhere, follow one of them next time so the largest group keeps using the vector path
+  if (groupSize * 2 < running)
+  {
+    for (size_t lane = 0; lane < laneCount; ++lane)
+    {
+      if (active[lane] && !group[lane])
+      {
+        leader = lane;
+        break;
+      }
+    }
+  }
+}
+
+void LockstepBatch::run(const size_t instructions)
+{
+  for (size_t i = 0; i < instructions; ++i)
+  {
+    step();
+  }
+}
+
+bool LockstepBatch::stepGroup(const uint16_t opcode)
+{
+#if defined(CHIP8_LOCKSTEP_VECTOR)
+  const OpcodeId id = decodeOpcode(opcode);
+  const uint8_t x = (opcode & 0x0F00u) >> 8u;
+  const uint8_t y = (opcode & 0x00F0u) >> 4u;
+  const uint8_t kk = opcode & 0x00FFu;
+  const uint16_t nnn = opcode & 0x0FFFu;
+
+  switch (id)
+  {
+  case OPCODE_1nnn:
+  case OPCODE_3xkk:
+  case OPCODE_4xkk:
+  case OPCODE_5xy0:
+  case OPCODE_6xkk:
+  case OPCODE_7xkk:
+  case OPCODE_8xy0:
+  case OPCODE_8xy1:
+  case OPCODE_8xy2:
+  case OPCODE_8xy3:
+  case OPCODE_8xy4:
+  case OPCODE_8xy5:
+  case OPCODE_8xy6:
+  case OPCODE_8xy7:
+  case OPCODE_8xyE:
+  case OPCODE_9xy0:
+  case OPCODE_Annn:
+  case OPCODE_Fx07:
+  case OPCODE_Fx15:
+  case OPCODE_Fx18:
+  case OPCODE_Fx1E:
+    break;
+  default:
+    // memory, stack, display, keypad and random are left to the single lane path
+    return false;
+  }
+
+  constexpr size_t WORDS = VECTOR_BYTES / 2;
+  uint8_t* Vx = V(x);
+  uint8_t* Vy = V(y);
+  uint8_t* VF = V(0xF);
+
+  // PC += 2 for the group, this is where the lanes' PCs still agree
+  const Vector two = broadcast16(2);
+  for (size_t lane = 0; lane < paddedLanes; lane += WORDS)
+  {
+    const Vector pc = load(&programCounter[lane]);
+    store(&programCounter[lane], add16(pc, bitAnd(widenMask(&group[lane]), two)));
+  }
+
+  // every kernel below works on one vector of lanes at a time and only keeps the result for the group, registers are
+  // loaded again after VF is written so that x or y being F behaves exactly like the scalar handlers
+  for (size_t lane = 0; lane < paddedLanes; lane += VECTOR_BYTES)
+  {
+    const Vector member = load(&group[lane]);
+    const auto set = [member](uint8_t* target, const Vector value)
+    {
+      store(target, select(member, value, load(target)));
+    };
+
+    switch (id)
+    {
+    case OPCODE_3xkk:
+      store(&condition[lane], bitAnd(member, equal8(load(Vx + lane), broadcast8(kk))));
+      break;
+    case OPCODE_4xkk:
+      store(&condition[lane], bitAndNot(equal8(load(Vx + lane), broadcast8(kk)), member));
+      break;
+    case OPCODE_5xy0:
+      store(&condition[lane], bitAnd(member, equal8(load(Vx + lane), load(Vy + lane))));
+      break;
+    case OPCODE_9xy0:
+      store(&condition[lane], bitAndNot(equal8(load(Vx + lane), load(Vy + lane)), member));
+      break;
+    case OPCODE_6xkk:
+      set(Vx + lane, broadcast8(kk));
+      break;
+    case OPCODE_7xkk:
+      set(Vx + lane, add8(load(Vx + lane), broadcast8(kk)));
+      break;
+    case OPCODE_8xy0:
+      set(Vx + lane, load(Vy + lane));
+      break;
+    case OPCODE_8xy1:
+      set(Vx + lane, bitOr(load(Vx + lane), load(Vy + lane)));
+      break;
+    case OPCODE_8xy2:
+      set(Vx + lane, bitAnd(load(Vx + lane), load(Vy + lane)));
+      break;
+    case OPCODE_8xy3:
+      set(Vx + lane, bitXor(load(Vx + lane), load(Vy + lane)));
+      break;
+    case OPCODE_8xy4:
+      {
+        const Vector a = load(Vx + lane);
+        const Vector b = load(Vy + lane);
+        const Vector sum = add8(a, b);
+        // the sum wrapped around exactly when it is smaller than one of the operands
+        set(VF + lane, greaterThan8(a, sum));
+        set(Vx + lane, sum);
+        break;
+      }
+    case OPCODE_8xy5:
+      set(VF + lane, greaterThan8(load(Vx + lane), load(Vy + lane)));
+      set(Vx + lane, sub8(load(Vx + lane), load(Vy + lane)));
+      break;
+    case OPCODE_8xy6:
+      set(VF + lane, bitAnd(load(Vx + lane), broadcast8(1)));
+      set(Vx + lane, shiftRightOne8(load(Vx + lane)));
+      break;
+    case OPCODE_8xy7:
+      set(VF + lane, greaterThan8(load(Vy + lane), load(Vx + lane)));
+      set(Vx + lane, sub8(load(Vx + lane), load(Vy + lane)));
+      break;
+    case OPCODE_8xyE:
+      set(VF + lane, bitAnd(shiftRight16<7>(load(Vx + lane)), broadcast8(1)));
+      set(Vx + lane, add8(load(Vx + lane), load(Vx + lane)));
+      break;
+    case OPCODE_Fx07:
+      set(Vx + lane, load(&delayTimer[lane]));
+      break;
+    case OPCODE_Fx15:
+      set(&delayTimer[lane], load(Vx + lane));
+      break;
+    case OPCODE_Fx18:
+      set(&soundTimer[lane], load(Vx + lane));
+      break;
+    default: ;
+    }
+  }
+
+  // the 16-bit registers take half as many lanes per vector
+  for (size_t lane = 0; lane < paddedLanes; lane += WORDS)
+  {
+    const Vector member = widenMask(&group[lane]);
+
+    switch (id)
+    {
+    case OPCODE_1nnn:
+      store(&programCounter[lane], select(member, broadcast16(nnn), load(&programCounter[lane])));
+      break;
+    case OPCODE_3xkk:
+    case OPCODE_4xkk:
+    case OPCODE_5xy0:
+    case OPCODE_9xy0:
+      // this is where the lanes can split up
+      store(&programCounter[lane], add16(load(&programCounter[lane]), bitAnd(widenMask(&condition[lane]), two)));
+      break;
+    case OPCODE_Annn:
+      store(&index[lane], select(member, broadcast16(nnn), load(&index[lane])));
+      break;
+    case OPCODE_Fx1E:
+      store(&index[lane], select(member, add16(load(&index[lane]), widen(Vx + lane)), load(&index[lane])));
+      break;
+    default: ;
+    }
+  }
+
+  return true;
+#else
+  (void)opcode;
+  return false;
+#endif
+}
+
+void LockstepBatch::stepLane(const size_t lane)
+{
+  ++scalarSteps;
+
+  uint8_t* ram = laneMemory(lane);
+  uint16_t& pc = programCounter[lane];
+  uint16_t& I = index[lane];
+
+  if (pc + 1u >= RAM_SIZE)
+  {
+    fault(lane);
+    return;
+  }
+
+  const uint16_t opcode = (static_cast<uint16_t>(ram[pc]) << 8u) | ram[pc + 1];
+  pc += 2;
+
+  const size_t x = (opcode & 0x0F00u) >> 8u;
+  const size_t y = (opcode & 0x00F0u) >> 4u;
+  const uint8_t kk = opcode & 0x00FFu;
+  const uint16_t nnn = opcode & 0x0FFFu;
+  uint8_t& Vx = V(x)[lane];
+  uint8_t& Vy = V(y)[lane];
+  uint8_t& VF = V(0xF)[lane];
+
+  // same order of reads and writes as the handlers in Chip8.cpp, it matters when x or y is F
+  switch (decodeOpcode(opcode))
+  {
+  case OPCODE_00E0:
+    graphics[lane]->Clear();
+    break;
+  case OPCODE_00EE:
+    if (stackPointer[lane] == 0) return fault(lane);
+    --stackPointer[lane];
+    pc = stack[stackPointer[lane] * paddedLanes + lane];
+    break;
+  case OPCODE_00Cn:
+    graphics[lane]->scrollDown(opcode & 0x000Fu);
+    break;
+  case OPCODE_00FB:
+    graphics[lane]->scrollRight(4);
+    break;
+  case OPCODE_00FC:
+    graphics[lane]->scrollLeft(4);
+    break;
+  case OPCODE_00FE:
+    graphics[lane]->setResolution(GRAPHIC_WIDTH, GRAPHIC_HEIGHT);
+    break;
+  case OPCODE_00FF:
+    graphics[lane]->setResolution(HIRES_GRAPHIC_WIDTH, HIRES_GRAPHIC_HEIGHT);
+    break;
+  case OPCODE_1nnn:
+    pc = nnn;
+    break;
+  case OPCODE_2nnn:
+    if (stackPointer[lane] == STACK_SIZE) return fault(lane);
+    stack[stackPointer[lane] * paddedLanes + lane] = pc;
+    ++stackPointer[lane];
+    pc = nnn;
+    break;
+  case OPCODE_3xkk:
+    if (Vx == kk) pc += 2;
+    break;
+  case OPCODE_4xkk:
+    if (Vx != kk) pc += 2;
+    break;
+  case OPCODE_5xy0:
+    if (Vx == Vy) pc += 2;
+    break;
+  case OPCODE_6xkk:
+    Vx = kk;
+    break;
+  case OPCODE_7xkk:
+    Vx += kk;
+    break;
+  case OPCODE_8xy0:
+    Vx = Vy;
+    break;
+  case OPCODE_8xy1:
+    Vx |= Vy;
+    break;
+  case OPCODE_8xy2:
+    Vx &= Vy;
+    break;
+  case OPCODE_8xy3:
+    Vx ^= Vy;
+    break;
+  case OPCODE_8xy4:
+    {
+      const uint16_t sum = Vx + Vy;
+      VF = sum > 0xFFu;
+      Vx = static_cast<uint8_t>(sum & 0x00FFu);
+      break;
+    }
+  case OPCODE_8xy5:
+    VF = Vx > Vy;
+    Vx -= Vy;
+    break;
+  case OPCODE_8xy6:
+    VF = Vx & 0x1u;
+    Vx >>= 1;
+    break;
+  case OPCODE_8xy7:
+    VF = Vy > Vx;
+    Vx -= Vy;
+    break;
+  case OPCODE_8xyE:
+    VF = (Vx & 0x80u) >> 7u;
+    Vx <<= 1;
+    break;
+  case OPCODE_9xy0:
+    if (Vx != Vy) pc += 2;
+    break;
+  case OPCODE_Annn:
+    I = nnn;
+    break;
+  case OPCODE_Bnnn:
+    pc = nnn + V(0)[lane];
+    break;
+  case OPCODE_Cxkk:
+    Vx = kk & randoms[lane].generateRandomValue();
+    break;
+  case OPCODE_Dxyn:
+    {
+      // n = 0 is a SUPER-CHIP 16x16 sprite
+      const uint8_t height = opcode & 0x000Fu;
+      const size_t length = height == 0 ? 32 : height;
+      if (I + length >= RAM_SIZE) return fault(lane);
+      // the original quirks, like the Chip8 default. drawSprite only ever sets VF
+      const size_t rows = height == 0 ? 16 : height;
+      const size_t width = height == 0 ? 16 : 8;
+      Graphic<uint32_t>& graphic = *graphics[lane];
+      const bool collision = graphic.GetWidth() == GRAPHIC_WIDTH
+        ? graphic.drawSprite<OriginalQuirks::loresEdge>(Vx, Vy, ram + I, rows, width)
+        : graphic.drawSprite<OriginalQuirks::hiresEdge>(Vx, Vy, ram + I, rows, width);
+      if (collision) VF = 1;
+      break;
+    }
+  case OPCODE_Ex9E:
+    if (keypads[lane].isPressed(Vx)) pc += 2;
+    break;
+  case OPCODE_ExA1:
+    if (!keypads[lane].isPressed(Vx)) pc += 2;
+    break;
+  case OPCODE_Fx07:
+    Vx = delayTimer[lane];
+    break;
+  case OPCODE_Fx0A:
+    for (uint8_t key = 0; key < 16; ++key)
+    {
+      if (keypads[lane].isPressed(key))
+      {
+        Vx = key;
+        return;
+      }
+    }
+    pc -= 2;
+    break;
+  case OPCODE_Fx15:
+    delayTimer[lane] = Vx;
+    break;
+  case OPCODE_Fx18:
+    soundTimer[lane] = Vx;
+    break;
+  case OPCODE_Fx1E:
+    I += Vx;
+    break;
+  case OPCODE_Fx29:
+    I = FONT_SET_START_ADDRESS + 5 * Vx;
+    break;
+  case OPCODE_Fx30:
+    I = LARGE_FONT_SET_START_ADDRESS + 10 * Vx;
+    break;
+  case OPCODE_Fx33:
+    {
+      if (I + 2u >= RAM_SIZE) return fault(lane);
+      uint8_t value = Vx;
+      ram[I + 2] = value % 10;
+      value /= 10;
+      ram[I + 1] = value % 10;
+      value /= 10;
+      ram[I] = value % 10;
+      break;
+    }
+  case OPCODE_Fx55:
+    for (size_t i = 0; i <= x; ++i)
+    {
+      if (I + i >= RAM_SIZE) return fault(lane);
+      ram[I + i] = V(i)[lane];
+    }
+    break;
+  case OPCODE_Fx65:
+    for (size_t i = 0; i <= x; ++i)
+    {
+      if (I + i >= RAM_SIZE) return fault(lane);
+      V(i)[lane] = ram[I + i];
+    }
+    break;
+  default: ;
+  }
+}
+
+Keypad& LockstepBatch::getKeypad(const size_t lane)
+{
+  return keypads.at(lane);
+}
+
+void LockstepBatch::seedRandom(const size_t lane, const unsigned long seed)
+{
+  randoms.at(lane).seed(seed);
+}
+
+const uint32_t* LockstepBatch::getBuffer(const size_t lane) const
+{
+  return graphics.at(lane)->getBuffer();
+}
+
+size_t LockstepBatch::getWidth(const size_t lane) const
+{
+  return graphics.at(lane)->GetWidth();
+}
+
+size_t LockstepBatch::getHeight(const size_t lane) const
+{
+  return graphics.at(lane)->GetHeight();
+}
+
+uint8_t LockstepBatch::getRegister(const size_t lane, const size_t x) const
+{
+  return registers[x * paddedLanes + lane];
+}
+
+uint16_t LockstepBatch::getIndex(const size_t lane) const
+{
+  return index[lane];
+}
+
+uint16_t LockstepBatch::getProgramCounter(const size_t lane) const
+{
+  return programCounter[lane];
+}
+
+uint8_t LockstepBatch::getDelayTimer(const size_t lane) const
+{
+  return delayTimer[lane];
+}
+
+uint8_t LockstepBatch::getSoundTimer(const size_t lane) const
+{
+  return soundTimer[lane];
+}
+
+bool LockstepBatch::isFaulted(const size_t lane) const
+{
+  return active[lane] == 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Chip8.h"
+
+// Runs many instances of the same rom side by side, one instruction per instance per step, like calling Cycle() on
+// that many Chip8 objects. The registers, I, PC, timers and stacks are kept as struct-of-arrays (one array per
+// register, one slot per lane), so while the lanes are at the same PC an instruction is executed for all of them at
+// once with SSE2/AVX2. Lanes that went somewhere else (a skip that went the other way, a keypress...) are stepped one
+// by one, and are picked up by the vector path again as soon as their PC and opcode match the group's.
+//
+// Results are the same as running separate Chip8 objects with the default CHIP-8 variant and QuirkPreset::Original
+// (seed the random generators the same way to compare Cxkk).
+// A lane that would have thrown from Cycle() stops and is reported as faulted instead.
+class LockstepBatch
+{
+  size_t laneCount;
+  // lane count rounded up to a whole number of vectors, the padding lanes are never active
+  size_t paddedLanes;
+
+  // [register][lane]
+  std::vector<uint8_t> registers;
+  std::vector<uint16_t> index;
+  std::vector<uint16_t> programCounter;
+  std::vector<uint8_t> delayTimer;
+  std::vector<uint8_t> soundTimer;
+  // [depth][lane]
+  std::vector<uint16_t> stack;
+  std::vector<uint8_t> stackPointer;
+  // 0xFF while the lane runs, 0 once it faulted (and for the padding lanes)
+  std::vector<uint8_t> active;
+
+  // 0xFF for the lanes executing the current instruction together, and scratch space for skip results
+  std::vector<uint8_t> group;
+  std::vector<uint8_t> condition;
+
+  // per lane, RAM_SIZE bytes each
+  std::vector<uint8_t> memory;
+  std::vector<std::unique_ptr<Graphic<uint32_t>>> graphics;
+  std::vector<Keypad> keypads;
+  std::vector<RandomGenerator<uint8_t>> randoms;
+
+  // the lane whose PC the vector group is built around
+  size_t leader = 0;
+  uint64_t vectorSteps = 0;
+  uint64_t scalarSteps = 0;
+
+  uint8_t* V(const size_t x)
+  {
+    return registers.data() + x * paddedLanes;
+  }
+
+  [[nodiscard]] uint8_t* laneMemory(const size_t lane)
+  {
+    return memory.data() + lane * RAM_SIZE;
+  }
+
+  // fetch, decode and execute one instruction on one lane, timers are handled by step()
+  void stepLane(size_t lane);
+  // same for every lane in group, false if the instruction has no vector version
+  bool stepGroup(uint16_t opcode);
+  void fault(size_t lane);
+
+public:
+  LockstepBatch(const RomImage& rom, size_t laneCount);
+
+  // one instruction on every lane that has not faulted
+  void step();
+  void run(size_t instructions);
+
+  [[nodiscard]] size_t getLaneCount() const
+  {
+    return laneCount;
+  }
+
+  Keypad& getKeypad(size_t lane);
+  void seedRandom(size_t lane, unsigned long seed);
+
+  [[nodiscard]] const uint32_t* getBuffer(size_t lane) const;
+  [[nodiscard]] size_t getWidth(size_t lane) const;
+  [[nodiscard]] size_t getHeight(size_t lane) const;
+  [[nodiscard]] uint8_t getRegister(size_t lane, size_t x) const;
+  [[nodiscard]] uint16_t getIndex(size_t lane) const;
+  [[nodiscard]] uint16_t getProgramCounter(size_t lane) const;
+  [[nodiscard]] uint8_t getDelayTimer(size_t lane) const;
+  [[nodiscard]] uint8_t getSoundTimer(size_t lane) const;
+  [[nodiscard]] bool isFaulted(size_t lane) const;
+
+  // how many steps went through the vector path, and how many single lane instructions were executed on the side
+  [[nodiscard]] uint64_t getVectorSteps() const
+  {
+    return vectorSteps;
+  }
+
+  [[nodiscard]] uint64_t getScalarSteps() const
+  {
+    return scalarSteps;
+  }
+};
@@ -0,0 +1,85 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filePath)
+{
+#if defined(_WIN32)
+  std::ifstream file(filePath, std::ios::binary);
+  if (!file.is_open()) throw std::runtime_error("MappedFile: Failed to open " + filePath);
+  fallback.assign(std::istreambuf_iterator(file), std::istreambuf_iterator<char>());
+  mapping = fallback.data();
+  length = fallback.size();
+#else
+  const int descriptor = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (descriptor < 0) throw std::runtime_error("MappedFile: Failed to open " + filePath);
+
+  struct stat status{};
+  if (fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode))
+  {
+    ::close(descriptor);
+    throw std::runtime_error("MappedFile: Not a regular file " + filePath);
+  }
+
+  length = static_cast<size_t>(status.st_size);
+  // mmap refuses empty mappings, an empty file is just an empty view
+  if (length > 0)
+  {
+    void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (address == MAP_FAILED)
+    {
+      ::close(descriptor);
+      throw std::runtime_error("MappedFile: Failed to map " + filePath);
+    }
+    mapping = static_cast<const uint8_t*>(address);
+  }
+
+  // the mapping stays valid after the descriptor is closed
+  ::close(descriptor);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+  release();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+  *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this == &other) return *this;
+  release();
+
+#if defined(_WIN32)
+  fallback = std::move(other.fallback);
+#endif
+  mapping = other.mapping;
+  length = other.length;
+  other.mapping = nullptr;
+  other.length = 0;
+
+  return *this;
+}
+
+void MappedFile::release()
+{
+#if !defined(_WIN32)
+  if (mapping != nullptr) munmap(const_cast<uint8_t*>(mapping), length);
+#endif
+  mapping = nullptr;
+  length = 0;
+}
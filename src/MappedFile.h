@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. On POSIX systems the file is mapped into memory so nothing is copied until the
+// pages are touched, elsewhere it falls back to reading the file into a buffer.
+class MappedFile
+{
+  const uint8_t* mapping = nullptr;
+  size_t length = 0;
+#if defined(_WIN32)
+  std::vector<uint8_t> fallback;
+#endif
+
+  void release();
+
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string& filePath);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  [[nodiscard]] const uint8_t* data() const
+  {
+    return mapping;
+  }
+
+  [[nodiscard]] size_t size() const
+  {
+    return length;
+  }
+};
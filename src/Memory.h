@@ -1,57 +1,137 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
+#include "Hash.h"
+
+// Guest ram, split in pages of PAGE_SIZE that are shared copy-on-write between copies of a Memory: copying one only
+// copies the page table, and the first write to a shared page copies that page alone. Pages never written (the font,
+// the rom, untouched ram) stay shared by every copy for good. A hash of the contents is kept up to date by the writes.
 template <typename T>
 class Memory
 {
+public:
+  static constexpr size_t PAGE_SIZE = 256;
+
+private:
   size_t size;
-  T* memory;
+  std::vector<std::shared_ptr<T[]>> pages;
+  // the xor of zobrist(address, byte) over the ram
+  uint64_t hash = 0;
+
+  // every page starts out as this one, so a new Memory only allocates the pages that are written to
+  static const std::shared_ptr<T[]>& zeroPage()
+  {
+    static const std::shared_ptr<T[]> page(new T[PAGE_SIZE]());
+    return page;
+  }
+
+  [[nodiscard]] T* writablePage(const size_t page)
+  {
+    std::shared_ptr<T[]>& data = pages[page];
+    // use_count is only ever 1 when no other Memory holds the page, copying it for nothing is the worst a race can do
+    if (data.use_count() > 1)
+    {
+      std::shared_ptr<T[]> copy(new T[PAGE_SIZE]);
+      memcpy(copy.get(), data.get(), sizeof(T) * PAGE_SIZE);
+      data = std::move(copy);
+    }
+    return data.get();
+  }
 
 public:
-  explicit Memory(const size_t size) : size(size), memory(new T[size])
+  explicit Memory(const size_t size) : size(size), pages((size + PAGE_SIZE - 1) / PAGE_SIZE, zeroPage())
   {
-    memset(memory, 0, sizeof(T) * size);
   }
 
-  ~Memory()
+  // shares every page with other, see above
+  Memory(const Memory& other) = default;
+  Memory& operator=(const Memory& other) = default;
+
+  [[nodiscard]] size_t getSize() const
   {
-    delete[] memory;
+    return size;
   }
 
-  void writeByte(size_t address, const uint8_t data) const
+  // Zeroes the ram. A page no other copy holds is zeroed in place and kept, so reloading a Memory (Chip8::reset) writes
+  // into the pages it already has instead of allocating them again; shared pages go back to the zero page.
+  void clear()
+  {
+    for (std::shared_ptr<T[]>& page : pages)
+    {
+      if (page.use_count() == 1) std::fill_n(page.get(), PAGE_SIZE, 0);
+      else page = zeroPage();
+    }
+    hash = 0;
+  }
+
+  void writeByte(size_t address, const uint8_t data)
   {
     if (address >= size) throw std::out_of_range("Address out of range");
-    memory[address] = data;
+    T& byte = writablePage(address / PAGE_SIZE)[address % PAGE_SIZE];
+    hash ^= zobrist(address, byte) ^ zobrist(address, data);
+    byte = data;
   }
 
-  void writeWord(size_t address, const uint16_t data) const
+  void writeWord(size_t address, const uint16_t data)
   {
     if (address + 1 >= size) throw std::out_of_range("Address out of range");
-    memory[address] = static_cast<uint8_t>(data & 0xff);
-    memory[address + 1] = static_cast<uint8_t>(data >> 8);
+    writeByte(address, static_cast<uint8_t>(data & 0xff));
+    writeByte(address + 1, static_cast<uint8_t>(data >> 8));
   }
 
-  void writeBytes(size_t address, const std::vector<uint8_t>& data) const
+  void writeBytes(const size_t address, const uint8_t* data, const size_t length)
   {
-    if (address + data.size() >= size) throw std::out_of_range("Address out of range");
+    if (address + length > size) throw std::out_of_range("Address out of range");
 
-    for (const uint8_t byte : data)
+    // page by page, so only the pages covered are copied
+    for (size_t offset = 0; offset < length;)
     {
-      memory[address++] = byte;
+      const size_t page = (address + offset) / PAGE_SIZE;
+      const size_t start = (address + offset) % PAGE_SIZE;
+      const size_t count = std::min(PAGE_SIZE - start, length - offset);
+      T* bytes = writablePage(page) + start;
+      for (size_t i = 0; i < count; ++i)
+      {
+        hash ^= zobrist(address + offset + i, bytes[i]) ^ zobrist(address + offset + i, data[offset + i]);
+      }
+      memcpy(bytes, data + offset, count);
+      offset += count;
     }
+  }
 
+  void writeBytes(const size_t address, const std::vector<uint8_t>& data)
+  {
+    writeBytes(address, data.data(), data.size());
   }
+
   [[nodiscard]] uint8_t readByte(const size_t address) const
   {
     if (address >= size) throw std::out_of_range("Address out of range");
-    return memory[address];
+    return pages[address / PAGE_SIZE][address % PAGE_SIZE];
   }
 
   [[nodiscard]] uint16_t readWord(const size_t address) const
   {
     if (address + 1 >= size) throw std::out_of_range("Address out of range");
-    return (static_cast<uint16_t>(memory[address]) << 8) | memory[address + 1];
+    // the two bytes can sit on different pages
+    return (static_cast<uint16_t>(pages[address / PAGE_SIZE][address % PAGE_SIZE]) << 8) |
+      pages[(address + 1) / PAGE_SIZE][(address + 1) % PAGE_SIZE];
+  }
+
+  // same bounds as the vector version, without the allocation
+  void readBytes(const size_t startingAddress, T* out, const size_t length) const
+  {
+    if (startingAddress + length >= size) throw std::out_of_range("Address out of range");
+    for (size_t i = 0; i < length; i++)
+    {
+      out[i] = pages[(startingAddress + i) / PAGE_SIZE][(startingAddress + i) % PAGE_SIZE];
+    }
   }
 
   std::vector<T> readBytes(const size_t startingAddress, const size_t length) const
@@ -61,7 +141,25 @@ public:
     result.reserve(length);
     for (size_t i = 0; i < length; i++)
     {
-      result.push_back(memory[startingAddress + i]);
+      result.push_back(readByte(startingAddress + i));
     }
     return result;
-  }};
+  }
+
+  // identifies the contents, equal for equal contents whatever wrote them
+  [[nodiscard]] uint64_t getHash() const
+  {
+    return hash;
+  }
+
+  // pages this copy does not share with any other, what a fork has cost so far
+  [[nodiscard]] size_t getPrivatePageCount() const
+  {
+    size_t count = 0;
+    for (const std::shared_ptr<T[]>& page : pages)
+    {
+      count += page.use_count() == 1;
+    }
+    return count;
+  }
+};
@@ -0,0 +1,223 @@
+#pragma once
+#include <cstdint>
+
+// Every instruction the interpreter knows. The value is an index into the handler table of Chip8, and it is also
+// what gets stored in predecoded instruction streams (see TranslationCache), so bump TRANSLATION_FORMAT_VERSION
+// when this list changes.
+enum OpcodeId : uint8_t
+{
+  OPCODE_NULL,
+  OPCODE_00E0,
+  OPCODE_00EE,
+  OPCODE_00Cn,
+  OPCODE_00Dn,
+  OPCODE_00FB,
+  OPCODE_00FC,
+  OPCODE_00FE,
+  OPCODE_00FF,
+  OPCODE_1nnn,
+  OPCODE_2nnn,
+  OPCODE_3xkk,
+  OPCODE_4xkk,
+  OPCODE_5xy0,
+  OPCODE_5xy2,
+  OPCODE_5xy3,
+  OPCODE_6xkk,
+  OPCODE_7xkk,
+  OPCODE_8xy0,
+  OPCODE_8xy1,
+  OPCODE_8xy2,
+  OPCODE_8xy3,
+  OPCODE_8xy4,
+  OPCODE_8xy5,
+  OPCODE_8xy6,
+  OPCODE_8xy7,
+  OPCODE_8xyE,
+  OPCODE_9xy0,
+  OPCODE_Annn,
+  OPCODE_Bnnn,
+  OPCODE_Cxkk,
+  OPCODE_Dxyn,
+  OPCODE_Ex9E,
+  OPCODE_ExA1,
+  OPCODE_F000,
+  OPCODE_Fn01,
+  OPCODE_F002,
+  OPCODE_Fx07,
+  OPCODE_Fx0A,
+  OPCODE_Fx15,
+  OPCODE_Fx18,
+  OPCODE_Fx1E,
+  OPCODE_Fx29,
+  OPCODE_Fx30,
+  OPCODE_Fx3A,
+  OPCODE_Fx33,
+  OPCODE_Fx55,
+  OPCODE_Fx65,
+  // never the result of decoding: the debugger writes it over the decoded instructions it wants to look at first
+  OPCODE_TRAP,
+  OPCODE_COUNT
+};
+
+// the instruction patterns, in the order of OpcodeId, for printing
+constexpr const char* OPCODE_NAMES[OPCODE_COUNT] = {
+  "????", "00E0", "00EE", "00Cn", "00Dn", "00FB", "00FC", "00FE", "00FF", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0",
+  "5xy2", "5xy3", "6xkk", "7xkk", "8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6", "8xy7", "8xyE", "9xy0",
+  "Annn", "Bnnn", "Cxkk", "Dxyn", "Ex9E", "ExA1", "F000", "Fn01", "F002", "Fx07", "Fx0A", "Fx15", "Fx18", "Fx1E",
+  "Fx29", "Fx30", "Fx3A", "Fx33", "Fx55", "Fx65", "trap"
+};
+
+/*
+  The entire list of opcodes is divided into 4 categories:
+  The entire opcode is unique:
+      $1nnn
+      $2nnn
+      $3xkk
+      $4xkk
+      $5xy0
+      $6xkk
+      $7xkk
+      $9xy0
+      $Annn
+      $Bnnn
+      $Cxkk
+      $Dxyn
+  The first digit repeats but the last digit is unique:
+      $8xy0
+      $8xy1
+      $8xy2
+      $8xy3
+      $8xy4
+      $8xy5
+      $8xy6
+      $8xy7
+      $8xyE
+  The first three digits are $00E but the fourth digit is unique:
+      $00E0
+      $00EE
+  The first digit repeats but the last two digits are unique:
+      $ExA1
+      $Ex9E
+      $Fx07
+      $Fx0A
+      $Fx15
+      $Fx18
+      $Fx1E
+      $Fx29
+      $Fx33
+      $Fx55
+      $Fx65
+
+  so the 1st nibble (what a funny word) is enough for the unique ones, and the others need one more look at the last
+  digit or the last two digits. This used to be done with nested function pointer tables on every cycle, now it is done
+  once per address when the rom is loaded (and again when the rom writes over its own code) and the result is cached.
+*/
+inline OpcodeId decodeOpcode(const uint16_t opcode)
+{
+  switch ((opcode & 0xF000u) >> 12u)
+  {
+  case 0x0:
+    // the SUPER-CHIP instructions are matched on the whole opcode
+    if ((opcode & 0xFFF0u) == 0x00C0u && (opcode & 0x000Fu) != 0x0u) return OPCODE_00Cn;
+    if (opcode == 0x00FBu) return OPCODE_00FB;
+    if (opcode == 0x00FCu) return OPCODE_00FC;
+    if (opcode == 0x00FEu) return OPCODE_00FE;
+    if (opcode == 0x00FFu) return OPCODE_00FF;
+    // only the last digit is looked at here (and for Ex9E/ExA1), so 0nn0 behaves like 00E0
+    if ((opcode & 0x000Fu) == 0x0u) return OPCODE_00E0;
+    if ((opcode & 0x000Fu) == 0xEu) return OPCODE_00EE;
+    return OPCODE_NULL;
+  case 0x1:
+    return OPCODE_1nnn;
+  case 0x2:
+    return OPCODE_2nnn;
+  case 0x3:
+    return OPCODE_3xkk;
+  case 0x4:
+    return OPCODE_4xkk;
+  case 0x5:
+    return OPCODE_5xy0;
+  case 0x6:
+    return OPCODE_6xkk;
+  case 0x7:
+    return OPCODE_7xkk;
+  case 0x8:
+    switch (opcode & 0x000Fu)
+    {
+    case 0x0:
+      return OPCODE_8xy0;
+    case 0x1:
+      return OPCODE_8xy1;
+    case 0x2:
+      return OPCODE_8xy2;
+    case 0x3:
+      return OPCODE_8xy3;
+    case 0x4:
+      return OPCODE_8xy4;
+    case 0x5:
+      return OPCODE_8xy5;
+    case 0x6:
+      return OPCODE_8xy6;
+    case 0x7:
+      return OPCODE_8xy7;
+    case 0xE:
+      return OPCODE_8xyE;
+    default:
+      return OPCODE_NULL;
+    }
+  case 0x9:
+    return OPCODE_9xy0;
+  case 0xA:
+    return OPCODE_Annn;
+  case 0xB:
+    return OPCODE_Bnnn;
+  case 0xC:
+    return OPCODE_Cxkk;
+  case 0xD:
+    return OPCODE_Dxyn;
+  case 0xE:
+    if ((opcode & 0x000Fu) == 0xEu) return OPCODE_Ex9E;
+    if ((opcode & 0x000Fu) == 0x1u) return OPCODE_ExA1;
+    return OPCODE_NULL;
+  default:
+    switch (opcode & 0x00FFu)
+    {
+    case 0x07:
+      return OPCODE_Fx07;
+    case 0x0A:
+      return OPCODE_Fx0A;
+    case 0x15:
+      return OPCODE_Fx15;
+    case 0x18:
+      return OPCODE_Fx18;
+    case 0x1E:
+      return OPCODE_Fx1E;
+    case 0x29:
+      return OPCODE_Fx29;
+    case 0x30:
+      return OPCODE_Fx30;
+    case 0x33:
+      return OPCODE_Fx33;
+    case 0x55:
+      return OPCODE_Fx55;
+    case 0x65:
+      return OPCODE_Fx65;
+    default:
+      return OPCODE_NULL;
+    }
+  }
+}
+
+// XO-CHIP adds a few instructions on top of CHIP-8 and SUPER-CHIP, matched exactly before falling back to the decoder
+// above. Only used for roms run as PlatformVariant::XoChip, the other roms keep decoding these as they always did.
+inline OpcodeId decodeXoChipOpcode(const uint16_t opcode)
+{
+  if ((opcode & 0xFFF0u) == 0x00D0u && (opcode & 0x000Fu) != 0x0u) return OPCODE_00Dn;
+  if ((opcode & 0xF00Fu) == 0x5002u) return OPCODE_5xy2;
+  if ((opcode & 0xF00Fu) == 0x5003u) return OPCODE_5xy3;
+  if (opcode == 0xF000u) return OPCODE_F000;
+  if ((opcode & 0xF0FFu) == 0xF001u) return OPCODE_Fn01;
+  if (opcode == 0xF002u) return OPCODE_F002;
+  if ((opcode & 0xF0FFu) == 0xF03Au) return OPCODE_Fx3A;
+  return decodeOpcode(opcode);
+}
@@ -1,12 +1,66 @@
 #include "PlatformSDL.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <iostream>
 #include <ostream>
 
+namespace
+{
+  // 3x5 glyphs for the overlay, one row of 3 bits per 3 bits from the top, the leftmost pixel the highest bit
+  constexpr char GLYPH_CHARACTERS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ:-*.()=/>";
+  constexpr uint16_t GLYPHS[] = {
+    0b111'101'101'101'111, 0b010'110'010'010'111, 0b111'001'111'100'111, 0b111'001'111'001'111,
+    0b101'101'111'001'001, 0b111'100'111'001'111, 0b111'100'111'101'111, 0b111'001'001'010'010,
+    0b111'101'111'101'111, 0b111'101'111'001'111, 0b010'101'111'101'101, 0b110'101'110'101'110,
+    0b011'100'100'100'011, 0b110'101'101'101'110, 0b111'100'110'100'111, 0b111'100'110'100'100,
+    0b011'100'101'101'011, 0b101'101'111'101'101, 0b111'010'010'010'111, 0b001'001'001'101'010,
+    0b101'101'110'101'101, 0b100'100'100'100'111, 0b101'111'111'101'101, 0b110'101'101'101'101,
+    0b010'101'101'101'010, 0b110'101'110'100'100, 0b010'101'101'110'011, 0b110'101'110'101'101,
+    0b011'100'010'001'110, 0b111'010'010'010'010, 0b101'101'101'101'111, 0b101'101'101'101'010,
+    0b101'101'111'111'101, 0b101'101'010'101'101, 0b101'101'010'010'010, 0b111'001'010'100'111,
+    0b000'010'000'010'000, 0b000'000'111'000'000, 0b000'101'010'101'000, 0b000'000'000'000'010,
+    0b010'100'100'100'010, 0b010'001'001'001'010, 0b000'111'000'111'000, 0b001'001'010'100'100,
+    0b100'010'001'010'100
+  };
+  static_assert(sizeof(GLYPHS) / sizeof(GLYPHS[0]) == sizeof(GLYPH_CHARACTERS) - 1);
+
+  // window pixels per glyph pixel, and glyph pixels per character cell
+  constexpr int OVERLAY_SCALE = 2;
+  constexpr int CELL_WIDTH = 4;
+  constexpr int CELL_HEIGHT = 7;
+
+  void drawText(SDL_Renderer* renderer, const std::string& text, const int left, const int top)
+  {
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+      const char character = static_cast<char>(std::toupper(static_cast<unsigned char>(text[i])));
+      const char* found = std::strchr(GLYPH_CHARACTERS, character);
+      if (character == '\0' || found == nullptr) continue;
+      const uint16_t glyph = GLYPHS[found - GLYPH_CHARACTERS];
+
+      for (int row = 0; row < 5; ++row)
+      {
+        for (int column = 0; column < 3; ++column)
+        {
+          if (!((glyph >> ((4 - row) * 3 + 2 - column)) & 0x1u)) continue;
+          const SDL_Rect pixel{
+            left + (static_cast<int>(i) * CELL_WIDTH + column) * OVERLAY_SCALE, top + row * OVERLAY_SCALE,
+            OVERLAY_SCALE, OVERLAY_SCALE
+          };
+          SDL_RenderFillRect(renderer, &pixel);
+        }
+      }
+    }
+  }
+}
+
 PlatformSDL::PlatformSDL()
 = default;
 
-PlatformSDL::PlatformSDL(const int graphicWidth, const int graphicHeight, const int scale)
+PlatformSDL::PlatformSDL(const int graphicWidth, const int graphicHeight, const int scale,
+                         const int maxGraphicWidth, const int maxGraphicHeight, const bool vsync)
 {
   if (SDL_Init(SDL_INIT_VIDEO) < 0 || SDL_Init(SDL_INIT_AUDIO) < 0)
   {
@@ -19,15 +73,15 @@ PlatformSDL::PlatformSDL(const int graphicWidth, const int graphicHeight, const
     throw std::runtime_error(std::string("Failed to initialize window ") + SDL_GetError());
   }
 
-  renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+  renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
   if (renderer == nullptr)
   {
     SDL_DestroyWindow(window);
     throw std::runtime_error(std::string("Failed to initialize renderer ") + SDL_GetError());
   }
 
-  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, graphicWidth,
-                              graphicHeight);
+  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, maxGraphicWidth,
+                              maxGraphicHeight);
   if (texture == nullptr)
   {
     SDL_DestroyWindow(window);
@@ -44,15 +98,45 @@ PlatformSDL::~PlatformSDL()
   SDL_Quit();
 }
 
-void PlatformSDL::update(const void* buffer, const int pitch) const
+void PlatformSDL::update(const void* buffer, const int width, const int height, const int pitch,
+                         const std::vector<std::string>* overlay) const
 {
-  SDL_UpdateTexture(texture, nullptr, buffer, pitch);
+  // only the corner of the texture used by the current resolution, switching resolution costs nothing
+  const SDL_Rect area{0, 0, width, height};
+  SDL_UpdateTexture(texture, &area, buffer, pitch);
   SDL_RenderClear(renderer);
-  SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+  SDL_RenderCopy(renderer, texture, &area, nullptr);
+
+  if (overlay != nullptr && !overlay->empty())
+  {
+    size_t columns = 0;
+    for (const std::string& line : *overlay)
+    {
+      columns = std::max(columns, line.size());
+    }
+
+    // the screen shows through a dark translucent panel
+    const SDL_Rect panel{
+      0, 0, (static_cast<int>(columns) * CELL_WIDTH + 2) * OVERLAY_SCALE,
+      (static_cast<int>(overlay->size()) * CELL_HEIGHT + 2) * OVERLAY_SCALE
+    };
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0x10, 0x10, 0x30, 0xC0);
+    SDL_RenderFillRect(renderer, &panel);
+
+    SDL_SetRenderDrawColor(renderer, 0xFF, 0xD0, 0x40, 0xFF);
+    for (size_t i = 0; i < overlay->size(); ++i)
+    {
+      drawText(renderer, (*overlay)[i], 2 * OVERLAY_SCALE, (2 + static_cast<int>(i) * CELL_HEIGHT) * OVERLAY_SCALE);
+    }
+    // RenderClear uses the draw color
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
+  }
+
   SDL_RenderPresent(renderer);
 }
 
-bool PlatformSDL::ProcessInput(Keypad& keypad)
+bool PlatformSDL::ProcessInput(Keypad& keypad, FunctionKey* functionKey)
 {
   bool quit = false;
 
@@ -73,6 +157,34 @@ bool PlatformSDL::ProcessInput(Keypad& keypad)
         quit = true;
         break;
 
+      case SDLK_F1:
+        if (functionKey != nullptr) *functionKey = FunctionKey::Overlay;
+        break;
+
+      case SDLK_F5:
+        if (functionKey != nullptr) *functionKey = FunctionKey::Continue;
+        break;
+
+      case SDLK_F6:
+        if (functionKey != nullptr) *functionKey = FunctionKey::SaveState;
+        break;
+
+      case SDLK_F7:
+        if (functionKey != nullptr) *functionKey = FunctionKey::LoadState;
+        break;
+
+      case SDLK_F8:
+        if (functionKey != nullptr) *functionKey = FunctionKey::NextSlot;
+        break;
+
+      case SDLK_F9:
+        if (functionKey != nullptr) *functionKey = FunctionKey::Breakpoint;
+        break;
+
+      case SDLK_F10:
+        if (functionKey != nullptr) *functionKey = FunctionKey::Step;
+        break;
+
       case SDLK_x:
         keypad.pressKey(0x0u);
         break;
@@ -2,8 +2,31 @@
 
 #include <SDL2/SDL.h>
 
+#include <string>
+#include <vector>
+
 #include "Keypad.h"
 
+// function keys of the frontend (debugger overlay and save states), only reported when asked for
+enum class FunctionKey : uint8_t
+{
+  None,
+  // F1
+  Overlay,
+  // F5
+  Continue,
+  // F6
+  SaveState,
+  // F7
+  LoadState,
+  // F8
+  NextSlot,
+  // F9
+  Breakpoint,
+  // F10
+  Step
+};
+
 class PlatformSDL
 {
   SDL_Window* window{};
@@ -12,8 +35,15 @@ class PlatformSDL
 
 public:
   PlatformSDL();
-  PlatformSDL(int graphicWidth, int graphicHeight, int scale);
+  // the window is graphicWidth x graphicHeight times scale, the texture is made once for the largest resolution.
+  // With vsync, update() blocks until the display refreshes.
+  PlatformSDL(int graphicWidth, int graphicHeight, int scale, int maxGraphicWidth, int maxGraphicHeight,
+              bool vsync = false);
   ~PlatformSDL();
-  void update(const void* buffer, int pitch) const;
-  static bool ProcessInput(Keypad& keypad);
+  // buffer is width x height, it is stretched over the whole window whatever the resolution. The overlay lines are
+  // drawn over it in the top left corner with a small built-in font (digits, letters and a few signs).
+  void update(const void* buffer, int width, int height, int pitch,
+              const std::vector<std::string>* overlay = nullptr) const;
+  // the last function key pressed is stored in functionKey when it is not nullptr
+  static bool ProcessInput(Keypad& keypad, FunctionKey* functionKey = nullptr);
 };
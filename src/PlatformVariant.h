@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+
+// which interpreter a rom was written for, guessed from the instructions it uses
+enum class PlatformVariant : uint8_t
+{
+  Chip8,
+  SuperChip,
+  XoChip,
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "Graphic.h"
+#include "PlatformVariant.h"
+
+// The behaviours CHIP-8 interpreters never agreed on. Every preset is a struct of constants, and the handlers that
+// depend on one are templates over it (see Chip8.cpp), so each preset gets its own handler table with the choices
+// compiled in: the quirk is picked once when the Chip8 is built and never looked at again while running.
+enum class QuirkPreset : uint8_t
+{
+  // what this interpreter always did, the default so existing users (batches, fuzzing, saved hashes) see no change
+  Original,
+  CosmacVip,
+  SuperChip,
+  XoChip
+};
+
+constexpr size_t QUIRK_PRESET_COUNT = 4;
+
+// names used on command lines and in the corpus manifest, in the order of QuirkPreset
+constexpr const char* QUIRK_PRESET_NAMES[QUIRK_PRESET_COUNT] = {"original", "vip", "schip", "xochip"};
+
+// The fields every preset defines:
+//   shiftVy         8xy6/8xyE shift Vy into Vx instead of shifting Vx in place
+//   advanceIndex    Fx55/Fx65 leave I at I + x + 1
+//   resetFlag       8xy1/8xy2/8xy3 set VF to 0
+//   loresEdge       what happens to sprites reaching the edge of the 64x32 screen
+//   hiresEdge       same for the 128x64 SUPER-CHIP screen
+//   displayWait     Dxyn waits for the start of a frame (the VIP drew during the vertical blank), so at most one
+//                   sprite is drawn per frame
+
+struct OriginalQuirks
+{
+  static constexpr bool shiftVy = false;
+  static constexpr bool advanceIndex = false;
+  static constexpr bool resetFlag = false;
+  static constexpr SpriteEdge loresEdge = SpriteEdge::Spill;
+  static constexpr SpriteEdge hiresEdge = SpriteEdge::Clip;
+  static constexpr bool displayWait = false;
+};
+
+struct CosmacVipQuirks
+{
+  static constexpr bool shiftVy = true;
+  static constexpr bool advanceIndex = true;
+  static constexpr bool resetFlag = true;
+  static constexpr SpriteEdge loresEdge = SpriteEdge::Clip;
+  static constexpr SpriteEdge hiresEdge = SpriteEdge::Clip;
+  static constexpr bool displayWait = true;
+};
+
+// SUPER-CHIP 1.1 on the HP 48, as most SUPER-CHIP roms expect
+struct SuperChipQuirks
+{
+  static constexpr bool shiftVy = false;
+  static constexpr bool advanceIndex = false;
+  static constexpr bool resetFlag = false;
+  static constexpr SpriteEdge loresEdge = SpriteEdge::Clip;
+  static constexpr SpriteEdge hiresEdge = SpriteEdge::Clip;
+  static constexpr bool displayWait = false;
+};
+
+struct XoChipQuirks
+{
+  static constexpr bool shiftVy = true;
+  static constexpr bool advanceIndex = true;
+  static constexpr bool resetFlag = false;
+  static constexpr SpriteEdge loresEdge = SpriteEdge::Wrap;
+  static constexpr SpriteEdge hiresEdge = SpriteEdge::Wrap;
+  static constexpr bool displayWait = false;
+};
+
+// the preset a rom of that platform was most likely written against
+inline QuirkPreset quirkPresetFor(const PlatformVariant variant)
+{
+  switch (variant)
+  {
+  case PlatformVariant::SuperChip:
+    return QuirkPreset::SuperChip;
+  case PlatformVariant::XoChip:
+    return QuirkPreset::XoChip;
+  default:
+    return QuirkPreset::CosmacVip;
+  }
+}
@@ -1,20 +1,46 @@
 #pragma once
+#include <chrono>
+#include <cstdint>
 #include <random>
 
 template <typename T>
 class RandomGenerator
 {
+  unsigned long seedValue;
+  // values generated since the last seed, with the seed where the generator is in its sequence
+  uint64_t draws = 0;
   std::default_random_engine generator;
   std::uniform_int_distribution<T> distribution;
 
 public:
-  RandomGenerator(T min, T max): generator(std::chrono::system_clock::now().time_since_epoch().count()),
+  RandomGenerator(T min, T max): seedValue(std::chrono::system_clock::now().time_since_epoch().count()),
+                                 generator(seedValue),
                                  distribution(std::uniform_int_distribution<uint8_t>(min, max))
   {
   }
 
   T generateRandomValue()
   {
+    ++draws;
     return distribution(generator);
   }
+
+  // the default seed is the clock, a fixed one makes runs reproducible
+  void seed(const unsigned long value)
+  {
+    seedValue = value;
+    draws = 0;
+    generator.seed(value);
+    distribution.reset();
+  }
+
+  [[nodiscard]] unsigned long getSeed() const
+  {
+    return seedValue;
+  }
+
+  [[nodiscard]] uint64_t getDraws() const
+  {
+    return draws;
+  }
 };
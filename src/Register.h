@@ -14,6 +14,8 @@ public:
   {
   }
 
+  Register(const Register& value) = default;
+
   void setAddress(T value)
   {
     address = value;
@@ -0,0 +1,330 @@
+#include "RomAnalyzer.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+namespace
+{
+  struct Instruction
+  {
+    uint16_t opcode;
+    // FallThrough means this instruction does not end a block
+    BlockExit exit;
+    std::vector<uint16_t> successors;
+    // 4 for XO-CHIP F000 nnnn, which loads I with the word after it
+    uint16_t length = 2;
+    uint16_t operand = 0;
+  };
+
+  struct Write
+  {
+    uint16_t instruction;
+    uint16_t start;
+    uint16_t length;
+  };
+
+  // Decodes the control flow part of an instruction, everything that is not a branch just falls through to the next
+  // one. length is the length of the instruction, skipped the length of the one after it, which a skip steps over.
+  Instruction decodeFlow(const uint16_t address, const uint16_t opcode, const uint16_t length, const uint16_t skipped)
+  {
+    const uint16_t nnn = opcode & 0x0FFFu;
+    const uint16_t next = address + length;
+    const auto skip = static_cast<uint16_t>(next + skipped);
+
+    switch ((opcode & 0xF000u) >> 12u)
+    {
+    case 0x0:
+      if (opcode == 0x00EEu) return {opcode, BlockExit::Return, {}};
+      break;
+    case 0x1:
+      if (nnn == address) return {opcode, BlockExit::Halt, {nnn}};
+      return {opcode, BlockExit::Jump, {nnn}};
+    case 0x2:
+      return {opcode, BlockExit::Call, {nnn, next}};
+    case 0x3:
+    case 0x4:
+      return {opcode, BlockExit::Skip, {next, skip}};
+    case 0x5:
+    case 0x9:
+      if ((opcode & 0x000Fu) == 0x0u) return {opcode, BlockExit::Skip, {next, skip}};
+      break;
+    case 0xB:
+      return {opcode, BlockExit::ComputedJump, {}};
+    case 0xE:
+      if ((opcode & 0x00FFu) == 0x9Eu || (opcode & 0x00FFu) == 0xA1u)
+      {
+        return {opcode, BlockExit::Skip, {next, skip}};
+      }
+      break;
+    default: ;
+    }
+
+    return {opcode, BlockExit::FallThrough, {next}};
+  }
+}
+
+int RomAnalysis::findBlock(const uint16_t address) const
+{
+  const auto it = std::lower_bound(blocks.begin(), blocks.end(), address,
+                                   [](const BasicBlock& block, const uint16_t value) { return block.start < value; });
+  if (it == blocks.end() || it->start != address) return -1;
+  return static_cast<int>(it - blocks.begin());
+}
+
+RomAnalysis RomAnalyzer::analyze(const RomImage& rom, const PlatformVariant variant, const uint16_t baseAddress)
+{
+  RomAnalysis analysis;
+  analysis.baseAddress = baseAddress;
+  analysis.entryPoint = baseAddress;
+  analysis.byteFlags.assign(rom.size, 0);
+
+  // first pass: find every reachable instruction and the addresses where blocks start (leaders)
+  std::map<uint16_t, Instruction> instructions;
+  std::set<uint16_t> leaders{analysis.entryPoint};
+  std::set<uint16_t> subroutines;
+  std::set<uint16_t> outside;
+  std::vector<uint16_t> worklist{analysis.entryPoint};
+
+  const auto wordAt = [&rom, baseAddress](const size_t address)
+  {
+    const size_t offset = address - baseAddress;
+    return static_cast<uint16_t>(rom[offset] << 8u | rom[offset + 1]);
+  };
+  // in bytes, XO-CHIP F000 nnnn is the only instruction longer than 2. Past the end of the image it does not matter.
+  const auto lengthAt = [&](const size_t address) -> uint16_t
+  {
+    if (variant != PlatformVariant::XoChip || !analysis.contains(address) || !analysis.contains(address + 1)) return 2;
+    return wordAt(address) == 0xF000u ? 4 : 2;
+  };
+
+  while (!worklist.empty())
+  {
+    const uint16_t address = worklist.back();
+    worklist.pop_back();
+
+    if (instructions.count(address) || outside.count(address)) continue;
+
+    // every byte of the instruction has to be inside the image
+    const uint16_t length = lengthAt(address);
+    if (!analysis.contains(address) || !analysis.contains(address + length - 1))
+    {
+      outside.insert(address);
+      analysis.uncertainties.push_back({UncertaintyKind::OutOfRom, address});
+      continue;
+    }
+
+    const uint16_t opcode = wordAt(address);
+    Instruction instruction = decodeFlow(address, opcode, length, lengthAt(address + length));
+    instruction.length = length;
+    if (length == 4) instruction.operand = wordAt(address + 2);
+
+    for (size_t i = 0; i < length; ++i)
+    {
+      analysis.byteFlags[address + i - baseAddress] |= ROM_BYTE_CODE;
+    }
+
+    if (instruction.exit == BlockExit::ComputedJump)
+    {
+      analysis.uncertainties.push_back({UncertaintyKind::ComputedJump, address});
+    }
+    if (instruction.exit == BlockExit::Call)
+    {
+      subroutines.insert(instruction.successors.front());
+    }
+    if (instruction.exit != BlockExit::FallThrough)
+    {
+      // everything a block can branch to starts a new block
+      leaders.insert(instruction.successors.begin(), instruction.successors.end());
+    }
+
+    worklist.insert(worklist.end(), instruction.successors.begin(), instruction.successors.end());
+    instructions.emplace(address, std::move(instruction));
+  }
+
+  // second pass: cut the instruction stream into blocks, tracking I inside each block so that
+  // Annn followed by Dxyn/Fx65/Fx55/Fx33 (and XO-CHIP 5xy2/5xy3) tells us what the bytes at I are used for
+  std::vector<Write> writes;
+
+  for (const uint16_t leader : leaders)
+  {
+    auto it = instructions.find(leader);
+    if (it == instructions.end()) continue;
+
+    BasicBlock block{leader, leader, BlockExit::FallThrough, {}};
+    // I as set by an Annn earlier in the block, while indexKnown
+    uint16_t index = 0;
+    bool indexKnown = false;
+
+    while (true)
+    {
+      const uint16_t address = it->first;
+      const Instruction& instruction = it->second;
+      const uint16_t opcode = instruction.opcode;
+      const uint8_t x = (opcode & 0x0F00u) >> 8u;
+      const uint8_t y = (opcode & 0x00F0u) >> 4u;
+
+      switch ((opcode & 0xF000u) >> 12u)
+      {
+      case 0x5:
+        // XO-CHIP 5xy2/5xy3 store/load Vx to Vy in either direction, I stays
+        if (variant != PlatformVariant::XoChip || ((opcode & 0x000Fu) != 0x2u && (opcode & 0x000Fu) != 0x3u)) break;
+        if ((opcode & 0x000Fu) == 0x2u)
+        {
+          if (!indexKnown)
+          {
+            analysis.uncertainties.push_back({UncertaintyKind::UnresolvedWrite, address});
+            break;
+          }
+          writes.push_back({address, index, static_cast<uint16_t>((x > y ? x - y : y - x) + 1)});
+        }
+        else if (indexKnown)
+        {
+          for (size_t i = 0; i <= static_cast<size_t>(x > y ? x - y : y - x); ++i)
+          {
+            if (analysis.contains(index + i)) analysis.byteFlags[index + i - baseAddress] |= ROM_BYTE_DATA;
+          }
+        }
+        break;
+      case 0xA:
+        index = opcode & 0x0FFFu;
+        indexKnown = true;
+        break;
+      case 0xD:
+        // n = 0 is a 16x16 sprite of 32 bytes. The XO-CHIP planes are not tracked, this is the sprite of one plane.
+        if (indexKnown)
+        {
+          const size_t size = (opcode & 0x000Fu) == 0 ? 32 : opcode & 0x000Fu;
+          for (size_t i = 0; i < size; ++i)
+          {
+            if (analysis.contains(index + i)) analysis.byteFlags[index + i - baseAddress] |= ROM_BYTE_SPRITE;
+          }
+        }
+        break;
+      case 0xF:
+        // XO-CHIP F000 nnnn
+        if (instruction.length == 4)
+        {
+          index = instruction.operand;
+          indexKnown = true;
+          break;
+        }
+        switch (opcode & 0x00FFu)
+        {
+        case 0x1E:
+        case 0x29:
+          indexKnown = false;
+          break;
+        case 0x33:
+        case 0x55:
+          if (!indexKnown)
+          {
+            analysis.uncertainties.push_back({UncertaintyKind::UnresolvedWrite, address});
+            break;
+          }
+          writes.push_back({address, index, static_cast<uint16_t>((opcode & 0x00FFu) == 0x33u ? 3 : x + 1)});
+          // the COSMAC VIP and XO-CHIP quirks leave I past the registers, the analysis does not know the quirks
+          if ((opcode & 0x00FFu) == 0x55u) indexKnown = false;
+          break;
+        case 0x65:
+          if (indexKnown)
+          {
+            for (size_t i = 0; i <= x; ++i)
+            {
+              if (analysis.contains(index + i)) analysis.byteFlags[index + i - baseAddress] |= ROM_BYTE_DATA;
+            }
+          }
+          indexKnown = false;
+          break;
+        default: ;
+        }
+        break;
+      default: ;
+      }
+
+      block.end = address + instruction.length;
+
+      if (instruction.exit != BlockExit::FallThrough)
+      {
+        block.exit = instruction.exit;
+        block.successors = instruction.successors;
+        break;
+      }
+
+      const uint16_t next = instruction.successors.front();
+      it = instructions.find(next);
+      if (it == instructions.end())
+      {
+        block.exit = BlockExit::Invalid;
+        break;
+      }
+      if (leaders.count(next))
+      {
+        block.successors = {next};
+        break;
+      }
+    }
+
+    analysis.blocks.push_back(std::move(block));
+  }
+
+  // only now do we know every code byte, so writes can be checked against them
+  for (const auto& [instruction, start, length] : writes)
+  {
+    bool hitsCode = false;
+    for (size_t i = 0; i < length; ++i)
+    {
+      if (!analysis.contains(start + i)) continue;
+      uint8_t& flags = analysis.byteFlags[start + i - baseAddress];
+      flags |= ROM_BYTE_WRITTEN;
+      hitsCode |= (flags & ROM_BYTE_CODE) != 0;
+    }
+    if (hitsCode) analysis.uncertainties.push_back({UncertaintyKind::SelfModifyingWrite, instruction});
+  }
+
+  analysis.subroutines.assign(subroutines.begin(), subroutines.end());
+  std::sort(analysis.uncertainties.begin(), analysis.uncertainties.end(),
+            [](const Uncertainty& a, const Uncertainty& b) { return a.address < b.address; });
+
+  return analysis;
+}
+
+const char* RomAnalyzer::toString(const UncertaintyKind kind)
+{
+  switch (kind)
+  {
+  case UncertaintyKind::ComputedJump:
+    return "computed jump";
+  case UncertaintyKind::SelfModifyingWrite:
+    return "self-modifying write";
+  case UncertaintyKind::UnresolvedWrite:
+    return "unresolved write";
+  case UncertaintyKind::OutOfRom:
+    return "out of rom";
+  }
+  return "unknown";
+}
+
+const char* RomAnalyzer::toString(const BlockExit exit)
+{
+  switch (exit)
+  {
+  case BlockExit::FallThrough:
+    return "fallthrough";
+  case BlockExit::Jump:
+    return "jump";
+  case BlockExit::Call:
+    return "call";
+  case BlockExit::Return:
+    return "return";
+  case BlockExit::Skip:
+    return "skip";
+  case BlockExit::ComputedJump:
+    return "computed jump";
+  case BlockExit::Halt:
+    return "halt";
+  case BlockExit::Invalid:
+    return "invalid";
+  }
+  return "unknown";
+}
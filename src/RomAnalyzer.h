@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Chip8.h"
+#include "PlatformVariant.h"
+#include "RomImage.h"
+
+// Every byte of the rom gets a combination of these flags, a byte that is never reached or referenced stays at 0
+// A byte can be both code and sprite (some roms draw their own instructions), that's why these are flags and not an enum
+enum RomByteFlag : uint8_t
+{
+  ROM_BYTE_CODE = 1u << 0u, // part of a reachable instruction
+  ROM_BYTE_SPRITE = 1u << 1u, // read by Dxyn with I set by a preceding Annn (or XO-CHIP F000 nnnn)
+  ROM_BYTE_DATA = 1u << 2u, // read by Fx65 or XO-CHIP 5xy3
+  ROM_BYTE_WRITTEN = 1u << 3u, // written by Fx33, Fx55 or XO-CHIP 5xy2
+};
+
+// the reason why the analyzer could not fully follow the program
+enum class UncertaintyKind : uint8_t
+{
+  ComputedJump, // Bnnn, the target depends on V0
+  SelfModifyingWrite, // Fx33/Fx55/5xy2 writing over bytes that are also code
+  UnresolvedWrite, // Fx33/Fx55/5xy2 with an I we could not track, it may write anywhere
+  OutOfRom, // control flow leaves the loaded image (or lands on a misaligned/truncated instruction)
+};
+
+struct Uncertainty
+{
+  UncertaintyKind kind;
+  // address of the instruction that caused it
+  uint16_t address;
+};
+
+// how a basic block ends
+enum class BlockExit : uint8_t
+{
+  FallThrough, // the next instruction is the start of another block (it is a jump target)
+  Jump, // 1nnn
+  Call, // 2nnn, successors are the subroutine and the return site
+  Return, // 00EE, successors are only known at run time
+  Skip, // 3xkk, 4xkk, 5xy0, 9xy0, Ex9E, ExA1
+  ComputedJump, // Bnnn
+  Halt, // jump to itself, most roms end this way
+  Invalid, // ran off the rom
+};
+
+struct BasicBlock
+{
+  // [start, end) in guest address space, end is the address right after the last instruction
+  uint16_t start;
+  uint16_t end;
+  BlockExit exit;
+  std::vector<uint16_t> successors;
+};
+
+struct RomAnalysis
+{
+  uint16_t baseAddress = STARTING_ADDRESS;
+  uint16_t entryPoint = STARTING_ADDRESS;
+  // one entry per rom byte, see RomByteFlag
+  std::vector<uint8_t> byteFlags;
+  // sorted by start address
+  std::vector<BasicBlock> blocks;
+  // addresses targeted by 2nnn
+  std::vector<uint16_t> subroutines;
+  std::vector<Uncertainty> uncertainties;
+
+  [[nodiscard]] bool contains(const size_t address) const
+  {
+    return address >= baseAddress && address < baseAddress + byteFlags.size();
+  }
+
+  [[nodiscard]] uint8_t flagsAt(const size_t address) const
+  {
+    return contains(address) ? byteFlags[address - baseAddress] : 0;
+  }
+
+  // index into blocks of the block starting at address, -1 if there is none
+  [[nodiscard]] int findBlock(uint16_t address) const;
+
+  // true when every reachable instruction is known ahead of time, meaning the rom can be fully translated
+  // before running it. Roms with computed jumps or self-modifying code still run, but need the interpreter.
+  [[nodiscard]] bool isFullyStatic() const
+  {
+    return uncertainties.empty();
+  }
+};
+
+// Walks the rom the same way the interpreter would, starting at the entry point and following jumps, calls and skips.
+// Nothing is executed, so anything that depends on register values is either tracked (I after Annn) or reported
+// as an uncertainty.
+class RomAnalyzer
+{
+public:
+  // variant decides the instruction lengths: for XO-CHIP, F000 nnnn is 4 bytes long, skips step over it whole and it
+  // sets I like Annn does
+  [[nodiscard]] static RomAnalysis analyze(const RomImage& rom, PlatformVariant variant = PlatformVariant::Chip8,
+                                           uint16_t baseAddress = STARTING_ADDRESS);
+
+  [[nodiscard]] static const char* toString(UncertaintyKind kind);
+  [[nodiscard]] static const char* toString(BlockExit exit);
+};
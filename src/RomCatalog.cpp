@@ -0,0 +1,259 @@
+#include "RomCatalog.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+#include "Chip8.h"
+#include "Hash.h"
+#include "RomAnalyzer.h"
+
+namespace
+{
+  constexpr char MAGIC[8] = {'C', '8', 'C', 'A', 'T', 'L', 'G', '\0'};
+  constexpr uint32_t INDEX_VERSION = 1;
+
+  struct RomCatalogHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t entryCount;
+    uint64_t stringTableSize;
+  };
+
+  struct RomCatalogRecord
+  {
+    uint64_t hash;
+    int64_t modified;
+    uint32_t size;
+    uint32_t pathOffset;
+    uint16_t pathLength;
+    uint8_t variant;
+    uint8_t padding[5];
+  };
+
+  int64_t modificationTime(const std::filesystem::path& path)
+  {
+    return std::filesystem::last_write_time(path).time_since_epoch().count();
+  }
+
+  bool hasRomExtension(const std::filesystem::path& path)
+  {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](const unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".ch8" || extension == ".c8" || extension == ".sc8" || extension == ".xo8";
+  }
+
+  bool isSuperChipOpcode(const uint16_t opcode)
+  {
+    if ((opcode & 0xFFF0u) == 0x00C0u && (opcode & 0x000Fu) != 0) return true; // 00Cn
+    if (opcode >= 0x00FBu && opcode <= 0x00FFu) return true; // 00FB - 00FF
+    if ((opcode & 0xF00Fu) == 0xD000u) return true; // Dxy0, 16x16 sprites
+    if ((opcode & 0xF000u) == 0xF000u)
+    {
+      const uint8_t low = opcode & 0x00FFu;
+      return low == 0x30u || low == 0x75u || low == 0x85u;
+    }
+    return false;
+  }
+
+  bool isXoChipOpcode(const uint16_t opcode)
+  {
+    if ((opcode & 0xFFF0u) == 0x00D0u) return true; // 00Dn, scroll up
+    if ((opcode & 0xF00Fu) == 0x5002u || (opcode & 0xF00Fu) == 0x5003u) return true; // 5xy2, 5xy3
+    if (opcode == 0xF000u || opcode == 0xF002u) return true; // long I, audio pattern
+    if ((opcode & 0xF0FFu) == 0xF001u || (opcode & 0xF0FFu) == 0xF03Au) return true; // Fn01, Fx3A
+    return false;
+  }
+}
+
+RomCatalog RomCatalog::scan(const std::filesystem::path& root)
+{
+  RomCatalog catalog;
+
+  const auto options = std::filesystem::directory_options::skip_permission_denied;
+  for (const auto& item : std::filesystem::recursive_directory_iterator(root, options))
+  {
+    if (!item.is_regular_file() || !hasRomExtension(item.path())) continue;
+
+    // one unreadable file (gone since the listing, no permission, not mappable) costs its entry, not the scan
+    try
+    {
+      const MappedFile file(item.path().string());
+      const RomImage rom(file.data(), file.size());
+
+      catalog.entries.push_back({
+        item.path().string(), file.size(), modificationTime(item.path()), fnv1a64(rom.data, rom.size),
+        detectVariant(rom, item.path())
+      });
+    }
+    catch (const std::exception& e)
+    {
+      catalog.skipped.push_back({item.path().string(), e.what()});
+    }
+  }
+
+  // directory iteration order is up to the file system, keep the index stable between scans
+  std::sort(catalog.entries.begin(), catalog.entries.end(),
+            [](const RomCatalogEntry& a, const RomCatalogEntry& b) { return a.path < b.path; });
+
+  return catalog;
+}
+
+RomCatalog RomCatalog::load(const std::filesystem::path& indexPath)
+{
+  const MappedFile file(indexPath.string());
+  const uint8_t* data = file.data();
+
+  if (file.size() < sizeof(RomCatalogHeader)) throw std::runtime_error("RomCatalog::load: Index too small");
+  RomCatalogHeader header{};
+  memcpy(&header, data, sizeof(header));
+
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != INDEX_VERSION)
+  {
+    throw std::runtime_error("RomCatalog::load: Not a rom catalog index");
+  }
+
+  const size_t stringsOffset = sizeof(RomCatalogHeader) + header.entryCount * sizeof(RomCatalogRecord);
+  if (stringsOffset + header.stringTableSize != file.size())
+  {
+    throw std::runtime_error("RomCatalog::load: Index truncated");
+  }
+
+  const auto* strings = reinterpret_cast<const char*>(data + stringsOffset);
+
+  RomCatalog catalog;
+  catalog.entries.reserve(header.entryCount);
+  for (size_t i = 0; i < header.entryCount; ++i)
+  {
+    RomCatalogRecord record{};
+    memcpy(&record, data + sizeof(RomCatalogHeader) + i * sizeof(RomCatalogRecord), sizeof(record));
+
+    if (record.pathOffset + record.pathLength > header.stringTableSize)
+    {
+      throw std::runtime_error("RomCatalog::load: Corrupted index");
+    }
+
+    catalog.entries.push_back({
+      std::string(strings + record.pathOffset, record.pathLength), record.size, record.modified, record.hash,
+      static_cast<PlatformVariant>(record.variant)
+    });
+  }
+
+  return catalog;
+}
+
+void RomCatalog::save(const std::filesystem::path& indexPath) const
+{
+  std::vector<RomCatalogRecord> records;
+  std::string strings;
+  records.reserve(entries.size());
+
+  for (const RomCatalogEntry& entry : entries)
+  {
+    RomCatalogRecord record{};
+    record.hash = entry.hash;
+    record.modified = entry.modified;
+    record.size = static_cast<uint32_t>(entry.size);
+    record.pathOffset = static_cast<uint32_t>(strings.size());
+    record.pathLength = static_cast<uint16_t>(entry.path.size());
+    record.variant = static_cast<uint8_t>(entry.variant);
+    records.push_back(record);
+    strings += entry.path;
+  }
+
+  RomCatalogHeader header{};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = INDEX_VERSION;
+  header.entryCount = static_cast<uint32_t>(records.size());
+  header.stringTableSize = strings.size();
+
+  // Written next to the index and renamed over it, a job reading the old index never sees half of the new one. The
+  // temporary name is unique per writer, two scans saving to the same index at once do not write into one file.
+  std::random_device device;
+  const std::filesystem::path temporary = indexPath.string() + ".tmp." + std::to_string(device());
+  std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) throw std::runtime_error("RomCatalog::save: Failed to open " + temporary.string());
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(records.data()),
+             static_cast<std::streamsize>(records.size() * sizeof(RomCatalogRecord)));
+  file.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+  file.close();
+
+  std::error_code error;
+  if (!file.fail()) std::filesystem::rename(temporary, indexPath, error);
+  if (file.fail() || error)
+  {
+    std::filesystem::remove(temporary, error);
+    throw std::runtime_error("RomCatalog::save: Failed to write " + indexPath.string());
+  }
+}
+
+PlatformVariant RomCatalog::detectVariant(const RomImage& rom, const std::filesystem::path& path)
+{
+  // anything that does not fit in the 4 KB address space can only be XO-CHIP
+  if (rom.size > RAM_SIZE - STARTING_ADDRESS) return PlatformVariant::XoChip;
+
+  // only look at instructions that are actually reachable, sprite data is full of bytes that look like opcodes
+  const RomAnalysis analysis = RomAnalyzer::analyze(rom);
+  bool superChip = false;
+
+  for (const BasicBlock& block : analysis.blocks)
+  {
+    for (size_t address = block.start; address < block.end; address += 2)
+    {
+      const size_t offset = address - analysis.baseAddress;
+      const uint16_t opcode = (static_cast<uint16_t>(rom[offset]) << 8u) | rom[offset + 1];
+
+      if (isXoChipOpcode(opcode)) return PlatformVariant::XoChip;
+      superChip |= isSuperChipOpcode(opcode);
+    }
+  }
+
+  if (superChip) return PlatformVariant::SuperChip;
+
+  // nothing in the code gave it away, fall back on the naming convention
+  const std::string extension = path.extension().string();
+  if (extension == ".xo8") return PlatformVariant::XoChip;
+  if (extension == ".sc8") return PlatformVariant::SuperChip;
+
+  return PlatformVariant::Chip8;
+}
+
+const char* RomCatalog::toString(const PlatformVariant variant)
+{
+  switch (variant)
+  {
+  case PlatformVariant::Chip8:
+    return "chip-8";
+  case PlatformVariant::SuperChip:
+    return "super-chip";
+  case PlatformVariant::XoChip:
+    return "xo-chip";
+  }
+  return "unknown";
+}
+
+const RomCatalogEntry* RomCatalog::find(const uint64_t hash) const
+{
+  const auto it = std::find_if(entries.begin(), entries.end(),
+                               [hash](const RomCatalogEntry& entry) { return entry.hash == hash; });
+  return it == entries.end() ? nullptr : &*it;
+}
+
+MappedFile RomCatalog::open(const RomCatalogEntry& entry)
+{
+  MappedFile file(entry.path);
+
+  if (file.size() != entry.size || modificationTime(entry.path) != entry.modified)
+  {
+    throw std::runtime_error("RomCatalog::open: " + entry.path + " changed since it was catalogued");
+  }
+
+  return file;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "PlatformVariant.h"
+#include "RomImage.h"
+
+struct RomCatalogEntry
+{
+  std::string path;
+  uint64_t size;
+  // last modification time when the entry was made, used to notice that the file changed since the scan
+  int64_t modified;
+  // fnv1a64 of the whole file
+  uint64_t hash;
+  PlatformVariant variant;
+};
+
+// a file scan() could not catalogue, with the reason
+struct RomCatalogSkip
+{
+  std::string path;
+  std::string reason;
+};
+
+// Index of every rom under a directory tree. Scanning reads each file once, after that a job only needs the index
+// file (mapped, no per-rom syscalls) to know what is there, and opening a rom is one mmap.
+//
+// Index layout: a header, one fixed size record per rom, then all the paths back to back.
+class RomCatalog
+{
+  std::vector<RomCatalogEntry> entries;
+  // only filled by scan(), not part of the index
+  std::vector<RomCatalogSkip> skipped;
+
+public:
+  // Recursive, only files with a known rom extension (.ch8, .c8, .sc8, .xo8) are picked up. A file that cannot be read
+  // is left out and listed by getSkipped() instead of failing the scan.
+  [[nodiscard]] static RomCatalog scan(const std::filesystem::path& root);
+  [[nodiscard]] static RomCatalog load(const std::filesystem::path& indexPath);
+  void save(const std::filesystem::path& indexPath) const;
+
+  [[nodiscard]] static PlatformVariant detectVariant(const RomImage& rom, const std::filesystem::path& path = {});
+  [[nodiscard]] static const char* toString(PlatformVariant variant);
+
+  [[nodiscard]] const std::vector<RomCatalogEntry>& getEntries() const
+  {
+    return entries;
+  }
+
+  [[nodiscard]] const std::vector<RomCatalogSkip>& getSkipped() const
+  {
+    return skipped;
+  }
+
+  // nullptr when no rom with this content hash was catalogued
+  [[nodiscard]] const RomCatalogEntry* find(uint64_t hash) const;
+
+  // Maps the rom of an entry, the RomImage handed to Chip8 then points straight into the mapping.
+  // Throws if the file changed since it was catalogued.
+  [[nodiscard]] static MappedFile open(const RomCatalogEntry& entry);
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Non-owning view of a rom image, whoever hands one out (a MappedFile, a vector, a fuzzer input...) keeps the bytes
+// alive. Chip8 copies it into guest ram once and never looks at it again.
+struct RomImage
+{
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+
+  RomImage() = default;
+
+  RomImage(const uint8_t* data, const size_t size): data(data), size(size)
+  {
+  }
+
+  // implicit on purpose so a vector can be passed wherever an image is expected
+  RomImage(const std::vector<uint8_t>& bytes): data(bytes.data()), size(bytes.size())
+  {
+  }
+
+  uint8_t operator[](const size_t offset) const
+  {
+    return data[offset];
+  }
+
+  [[nodiscard]] bool empty() const
+  {
+    return size == 0;
+  }
+};
@@ -0,0 +1,60 @@
+#include "RomWatcher.h"
+
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+RomWatcher::RomWatcher(const std::string& filePath)
+{
+#if !defined(__linux__)
+  throw std::runtime_error("RomWatcher: Watching files needs inotify");
+#else
+  const size_t slash = filePath.find_last_of('/');
+  const std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : filePath.substr(0, slash);
+  name = slash == std::string::npos ? filePath : filePath.substr(slash + 1);
+
+  descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (descriptor < 0) throw std::runtime_error("RomWatcher: Failed to initialize inotify");
+  if (inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+  {
+    ::close(descriptor);
+    throw std::runtime_error("RomWatcher: Failed to watch " + directory);
+  }
+#endif
+}
+
+RomWatcher::~RomWatcher()
+{
+#if defined(__linux__)
+  ::close(descriptor);
+#endif
+}
+
+bool RomWatcher::changed()
+{
+  bool found = false;
+#if defined(__linux__)
+  // enough for a few events with the longest names, whatever is left is read in the next round of the loop
+  alignas(inotify_event) char buffer[4 * (sizeof(inotify_event) + NAME_MAX + 1)];
+  for (;;)
+  {
+    const ssize_t length = read(descriptor, buffer, sizeof(buffer));
+    if (length < 0 && errno == EINTR) continue;
+    if (length <= 0) break;
+
+    for (ssize_t offset = 0; offset < length;)
+    {
+      const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+      if (event->len > 0 && name == event->name) found = true;
+      offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+    }
+  }
+#endif
+  return found;
+}
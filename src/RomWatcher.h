@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+
+// Tells when a rom file was saved, for the frontend to reload it without restarting. inotify watches the directory
+// rather than the file: editors and assemblers that write a temporary and rename it over the rom would otherwise end a
+// watch on the file itself. Linux only, the constructor throws elsewhere.
+class RomWatcher
+{
+  std::string name;
+  int descriptor = -1;
+
+public:
+  explicit RomWatcher(const std::string& filePath);
+  ~RomWatcher();
+  RomWatcher(const RomWatcher&) = delete;
+  RomWatcher& operator=(const RomWatcher&) = delete;
+
+  // true when the file was written or renamed into place since the last call, never blocks
+  bool changed();
+};
@@ -0,0 +1,129 @@
+#include "SharedExport.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+SharedExportWriter::SharedExportWriter(std::string name): name(std::move(name))
+{
+#if defined(_WIN32)
+  throw std::runtime_error("SharedExportWriter: Shared memory export needs a POSIX system");
+#else
+  const int descriptor = shm_open(this->name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+  if (descriptor < 0) throw std::runtime_error("SharedExportWriter: Failed to create " + this->name);
+
+  if (ftruncate(descriptor, sizeof(SharedExportLayout)) != 0)
+  {
+    ::close(descriptor);
+    shm_unlink(this->name.c_str());
+    throw std::runtime_error("SharedExportWriter: Failed to size " + this->name);
+  }
+
+  void* address = mmap(nullptr, sizeof(SharedExportLayout), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+  ::close(descriptor);
+  if (address == MAP_FAILED)
+  {
+    shm_unlink(this->name.c_str());
+    throw std::runtime_error("SharedExportWriter: Failed to map " + this->name);
+  }
+
+  // a segment left behind by a writer that crashed is reused, it starts over from nothing published
+  layout = new(address) SharedExportLayout{};
+  layout->magic = SHARED_EXPORT_MAGIC;
+  layout->version = SHARED_EXPORT_VERSION;
+  layout->size = sizeof(SharedExportLayout);
+  layout->writer.store(static_cast<uint32_t>(getpid()), std::memory_order_release);
+#endif
+}
+
+SharedExportWriter::~SharedExportWriter()
+{
+#if !defined(_WIN32)
+  layout->writer.store(0, std::memory_order_release);
+  munmap(layout, sizeof(SharedExportLayout));
+  // readers that already mapped the segment keep it until they unmap it
+  shm_unlink(name.c_str());
+#endif
+}
+
+void SharedExportWriter::publish(const Chip8& chip8)
+{
+  SharedExportState& state = layout->state;
+  const uint64_t sequence = layout->sequence.load(std::memory_order_relaxed);
+
+  layout->sequence.store(sequence + 1, std::memory_order_relaxed);
+  // the odd sequence must be visible before any of the state changes
+  std::atomic_thread_fence(std::memory_order_release);
+
+  ++state.frame;
+  state.programCounter = chip8.getProgramCounter();
+  state.index = chip8.getIndex();
+  for (size_t x = 0; x < 16; ++x)
+  {
+    state.registers[x] = chip8.getRegister(x);
+  }
+  state.delayTimer = chip8.getDelayTimer();
+  state.soundTimer = chip8.getSoundTimer();
+  state.variant = static_cast<uint8_t>(chip8.getVariant());
+  state.width = static_cast<uint32_t>(chip8.getWidth());
+  state.height = static_cast<uint32_t>(chip8.getHeight());
+  std::memcpy(state.pixels, chip8.getBuffer(), chip8.getWidth() * chip8.getHeight() * sizeof(uint32_t));
+
+  layout->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+SharedExportReader::SharedExportReader(const std::string& name)
+{
+#if defined(_WIN32)
+  throw std::runtime_error("SharedExportReader: Shared memory export needs a POSIX system");
+#else
+  const int descriptor = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (descriptor < 0) throw std::runtime_error("SharedExportReader: No segment named " + name);
+
+  void* address = mmap(nullptr, sizeof(SharedExportLayout), PROT_READ, MAP_SHARED, descriptor, 0);
+  ::close(descriptor);
+  if (address == MAP_FAILED) throw std::runtime_error("SharedExportReader: Failed to map " + name);
+  layout = static_cast<const SharedExportLayout*>(address);
+
+  if (layout->magic != SHARED_EXPORT_MAGIC || layout->version != SHARED_EXPORT_VERSION ||
+    layout->size != sizeof(SharedExportLayout))
+  {
+    munmap(address, sizeof(SharedExportLayout));
+    throw std::runtime_error("SharedExportReader: " + name + " is not a compatible Chip8 export");
+  }
+#endif
+}
+
+SharedExportReader::~SharedExportReader()
+{
+#if !defined(_WIN32)
+  munmap(const_cast<SharedExportLayout*>(layout), sizeof(SharedExportLayout));
+#endif
+}
+
+bool SharedExportReader::read(SharedExportState& state, const unsigned int attempts) const
+{
+  for (unsigned int attempt = 0; attempt < attempts; ++attempt)
+  {
+    const uint64_t before = layout->sequence.load(std::memory_order_acquire);
+    if (before == 0) return false;
+    if (before & 0x1u) continue;
+
+    std::memcpy(&state, &layout->state, sizeof(SharedExportState));
+
+    // the copy must be complete before sequence is read again
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (layout->sequence.load(std::memory_order_relaxed) == before) return true;
+  }
+  return false;
+}
+
+bool SharedExportReader::isLive() const
+{
+  return layout->writer.load(std::memory_order_acquire) != 0;
+}
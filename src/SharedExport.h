@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Chip8.h"
+
+// Publishes the state of a running Chip8 into a POSIX shared memory segment (shm_open), so that other processes can
+// watch it without linking the emulator: map the segment and read SharedExportLayout out of it.
+//
+// The segment is a seqlock. The writer makes sequence odd, writes the state, then makes it even again; a reader copies
+// the state out between two reads of sequence and keeps the copy only if both were the same even number. The writer
+// never waits for readers, a reader racing a publish simply copies again. SharedExportReader does exactly that.
+//
+// Not available on Windows, the constructors throw there.
+
+constexpr uint32_t SHARED_EXPORT_MAGIC = 0x48533843; // "C8SH"
+constexpr uint32_t SHARED_EXPORT_VERSION = 1;
+
+// the state as it is laid out in the segment, every field is fixed size so other languages can map it as well
+struct SharedExportState
+{
+  // frames published since the export was created, starting at 1
+  uint64_t frame;
+  uint16_t programCounter;
+  uint16_t index;
+  uint8_t registers[16];
+  uint8_t delayTimer;
+  uint8_t soundTimer;
+  // a PlatformVariant
+  uint8_t variant;
+  uint8_t reserved;
+  // the screen is width x height pixels at the start of pixels, RGBA8888 words, the rest is unused
+  uint32_t width;
+  uint32_t height;
+  uint32_t pixels[HIRES_GRAPHIC_WIDTH * HIRES_GRAPHIC_HEIGHT];
+};
+
+struct SharedExportLayout
+{
+  uint32_t magic;
+  uint32_t version;
+  // sizeof(SharedExportLayout), readers built against another layout refuse the segment
+  uint32_t size;
+  // process id of the writer, 0 once it unlinked the segment
+  std::atomic<uint32_t> writer;
+  // odd while a publish is in progress
+  std::atomic<uint64_t> sequence;
+  SharedExportState state;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the seqlock must work across processes");
+
+class SharedExportWriter
+{
+  std::string name;
+  SharedExportLayout* layout = nullptr;
+
+public:
+  // name is a shm_open name like "/chip8-1234", the segment is created (or taken over) and removed on destruction
+  explicit SharedExportWriter(std::string name);
+  ~SharedExportWriter();
+  SharedExportWriter(const SharedExportWriter&) = delete;
+  SharedExportWriter& operator=(const SharedExportWriter&) = delete;
+
+  // copies the state of chip8 into the segment as the next frame
+  void publish(const Chip8& chip8);
+};
+
+class SharedExportReader
+{
+  const SharedExportLayout* layout = nullptr;
+
+public:
+  // throws if the segment does not exist or was written by an incompatible version
+  explicit SharedExportReader(const std::string& name);
+  ~SharedExportReader();
+  SharedExportReader(const SharedExportReader&) = delete;
+  SharedExportReader& operator=(const SharedExportReader&) = delete;
+
+  // copies a consistent state into state, false if no consistent copy could be made in attempts tries (the writer
+  // publishing faster than the copy takes) or nothing was published yet
+  bool read(SharedExportState& state, unsigned int attempts = 100) const;
+  // false once the writer removed the segment, what was published last can still be read
+  [[nodiscard]] bool isLive() const;
+};
@@ -1,5 +1,7 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
+#include <stdexcept>
 
 #include "Register.h"
 
@@ -16,11 +18,36 @@ public:
   {
   }
 
+  Stack(const Stack& other): size(other.size), stack(new T[other.size]), stackPointer(other.stackPointer)
+  {
+    std::copy_n(other.stack, size, stack);
+  }
+
+  Stack& operator=(const Stack& other)
+  {
+    if (this == &other) return *this;
+    if (size != other.size)
+    {
+      delete[] stack;
+      stack = new T[other.size];
+    }
+    size = other.size;
+    std::copy_n(other.stack, size, stack);
+    stackPointer = other.stackPointer;
+
+    return *this;
+  }
+
   ~Stack()
   {
     delete[] stack;
   }
 
+  void clear()
+  {
+    stackPointer.setAddress(0);
+  }
+
   [[nodiscard]] bool isEmpty() const
   {
     return stackPointer.getAddress() == 0;
@@ -56,11 +83,18 @@ public:
     return size - stackPointer.getAddress();
   }
 
-  // [[nodiscard]] T get(const size_t index) const
-  // {
-  //   if (isEmpty()) throw std::out_of_range("Empty stack");
-  //   if (index >= stackPointer.getAddress()) throw std::out_of_range("Invalid index");
-  //
-  //   return stack[index];
-  // }
+  // number of values pushed
+  [[nodiscard]] size_t getDepth() const
+  {
+    return stackPointer.getAddress();
+  }
+
+  // the index-th value pushed, 0 being the oldest
+  [[nodiscard]] T get(const size_t index) const
+  {
+    if (isEmpty()) throw std::out_of_range("Empty stack");
+    if (index >= stackPointer.getAddress()) throw std::out_of_range("Invalid index");
+
+    return stack[index];
+  }
 };
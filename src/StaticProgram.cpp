@@ -0,0 +1,213 @@
+#include "StaticProgram.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Hash.h"
+
+namespace
+{
+  std::vector<const StaticProgram*>& registry()
+  {
+    // filled by the static registrations of the generated files, before main
+    static std::vector<const StaticProgram*> programs;
+    return programs;
+  }
+
+  // the registers and the screen, what tells two runs apart
+  uint64_t hashState(const Chip8& chip8)
+  {
+    uint8_t registers[16 + 2 + 2 + 2];
+    for (size_t x = 0; x < 16; ++x) registers[x] = chip8.getRegister(x);
+    registers[16] = static_cast<uint8_t>(chip8.getIndex() >> 8u);
+    registers[17] = static_cast<uint8_t>(chip8.getIndex());
+    registers[18] = static_cast<uint8_t>(chip8.getProgramCounter() >> 8u);
+    registers[19] = static_cast<uint8_t>(chip8.getProgramCounter());
+    registers[20] = chip8.getDelayTimer();
+    registers[21] = chip8.getSoundTimer();
+    return fnv1a64(chip8.getBuffer(), chip8.getWidth() * chip8.getHeight() * sizeof(uint32_t),
+                   fnv1a64(registers, sizeof(registers)));
+  }
+}
+
+void StaticState::load()
+{
+  for (size_t x = 0; x < V.size(); ++x) V[x] = machine->registers[x].getAddress();
+  I = machine->index.getAddress();
+  pc = machine->programCounter.getAddress();
+  delayTimer = machine->delayTimer.getAddress();
+  soundTimer = machine->soundTimer.getAddress();
+  frameCycle = machine->frameCycle;
+}
+
+void StaticState::store()
+{
+  for (size_t x = 0; x < V.size(); ++x) machine->registers[x] = V[x];
+  machine->index = I;
+  machine->programCounter = pc;
+  machine->delayTimer = delayTimer;
+  machine->soundTimer = soundTimer;
+  machine->frameCycle = frameCycle;
+}
+
+void StaticState::interpret()
+{
+  store();
+  inMachine = true;
+  machine->Cycle();
+  inMachine = false;
+  load();
+  --cycles;
+}
+
+void StaticState::call(const uint16_t target)
+{
+  machine->stack.push(pc);
+  pc = target;
+}
+
+uint16_t StaticState::ret()
+{
+  return machine->stack.pop();
+}
+
+bool StaticState::isPressed(const uint8_t key) const
+{
+  return machine->keypad.isPressed(key);
+}
+
+uint8_t StaticState::random()
+{
+  return machine->random.generateRandomValue();
+}
+
+uint8_t StaticState::read(const size_t address) const
+{
+  return machine->memory.readByte(address);
+}
+
+void StaticState::write(const size_t address, const uint8_t value)
+{
+  machine->memory.writeByte(address, value);
+}
+
+void StaticState::written(const size_t address, const size_t length)
+{
+  machine->redecode(address, length);
+}
+
+void StaticState::selectPlanes(const uint8_t mask)
+{
+  machine->planeMask = mask & decltype(machine->graphic)::ALL_PLANES;
+}
+
+const StaticProgram* StaticProgram::find(const RomImage& rom, const PlatformVariant variant, const QuirkPreset quirks)
+{
+  for (const StaticProgram* program : registry())
+  {
+    if (program->variant == variant && program->quirks == quirks && program->romSize == rom.size &&
+      std::equal(rom.data, rom.data + rom.size, program->rom))
+      return program;
+  }
+  return nullptr;
+}
+
+void StaticProgram::run(Chip8& chip8, const unsigned int cycles)
+{
+  const StaticBlock* blocks = chip8.staticProgram->blocks;
+  const std::vector<uint16_t>& bound = chip8.staticBlocks;
+  // a block only runs whole, the cycle count stays exact
+  const auto runnable = [&](const uint16_t address, const unsigned int left)
+  {
+    return address < bound.size() && bound[address] != 0 && blocks[bound[address] - 1].length <= left;
+  };
+
+  StaticState state{};
+  state.machine = &chip8;
+  state.blocks = bound.data();
+  state.load();
+  state.cycles = cycles;
+
+  try
+  {
+    while (state.cycles > 0)
+    {
+      if (runnable(state.pc, state.cycles))
+      {
+        blocks[bound[state.pc] - 1].run(state);
+        continue;
+      }
+
+      // the interpreter until the next block, without going through the flat state every cycle
+      state.store();
+      state.inMachine = true;
+      do
+      {
+        chip8.Cycle();
+        --state.cycles;
+      }
+      while (state.cycles > 0 && !runnable(chip8.programCounter.getAddress(), state.cycles));
+      state.inMachine = false;
+      state.load();
+    }
+  }
+  catch (...)
+  {
+    // the machine is where it failed if the interpreter threw, the flat state is if a block did
+    if (!state.inMachine) state.store();
+    throw;
+  }
+  state.store();
+}
+
+StaticProgramRegistration::StaticProgramRegistration(const StaticProgram& program)
+{
+  registry().push_back(&program);
+}
+
+int runStaticProgram(const int argc, char* argv[], const StaticProgram& program)
+{
+  unsigned long frames = 1800;
+  bool interpret = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (const std::string argument = argv[i]; argument == "--frames" && i + 1 < argc)
+      frames = std::strtoul(argv[++i], nullptr, 10);
+    else if (argument == "--interpret") interpret = true;
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [--frames <count>] [--interpret]\n"
+        << "  --frames     frames to run, 1800 (one minute) by default\n"
+        << "  --interpret  run the rom on the interpreter alone, to compare\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  try
+  {
+    Chip8 chip8(RomImage(program.rom, program.romSize), nullptr, program.variant, program.quirks);
+    chip8.seedRandom(0);
+    if (interpret) chip8.setStaticProgram(nullptr);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned long frame = 0; frame < frames; ++frame)
+    {
+      chip8.Run(CYCLES_PER_FRAME);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const uint64_t cycles = static_cast<uint64_t>(frames) * CYCLES_PER_FRAME;
+    std::cout << cycles << " instructions in " << frames << " frames, " << (interpret ? "interpreted" : "translated")
+      << ", " << static_cast<uint64_t>(static_cast<double>(cycles) / std::max(seconds, 1e-9)) << " instructions/s\n"
+      << "state " << std::hex << hashState(chip8) << std::dec << '\n';
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "Chip8.h"
+
+// Runtime side of the roms chip8-aot translated to C++ ahead of time. The tool cuts the rom into basic blocks with
+// RomAnalyzer and writes every block as a function over StaticState, a flat copy of the registers, so that a block is
+// straight-line native code with the timers advanced in one go. Memory, the stack, the keypad and the random generator
+// stay in the Chip8 and are reached through StaticState; what draws, the computed jumps (Bnnn) and the key waits
+// (Fx0A) are handed to the interpreter one instruction at a time (StaticState::interpret).
+//
+// The generated file registers its program, so a Chip8 of that exact rom, variant and quirk preset built in a binary
+// the file is linked into runs it from Chip8::Run. A block only runs while the ram under it still holds the bytes it
+// was translated from: a write over translated code (see Chip8::redecode) unbinds the blocks it overlaps, and the
+// interpreter runs that code from then on. The results are the ones of the interpreter, cycle for cycle.
+
+struct StaticProgram;
+
+// What the generated blocks run on. Only the registers live here, the rest of the machine stays in the Chip8.
+struct StaticState
+{
+  std::array<uint8_t, 16> V;
+  uint16_t I;
+  uint16_t pc;
+  uint8_t delayTimer;
+  uint8_t soundTimer;
+  unsigned int frameCycle;
+  // cycles left to run in this Chip8::Run
+  unsigned int cycles;
+
+  Chip8* machine;
+  // Chip8::staticBlocks, 1 + the index of the block bound at every address, 0 for none
+  const uint16_t* blocks;
+  // the machine holds the state while the interpreter runs
+  bool inMachine;
+
+  // what count cycles do besides their instructions: the frame cycle count and the timers
+  void tick(const unsigned int count)
+  {
+    cycles -= count;
+    frameCycle = (frameCycle + count) % CYCLES_PER_FRAME;
+    delayTimer = delayTimer > count ? static_cast<uint8_t>(delayTimer - count) : 0;
+    soundTimer = soundTimer > count ? static_cast<uint8_t>(soundTimer - count) : 0;
+  }
+
+  // whether the block starting at address still holds the translated code, the instruction before may have written it
+  [[nodiscard]] bool isBound(const uint16_t address) const
+  {
+    return blocks[address] != 0;
+  }
+
+  // runs the instruction at pc through Chip8::Cycle
+  void interpret();
+  // 2nnn, pc is the return address
+  void call(uint16_t target);
+  // 00EE, the address to return to
+  uint16_t ret();
+  [[nodiscard]] bool isPressed(uint8_t key) const;
+  uint8_t random();
+  [[nodiscard]] uint8_t read(size_t address) const;
+  void write(size_t address, uint8_t value);
+  // after the writes of one instruction, Chip8::redecode, which unbinds the blocks they went over
+  void written(size_t address, size_t length);
+  // XO-CHIP Fn01
+  void selectPlanes(uint8_t mask);
+
+  void load();
+  void store();
+};
+
+typedef void (*StaticBlockFunction)(StaticState& state);
+
+struct StaticBlock
+{
+  // [start, end) in guest address space
+  uint16_t start;
+  uint16_t end;
+  // instructions, only run when that many cycles are left
+  uint16_t length;
+  StaticBlockFunction run;
+};
+
+// One translated rom, as chip8-aot writes it
+struct StaticProgram
+{
+  const uint8_t* rom;
+  size_t romSize;
+  PlatformVariant variant;
+  QuirkPreset quirks;
+  // sorted by start address
+  const StaticBlock* blocks;
+  size_t blockCount;
+
+  // the registered program translated from this exact rom for this variant and quirk preset, nullptr if none
+  [[nodiscard]] static const StaticProgram* find(const RomImage& rom, PlatformVariant variant, QuirkPreset quirks);
+
+  // Chip8::Run with a program attached: the bound blocks, and the interpreter everywhere else
+  static void run(Chip8& chip8, unsigned int cycles);
+};
+
+// a static one in the generated file makes its program known to find()
+class StaticProgramRegistration
+{
+public:
+  explicit StaticProgramRegistration(const StaticProgram& program);
+};
+
+// main() of a rom translated with chip8-aot --main: runs it headless, prints the hashes to compare with the interpreter
+int runStaticProgram(int argc, char* argv[], const StaticProgram& program);
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "Opcode.h"
+
+// Superinstructions: runs of consecutive instructions that Chip8::Run executes with a single dispatch. Each pattern
+// is one line of FUSED_PATTERNS, the fused handler is generated from it (Chip8::makeFusedHandlers). They were picked
+// from the straight-line opcode pairs and triples chip8-profile --pairs counts on game loops; to add one, count, add
+// the line, and check that the corpus hashes do not move.
+//
+// A fused run behaves exactly like the same instructions run one Cycle() at a time, timers and the display wait
+// included. Only the last instruction of a pattern may jump, skip or write memory, so the instructions after the first
+// are always the ones that were matched. A jump into the middle of a pattern just runs from there: every address has
+// its own entry.
+enum FusedId : uint8_t
+{
+  FUSED_NONE,
+  // longest first, the first pattern that matches wins
+  FUSED_6xkk_6xkk_6xkk,
+  FUSED_6xkk_6xkk,
+  FUSED_Annn_Dxyn,
+  FUSED_Fx29_Dxyn,
+  FUSED_7xkk_3xkk,
+  FUSED_7xkk_4xkk,
+  FUSED_Annn_Fx65,
+  FUSED_COUNT
+};
+
+constexpr size_t FUSED_MAX_LENGTH = 3;
+
+struct FusedPattern
+{
+  uint8_t length;
+  OpcodeId ids[FUSED_MAX_LENGTH];
+};
+
+constexpr FusedPattern FUSED_PATTERNS[FUSED_COUNT] = {
+  {0, {}},
+  {3, {OPCODE_6xkk, OPCODE_6xkk, OPCODE_6xkk}},
+  {2, {OPCODE_6xkk, OPCODE_6xkk}},
+  {2, {OPCODE_Annn, OPCODE_Dxyn}},
+  {2, {OPCODE_Fx29, OPCODE_Dxyn}},
+  {2, {OPCODE_7xkk, OPCODE_3xkk}},
+  {2, {OPCODE_7xkk, OPCODE_4xkk}},
+  {2, {OPCODE_Annn, OPCODE_Fx65}},
+};
+
+// the pattern starting at decoded[0], count entries of which are valid, FUSED_NONE when none matches
+inline FusedId matchFused(const uint8_t* decoded, const size_t count)
+{
+  for (uint8_t pattern = FUSED_NONE + 1; pattern < FUSED_COUNT; ++pattern)
+  {
+    const FusedPattern& candidate = FUSED_PATTERNS[pattern];
+    if (2u * (candidate.length - 1u) >= count) continue;
+
+    bool matches = true;
+    for (size_t step = 0; step < candidate.length && matches; ++step)
+    {
+      matches = decoded[2 * step] == candidate.ids[step];
+    }
+    if (matches) return static_cast<FusedId>(pattern);
+  }
+  return FUSED_NONE;
+}
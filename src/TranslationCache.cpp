@@ -0,0 +1,279 @@
+#include "TranslationCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+
+#include "Hash.h"
+#include "Opcode.h"
+#include "RomCatalog.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  constexpr char MAGIC[8] = {'C', '8', 'T', 'R', 'A', 'N', 'S', '\0'};
+
+  uint64_t versionHash()
+  {
+    const uint64_t seed = fnv1a64(EMULATOR_VERSION, strlen(EMULATOR_VERSION));
+    return fnv1a64(&TRANSLATION_FORMAT_VERSION, sizeof(TRANSLATION_FORMAT_VERSION), seed);
+  }
+
+  // sections are 8-byte aligned so the records can be read in place
+  size_t align(const size_t offset)
+  {
+    return (offset + 7u) & ~static_cast<size_t>(7u);
+  }
+
+  struct Layout
+  {
+    size_t rom;
+    size_t decoded;
+    size_t byteFlags;
+    size_t blocks;
+    size_t subroutines;
+    size_t uncertainties;
+    size_t end;
+  };
+
+  Layout layoutOf(const size_t romSize, const size_t blockCount, const size_t subroutineCount,
+                  const size_t uncertaintyCount)
+  {
+    Layout layout{};
+    layout.rom = align(sizeof(TranslationCacheHeader));
+    layout.decoded = align(layout.rom + romSize);
+    layout.byteFlags = align(layout.decoded + romSize);
+    layout.blocks = align(layout.byteFlags + romSize);
+    layout.subroutines = align(layout.blocks + blockCount * sizeof(CachedBlock));
+    layout.uncertainties = align(layout.subroutines + subroutineCount * sizeof(uint16_t));
+    layout.end = align(layout.uncertainties + uncertaintyCount * sizeof(CachedUncertainty));
+    return layout;
+  }
+}
+
+bool CachedTranslation::bind(const uint8_t* data, const size_t size)
+{
+  if (size < sizeof(TranslationCacheHeader)) return false;
+  const auto* candidate = reinterpret_cast<const TranslationCacheHeader*>(data);
+
+  if (memcmp(candidate->magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+  if (candidate->formatVersion != TRANSLATION_FORMAT_VERSION) return false;
+  if (candidate->headerSize != sizeof(TranslationCacheHeader)) return false;
+  if (candidate->versionHash != versionHash()) return false;
+
+  const Layout layout = layoutOf(candidate->romSize, candidate->blockCount, candidate->subroutineCount,
+                                 candidate->uncertaintyCount);
+  if (layout.end != size || candidate->payloadSize != size - sizeof(TranslationCacheHeader)) return false;
+  if (fnv1a64(data + sizeof(TranslationCacheHeader), candidate->payloadSize) != candidate->payloadHash) return false;
+
+  header = candidate;
+  rom = data + layout.rom;
+  decoded = data + layout.decoded;
+  byteFlags = data + layout.byteFlags;
+  blocks = reinterpret_cast<const CachedBlock*>(data + layout.blocks);
+  subroutines = reinterpret_cast<const uint16_t*>(data + layout.subroutines);
+  uncertainties = reinterpret_cast<const CachedUncertainty*>(data + layout.uncertainties);
+
+  return true;
+}
+
+std::unique_ptr<CachedTranslation> CachedTranslation::open(const std::filesystem::path& path,
+                                                           const RomImage& rom)
+{
+  auto translation = std::make_unique<CachedTranslation>();
+
+  try
+  {
+    translation->file = MappedFile(path.string());
+  }
+  catch (const std::exception&)
+  {
+    return nullptr;
+  }
+
+  if (!translation->bind(translation->file.data(), translation->file.size())) return nullptr;
+
+  // the file name is only a hash, the image itself is stored in the entry so a collision can never hand out
+  // the wrong instructions
+  if (translation->header->romSize != rom.size || memcmp(translation->rom, rom.data, rom.size) != 0)
+  {
+    return nullptr;
+  }
+
+  return translation;
+}
+
+std::unique_ptr<CachedTranslation> CachedTranslation::fromBuffer(std::vector<uint8_t> data)
+{
+  auto translation = std::make_unique<CachedTranslation>();
+  translation->buffer = std::move(data);
+  if (!translation->bind(translation->buffer.data(), translation->buffer.size())) return nullptr;
+  return translation;
+}
+
+RomAnalysis CachedTranslation::toAnalysis() const
+{
+  RomAnalysis analysis;
+  analysis.baseAddress = header->baseAddress;
+  analysis.entryPoint = header->entryPoint;
+  analysis.byteFlags.assign(byteFlags, byteFlags + header->romSize);
+
+  analysis.blocks.reserve(header->blockCount);
+  for (size_t i = 0; i < header->blockCount; ++i)
+  {
+    const CachedBlock& block = blocks[i];
+    analysis.blocks.push_back({
+      block.start, block.end, static_cast<BlockExit>(block.exit),
+      std::vector<uint16_t>(block.successors, block.successors + block.successorCount)
+    });
+  }
+
+  analysis.subroutines.assign(subroutines, subroutines + header->subroutineCount);
+
+  for (size_t i = 0; i < header->uncertaintyCount; ++i)
+  {
+    analysis.uncertainties.push_back({
+      static_cast<UncertaintyKind>(uncertainties[i].kind), uncertainties[i].address
+    });
+  }
+
+  return analysis;
+}
+
+TranslationCache::TranslationCache(std::filesystem::path directory): directory(std::move(directory))
+{
+  std::error_code error;
+  std::filesystem::create_directories(this->directory, error);
+}
+
+uint64_t TranslationCache::keyOf(const RomImage& rom)
+{
+  return fnv1a64(rom.data, rom.size, versionHash());
+}
+
+std::filesystem::path TranslationCache::pathOf(const RomImage& rom) const
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.c8t", static_cast<unsigned long long>(keyOf(rom)));
+  return directory / name;
+}
+
+std::vector<uint8_t> TranslationCache::build(const RomImage& rom, const uint16_t baseAddress)
+{
+  // entries are per rom image, the variant it is analysed for is the one it looks like
+  const RomAnalysis analysis = RomAnalyzer::analyze(rom, RomCatalog::detectVariant(rom), baseAddress);
+  const Layout layout = layoutOf(rom.size, analysis.blocks.size(), analysis.subroutines.size(),
+                                 analysis.uncertainties.size());
+
+  std::vector<uint8_t> entry(layout.end, 0);
+
+  memcpy(entry.data() + layout.rom, rom.data, rom.size);
+
+  // an instruction can start on any address, so every one of them gets decoded
+  uint8_t* decoded = entry.data() + layout.decoded;
+  for (size_t offset = 0; offset < rom.size; ++offset)
+  {
+    const uint16_t opcode = (static_cast<uint16_t>(rom[offset]) << 8u) | (offset + 1 < rom.size ? rom[offset + 1] : 0);
+    decoded[offset] = decodeOpcode(opcode);
+  }
+
+  memcpy(entry.data() + layout.byteFlags, analysis.byteFlags.data(), analysis.byteFlags.size());
+
+  auto* blocks = reinterpret_cast<CachedBlock*>(entry.data() + layout.blocks);
+  for (const BasicBlock& block : analysis.blocks)
+  {
+    CachedBlock& cached = *blocks++;
+    cached.start = block.start;
+    cached.end = block.end;
+    cached.exit = static_cast<uint8_t>(block.exit);
+    cached.successorCount = static_cast<uint8_t>(block.successors.size());
+    for (size_t i = 0; i < block.successors.size() && i < 2; ++i) cached.successors[i] = block.successors[i];
+  }
+
+  memcpy(entry.data() + layout.subroutines, analysis.subroutines.data(),
+         analysis.subroutines.size() * sizeof(uint16_t));
+
+  auto* uncertainties = reinterpret_cast<CachedUncertainty*>(entry.data() + layout.uncertainties);
+  for (const auto& [kind, address] : analysis.uncertainties)
+  {
+    *uncertainties++ = {static_cast<uint8_t>(kind), 0, address};
+  }
+
+  TranslationCacheHeader header{};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.formatVersion = TRANSLATION_FORMAT_VERSION;
+  header.headerSize = sizeof(TranslationCacheHeader);
+  header.versionHash = versionHash();
+  header.romHash = fnv1a64(rom.data, rom.size);
+  header.payloadSize = static_cast<uint32_t>(layout.end - sizeof(TranslationCacheHeader));
+  header.baseAddress = analysis.baseAddress;
+  header.entryPoint = analysis.entryPoint;
+  header.romSize = static_cast<uint32_t>(rom.size);
+  header.blockCount = static_cast<uint32_t>(analysis.blocks.size());
+  header.subroutineCount = static_cast<uint32_t>(analysis.subroutines.size());
+  header.uncertaintyCount = static_cast<uint32_t>(analysis.uncertainties.size());
+  header.payloadHash = fnv1a64(entry.data() + sizeof(TranslationCacheHeader), header.payloadSize);
+  memcpy(entry.data(), &header, sizeof(header));
+
+  return entry;
+}
+
+void TranslationCache::store(const std::filesystem::path& path, const std::vector<uint8_t>& entry) const
+{
+#if !defined(_WIN32)
+  // whoever holds the lock is writing this entry right now, no point in doing it twice
+  const std::string lockPath = path.string() + ".lock";
+  const int lock = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (lock < 0) return;
+  if (flock(lock, LOCK_EX | LOCK_NB) != 0)
+  {
+    ::close(lock);
+    return;
+  }
+#endif
+
+  // unique temporary name per writer, the rename is atomic so a reader sees either no entry or a complete one
+  std::random_device device;
+  const std::filesystem::path temporary = path.string() + ".tmp." + std::to_string(device());
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(entry.data()), static_cast<std::streamsize>(entry.size()));
+    file.close();
+    if (!file.fail())
+    {
+      std::error_code error;
+      std::filesystem::rename(temporary, path, error);
+    }
+  }
+  std::error_code error;
+  std::filesystem::remove(temporary, error);
+
+#if !defined(_WIN32)
+  flock(lock, LOCK_UN);
+  ::close(lock);
+#endif
+}
+
+std::shared_ptr<const CachedTranslation> TranslationCache::load(const RomImage& rom,
+                                                                const uint16_t baseAddress) const
+{
+  const std::filesystem::path path = pathOf(rom);
+
+  if (auto translation = CachedTranslation::open(path, rom);
+    translation != nullptr && translation->getBaseAddress() == baseAddress)
+  {
+    return translation;
+  }
+
+  // missing or stale, rebuild it and hand out the in-memory copy, the next process will map the stored one
+  std::vector<uint8_t> entry = build(rom, baseAddress);
+  store(path, entry);
+  return CachedTranslation::fromBuffer(std::move(entry));
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "MappedFile.h"
+#include "RomAnalyzer.h"
+
+// bump this when the entry layout, OpcodeId or the analyzer output changes, old entries are then rebuilt
+constexpr uint32_t TRANSLATION_FORMAT_VERSION = 6;
+
+// Everything below is written to disk as is and read back through a memory mapping, so the records are plain
+// structs with explicit sizes. Entries are only meant to be read on the machine that wrote them.
+struct TranslationCacheHeader
+{
+  char magic[8];
+  uint32_t formatVersion;
+  uint32_t headerSize;
+  uint64_t versionHash;
+  uint64_t romHash;
+  // fnv1a64 over everything after the header, a truncated or corrupted entry fails this check
+  uint64_t payloadHash;
+  uint32_t payloadSize;
+  uint16_t baseAddress;
+  uint16_t entryPoint;
+  uint32_t romSize;
+  uint32_t blockCount;
+  uint32_t subroutineCount;
+  uint32_t uncertaintyCount;
+};
+
+struct CachedBlock
+{
+  uint16_t start;
+  uint16_t end;
+  uint8_t exit;
+  uint8_t successorCount;
+  uint16_t successors[2];
+};
+
+struct CachedUncertainty
+{
+  uint8_t kind;
+  uint8_t padding;
+  uint16_t address;
+};
+
+// One cache entry: the rom image it was built from, one predecoded OpcodeId per rom address, and the analyzer
+// output. All the accessors point straight into the mapped file (or into the buffer it was just built in).
+class CachedTranslation
+{
+  MappedFile file;
+  std::vector<uint8_t> buffer;
+
+  const TranslationCacheHeader* header = nullptr;
+  const uint8_t* rom = nullptr;
+  const uint8_t* decoded = nullptr;
+  const uint8_t* byteFlags = nullptr;
+  const CachedBlock* blocks = nullptr;
+  const uint16_t* subroutines = nullptr;
+  const CachedUncertainty* uncertainties = nullptr;
+
+  // checks the layout of the entry and sets up the pointers, false if it is not usable
+  bool bind(const uint8_t* data, size_t size);
+
+public:
+  // nullptr when the file does not hold a valid entry for this exact rom
+  static std::unique_ptr<CachedTranslation> open(const std::filesystem::path& path, const RomImage& rom);
+  static std::unique_ptr<CachedTranslation> fromBuffer(std::vector<uint8_t> data);
+
+  [[nodiscard]] uint16_t getBaseAddress() const
+  {
+    return header->baseAddress;
+  }
+
+  [[nodiscard]] size_t getRomSize() const
+  {
+    return header->romSize;
+  }
+
+  // OpcodeId for every address from the base address to the end of the rom
+  [[nodiscard]] const uint8_t* getDecoded() const
+  {
+    return decoded;
+  }
+
+  [[nodiscard]] const uint8_t* getByteFlags() const
+  {
+    return byteFlags;
+  }
+
+  [[nodiscard]] bool isFullyStatic() const
+  {
+    return header->uncertaintyCount == 0;
+  }
+
+  // copies the metadata back into the form RomAnalyzer produces
+  [[nodiscard]] RomAnalysis toAnalysis() const;
+};
+
+// Directory of translation entries, one file per rom image, named after a hash of the image and the emulator version.
+// Entries are written to a temporary file and renamed into place so readers never see a partial file, and a lock file
+// keeps several processes that start on the same new rom from all doing the work.
+class TranslationCache
+{
+  std::filesystem::path directory;
+
+  [[nodiscard]] static std::vector<uint8_t> build(const RomImage& rom, uint16_t baseAddress);
+  void store(const std::filesystem::path& path, const std::vector<uint8_t>& entry) const;
+
+public:
+  explicit TranslationCache(std::filesystem::path directory);
+
+  [[nodiscard]] static uint64_t keyOf(const RomImage& rom);
+
+  // Returns the entry for this rom image, loading it from disk when possible and building (and storing) it otherwise.
+  // Never fails because of the cache itself: if the directory is not writable the entry is simply kept in memory.
+  [[nodiscard]] std::shared_ptr<const CachedTranslation> load(const RomImage& rom,
+                                                              uint16_t baseAddress = STARTING_ADDRESS) const;
+
+  [[nodiscard]] std::filesystem::path pathOf(const RomImage& rom) const;
+};
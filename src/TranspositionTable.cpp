@@ -0,0 +1,57 @@
+#include "TranspositionTable.h"
+
+TranspositionTable::Shard& TranspositionTable::shardOf(const uint64_t hash)
+{
+  // the map buckets by the low bits, the shards take the high ones
+  return shards[hash >> 58u];
+}
+
+const TranspositionTable::Shard& TranspositionTable::shardOf(const uint64_t hash) const
+{
+  return shards[hash >> 58u];
+}
+
+size_t TranspositionTable::insert(const uint64_t hash, const size_t node)
+{
+  Shard& shard = shardOf(hash);
+  std::lock_guard lock(shard.mutex);
+  const auto [entry, inserted] = shard.nodes.emplace(hash, node);
+  if (!inserted && node < entry->second) entry->second = node;
+  return entry->second;
+}
+
+void TranspositionTable::assign(const uint64_t hash, const size_t node)
+{
+  Shard& shard = shardOf(hash);
+  std::lock_guard lock(shard.mutex);
+  shard.nodes[hash] = node;
+}
+
+std::optional<size_t> TranspositionTable::find(const uint64_t hash) const
+{
+  const Shard& shard = shardOf(hash);
+  std::lock_guard lock(shard.mutex);
+  const auto entry = shard.nodes.find(hash);
+  if (entry == shard.nodes.end()) return std::nullopt;
+  return entry->second;
+}
+
+size_t TranspositionTable::size() const
+{
+  size_t count = 0;
+  for (const Shard& shard : shards)
+  {
+    std::lock_guard lock(shard.mutex);
+    count += shard.nodes.size();
+  }
+  return count;
+}
+
+void TranspositionTable::clear()
+{
+  for (Shard& shard : shards)
+  {
+    std::lock_guard lock(shard.mutex);
+    shard.nodes.clear();
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+// The machine states a search has already reached, by Chip8::getStateHash, with the node that reached them. Safe to
+// use from several threads: the table is split into shards with a lock each, picked by the top bits of the hash, so
+// threads inserting different states seldom wait for one another.
+class TranspositionTable
+{
+  static constexpr size_t SHARD_COUNT = 64;
+
+  struct Shard
+  {
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, size_t> nodes;
+  };
+
+  std::array<Shard, SHARD_COUNT> shards;
+
+  [[nodiscard]] Shard& shardOf(uint64_t hash);
+  [[nodiscard]] const Shard& shardOf(uint64_t hash) const;
+
+public:
+  // Records node for hash, unless a smaller node is recorded already. Returns the node recorded, node itself when the
+  // state is new: with nodes numbered in the order they are found, the first one to reach a state keeps it whatever
+  // the order the threads insert in.
+  size_t insert(uint64_t hash, size_t node);
+  // records node for hash whatever was there
+  void assign(uint64_t hash, size_t node);
+  [[nodiscard]] std::optional<size_t> find(uint64_t hash) const;
+  [[nodiscard]] size_t size() const;
+  void clear();
+};
@@ -1,47 +1,287 @@
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <vector>
 
 #include "Chip8.h"
+#include "Debugger.h"
+#include "FramePacer.h"
+#include "FrameRecorder.h"
 #include "PlatformSDL.h"
+#include "RomCatalog.h"
+#include "RomWatcher.h"
+#include "SharedExport.h"
+#include "TranslationCache.h"
+
+namespace
+{
+  constexpr size_t SAVE_SLOTS = 4;
+  // frames of --run-ahead, each costs a frame of emulation every frame
+  constexpr unsigned long MAX_RUN_AHEAD = 8;
+
+  // registers and the next instructions, for the overlay of --debug
+  std::vector<std::string> debugOverlay(const Debugger& debugger)
+  {
+    const Chip8& chip8 = debugger.getChip8();
+    std::vector<std::string> lines{debugger.describeStop()};
+    char line[64];
+
+    std::snprintf(line, sizeof(line), "PC %04X  I %04X  DT %02X  ST %02X", chip8.getProgramCounter(),
+                  chip8.getIndex(), chip8.getDelayTimer(), chip8.getSoundTimer());
+    lines.emplace_back(line);
+    for (uint8_t row = 0; row < 4; ++row)
+    {
+      const uint8_t first = row * 4;
+      std::snprintf(line, sizeof(line), "V%X %02X  V%X %02X  V%X %02X  V%X %02X", first, chip8.getRegister(first),
+                    first + 1, chip8.getRegister(first + 1), first + 2, chip8.getRegister(first + 2), first + 3,
+                    chip8.getRegister(first + 3));
+      lines.emplace_back(line);
+    }
+
+    for (uint16_t i = 0; i < 5; ++i)
+    {
+      lines.push_back((i == 0 ? "> " : "  ") + debugger.disassemble(chip8.getProgramCounter() + 2 * i));
+    }
+    lines.emplace_back("F5 RUN/PAUSE  F10 STEP  F9 BREAK  F1 HIDE");
+    return lines;
+  }
+
+  // --watch: the rom was saved again, it restarts in the same machine (or goes on from state with the new code). A rom
+  // that fails to load is reported and the old one keeps running, the next save tries again.
+  void reloadRom(Chip8& chip8, const std::string& romFilename, const Chip8* state)
+  {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try
+    {
+      const MappedFile file(romFilename);
+      const RomImage rom(file.data(), file.size());
+      if (state != nullptr) chip8.restore(*state, &rom);
+      else chip8.reset(rom);
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << "Failed to reload " << romFilename << ": " << e.what() << '\n';
+      return;
+    }
+    std::cerr << "Reloaded " << romFilename << (state != nullptr ? " over the save state" : "") << " in "
+      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+  }
+}
 
 int main(const int argc, char* argv[])
 {
-  if (argc != 2)
+  std::string romFilename;
+  std::string cacheDirectory;
+  std::string quirksName;
+  std::string recordingFilename;
+  std::string recordingFormatName;
+  std::string exportName;
+  bool vsync = false;
+  bool pacingStatistics = false;
+  bool debug = false;
+  bool watch = false;
+  // 1 based, 0 to restart from the beginning on reload
+  size_t reloadSlot = 0;
+  unsigned long runAhead = 0;
+  bool validArguments = true;
+
+  for (int i = 1; i < argc; ++i)
   {
-    std::cerr << "Usage: " << argv[0] << " <ROM>\n";
-    std::exit(EXIT_FAILURE);
+    if (const std::string argument = argv[i]; argument == "--cache-dir" && i + 1 < argc) cacheDirectory = argv[++i];
+    else if (argument == "--quirks" && i + 1 < argc) quirksName = argv[++i];
+    else if (argument == "--record" && i + 1 < argc) recordingFilename = argv[++i];
+    else if (argument == "--record-format" && i + 1 < argc) recordingFormatName = argv[++i];
+    else if (argument == "--export" && i + 1 < argc) exportName = argv[++i];
+    else if (argument == "--vsync") vsync = true;
+    else if (argument == "--pacing-stats") pacingStatistics = true;
+    else if (argument == "--debug") debug = true;
+    else if (argument == "--watch") watch = true;
+    else if (argument == "--run-ahead" && i + 1 < argc)
+    {
+      runAhead = std::strtoul(argv[++i], nullptr, 10);
+      if (runAhead < 1 || runAhead > MAX_RUN_AHEAD) validArguments = false;
+    }
+    else if (argument == "--reload-slot" && i + 1 < argc)
+    {
+      reloadSlot = std::strtoul(argv[++i], nullptr, 10);
+      if (reloadSlot < 1 || reloadSlot > SAVE_SLOTS) validArguments = false;
+    }
+    else if (romFilename.empty()) romFilename = argument;
+    else validArguments = false;
+  }
+
+  // without --quirks the preset follows the platform the rom was written for
+  std::optional<QuirkPreset> quirks;
+  for (size_t preset = 0; preset < QUIRK_PRESET_COUNT; ++preset)
+  {
+    if (quirksName == QUIRK_PRESET_NAMES[preset]) quirks = static_cast<QuirkPreset>(preset);
   }
+  if (!quirksName.empty() && !quirks) validArguments = false;
+
+  // without --record-format, .y4m files are Y4M and anything else raw RGBA
+  RecordingFormat recordingFormat = RecordingFormat::Rgba;
+  if (recordingFormatName == "y4m" || (recordingFormatName.empty() && recordingFilename.size() >= 4 &&
+    recordingFilename.compare(recordingFilename.size() - 4, 4, ".y4m") == 0))
+    recordingFormat = RecordingFormat::Y4m;
+  else if (recordingFormatName == "rle") recordingFormat = RecordingFormat::RgbaRle;
+  else if (!recordingFormatName.empty() && recordingFormatName != "rgba") validArguments = false;
 
-  const std::string romFilename = argv[1];
+  if (!validArguments || romFilename.empty())
+  {
+    std::cerr << "Usage: " << argv[0] << " [--cache-dir <directory>] [--quirks original|vip|schip|xochip] [--vsync] "
+      << "[--pacing-stats] [--record <file> [--record-format y4m|rgba|rle]] "
+      << "[--export <shared memory name>] [--debug] [--watch [--reload-slot 1-" << SAVE_SLOTS << "]] "
+      << "[--run-ahead 1-" << MAX_RUN_AHEAD << "] <ROM>\n";
+    std::exit(EXIT_FAILURE);
+  }
 
   constexpr unsigned int SCALE = 15;
-  constexpr unsigned int CYCLES_PER_SECOND = 1082; // Emulated CPU cycles per second
-  constexpr unsigned int FRAME_RATE = 30;
 
 
   try
   {
-    Chip8 chip8(romFilename);
-    const PlatformSDL platform_sdl(GRAPHIC_WIDTH, GRAPHIC_HEIGHT, SCALE);
+    const std::unique_ptr<TranslationCache> cache =
+      cacheDirectory.empty() ? nullptr : std::make_unique<TranslationCache>(cacheDirectory);
+    // XO-CHIP roms need their own instructions and 64 KB of ram, everything else runs as CHIP-8 / SUPER-CHIP
+    const MappedFile file(romFilename);
+    const RomImage rom(file.data(), file.size());
+    const PlatformVariant variant = RomCatalog::detectVariant(rom, romFilename);
+    Chip8 chip8(rom, cache.get(), variant, quirks.value_or(quirkPresetFor(variant)));
+    const PlatformSDL platform_sdl(GRAPHIC_WIDTH, GRAPHIC_HEIGHT, SCALE, HIRES_GRAPHIC_WIDTH, HIRES_GRAPHIC_HEIGHT,
+                                   vsync);
+    FramePacer pacer(CYCLES_PER_SECOND, FRAME_RATE, vsync);
+    // recordings are always at the 128x64 resolution, the 64x32 screen is doubled
+    const std::unique_ptr<FrameRecorder> recorder = recordingFilename.empty()
+                                                      ? nullptr
+                                                      : std::make_unique<FrameRecorder>(
+                                                        recordingFilename, recordingFormat, HIRES_GRAPHIC_WIDTH,
+                                                        HIRES_GRAPHIC_HEIGHT, FRAME_RATE);
+    // for chip8-watch and other tools outside the process
+    const std::unique_ptr<SharedExportWriter> exporter =
+      exportName.empty() ? nullptr : std::make_unique<SharedExportWriter>(exportName);
+    // starts running with the overlay shown, F5 pauses
+    const std::unique_ptr<Debugger> debugger = debug ? std::make_unique<Debugger>(chip8) : nullptr;
+    bool overlay = debug;
+    // F6 saves into the selected slot, F7 loads it back, F8 selects the next one
+    std::array<std::unique_ptr<Chip8>, SAVE_SLOTS> slots;
+    size_t slot = 0;
+    // the window, the pacing and everything else live on across reloads
+    const std::unique_ptr<RomWatcher> watcher = watch ? std::make_unique<RomWatcher>(romFilename) : nullptr;
+    // --run-ahead: every frame the live machine is copied into this one, which runs the next frames with the keys held
+    // now and is shown instead; the live machine never rolls back, the copy is simply overwritten the next frame
+    const std::unique_ptr<Chip8> speculation = runAhead > 0 ? chip8.clone() : nullptr;
     bool quit = false;
 
     while (!quit)
     {
-      const uint32_t start_time = SDL_GetTicks();
+      FunctionKey functionKey = FunctionKey::None;
+      quit = PlatformSDL::ProcessInput(chip8.getKeypad(), &functionKey);
 
-      quit = PlatformSDL::ProcessInput(chip8.getKeypad());
+      if (watcher && watcher->changed())
+        reloadRom(chip8, romFilename, reloadSlot > 0 ? slots[reloadSlot - 1].get() : nullptr);
 
-      for (int i = 0; i < (CYCLES_PER_SECOND / FRAME_RATE); ++i)
+      switch (functionKey)
       {
-        chip8.Cycle();
+      case FunctionKey::SaveState:
+        slots[slot] = chip8.clone();
+        std::cerr << "Saved slot " << slot + 1 << '\n';
+        break;
+      case FunctionKey::LoadState:
+        if (slots[slot]) chip8.restore(*slots[slot]);
+        std::cerr << (slots[slot] ? "Loaded slot " : "Nothing saved in slot ") << slot + 1 << '\n';
+        break;
+      case FunctionKey::NextSlot:
+        slot = (slot + 1) % SAVE_SLOTS;
+        std::cerr << "Slot " << slot + 1 << '\n';
+        break;
+      default:
+        break;
       }
-      // Update Display at 60 Hz
-      platform_sdl.update(chip8.getBuffer(), sizeof(uint32_t) * GRAPHIC_WIDTH);
 
-      // Wait for the next frame if needed
-      if (const uint32_t frame_time = SDL_GetTicks() - start_time; frame_time < (1000 / FRAME_RATE))
+      const unsigned int cycles = pacer.beginFrame();
+      if (debugger)
+      {
+        const bool wasPaused = debugger->isPaused();
+        switch (functionKey)
+        {
+        case FunctionKey::Overlay:
+          overlay = !overlay;
+          break;
+        case FunctionKey::Continue:
+          if (wasPaused) debugger->resume();
+          else debugger->pause();
+          break;
+        case FunctionKey::Breakpoint:
+          if (const uint16_t address = chip8.getProgramCounter(); !debugger->clearBreakpoint(address))
+            debugger->setBreakpoint(address);
+          break;
+        case FunctionKey::Step:
+          debugger->pause();
+          debugger->step();
+          break;
+        default:
+          break;
+        }
+
+        debugger->run(cycles);
+        if (!wasPaused && debugger->isPaused()) std::cerr << debugger->describeStop() << '\n';
+      }
+      else
       {
-        SDL_Delay((1000 / FRAME_RATE) - frame_time);
+        chip8.Run(cycles);
       }
+
+      // the debugger shows the machine it stopped
+      const Chip8* shown = &chip8;
+      if (speculation && !(debugger && debugger->isPaused()))
+      {
+        speculation->restore(chip8);
+        speculation->getKeypad() = chip8.getKeypad();
+        try
+        {
+          speculation->Run(static_cast<unsigned int>(runAhead * CYCLES_PER_FRAME));
+          shown = speculation.get();
+        }
+        catch (const std::exception&)
+        {
+          // the live machine fails the same way once it gets there, until then it is shown as it is
+        }
+      }
+
+      const int width = static_cast<int>(shown->getWidth());
+      const std::vector<std::string> overlayLines = debugger && overlay
+                                                      ? debugOverlay(*debugger)
+                                                      : std::vector<std::string>{};
+      platform_sdl.update(shown->getBuffer(), width, static_cast<int>(shown->getHeight()),
+                          static_cast<int>(sizeof(uint32_t)) * width, overlayLines.empty() ? nullptr : &overlayLines);
+      // recordings and exports follow the live machine, speculated frames may never happen
+      if (recorder) recorder->capture(chip8.getBuffer(), chip8.getWidth(), chip8.getHeight());
+      if (exporter) exporter->publish(chip8);
+
+      // Wait for the next frame if needed
+      pacer.endFrame();
+    }
+
+    if (pacingStatistics)
+    {
+      const FramePacer::Statistics statistics = pacer.getStatistics();
+      std::cerr << statistics.frames << " frames, frame time p50 " << statistics.p50 << " ms, p90 " << statistics.p90
+        << " ms, p99 " << statistics.p99 << " ms, max " << statistics.max << " ms";
+      if (statistics.target > 0) std::cerr << ", target " << statistics.target << " ms";
+      std::cerr << ", " << statistics.resyncs << " resyncs\n";
+    }
+
+    if (recorder)
+    {
+      // the frames still waiting are written before the counts are final
+      recorder->finish();
+      if (recorder->hasFailed()) std::cerr << "Failed to write " << recordingFilename << '\n';
+      std::cerr << "Recorded " << recorder->getWritten() << " frames to " << recordingFilename << ", "
+        << recorder->getDropped() << " dropped\n";
     }
   }
   catch (const std::exception& e)
@@ -0,0 +1,194 @@
+#include <iomanip>
+#include <iostream>
+
+#include <optional>
+
+#include "RomAnalyzer.h"
+#include "RomCatalog.h"
+#include "TranslationCache.h"
+
+namespace
+{
+  void printUsage(const char* program)
+  {
+    std::cerr << "Usage: " << program << " [--dot] [--variant chip-8|super-chip|xo-chip] [--cache-dir <directory>] "
+      << "<ROM>\n"
+      << "  --dot        print the control-flow graph in graphviz format instead of the report\n"
+      << "  --variant    platform the rom is written for, detected from the rom by default\n"
+      << "  --cache-dir  reuse (or store) the analysis in this translation cache directory, always of the detected\n"
+      << "               variant\n";
+  }
+
+  std::ostream& hex(std::ostream& out, const unsigned int value, const int width = 3)
+  {
+    return out << "0x" << std::hex << std::uppercase << std::setw(width) << std::setfill('0') << value << std::dec;
+  }
+
+  // one character per rom byte, 64 bytes per line: C code, S sprite, D data, W written, * more than one, . unknown
+  void printByteMap(const RomAnalysis& analysis)
+  {
+    for (size_t offset = 0; offset < analysis.byteFlags.size(); ++offset)
+    {
+      if (offset % 64 == 0)
+      {
+        if (offset != 0) std::cout << '\n';
+        hex(std::cout, analysis.baseAddress + offset) << "  ";
+      }
+
+      switch (const uint8_t flags = analysis.byteFlags[offset])
+      {
+      case 0:
+        std::cout << '.';
+        break;
+      case ROM_BYTE_CODE:
+        std::cout << 'C';
+        break;
+      case ROM_BYTE_SPRITE:
+        std::cout << 'S';
+        break;
+      case ROM_BYTE_DATA:
+        std::cout << 'D';
+        break;
+      case ROM_BYTE_WRITTEN:
+        std::cout << 'W';
+        break;
+      default:
+        std::cout << ((flags & (flags - 1)) ? '*' : '?');
+      }
+    }
+    std::cout << '\n';
+  }
+
+  void printReport(const RomAnalysis& analysis)
+  {
+    size_t counts[4]{};
+    for (const uint8_t flags : analysis.byteFlags)
+    {
+      for (size_t bit = 0; bit < 4; ++bit)
+      {
+        if (flags & (1u << bit)) ++counts[bit];
+      }
+    }
+
+    std::cout << "rom size:      " << analysis.byteFlags.size() << " bytes\n"
+      << "code bytes:    " << counts[0] << '\n'
+      << "sprite bytes:  " << counts[1] << '\n'
+      << "data bytes:    " << counts[2] << '\n'
+      << "written bytes: " << counts[3] << '\n'
+      << "blocks:        " << analysis.blocks.size() << '\n'
+      << "subroutines:   " << analysis.subroutines.size() << '\n'
+      << "fully static:  " << (analysis.isFullyStatic() ? "yes" : "no") << "\n\n";
+
+    std::cout << "blocks:\n";
+    for (const BasicBlock& block : analysis.blocks)
+    {
+      std::cout << "  ";
+      hex(std::cout, block.start) << '-';
+      hex(std::cout, block.end) << "  " << RomAnalyzer::toString(block.exit);
+      for (const uint16_t successor : block.successors)
+      {
+        hex(std::cout << ' ', successor);
+      }
+      std::cout << '\n';
+    }
+
+    if (!analysis.uncertainties.empty())
+    {
+      std::cout << "\nuncertain:\n";
+      for (const auto& [kind, address] : analysis.uncertainties)
+      {
+        hex(std::cout << "  ", address) << "  " << RomAnalyzer::toString(kind) << '\n';
+      }
+    }
+
+    std::cout << "\nmap (C code, S sprite, D data, W written, * mixed, . unknown):\n";
+    printByteMap(analysis);
+  }
+
+  void printDot(const RomAnalysis& analysis)
+  {
+    std::cout << "digraph cfg {\n  node [shape=box fontname=monospace];\n";
+    for (const BasicBlock& block : analysis.blocks)
+    {
+      hex(std::cout << "  \"", block.start) << "\" [label=\"";
+      hex(std::cout, block.start) << '-';
+      hex(std::cout, block.end) << "\\n" << RomAnalyzer::toString(block.exit) << "\"];\n";
+      for (const uint16_t successor : block.successors)
+      {
+        hex(std::cout << "  \"", block.start) << "\" -> \"";
+        hex(std::cout, successor) << "\";\n";
+      }
+    }
+    std::cout << "}\n";
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  bool dot = false;
+  std::string romFilename;
+  std::string cacheDirectory;
+  std::optional<PlatformVariant> variant;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (const std::string argument = argv[i]; argument == "--dot") dot = true;
+    else if (argument == "--cache-dir" && i + 1 < argc) cacheDirectory = argv[++i];
+    else if (argument == "--variant" && i + 1 < argc)
+    {
+      const std::string name = argv[++i];
+      for (const PlatformVariant candidate :
+           {PlatformVariant::Chip8, PlatformVariant::SuperChip, PlatformVariant::XoChip})
+      {
+        if (name == RomCatalog::toString(candidate)) variant = candidate;
+      }
+      if (!variant)
+      {
+        std::cerr << "Unknown platform variant " << name << '\n';
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+    else if (romFilename.empty()) romFilename = argument;
+    else
+    {
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (romFilename.empty())
+  {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  MappedFile file;
+  try
+  {
+    file = MappedFile(romFilename);
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+  const RomImage rom(file.data(), file.size());
+
+  if (!variant) variant = RomCatalog::detectVariant(rom, romFilename);
+  // the ram of the variant, as the core loads it
+  if (rom.size > (*variant == PlatformVariant::XoChip ? XO_CHIP_RAM_SIZE : RAM_SIZE) - STARTING_ADDRESS)
+  {
+    std::cerr << "Rom too large for " << RomCatalog::toString(*variant) << '\n';
+    return EXIT_FAILURE;
+  }
+
+  const RomAnalysis analysis = cacheDirectory.empty()
+                                ? RomAnalyzer::analyze(rom, *variant)
+                                : TranslationCache(cacheDirectory).load(rom)->toAnalysis();
+
+  if (dot) printDot(analysis);
+  else printReport(analysis);
+
+  return 0;
+}
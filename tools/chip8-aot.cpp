@@ -0,0 +1,567 @@
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include "Chip8.h"
+#include "MappedFile.h"
+#include "RomAnalyzer.h"
+#include "RomCatalog.h"
+
+// Translates a rom ahead of time to C++ that links against the core, see src/StaticProgram.h for how it runs:
+//   chip8-aot --main -o game.cpp game.ch8
+//   c++ -std=c++17 -O2 -I src game.cpp libChip8Core.a -o game
+// Without --main the file only registers its program, and every Chip8 of that rom (same variant and quirk preset) in
+// the binary it is linked into runs it, chip8-corpus-static is built that way.
+
+namespace
+{
+  // a longer straight line is cut in several blocks, a block only runs when all of it fits in the cycles left
+  constexpr size_t MAX_BLOCK_LENGTH = 16;
+
+  // the quirks the translated instructions depend on, the others only matter to the screen, left to the interpreter
+  struct QuirkFlags
+  {
+    bool shiftVy;
+    bool advanceIndex;
+    bool resetFlag;
+  };
+
+  template <typename Quirks>
+  constexpr QuirkFlags flagsOf()
+  {
+    return {Quirks::shiftVy, Quirks::advanceIndex, Quirks::resetFlag};
+  }
+
+  // in the order of QuirkPreset
+  constexpr QuirkFlags QUIRK_FLAGS[QUIRK_PRESET_COUNT] = {
+    flagsOf<OriginalQuirks>(), flagsOf<CosmacVipQuirks>(), flagsOf<SuperChipQuirks>(), flagsOf<XoChipQuirks>()
+  };
+
+  constexpr const char* VARIANT_NAMES[] = {"PlatformVariant::Chip8", "PlatformVariant::SuperChip",
+    "PlatformVariant::XoChip"};
+  constexpr const char* QUIRK_PRESET_ENUM_NAMES[QUIRK_PRESET_COUNT] = {"QuirkPreset::Original",
+    "QuirkPreset::CosmacVip", "QuirkPreset::SuperChip", "QuirkPreset::XoChip"};
+
+  void printUsage(const char* program)
+  {
+    std::cerr << "Usage: " << program << " [--variant chip-8|super-chip|xo-chip] "
+      << "[--quirks original|vip|schip|xochip] [--main] [-o <file>] <ROM>\n"
+      << "  --variant  detected from the rom by default\n"
+      << "  --quirks   the usual preset of the variant by default\n"
+      << "  --main     add a main() running the rom headless, for a standalone binary\n"
+      << "  -o         write the C++ to file instead of stdout\n";
+  }
+
+  std::string hex(const unsigned int value, const int width = 4)
+  {
+    std::ostringstream text;
+    text << "0x" << std::hex << std::uppercase << std::setw(width) << std::setfill('0') << value;
+    return text.str();
+  }
+
+  std::string nibble(const unsigned int value)
+  {
+    return hex(value, 1);
+  }
+
+  // whether the instruction is translated to native code, the others run on the interpreter. The screen is left to it.
+  bool isNative(const OpcodeId id)
+  {
+    switch (id)
+    {
+    case OPCODE_NULL:
+    case OPCODE_00E0:
+    case OPCODE_00Cn:
+    case OPCODE_00Dn:
+    case OPCODE_00FB:
+    case OPCODE_00FC:
+    case OPCODE_00FE:
+    case OPCODE_00FF:
+    case OPCODE_Bnnn:
+    case OPCODE_Dxyn:
+    case OPCODE_Fx0A:
+    case OPCODE_F002:
+    case OPCODE_Fx3A:
+    case OPCODE_TRAP:
+      return false;
+    default:
+      return true;
+    }
+  }
+
+  bool isSkip(const OpcodeId id)
+  {
+    return id == OPCODE_3xkk || id == OPCODE_4xkk || id == OPCODE_5xy0 || id == OPCODE_9xy0 || id == OPCODE_Ex9E ||
+      id == OPCODE_ExA1;
+  }
+
+  // whether the instruction can throw (stack or memory out of range), the cycles before it are counted first
+  bool canThrow(const OpcodeId id)
+  {
+    switch (id)
+    {
+    case OPCODE_00EE:
+    case OPCODE_2nnn:
+    case OPCODE_5xy2:
+    case OPCODE_5xy3:
+    case OPCODE_Fx33:
+    case OPCODE_Fx55:
+    case OPCODE_Fx65:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // whether the instruction ends its block, what runs next is decided by it
+  bool isControlTransfer(const OpcodeId id)
+  {
+    switch (id)
+    {
+    case OPCODE_00EE:
+    case OPCODE_1nnn:
+    case OPCODE_2nnn:
+    case OPCODE_3xkk:
+    case OPCODE_4xkk:
+    case OPCODE_5xy0:
+    case OPCODE_9xy0:
+    case OPCODE_Bnnn:
+    case OPCODE_Ex9E:
+    case OPCODE_ExA1:
+    case OPCODE_Fx0A:
+    case OPCODE_F000:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  struct TranslatedBlock
+  {
+    uint16_t start;
+    uint16_t end;
+    uint16_t length;
+    std::string body;
+    // where the native code leaves to, known when translating
+    std::set<uint16_t> successors;
+  };
+
+  class Translator
+  {
+    const RomImage& rom;
+    PlatformVariant variant;
+    QuirkFlags quirks;
+    RomAnalysis analysis;
+    std::set<uint16_t> leaders;
+
+    [[nodiscard]] bool isTranslatable(const size_t address) const
+    {
+      // both bytes in the rom, and not written by the rom itself as far as the analysis can tell
+      return address >= STARTING_ADDRESS && address + 1 < STARTING_ADDRESS + rom.size &&
+        !((analysis.flagsAt(address) | analysis.flagsAt(address + 1)) & ROM_BYTE_WRITTEN);
+    }
+
+    [[nodiscard]] uint16_t wordAt(const size_t address) const
+    {
+      const size_t offset = address - STARTING_ADDRESS;
+      return static_cast<uint16_t>(rom[offset] << 8u | rom[offset + 1]);
+    }
+
+  public:
+    Translator(const RomImage& rom, const PlatformVariant variant, const QuirkPreset preset):
+      rom(rom), variant(variant), quirks(QUIRK_FLAGS[static_cast<size_t>(preset)]),
+      analysis(RomAnalyzer::analyze(rom, variant))
+    {
+      for (const BasicBlock& block : analysis.blocks) leaders.insert(block.start);
+    }
+
+    [[nodiscard]] const RomAnalysis& getAnalysis() const
+    {
+      return analysis;
+    }
+
+    // Every block from the leaders the analysis found and from where the translated ones leave to, a block also stops
+    // in front of the first instruction it leaves to the interpreter. The code only reached through computed jumps is
+    // not translated, the interpreter runs it.
+    [[nodiscard]] std::map<uint16_t, TranslatedBlock> translate() const
+    {
+      std::map<uint16_t, TranslatedBlock> blocks;
+      std::set<uint16_t> pending(leaders);
+      while (!pending.empty())
+      {
+        const uint16_t start = *pending.begin();
+        pending.erase(pending.begin());
+        if (blocks.count(start) || !isTranslatable(start)) continue;
+
+        TranslatedBlock block = translateBlock(start);
+        pending.insert(block.successors.begin(), block.successors.end());
+        blocks.emplace(start, std::move(block));
+      }
+      return blocks;
+    }
+
+    // The instructions from start to the first control transfer, the next leader or the first byte that cannot be
+    // translated. Native code for everything but the screen, which the interpreter draws.
+    [[nodiscard]] TranslatedBlock translateBlock(const uint16_t start) const
+    {
+      std::ostringstream body;
+      std::set<uint16_t> successors;
+      // cycles run since the timers were last advanced
+      unsigned int ticks = 0;
+      const auto flush = [&]
+      {
+        if (ticks > 0) body << "    s.tick(" << ticks << ");\n";
+        ticks = 0;
+      };
+
+      uint16_t address = start;
+      // past the last byte the block depends on, a skip also depends on what it skips
+      uint16_t end = start;
+      uint16_t length = 0;
+      bool ended = false;
+      while (!ended && length < MAX_BLOCK_LENGTH && isTranslatable(address) && (length == 0 || !leaders.count(address)))
+      {
+        const uint16_t opcode = wordAt(address);
+        const OpcodeId id = variant == PlatformVariant::XoChip ? decodeXoChipOpcode(opcode) : decodeOpcode(opcode);
+        const uint8_t x = (opcode & 0x0F00u) >> 8u;
+        const uint8_t y = (opcode & 0x00F0u) >> 4u;
+        const std::string kk = hex(opcode & 0x00FFu, 2);
+        const std::string nnn = hex(opcode & 0x0FFFu);
+        const std::string next = hex(address + 2);
+        const std::string Vx = "s.V[" + nibble(x) + "]";
+        const std::string Vy = "s.V[" + nibble(y) + "]";
+
+        // XO-CHIP: a skip steps over a whole F000 nnnn, and F000 reads the word after it
+        const bool readsNext = id == OPCODE_F000 || (variant == PlatformVariant::XoChip && isSkip(id));
+        const bool native = isNative(id) && (!readsNext || isTranslatable(address + 2));
+        const bool halts = id == OPCODE_1nnn && (opcode & 0x0FFFu) == address;
+        // the cycles before are counted first when the interpreter runs on the real timers, when the instruction
+        // may throw, and for the timer instructions, which see the timers as they are
+        if (!native || halts || canThrow(id) || id == OPCODE_Fx07 || id == OPCODE_Fx15 || id == OPCODE_Fx18) flush();
+
+        body << "    // " << hex(address) << ": " << hex(opcode).substr(2) << ' ' << OPCODE_NAMES[id] << '\n';
+        ++length;
+        end = static_cast<uint16_t>(address + (native && readsNext ? 4 : 2));
+        ended = isControlTransfer(id);
+
+        if (!native)
+        {
+          body << "    s.pc = " << hex(address) << ";\n    s.interpret();\n";
+          // Dxyn waiting for the display goes back to itself
+          if (!ended) body << "    if (s.pc != " << next << ") return;\n";
+          address += 2;
+          continue;
+        }
+
+        // the interpreter has the program counter past the instruction when one throws
+        if (canThrow(id)) body << "    s.pc = " << next << ";\n";
+        ++ticks;
+
+        const auto skip = [&](const std::string& condition)
+        {
+          const bool longNext = readsNext && wordAt(address + 2) == 0xF000u;
+          const uint16_t skipped = address + (longNext ? 6 : 4);
+          body << "    s.pc = " << condition << " ? " << hex(skipped) << " : " << next << ";\n";
+          successors.insert({skipped, static_cast<uint16_t>(address + 2)});
+          flush();
+        };
+        // after a write: the timers are brought up to date before leaving, in case it went over this block
+        const auto leaveIfUnbound = [&]
+        {
+          flush();
+          body << "    if (!s.isBound(" << hex(start) << ")) return;\n";
+        };
+        // XO-CHIP 5xy2/5xy3 go from x to y, downwards if x > y
+        const unsigned int rangeLength = (x > y ? x - y : y - x) + 1;
+        const auto inRange = [&](const unsigned int i)
+        {
+          return nibble(x > y ? x - i : x + i);
+        };
+
+        switch (id)
+        {
+        case OPCODE_00EE:
+          body << "    s.pc = s.ret();\n";
+          flush();
+          break;
+        case OPCODE_1nnn:
+          if (halts)
+          {
+            // a jump to itself spins until the cycles run out, which is all of them
+            body << "    s.pc = " << hex(address) << ";\n    s.tick(s.cycles);\n";
+            ticks = 0;
+          }
+          else
+          {
+            body << "    s.pc = " << nnn << ";\n";
+            flush();
+            successors.insert(opcode & 0x0FFFu);
+          }
+          break;
+        case OPCODE_2nnn:
+          body << "    s.call(" << nnn << ");\n";
+          flush();
+          // the return address too
+          successors.insert({static_cast<uint16_t>(opcode & 0x0FFFu), static_cast<uint16_t>(address + 2)});
+          break;
+        case OPCODE_3xkk:
+          skip(Vx + " == " + kk);
+          break;
+        case OPCODE_4xkk:
+          skip(Vx + " != " + kk);
+          break;
+        case OPCODE_5xy0:
+          skip(Vx + " == " + Vy);
+          break;
+        case OPCODE_9xy0:
+          skip(Vx + " != " + Vy);
+          break;
+        case OPCODE_Ex9E:
+          skip("s.isPressed(" + Vx + ")");
+          break;
+        case OPCODE_ExA1:
+          skip("!s.isPressed(" + Vx + ")");
+          break;
+        case OPCODE_5xy2:
+          for (unsigned int i = 0; i < rangeLength; ++i)
+            body << "    s.write(s.I + " << i << ", s.V[" << inRange(i) << "]);\n";
+          body << "    s.written(s.I, " << rangeLength << ");\n";
+          leaveIfUnbound();
+          break;
+        case OPCODE_5xy3:
+          for (unsigned int i = 0; i < rangeLength; ++i)
+            body << "    s.V[" << inRange(i) << "] = s.read(s.I + " << i << ");\n";
+          break;
+        case OPCODE_6xkk:
+          body << "    " << Vx << " = " << kk << ";\n";
+          break;
+        case OPCODE_7xkk:
+          body << "    " << Vx << " += " << kk << ";\n";
+          break;
+        case OPCODE_8xy0:
+          body << "    " << Vx << " = " << Vy << ";\n";
+          break;
+        case OPCODE_8xy1:
+        case OPCODE_8xy2:
+        case OPCODE_8xy3:
+          body << "    " << Vx << (id == OPCODE_8xy1 ? " |= " : id == OPCODE_8xy2 ? " &= " : " ^= ") << Vy << ";\n";
+          if (quirks.resetFlag) body << "    s.V[0xF] = 0;\n";
+          break;
+        // the same statements in the same order as the handlers, for when x or y is F
+        case OPCODE_8xy4:
+          body << "    {\n      const unsigned int sum = " << Vx << " + " << Vy << ";\n      s.V[0xF] = sum > 0xFF;\n      "
+            << Vx << " = static_cast<uint8_t>(sum);\n    }\n";
+          break;
+        case OPCODE_8xy5:
+          body << "    s.V[0xF] = " << Vx << " > " << Vy << ";\n    " << Vx << " -= " << Vy << ";\n";
+          break;
+        case OPCODE_8xy6:
+          if (quirks.shiftVy) body << "    " << Vx << " = " << Vy << ";\n";
+          body << "    s.V[0xF] = " << Vx << " & 0x1;\n    " << Vx << " >>= 1;\n";
+          break;
+        case OPCODE_8xy7:
+          body << "    s.V[0xF] = " << Vy << " > " << Vx << ";\n    " << Vx << " -= " << Vy << ";\n";
+          break;
+        case OPCODE_8xyE:
+          if (quirks.shiftVy) body << "    " << Vx << " = " << Vy << ";\n";
+          body << "    s.V[0xF] = " << Vx << " >> 7;\n    " << Vx << " <<= 1;\n";
+          break;
+        case OPCODE_Annn:
+          body << "    s.I = " << nnn << ";\n";
+          break;
+        case OPCODE_Cxkk:
+          body << "    " << Vx << " = " << kk << " & s.random();\n";
+          break;
+        case OPCODE_F000:
+          body << "    s.I = " << hex(wordAt(address + 2)) << ";\n    s.pc = " << hex(address + 4) << ";\n";
+          flush();
+          successors.insert(address + 4);
+          break;
+        case OPCODE_Fn01:
+          body << "    s.selectPlanes(" << nibble(x) << ");\n";
+          break;
+        case OPCODE_Fx07:
+          body << "    " << Vx << " = s.delayTimer;\n";
+          break;
+        case OPCODE_Fx15:
+        case OPCODE_Fx18:
+          body << "    s." << (id == OPCODE_Fx15 ? "delayTimer" : "soundTimer") << " = " << Vx << ";\n";
+          break;
+        case OPCODE_Fx1E:
+          body << "    s.I += " << Vx << ";\n";
+          break;
+        case OPCODE_Fx29:
+          body << "    s.I = FONT_SET_START_ADDRESS + 5 * " << Vx << ";\n";
+          break;
+        case OPCODE_Fx30:
+          body << "    s.I = LARGE_FONT_SET_START_ADDRESS + 10 * " << Vx << ";\n";
+          break;
+        case OPCODE_Fx33:
+          body << "    {\n      unsigned int value = " << Vx << ";\n      s.write(s.I + 2, value % 10);\n"
+            << "      value /= 10;\n      s.write(s.I + 1, value % 10);\n      value /= 10;\n"
+            << "      s.write(s.I, value % 10);\n    }\n    s.written(s.I, 3);\n";
+          leaveIfUnbound();
+          break;
+        case OPCODE_Fx55:
+          for (uint8_t i = 0; i <= x; ++i) body << "    s.write(s.I + " << +i << ", s.V[" << nibble(i) << "]);\n";
+          body << "    s.written(s.I, " << x + 1 << ");\n";
+          if (quirks.advanceIndex) body << "    s.I += " << x + 1 << ";\n";
+          leaveIfUnbound();
+          break;
+        case OPCODE_Fx65:
+          for (uint8_t i = 0; i <= x; ++i) body << "    s.V[" << nibble(i) << "] = s.read(s.I + " << +i << ");\n";
+          if (quirks.advanceIndex) body << "    s.I += " << x + 1 << ";\n";
+          break;
+        default: ;
+        }
+
+        address += 2;
+      }
+
+      if (!ended)
+      {
+        body << "    s.pc = " << hex(address) << ";\n";
+        flush();
+      }
+      if (!ended) successors.insert(address);
+      return {start, std::max(end, address), length, body.str(), successors};
+    }
+  };
+
+  void writeProgram(std::ostream& out, const std::string& romName, const RomImage& rom, const PlatformVariant variant,
+                    const QuirkPreset quirks, const std::map<uint16_t, TranslatedBlock>& blocks, const bool withMain)
+  {
+    out << "// Generated by chip8-aot from " << romName << " (" << RomCatalog::toString(variant) << ", "
+      << QUIRK_PRESET_NAMES[static_cast<size_t>(quirks)] << " quirks), do not edit.\n"
+      << "#include \"StaticProgram.h\"\n\nnamespace\n{\n  constexpr uint8_t ROM[] = {";
+    for (size_t i = 0; i < rom.size; ++i)
+    {
+      out << (i % 16 == 0 ? "\n    " : " ") << hex(rom[i], 2) << ',';
+    }
+    out << "\n  };\n";
+
+    for (const auto& [start, block] : blocks)
+    {
+      out << "\n  void block_" << hex(start).substr(2) << "(StaticState& s)\n  {\n" << block.body << "  }\n";
+    }
+
+    out << "\n  constexpr StaticBlock BLOCKS[] = {\n";
+    for (const auto& [start, block] : blocks)
+    {
+      out << "    {" << hex(block.start) << ", " << hex(block.end) << ", " << block.length << ", block_"
+        << hex(start).substr(2) << "},\n";
+    }
+    out << "  };\n\n"
+      << "  const StaticProgram PROGRAM{ROM, sizeof(ROM), " << VARIANT_NAMES[static_cast<size_t>(variant)] << ", "
+      << QUIRK_PRESET_ENUM_NAMES[static_cast<size_t>(quirks)] << ", BLOCKS, sizeof(BLOCKS) / sizeof(BLOCKS[0])};\n"
+      << "  const StaticProgramRegistration registration(PROGRAM);\n}\n";
+
+    if (withMain)
+    {
+      out << "\nint main(const int argc, char* argv[])\n{\n  return runStaticProgram(argc, argv, PROGRAM);\n}\n";
+    }
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  std::string romFilename;
+  std::string outputFilename;
+  std::optional<PlatformVariant> variant;
+  std::optional<QuirkPreset> quirks;
+  bool withMain = false;
+
+  try
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      if (const std::string argument = argv[i]; argument == "-o" && i + 1 < argc) outputFilename = argv[++i];
+      else if (argument == "--main") withMain = true;
+      else if (argument == "--variant" && i + 1 < argc)
+      {
+        const std::string name = argv[++i];
+        for (const PlatformVariant candidate : {PlatformVariant::Chip8, PlatformVariant::SuperChip,
+               PlatformVariant::XoChip})
+        {
+          if (name == RomCatalog::toString(candidate)) variant = candidate;
+        }
+        if (!variant) throw std::invalid_argument("Unknown platform variant " + name);
+      }
+      else if (argument == "--quirks" && i + 1 < argc)
+      {
+        const std::string name = argv[++i];
+        for (size_t preset = 0; preset < QUIRK_PRESET_COUNT; ++preset)
+        {
+          if (name == QUIRK_PRESET_NAMES[preset]) quirks = static_cast<QuirkPreset>(preset);
+        }
+        if (!quirks) throw std::invalid_argument("Unknown quirk preset " + name);
+      }
+      else if (romFilename.empty()) romFilename = argument;
+      else throw std::invalid_argument("Unexpected argument " + argument);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (romFilename.empty())
+  {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    const MappedFile file(romFilename);
+    const RomImage rom(file.data(), file.size());
+    if (rom.empty()) throw std::runtime_error("Empty rom " + romFilename);
+    if (!variant) variant = RomCatalog::detectVariant(rom, romFilename);
+    if (!quirks) quirks = quirkPresetFor(*variant);
+
+    const Translator translator(rom, *variant, *quirks);
+    const std::map<uint16_t, TranslatedBlock> blocks = translator.translate();
+
+    std::ostringstream program;
+    writeProgram(program, std::filesystem::path(romFilename).filename().string(), rom, *variant, *quirks, blocks,
+                 withMain);
+    if (outputFilename.empty()) std::cout << program.str();
+    else
+    {
+      // the build writes into a directory of its own, which may not exist yet
+      if (const std::filesystem::path directory = std::filesystem::path(outputFilename).parent_path();
+        !directory.empty())
+      {
+        std::filesystem::create_directories(directory);
+      }
+      std::ofstream output(outputFilename);
+      output << program.str();
+      if (!output) throw std::runtime_error("Failed to write " + outputFilename);
+    }
+
+    size_t instructions = 0;
+    for (const auto& [start, block] : blocks) instructions += block.length;
+    std::cerr << blocks.size() << " blocks, " << instructions << " instructions translated";
+    if (!translator.getAnalysis().isFullyStatic())
+    {
+      std::cerr << ", " << translator.getAnalysis().uncertainties.size()
+        << " places the analysis could not follow are left to the interpreter";
+    }
+    std::cerr << '\n';
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
@@ -0,0 +1,433 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "Chip8.h"
+#include "Graphic.h"
+#include "LockstepBatch.h"
+#include "Memory.h"
+#include "RandomGenerator.h"
+#include "Stack.h"
+
+// Microbenchmarks of the hot paths of the core. Every benchmark is a body doing a fixed number of operations; the
+// runner grows the number of times it is called until a run lasts --min-time, repeats that --repetitions times and
+// keeps the median, which is what gets reported (and written as JSON to compare two builds).
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  // keeps the compiler from dropping a result nobody reads
+  template <typename T>
+  void keep(const T& value)
+  {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  struct Benchmark
+  {
+    std::string name;
+    // operations done by one call of body
+    size_t operationsPerCall;
+    // guest instructions per operation, 0 when it does not run any
+    size_t instructionsPerOperation;
+    std::function<void()> body;
+  };
+
+  struct Result
+  {
+    std::string name;
+    uint64_t operations;
+    double nanosecondsPerOperation;
+    double instructionsPerSecond;
+  };
+
+  struct Options
+  {
+    std::string filter;
+    std::string jsonFile;
+    std::string romFilename;
+    double minTime = 0.2;
+    size_t repetitions = 5;
+  };
+
+  void printUsage(const char* program)
+  {
+    std::cerr << "Usage: " << program << " [--filter <text>] [--min-time <seconds>] [--repetitions <n>] "
+      << "[--json <file>] [--rom <ROM>]\n"
+      << "  --filter       only run the benchmarks whose name contains text\n"
+      << "  --min-time     shortest run measured, 0.2 s by default\n"
+      << "  --repetitions  runs per benchmark, the median is reported, 5 by default\n"
+      << "  --json         also write the results to file, - for stdout\n"
+      << "  --rom          run the frame loop benchmark on this rom instead of the built-in one\n";
+  }
+
+  // a rom that runs setup once and then loops over count copies of instruction forever
+  std::vector<uint8_t> loopRom(const std::vector<uint16_t>& setup, const uint16_t instruction, const size_t count = 256)
+  {
+    std::vector<uint8_t> rom;
+    const auto emit = [&rom](const uint16_t opcode)
+    {
+      rom.push_back(static_cast<uint8_t>(opcode >> 8u));
+      rom.push_back(static_cast<uint8_t>(opcode & 0xFFu));
+    };
+
+    for (const uint16_t opcode : setup) emit(opcode);
+    const uint16_t loop = STARTING_ADDRESS + rom.size();
+    for (size_t i = 0; i < count; ++i) emit(instruction);
+    emit(0x1000u | loop);
+    return rom;
+  }
+
+  // a small game-like loop: pick a random digit, draw it at a moving position, test a key, repeat
+  std::vector<uint8_t> frameRom()
+  {
+    return {
+      0x00, 0xE0, // 200: clear
+      0x61, 0x00, // 202: V1 = 0
+      0x62, 0x00, // 204: V2 = 0
+      0xC0, 0x0F, // 206: V0 = random digit
+      0xF0, 0x29, // 208: I = digit sprite
+      0xD1, 0x25, // 20A: draw at V1, V2
+      0x71, 0x05, // 20C: V1 += 5
+      0x72, 0x03, // 20E: V2 += 3
+      0xE3, 0x9E, // 210: skip if key V3
+      0x83, 0x14, // 212: V3 += V1
+      0x33, 0x00, // 214: skip if V3 == 0
+      0xF3, 0x1E, // 216: I += V3
+      0x12, 0x06  // 218: loop
+    };
+  }
+
+  void cycleBenchmark(std::vector<Benchmark>& benchmarks, const std::string& family, const std::vector<uint8_t>& rom)
+  {
+    auto chip8 = std::make_shared<Chip8>(RomImage(rom));
+    chip8->seedRandom(0);
+    benchmarks.push_back({"Chip8::Cycle/" + family, 1000, 1, [chip8]
+    {
+      for (size_t i = 0; i < 1000; ++i) chip8->Cycle();
+    }});
+  }
+
+  std::vector<Benchmark> makeBenchmarks(const Options& options)
+  {
+    std::vector<Benchmark> benchmarks;
+
+    // one opcode family at a time, the loop jump back is one instruction in 257
+    cycleBenchmark(benchmarks, "00E0", loopRom({}, 0x00E0u));
+    // call, jump over the subroutine, return
+    cycleBenchmark(benchmarks, "2nnn+00EE", {0x22, 0x04, 0x12, 0x00, 0x00, 0xEE});
+    cycleBenchmark(benchmarks, "1nnn", {0x12, 0x00});
+    cycleBenchmark(benchmarks, "3xkk", loopRom({}, 0x3001u));
+    cycleBenchmark(benchmarks, "6xkk", loopRom({}, 0x6A42u));
+    cycleBenchmark(benchmarks, "7xkk", loopRom({}, 0x7A01u));
+    cycleBenchmark(benchmarks, "8xy4", loopRom({0x6B07u}, 0x8AB4u));
+    cycleBenchmark(benchmarks, "8xy6", loopRom({}, 0x8A06u));
+    cycleBenchmark(benchmarks, "Annn", loopRom({}, 0xA123u));
+    cycleBenchmark(benchmarks, "Cxkk", loopRom({}, 0xCAFFu));
+    cycleBenchmark(benchmarks, "Dxy8", loopRom({0xA050u, 0x6A0Cu, 0x6B04u}, 0xDAB8u));
+    cycleBenchmark(benchmarks, "Ex9E", loopRom({}, 0xEA9Eu));
+    cycleBenchmark(benchmarks, "Fx1E", loopRom({0xA000u, 0x6A00u}, 0xFA1Eu));
+    // these write to ram, which decodes the bytes written again
+    cycleBenchmark(benchmarks, "Fx33", loopRom({0xAE00u, 0x6AFFu}, 0xFA33u));
+    cycleBenchmark(benchmarks, "Fx55", loopRom({0xAE00u}, 0xFF55u));
+    cycleBenchmark(benchmarks, "Fx65", loopRom({0xAE00u}, 0xFF65u));
+
+    // sprites: inside a word, across two words, spilling / wrapping / cut at the right edge
+    static const uint8_t SPRITE[32] = {
+      0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF, 0x3C, 0x42, 0x99, 0xA5, 0xA5, 0x99, 0x42, 0x3C,
+      0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF, 0x3C, 0x42, 0x99, 0xA5, 0xA5, 0x99, 0x42, 0x3C
+    };
+    struct SpriteCase
+    {
+      const char* name;
+      size_t x;
+      size_t y;
+      size_t rows;
+      size_t width;
+      SpriteEdge edge;
+      bool hires;
+    };
+    static const SpriteCase SPRITE_CASES[] = {
+      {"1row/aligned", 8, 4, 1, 8, SpriteEdge::Spill, false},
+      {"8rows/aligned", 8, 4, 8, 8, SpriteEdge::Spill, false},
+      {"15rows/aligned", 8, 4, 15, 8, SpriteEdge::Spill, false},
+      {"8rows/straddle", 60, 4, 8, 8, SpriteEdge::Spill, false},
+      {"8rows/spill", 62, 28, 8, 8, SpriteEdge::Spill, false},
+      {"8rows/wrap", 62, 28, 8, 8, SpriteEdge::Wrap, false},
+      {"8rows/clip", 62, 28, 8, 8, SpriteEdge::Clip, false},
+      {"16x16/hires", 60, 20, 16, 16, SpriteEdge::Clip, true},
+      {"16x16/hires-wrap", 120, 56, 16, 16, SpriteEdge::Wrap, true},
+    };
+    for (const SpriteCase& sprite : SPRITE_CASES)
+    {
+      auto graphic = std::make_shared<Graphic<uint32_t>>(GRAPHIC_WIDTH, GRAPHIC_HEIGHT, HIRES_GRAPHIC_WIDTH,
+                                                         HIRES_GRAPHIC_HEIGHT);
+      if (sprite.hires) graphic->setResolution(HIRES_GRAPHIC_WIDTH, HIRES_GRAPHIC_HEIGHT);
+      benchmarks.push_back({std::string("Graphic::drawSprite/") + sprite.name, 100, 0, [graphic, sprite]
+      {
+        for (size_t i = 0; i < 100; ++i)
+        {
+          bool collision;
+          switch (sprite.edge)
+          {
+          case SpriteEdge::Spill:
+            collision = graphic->drawSprite<SpriteEdge::Spill>(sprite.x, sprite.y, SPRITE, sprite.rows, sprite.width);
+            break;
+          case SpriteEdge::Clip:
+            collision = graphic->drawSprite<SpriteEdge::Clip>(sprite.x, sprite.y, SPRITE, sprite.rows, sprite.width);
+            break;
+          default:
+            collision = graphic->drawSprite<SpriteEdge::Wrap>(sprite.x, sprite.y, SPRITE, sprite.rows, sprite.width);
+          }
+          keep(collision);
+        }
+      }});
+    }
+
+    for (const bool hires : {false, true})
+    {
+      auto graphic = std::make_shared<Graphic<uint32_t>>(GRAPHIC_WIDTH, GRAPHIC_HEIGHT, HIRES_GRAPHIC_WIDTH,
+                                                         HIRES_GRAPHIC_HEIGHT);
+      if (hires) graphic->setResolution(HIRES_GRAPHIC_WIDTH, HIRES_GRAPHIC_HEIGHT);
+      const std::string resolution = hires ? "hires" : "lores";
+
+      benchmarks.push_back({"Graphic::Clear/" + resolution, 100, 0, [graphic]
+      {
+        for (size_t i = 0; i < 100; ++i)
+        {
+          graphic->Clear();
+          keep(graphic.get());
+        }
+      }});
+      // what presenting a frame costs: the planes are composited again after every change
+      benchmarks.push_back({"Graphic::getBuffer/" + resolution, 10, 0, [graphic]
+      {
+        for (size_t i = 0; i < 10; ++i)
+        {
+          graphic->drawSprite<SpriteEdge::Clip>(i, i, SPRITE, 8);
+          keep(graphic->getBuffer());
+        }
+      }});
+    }
+
+    auto memory = std::make_shared<Memory<uint8_t>>(RAM_SIZE);
+    for (size_t address = 0; address < RAM_SIZE; ++address) memory->writeByte(address, address * 7);
+    benchmarks.push_back({"Memory::readWord", 1000, 0, [memory]
+    {
+      for (size_t i = 0; i < 1000; ++i) keep(memory->readWord(STARTING_ADDRESS + 2 * i % 2048));
+    }});
+    benchmarks.push_back({"Memory::readBytes/15", 100, 0, [memory]
+    {
+      uint8_t bytes[15];
+      for (size_t i = 0; i < 100; ++i)
+      {
+        memory->readBytes(STARTING_ADDRESS + 17 * i, bytes, sizeof(bytes));
+        keep(bytes[0]);
+      }
+    }});
+    benchmarks.push_back({"Memory::readBytes/15/vector", 100, 0, [memory]
+    {
+      for (size_t i = 0; i < 100; ++i) keep(memory->readBytes(STARTING_ADDRESS + 17 * i, 15).data());
+    }});
+
+    auto stack = std::make_shared<Stack<uint16_t>>(STACK_SIZE);
+    benchmarks.push_back({"Stack::push+pop", 1000, 0, [stack]
+    {
+      for (size_t i = 0; i < 1000; ++i)
+      {
+        stack->push(static_cast<uint16_t>(i));
+        keep(stack->pop());
+      }
+    }});
+
+    auto random = std::make_shared<RandomGenerator<uint8_t>>(0, 255);
+    random->seed(0);
+    benchmarks.push_back({"RandomGenerator::generateRandomValue", 1000, 0, [random]
+    {
+      for (size_t i = 0; i < 1000; ++i) keep(random->generateRandomValue());
+    }});
+
+    // what the SDL frontend does per frame minus SDL: the cycles, then fetching the screen
+    std::shared_ptr<Chip8> chip8 = options.romFilename.empty()
+      ? std::make_shared<Chip8>(RomImage(frameRom()))
+      : std::make_shared<Chip8>(options.romFilename);
+    chip8->seedRandom(0);
+    benchmarks.push_back({"frame", 1, CYCLES_PER_FRAME, [chip8]
+    {
+      chip8->Run(CYCLES_PER_FRAME);
+      keep(chip8->getBuffer());
+    }});
+    // the same frame without superinstructions, one dispatch per instruction
+    benchmarks.push_back({"frame/Cycle", 1, CYCLES_PER_FRAME, [chip8]
+    {
+      for (unsigned int i = 0; i < CYCLES_PER_FRAME; ++i) chip8->Cycle();
+      keep(chip8->getBuffer());
+    }});
+
+    // LockstepBatch, per lane instruction: lanes that stay together on the vector path, and the frame rom, where the
+    // random digits send the lanes their own way at every skip
+    for (const size_t lanes : {8, 64})
+    {
+      auto together = std::make_shared<LockstepBatch>(RomImage(loopRom({0x6B07u}, 0x8AB4u)), lanes);
+      benchmarks.push_back({"LockstepBatch::step/8xy4/" + std::to_string(lanes), 100 * lanes, 1, [together]
+      {
+        together->run(100);
+      }});
+      auto apart = std::make_shared<LockstepBatch>(RomImage(frameRom()), lanes);
+      for (size_t lane = 0; lane < lanes; ++lane) apart->seedRandom(lane, lane);
+      benchmarks.push_back({"LockstepBatch::step/frame/" + std::to_string(lanes), CYCLES_PER_FRAME * lanes, 1, [apart]
+      {
+        apart->run(CYCLES_PER_FRAME);
+        keep(apart->getBuffer(0));
+      }});
+    }
+
+    // save states: a new copy, and copying into one that exists (what run-ahead does every frame)
+    benchmarks.push_back({"Chip8::clone", 1, 0, [chip8]
+    {
+      keep(chip8->clone().get());
+    }});
+    std::shared_ptr<Chip8> state = chip8->clone();
+    benchmarks.push_back({"Chip8::restore", 1, 0, [chip8, state]
+    {
+      state->restore(*chip8);
+      keep(state.get());
+    }});
+
+    return benchmarks;
+  }
+
+  Result run(const Benchmark& benchmark, const Options& options)
+  {
+    const auto time = [&benchmark](const uint64_t calls)
+    {
+      const Clock::time_point start = Clock::now();
+      for (uint64_t call = 0; call < calls; ++call) benchmark.body();
+      return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    // grow the call count until a run lasts long enough to be measured
+    uint64_t calls = 1;
+    for (double seconds = time(calls); seconds < options.minTime; seconds = time(calls))
+    {
+      const double factor = seconds > 0 ? std::min(options.minTime * 1.2 / seconds, 10.0) : 10.0;
+      calls = std::max<uint64_t>(calls + 1, static_cast<uint64_t>(calls * factor));
+    }
+
+    std::vector<double> samples;
+    for (size_t repetition = 0; repetition < options.repetitions; ++repetition)
+    {
+      samples.push_back(time(calls) * 1e9 / static_cast<double>(calls * benchmark.operationsPerCall));
+    }
+    std::sort(samples.begin(), samples.end());
+    const double median = samples[samples.size() / 2];
+
+    return {
+      benchmark.name, calls * benchmark.operationsPerCall, median,
+      benchmark.instructionsPerOperation * 1e9 / median
+    };
+  }
+
+  void printResult(const Result& result)
+  {
+    std::cout << std::left << std::setw(44) << result.name << std::right << std::fixed << std::setprecision(2)
+      << std::setw(12) << result.nanosecondsPerOperation << " ns/op";
+    if (result.instructionsPerSecond > 0)
+    {
+      std::cout << std::setw(12) << result.instructionsPerSecond / 1e6 << " M instructions/s";
+    }
+    std::cout << std::defaultfloat << '\n';
+  }
+
+  void writeJson(std::ostream& out, const std::vector<Result>& results)
+  {
+    const std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    out << "{\n"
+      << "  \"context\": {\n"
+      << "    \"emulator_version\": \"" << EMULATOR_VERSION << "\",\n"
+      << "    \"date\": \"" << date << "\",\n"
+#ifdef __VERSION__
+      << "    \"compiler\": \"" << __VERSION__ << "\",\n"
+#endif
+#ifdef NDEBUG
+      << "    \"assertions\": false\n"
+#else
+      << "    \"assertions\": true\n"
+#endif
+      << "  },\n"
+      << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+      const Result& result = results[i];
+      out << "    {\"name\": \"" << result.name << "\", \"operations\": " << result.operations
+        << ", \"ns_per_op\": " << result.nanosecondsPerOperation
+        << ", \"ops_per_second\": " << 1e9 / result.nanosecondsPerOperation
+        << ", \"instructions_per_second\": " << result.instructionsPerSecond << '}'
+        << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  Options options;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string argument = argv[i];
+    if (argument == "--filter" && i + 1 < argc) options.filter = argv[++i];
+    else if (argument == "--min-time" && i + 1 < argc) options.minTime = std::atof(argv[++i]);
+    else if (argument == "--repetitions" && i + 1 < argc) options.repetitions = std::max(1, std::atoi(argv[++i]));
+    else if (argument == "--json" && i + 1 < argc) options.jsonFile = argv[++i];
+    else if (argument == "--rom" && i + 1 < argc) options.romFilename = argv[++i];
+    else
+    {
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<Result> results;
+  try
+  {
+    for (const Benchmark& benchmark : makeBenchmarks(options))
+    {
+      if (benchmark.name.find(options.filter) == std::string::npos) continue;
+      results.push_back(run(benchmark, options));
+      // with JSON on stdout the table would get in the way
+      if (options.jsonFile != "-") printResult(results.back());
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  if (options.jsonFile == "-")
+  {
+    writeJson(std::cout, results);
+  }
+  else if (!options.jsonFile.empty())
+  {
+    std::ofstream out(options.jsonFile);
+    writeJson(out, results);
+    if (!out)
+    {
+      std::cerr << "Failed to write " << options.jsonFile << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  return 0;
+}
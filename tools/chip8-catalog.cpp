@@ -0,0 +1,66 @@
+#include <iomanip>
+#include <iostream>
+
+#include "RomCatalog.h"
+
+namespace
+{
+  void printUsage(const char* program)
+  {
+    std::cerr << "Usage: " << program << " scan <ROM directory> <index file>\n"
+      << "       " << program << " list <index file>\n";
+  }
+
+  void printCatalog(const RomCatalog& catalog)
+  {
+    for (const RomCatalogEntry& entry : catalog.getEntries())
+    {
+      std::cout << std::hex << std::setw(16) << std::setfill('0') << entry.hash << std::dec << std::setfill(' ')
+        << "  " << std::setw(10) << std::left << RomCatalog::toString(entry.variant) << std::right
+        << std::setw(6) << entry.size << "  " << entry.path << '\n';
+    }
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  if (argc < 3)
+  {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const std::string command = argv[1];
+
+  try
+  {
+    if (command == "scan" && argc == 4)
+    {
+      const RomCatalog catalog = RomCatalog::scan(argv[2]);
+      for (const RomCatalogSkip& skip : catalog.getSkipped())
+      {
+        std::cerr << "Skipped " << skip.path << ": " << skip.reason << '\n';
+      }
+      catalog.save(argv[3]);
+      std::cout << catalog.getEntries().size() << " roms catalogued in " << argv[3];
+      if (!catalog.getSkipped().empty()) std::cout << ", " << catalog.getSkipped().size() << " skipped";
+      std::cout << '\n';
+    }
+    else if (command == "list" && argc == 3)
+    {
+      printCatalog(RomCatalog::load(argv[2]));
+    }
+    else
+    {
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
@@ -0,0 +1,495 @@
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "Chip8.h"
+#include "Hash.h"
+#include "LockstepBatch.h"
+#include "RomCatalog.h"
+
+// Runs the roms of a corpus manifest headless for a fixed number of frames with scripted input, checks the screen
+// against golden hashes at checkpoints and reports how fast each one ran. One line per rom in the manifest:
+//
+//   <name> <rom> <variant> <quirks> <frames> <input> <frame>:<hash>...
+//
+// The rom path is relative to the manifest. variant is chip-8, super-chip or xo-chip and quirks one of
+// QUIRK_PRESET_NAMES. input is - or a comma separated list of <frame>+<key> (press) and <frame>-<key> (release), both
+// in hex for the key, applied before that frame runs. A checkpoint hashes the screen after that many frames. The last
+// checkpoint may be <frame>:fault instead, for a rom that has to fail during that frame the way the interpreter reports
+// the rom's errors (an address out of range, stack misuse), the run stops there. Lines starting with # are comments.
+//
+// Throughput is checked against a baseline written by --write-baseline on the same machine, there is no point in
+// comparing instructions per second across machines.
+//
+// With --lockstep <lanes> the CHIP-8 roms with the original quirks run on a LockstepBatch instead, checked lane by lane
+// against as many Chip8 objects after every frame. Lane l is seeded with l and gets the input l frames late, so the
+// lanes split up and the scalar path gets exercised next to the vector one. Lane 0 runs the entry as written and is
+// also checked against the golden hashes.
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  struct InputEvent
+  {
+    unsigned int frame;
+    uint8_t key;
+    bool pressed;
+  };
+
+  struct Checkpoint
+  {
+    unsigned int frame;
+    uint64_t hash;
+  };
+
+  struct CorpusEntry
+  {
+    std::string name;
+    std::filesystem::path rom;
+    PlatformVariant variant;
+    QuirkPreset quirks;
+    unsigned int frames;
+    std::vector<InputEvent> input;
+    std::vector<Checkpoint> checkpoints;
+    // the frame the rom has to fail in, 0 for none
+    unsigned int faultFrame = 0;
+  };
+
+  struct Options
+  {
+    std::string manifest;
+    std::string only;
+    std::string baselineFile;
+    std::string writeBaselineFile;
+    double tolerance = 0.25;
+    size_t repeat = 5;
+    bool printGolden = false;
+    bool requireStatic = false;
+    size_t lockstepLanes = 0;
+  };
+
+  void printUsage(const char* program)
+  {
+    std::cerr << "Usage: " << program << " <manifest> [--only <name>] [--repeat <n>] [--baseline <file>] "
+      << "[--tolerance <fraction>] [--write-baseline <file>] [--print-golden] [--require-static] [--lockstep <lanes>]\n"
+      << "  --only            run a single rom of the manifest\n"
+      << "  --repeat          runs per rom, the fastest is reported, 5 by default\n"
+      << "  --baseline        fail when a rom runs slower than in this file by more than the tolerance\n"
+      << "  --tolerance       slowdown allowed against the baseline, 0.25 by default\n"
+      << "  --write-baseline  write the instructions per second of every rom run to file\n"
+      << "  --print-golden    print the manifest lines with the hashes seen, to update the golden values\n"
+      << "  --require-static  fail a rom that has no chip8-aot translation linked in, see src/StaticProgram.h\n"
+      << "  --lockstep        run lanes of a LockstepBatch against as many Chip8 objects, see above\n";
+  }
+
+  PlatformVariant parseVariant(const std::string& name)
+  {
+    for (const PlatformVariant variant : {PlatformVariant::Chip8, PlatformVariant::SuperChip, PlatformVariant::XoChip})
+    {
+      if (name == RomCatalog::toString(variant)) return variant;
+    }
+    throw std::runtime_error("Unknown platform variant " + name);
+  }
+
+  QuirkPreset parseQuirks(const std::string& name)
+  {
+    for (size_t preset = 0; preset < QUIRK_PRESET_COUNT; ++preset)
+    {
+      if (name == QUIRK_PRESET_NAMES[preset]) return static_cast<QuirkPreset>(preset);
+    }
+    throw std::runtime_error("Unknown quirk preset " + name);
+  }
+
+  std::vector<InputEvent> parseInput(const std::string& input)
+  {
+    std::vector<InputEvent> events;
+    if (input == "-") return events;
+
+    std::istringstream stream(input);
+    for (std::string event; std::getline(stream, event, ',');)
+    {
+      const size_t sign = event.find_first_of("+-");
+      if (sign == std::string::npos || sign == 0 || sign + 1 == event.size())
+      {
+        throw std::runtime_error("Bad input event " + event);
+      }
+      const auto key = static_cast<uint8_t>(std::stoul(event.substr(sign + 1), nullptr, 16));
+      if (key >= 16) throw std::runtime_error("Bad key in input event " + event);
+      events.push_back({static_cast<unsigned int>(std::stoul(event.substr(0, sign))), key, event[sign] == '+'});
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+                     [](const InputEvent& a, const InputEvent& b) { return a.frame < b.frame; });
+    return events;
+  }
+
+  std::vector<CorpusEntry> loadManifest(const std::filesystem::path& path)
+  {
+    std::ifstream file(path);
+    if (!file) throw std::runtime_error("Failed to open " + path.string());
+
+    std::vector<CorpusEntry> entries;
+    for (std::string line; std::getline(file, line);)
+    {
+      if (line.empty() || line[0] == '#') continue;
+
+      std::istringstream stream(line);
+      CorpusEntry entry;
+      std::string rom, variant, quirks, input;
+      if (!(stream >> entry.name >> rom >> variant >> quirks >> entry.frames >> input))
+      {
+        throw std::runtime_error("Bad manifest line: " + line);
+      }
+      entry.rom = path.parent_path() / rom;
+      entry.variant = parseVariant(variant);
+      entry.quirks = parseQuirks(quirks);
+      entry.input = parseInput(input);
+
+      for (std::string checkpoint; stream >> checkpoint;)
+      {
+        const size_t colon = checkpoint.find(':');
+        if (colon == std::string::npos || entry.faultFrame != 0)
+          throw std::runtime_error("Bad checkpoint " + checkpoint);
+        if (checkpoint.substr(colon + 1) == "fault")
+        {
+          entry.faultFrame = static_cast<unsigned int>(std::stoul(checkpoint.substr(0, colon)));
+          continue;
+        }
+        entry.checkpoints.push_back({
+          static_cast<unsigned int>(std::stoul(checkpoint.substr(0, colon))),
+          std::stoull(checkpoint.substr(colon + 1), nullptr, 16)
+        });
+      }
+      entries.push_back(std::move(entry));
+    }
+    return entries;
+  }
+
+  std::map<std::string, double> loadBaseline(const std::string& path)
+  {
+    std::ifstream file(path);
+    if (!file) throw std::runtime_error("Failed to open " + path);
+
+    std::map<std::string, double> baseline;
+    std::string name;
+    double instructionsPerSecond;
+    while (file >> name >> instructionsPerSecond) baseline[name] = instructionsPerSecond;
+    return baseline;
+  }
+
+  uint64_t hashScreen(const Chip8& chip8)
+  {
+    return fnv1a64(chip8.getBuffer(), chip8.getWidth() * chip8.getHeight() * sizeof(uint32_t));
+  }
+
+  // one headless run, returns the hash at every checkpoint frame of the entry
+  std::vector<uint64_t> runEntry(const CorpusEntry& entry, const RomImage& rom, const bool requireStatic,
+                                 double& seconds)
+  {
+    Chip8 chip8(rom, nullptr, entry.variant, entry.quirks);
+    chip8.seedRandom(0);
+    if (requireStatic && chip8.getStaticProgram() == nullptr)
+      throw std::runtime_error("No static translation of the rom is linked in");
+
+    std::vector<uint64_t> hashes;
+    auto event = entry.input.begin();
+    auto checkpoint = entry.checkpoints.begin();
+    seconds = 0;
+
+    for (unsigned int frame = 0; frame < entry.frames; ++frame)
+    {
+      for (; event != entry.input.end() && event->frame == frame; ++event)
+      {
+        if (event->pressed) chip8.getKeypad().pressKey(event->key);
+        else chip8.getKeypad().releaseKey(event->key);
+      }
+
+      const Clock::time_point start = Clock::now();
+      try
+      {
+        chip8.Run(CYCLES_PER_FRAME);
+      }
+      catch (const std::exception&)
+      {
+        if (frame + 1 != entry.faultFrame) throw;
+        seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        return hashes;
+      }
+      seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+      for (; checkpoint != entry.checkpoints.end() && checkpoint->frame == frame + 1; ++checkpoint)
+      {
+        hashes.push_back(hashScreen(chip8));
+      }
+    }
+    if (entry.faultFrame != 0) throw std::runtime_error("No fault in frame " + std::to_string(entry.faultFrame));
+    return hashes;
+  }
+
+  // what the lane differs in from the reference, empty when nothing does
+  std::string compareLane(const LockstepBatch& batch, const size_t lane, const Chip8& reference)
+  {
+    std::ostringstream difference;
+    for (size_t x = 0; x < 16; ++x)
+    {
+      if (batch.getRegister(lane, x) != reference.getRegister(x)) difference << " V" << std::hex << x << std::dec;
+    }
+    if (batch.getIndex(lane) != reference.getIndex()) difference << " I";
+    if (batch.getProgramCounter(lane) != reference.getProgramCounter()) difference << " PC";
+    if (batch.getDelayTimer(lane) != reference.getDelayTimer()) difference << " DT";
+    if (batch.getSoundTimer(lane) != reference.getSoundTimer()) difference << " ST";
+    if (batch.getWidth(lane) != reference.getWidth() || batch.getHeight(lane) != reference.getHeight() ||
+      memcmp(batch.getBuffer(lane), reference.getBuffer(),
+             reference.getWidth() * reference.getHeight() * sizeof(uint32_t)) != 0)
+    {
+      difference << " screen";
+    }
+    return difference.str();
+  }
+
+  // --lockstep: returns the hashes of lane 0, throws at the first frame a lane differs from its Chip8
+  std::vector<uint64_t> runLockstep(const CorpusEntry& entry, const RomImage& rom, const size_t lanes,
+                                    double& seconds)
+  {
+    LockstepBatch batch(rom, lanes);
+    std::vector<std::unique_ptr<Chip8>> references;
+    std::vector<bool> faulted(lanes, false);
+    for (size_t lane = 0; lane < lanes; ++lane)
+    {
+      batch.seedRandom(lane, lane);
+      references.push_back(std::make_unique<Chip8>(rom, nullptr, PlatformVariant::Chip8, QuirkPreset::Original));
+      references.back()->seedRandom(lane);
+    }
+
+    std::vector<uint64_t> hashes;
+    auto checkpoint = entry.checkpoints.begin();
+    seconds = 0;
+
+    for (unsigned int frame = 0; frame < entry.frames; ++frame)
+    {
+      for (const InputEvent& event : entry.input)
+      {
+        for (size_t lane = 0; lane < lanes; ++lane)
+        {
+          if (event.frame + lane != frame) continue;
+          for (Keypad* keypad : {&batch.getKeypad(lane), &references[lane]->getKeypad()})
+          {
+            if (event.pressed) keypad->pressKey(event.key);
+            else keypad->releaseKey(event.key);
+          }
+        }
+      }
+
+      const Clock::time_point start = Clock::now();
+      batch.run(CYCLES_PER_FRAME);
+      seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+      for (size_t lane = 0; lane < lanes; ++lane)
+      {
+        if (faulted[lane]) continue;
+        try
+        {
+          for (unsigned int cycle = 0; cycle < CYCLES_PER_FRAME; ++cycle) references[lane]->Cycle();
+        }
+        catch (const std::exception&)
+        {
+          faulted[lane] = true;
+        }
+
+        std::string difference;
+        if (faulted[lane] != batch.isFaulted(lane)) difference = faulted[lane] ? " no fault" : " fault";
+        else if (!faulted[lane]) difference = compareLane(batch, lane, *references[lane]);
+        if (!difference.empty())
+        {
+          throw std::runtime_error("lane " + std::to_string(lane) + " differs after frame " +
+                                   std::to_string(frame + 1) + " in" + difference);
+        }
+      }
+
+      // lane 0 stops where runEntry would
+      if (faulted[0])
+      {
+        if (frame + 1 != entry.faultFrame)
+          throw std::runtime_error("lane 0 faulted in frame " + std::to_string(frame + 1));
+        return hashes;
+      }
+
+      for (; checkpoint != entry.checkpoints.end() && checkpoint->frame == frame + 1; ++checkpoint)
+      {
+        hashes.push_back(fnv1a64(batch.getBuffer(0), batch.getWidth(0) * batch.getHeight(0) * sizeof(uint32_t)));
+      }
+    }
+    if (entry.faultFrame != 0) throw std::runtime_error("No fault in frame " + std::to_string(entry.faultFrame));
+    return hashes;
+  }
+
+  size_t peakResidentKilobytes()
+  {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    // kilobytes on Linux
+    return static_cast<size_t>(usage.ru_maxrss);
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  Options options;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (const std::string argument = argv[i]; argument == "--only" && i + 1 < argc) options.only = argv[++i];
+    else if (argument == "--repeat" && i + 1 < argc) options.repeat = std::max(1, std::atoi(argv[++i]));
+    else if (argument == "--baseline" && i + 1 < argc) options.baselineFile = argv[++i];
+    else if (argument == "--tolerance" && i + 1 < argc) options.tolerance = std::atof(argv[++i]);
+    else if (argument == "--write-baseline" && i + 1 < argc) options.writeBaselineFile = argv[++i];
+    else if (argument == "--print-golden") options.printGolden = true;
+    else if (argument == "--require-static") options.requireStatic = true;
+    else if (argument == "--lockstep" && i + 1 < argc) options.lockstepLanes = std::max(1, std::atoi(argv[++i]));
+    else if (options.manifest.empty()) options.manifest = argument;
+    else
+    {
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (options.manifest.empty())
+  {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  bool failed = false;
+  std::map<std::string, double> measured;
+
+  try
+  {
+    const std::vector<CorpusEntry> entries = loadManifest(options.manifest);
+    const std::map<std::string, double> baseline =
+      options.baselineFile.empty() ? std::map<std::string, double>() : loadBaseline(options.baselineFile);
+    bool found = options.only.empty();
+
+    for (const CorpusEntry& entry : entries)
+    {
+      if (!options.only.empty() && entry.name != options.only) continue;
+      found = true;
+
+      if (options.lockstepLanes > 0 &&
+        (entry.variant != PlatformVariant::Chip8 || entry.quirks != QuirkPreset::Original))
+      {
+        std::cout << entry.name << ": skipped, LockstepBatch only runs CHIP-8 with the original quirks\n";
+        continue;
+      }
+
+      const MappedFile file(entry.rom.string());
+      const RomImage rom(file.data(), file.size());
+
+      std::vector<uint64_t> hashes;
+      double fastest = 0;
+      std::string fault;
+      for (size_t run = 0; run < options.repeat; ++run)
+      {
+        double seconds;
+        try
+        {
+          hashes = options.lockstepLanes > 0
+            ? runLockstep(entry, rom, options.lockstepLanes, seconds)
+            : runEntry(entry, rom, options.requireStatic, seconds);
+        }
+        catch (const std::exception& e)
+        {
+          fault = e.what();
+          break;
+        }
+        if (run == 0 || seconds < fastest) fastest = seconds;
+      }
+
+      if (!fault.empty())
+      {
+        std::cout << entry.name << ": FAULT " << fault << '\n';
+        failed = true;
+        continue;
+      }
+
+      // every lane counts in lockstep mode
+      const double instructionsPerSecond = static_cast<double>(entry.frames) * CYCLES_PER_FRAME *
+        static_cast<double>(std::max<size_t>(options.lockstepLanes, 1)) / std::max(fastest, 1e-9);
+      measured[entry.name] = instructionsPerSecond;
+
+      std::cout << std::left << std::setw(16) << entry.name << std::right << std::setw(6) << entry.frames
+        << " frames" << std::fixed << std::setprecision(2) << std::setw(10) << fastest * 1e3 << " ms"
+        << std::setw(10) << instructionsPerSecond / 1e6 << " M instructions/s" << std::defaultfloat
+        << std::setw(8) << peakResidentKilobytes() << " KB peak RSS\n";
+
+      for (size_t i = 0; i < entry.checkpoints.size(); ++i)
+      {
+        const Checkpoint& checkpoint = entry.checkpoints[i];
+        if (i < hashes.size() && hashes[i] == checkpoint.hash) continue;
+        std::cout << "  frame " << checkpoint.frame << ": expected " << std::hex << checkpoint.hash << ", got "
+          << (i < hashes.size() ? hashes[i] : 0) << std::dec << '\n';
+        failed = true;
+      }
+
+      if (const auto reference = baseline.find(entry.name); reference != baseline.end() &&
+        instructionsPerSecond < reference->second * (1 - options.tolerance))
+      {
+        std::cout << "  throughput regression: " << std::fixed << std::setprecision(2) << instructionsPerSecond / 1e6
+          << " M instructions/s against " << reference->second / 1e6 << " in the baseline\n" << std::defaultfloat;
+        failed = true;
+      }
+
+      if (options.printGolden)
+      {
+        // the same line with the hashes seen, for the same checkpoint frames
+        std::ifstream manifest(options.manifest);
+        for (std::string line; std::getline(manifest, line);)
+        {
+          std::istringstream stream(line);
+          std::string name;
+          if (!(stream >> name) || name != entry.name) continue;
+          std::string field;
+          std::string prefix = name;
+          for (size_t column = 0; column < 5 && stream >> field; ++column) prefix += ' ' + field;
+          std::cout << prefix;
+          for (size_t i = 0; i < entry.checkpoints.size() && i < hashes.size(); ++i)
+          {
+            std::cout << ' ' << entry.checkpoints[i].frame << ':' << std::hex << std::setw(16) << std::setfill('0')
+              << hashes[i] << std::dec << std::setfill(' ');
+          }
+          if (entry.faultFrame != 0) std::cout << ' ' << entry.faultFrame << ":fault";
+          std::cout << '\n';
+        }
+      }
+    }
+
+    if (!found)
+    {
+      std::cerr << "No rom named " << options.only << " in " << options.manifest << '\n';
+      return EXIT_FAILURE;
+    }
+
+    if (!options.writeBaselineFile.empty())
+    {
+      std::ofstream out(options.writeBaselineFile);
+      for (const auto& [name, instructionsPerSecond] : measured) out << name << ' ' << instructionsPerSecond << '\n';
+      if (!out) throw std::runtime_error("Failed to write " + options.writeBaselineFile);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#include "Chip8.h"
+#include "Debugger.h"
+#include "MappedFile.h"
+#include "RomCatalog.h"
+
+// Terminal frontend of the debugger, headless: the rom runs frame by frame (CYCLES_PER_FRAME cycles, like the SDL
+// frontend) only when told to, and Ctrl-C stops a running "continue" at the next frame.
+
+namespace
+{
+  volatile std::sig_atomic_t interrupted = 0;
+
+  void printUsage(const char* program)
+  {
+    std::cerr << "Usage: " << program << " [--quirks original|vip|schip|xochip] <ROM>\n";
+  }
+
+  void printHelp()
+  {
+    std::cout
+      << "  b <addr> [v<x>|i <op> <value>]  breakpoint, op is == != < <= > >=\n"
+      << "  d <addr>                        delete breakpoint\n"
+      << "  w <addr> [length] [r|w|rw]      watchpoint on memory, rw by default\n"
+      << "  dw <index>                      delete watchpoint\n"
+      << "  l                               list breakpoints and watchpoints\n"
+      << "  s [count]                       step instructions\n"
+      << "  c [frames]                      continue until something stops the machine, or for a number of frames\n"
+      << "  r                               registers\n"
+      << "  x <addr> [length]               memory\n"
+      << "  u [addr] [count]                instructions, from the program counter by default\n"
+      << "  bt                              call stack\n"
+      << "  screen                          the screen\n"
+      << "  k <mask>                        keys held from now on, bit k for key k\n"
+      << "  q                               quit\n"
+      << "Addresses and values are hexadecimal.\n";
+  }
+
+  std::optional<unsigned long> parseHex(const std::string& text)
+  {
+    try
+    {
+      size_t used;
+      const unsigned long value = std::stoul(text, &used, 16);
+      if (used == text.size()) return value;
+    }
+    catch (const std::exception&)
+    {
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Comparison> parseComparison(const std::string& text)
+  {
+    if (text == "==") return Comparison::Equal;
+    if (text == "!=") return Comparison::NotEqual;
+    if (text == "<") return Comparison::Less;
+    if (text == "<=") return Comparison::LessEqual;
+    if (text == ">") return Comparison::Greater;
+    if (text == ">=") return Comparison::GreaterEqual;
+    return std::nullopt;
+  }
+
+  const char* comparisonText(const Comparison comparison)
+  {
+    constexpr const char* TEXTS[] = {"==", "!=", "<", "<=", ">", ">="};
+    return TEXTS[static_cast<size_t>(comparison)];
+  }
+
+  void printRegisters(const Chip8& chip8)
+  {
+    std::cout << std::hex << std::uppercase << std::setfill('0') << "PC " << std::setw(4) << chip8.getProgramCounter()
+      << "  I " << std::setw(4) << chip8.getIndex() << "  DT " << std::setw(2) << +chip8.getDelayTimer() << "  ST "
+      << std::setw(2) << +chip8.getSoundTimer() << '\n';
+    for (size_t x = 0; x < 16; ++x)
+    {
+      std::cout << 'V' << x << ' ' << std::setw(2) << +chip8.getRegister(x) << (x % 8 == 7 ? '\n' : ' ');
+    }
+    std::cout << std::dec << std::nouppercase << std::setfill(' ');
+  }
+
+  void printMemory(const Debugger& debugger, const size_t start, const size_t length)
+  {
+    const size_t end = std::min(start + length, debugger.getMemorySize());
+    std::cout << std::hex << std::uppercase << std::setfill('0');
+    for (size_t row = start; row < end; row += 16)
+    {
+      std::cout << std::setw(4) << row << ':';
+      for (size_t address = row; address < std::min(row + 16, end); ++address)
+      {
+        std::cout << ' ' << std::setw(2) << +debugger.readMemory(address);
+      }
+      std::cout << '\n';
+    }
+    std::cout << std::dec << std::nouppercase << std::setfill(' ');
+  }
+
+  void printScreen(const Chip8& chip8)
+  {
+    const uint32_t* pixels = chip8.getBuffer();
+    for (size_t y = 0; y < chip8.getHeight(); ++y)
+    {
+      std::string line;
+      for (size_t x = 0; x < chip8.getWidth(); ++x)
+      {
+        line += pixels[y * chip8.getWidth() + x] != 0 ? '#' : '.';
+      }
+      std::cout << line << '\n';
+    }
+  }
+
+  void list(const Debugger& debugger)
+  {
+    for (const auto& [address, condition] : debugger.getBreakpoints())
+    {
+      std::cout << "breakpoint " << debugger.disassemble(address);
+      if (condition)
+      {
+        std::cout << " if " << std::hex << std::uppercase;
+        if (condition->operand == BREAKPOINT_INDEX) std::cout << 'I';
+        else std::cout << 'V' << +condition->operand;
+        std::cout << ' ' << comparisonText(condition->comparison) << ' ' << condition->value << std::dec
+          << std::nouppercase;
+      }
+      std::cout << '\n';
+    }
+
+    const std::vector<Watchpoint>& watchpoints = debugger.getWatchpoints();
+    for (size_t i = 0; i < watchpoints.size(); ++i)
+    {
+      const Watchpoint& watchpoint = watchpoints[i];
+      std::cout << "watchpoint " << i << ": " << std::hex << std::uppercase << std::setfill('0') << std::setw(4)
+        << watchpoint.start << '-' << std::setw(4) << watchpoint.start + watchpoint.length - 1 << std::dec
+        << std::nouppercase << std::setfill(' ') << ' ' << (watchpoint.read ? "r" : "") << (watchpoint.write ? "w" : "")
+        << '\n';
+    }
+  }
+
+  // runs whole frames until the machine stops, frames run out or Ctrl-C, returns false if the machine threw
+  bool proceed(Debugger& debugger, std::optional<unsigned long> frames)
+  {
+    interrupted = 0;
+    debugger.resume();
+    try
+    {
+      while (!debugger.isPaused() && !interrupted && (!frames || (*frames)-- > 0))
+      {
+        debugger.run(CYCLES_PER_FRAME);
+      }
+    }
+    catch (const std::exception& e)
+    {
+      debugger.pause();
+      std::cout << "the rom faulted: " << e.what() << '\n';
+      return false;
+    }
+    debugger.pause();
+    return true;
+  }
+
+  // false to quit
+  bool execute(Debugger& debugger, Chip8& chip8, const std::string& line)
+  {
+    std::istringstream words(line);
+    std::string command;
+    words >> command;
+    std::string first, second, third;
+    words >> first >> second >> third;
+
+    if (command.empty()) return true;
+    if (command == "q") return false;
+
+    if (command == "b" && parseHex(first))
+    {
+      std::optional<BreakpointCondition> condition;
+      if (!second.empty())
+      {
+        BreakpointCondition parsed{};
+        const std::optional<Comparison> comparison = parseComparison(third);
+        std::string value;
+        words >> value;
+        const std::optional<unsigned long> number = parseHex(value);
+        if (second == "i" || second == "I") parsed.operand = BREAKPOINT_INDEX;
+        else if (second.size() == 2 && (second[0] == 'v' || second[0] == 'V') && parseHex(second.substr(1)))
+          parsed.operand = static_cast<uint8_t>(*parseHex(second.substr(1)));
+        else
+        {
+          std::cout << "operand is v0 to vf or i\n";
+          return true;
+        }
+        if (!comparison || !number)
+        {
+          std::cout << "condition is <operand> <op> <value>\n";
+          return true;
+        }
+        parsed.comparison = *comparison;
+        parsed.value = static_cast<uint16_t>(*number);
+        condition = parsed;
+      }
+      debugger.setBreakpoint(static_cast<uint16_t>(*parseHex(first)), condition);
+    }
+    else if (command == "d" && parseHex(first))
+    {
+      if (!debugger.clearBreakpoint(static_cast<uint16_t>(*parseHex(first)))) std::cout << "no breakpoint there\n";
+    }
+    else if (command == "w" && parseHex(first))
+    {
+      Watchpoint watchpoint{static_cast<uint16_t>(*parseHex(first)), 1, true, true};
+      std::string mode = third;
+      if (const std::optional<unsigned long> length = parseHex(second)) watchpoint.length = static_cast<uint16_t>(*length);
+      else mode = second;
+      if (!mode.empty())
+      {
+        watchpoint.read = mode.find('r') != std::string::npos;
+        watchpoint.write = mode.find('w') != std::string::npos;
+      }
+      std::cout << "watchpoint " << debugger.addWatchpoint(watchpoint) << '\n';
+    }
+    else if (command == "dw" && !first.empty())
+    {
+      if (!debugger.removeWatchpoint(std::stoul(first))) std::cout << "no such watchpoint\n";
+    }
+    else if (command == "l") list(debugger);
+    else if (command == "s")
+    {
+      const unsigned long count = first.empty() ? 1 : std::stoul(first);
+      try
+      {
+        for (unsigned long i = 0; i < count; ++i)
+        {
+          debugger.step();
+          if (debugger.getStop().reason != StopReason::Step) break;
+        }
+      }
+      catch (const std::exception& e)
+      {
+        std::cout << "the rom faulted: " << e.what() << '\n';
+      }
+      std::cout << debugger.describeStop() << '\n' << debugger.disassemble(chip8.getProgramCounter()) << '\n';
+    }
+    else if (command == "c")
+    {
+      proceed(debugger, first.empty() ? std::nullopt : std::optional(std::stoul(first)));
+      std::cout << debugger.describeStop() << '\n' << debugger.disassemble(chip8.getProgramCounter()) << '\n';
+    }
+    else if (command == "r") printRegisters(chip8);
+    else if (command == "x" && parseHex(first)) printMemory(debugger, *parseHex(first), parseHex(second).value_or(0x40));
+    else if (command == "u")
+    {
+      uint16_t address = static_cast<uint16_t>(parseHex(first).value_or(chip8.getProgramCounter()));
+      const unsigned long count = parseHex(second).value_or(8);
+      for (unsigned long i = 0; i < count; ++i, address += 2)
+      {
+        std::cout << (address == chip8.getProgramCounter() ? "> " : "  ") << debugger.disassemble(address) << '\n';
+      }
+    }
+    else if (command == "bt")
+    {
+      const std::vector<uint16_t> calls = debugger.getCallStack();
+      // the stack holds return addresses, the call is the instruction before
+      for (auto call = calls.rbegin(); call != calls.rend(); ++call)
+      {
+        std::cout << "  called from " << debugger.disassemble(static_cast<uint16_t>(*call - 2)) << '\n';
+      }
+      if (calls.empty()) std::cout << "  no call\n";
+    }
+    else if (command == "screen") printScreen(chip8);
+    else if (command == "k" && parseHex(first))
+    {
+      for (size_t key = 0; key < 16; ++key)
+      {
+        if ((*parseHex(first) >> key) & 0x1u) chip8.getKeypad().pressKey(key);
+        else chip8.getKeypad().releaseKey(key);
+      }
+    }
+    else printHelp();
+
+    return true;
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  std::string romFilename;
+  std::optional<QuirkPreset> quirks;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (const std::string argument = argv[i]; argument == "--quirks" && i + 1 < argc)
+    {
+      const std::string name = argv[++i];
+      for (size_t preset = 0; preset < QUIRK_PRESET_COUNT; ++preset)
+      {
+        if (name == QUIRK_PRESET_NAMES[preset]) quirks = static_cast<QuirkPreset>(preset);
+      }
+      if (!quirks)
+      {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+    else if (romFilename.empty()) romFilename = argument;
+    else
+    {
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (romFilename.empty())
+  {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    const MappedFile file(romFilename);
+    const RomImage rom(file.data(), file.size());
+    const PlatformVariant variant = RomCatalog::detectVariant(rom, romFilename);
+    Chip8 chip8(rom, nullptr, variant, quirks.value_or(quirkPresetFor(variant)));
+    Debugger debugger(chip8);
+    debugger.pause();
+
+    std::signal(SIGINT, [](int) { interrupted = 1; });
+
+    std::cout << "h for help\n" << debugger.disassemble(chip8.getProgramCounter()) << '\n';
+    std::string line;
+    while (std::cout << "(chip8) " << std::flush, std::getline(std::cin, line))
+    {
+      // a bad command is reported, the session goes on
+      try
+      {
+        if (!execute(debugger, chip8, line)) break;
+      }
+      catch (const std::exception& e)
+      {
+        std::cout << e.what() << '\n';
+      }
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
@@ -0,0 +1,101 @@
+// libFuzzer target, the input is a rom and the keys pressed while it runs:
+//   2 bytes   rom size, big endian (clipped to the rest of the input and to the ram above STARTING_ADDRESS)
+//   n bytes   the rom
+//   the rest  one byte per frame, the low nibble is a key, pressed when bit 7 is set and released otherwise
+//
+// Every input runs on two machines, reused for every input through reset(), so an iteration does no file I/O and no
+// allocation outside of what the rom itself makes the interpreter do. One steps with Cycle() and records the guest
+// coverage (control transfers and opcodes executed, see GuestCoverage), handed to libFuzzer as extra counters next to
+// the compiler coverage of the emulator, so inputs that make the rom do something new are kept as well. The other runs
+// the same frames with Run(), which fuses instructions and skips waits when no coverage is recorded; it has to fault
+// in the same frame and be in the same state after every frame, anything else is a finding.
+//
+// Build with clang and -DCHIP8_BUILD_FUZZER=ON, then run: chip8-fuzz corpus/
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+
+#include "Chip8.h"
+#include "GuestCoverage.h"
+
+namespace
+{
+  // a rom with no keys in the input still runs for a while
+  constexpr size_t MIN_FRAMES = 16;
+  constexpr size_t MAX_FRAMES = 256;
+
+  // libFuzzer reads every counter in this section after each run
+  __attribute__((section("__libfuzzer_extra_counters"), used)) uint8_t edgeCounters[GuestCoverage::EDGE_COUNT];
+  __attribute__((section("__libfuzzer_extra_counters"), used)) uint8_t opcodeCounters[OPCODE_COUNT];
+
+  GuestCoverage coverage{edgeCounters, opcodeCounters};
+  std::unique_ptr<Chip8> stepped;
+  std::unique_ptr<Chip8> run;
+
+  // runs one frame, false when the rom faulted
+  template <typename Frame>
+  bool runFrame(const Frame& frame)
+  {
+    try
+    {
+      frame();
+      return true;
+    }
+    catch (const std::exception&)
+    {
+      // addresses out of range and stack misuse are the rom's errors, reported the way the interpreter reports them,
+      // only real crashes of the emulator are findings
+      return false;
+    }
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, const size_t size)
+{
+  if (size < 2) return 0;
+
+  const size_t romSize = std::min<size_t>({
+    (static_cast<size_t>(data[0]) << 8u) | data[1], size - 2, RAM_SIZE - STARTING_ADDRESS
+  });
+  const RomImage rom(data + 2, romSize);
+  const uint8_t* keys = data + 2 + romSize;
+  const size_t keyCount = std::min(size - 2 - romSize, MAX_FRAMES);
+
+  if (stepped == nullptr)
+  {
+    stepped = std::make_unique<Chip8>(rom);
+    stepped->setCoverage(&coverage);
+    run = std::make_unique<Chip8>(rom);
+  }
+  else
+  {
+    stepped->reset(rom);
+    run->reset(rom);
+  }
+  stepped->seedRandom(0);
+  run->seedRandom(0);
+
+  for (size_t frame = 0; frame < std::max(keyCount, MIN_FRAMES); ++frame)
+  {
+    if (frame < keyCount)
+    {
+      for (Chip8* chip8 : {stepped.get(), run.get()})
+      {
+        if (keys[frame] & 0x80u) chip8->getKeypad().pressKey(keys[frame] & 0x0Fu);
+        else chip8->getKeypad().releaseKey(keys[frame] & 0x0Fu);
+      }
+    }
+
+    const bool steppedRan = runFrame([]
+    {
+      for (size_t cycle = 0; cycle < CYCLES_PER_FRAME; ++cycle) stepped->Cycle();
+    });
+    const bool runRan = runFrame([] { run->Run(CYCLES_PER_FRAME); });
+    if (steppedRan != runRan || (steppedRan && stepped->getStateHash() != run->getStateHash())) __builtin_trap();
+    if (!steppedRan) break;
+  }
+
+  return 0;
+}
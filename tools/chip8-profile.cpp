@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "Chip8.h"
+#include "GuestProfiler.h"
+#include "GuestSampleLog.h"
+#include "MappedFile.h"
+#include "RomCatalog.h"
+
+// Runs a rom headless for a number of frames and reports where the guest spent its instructions, per subroutine, with
+// the call stacks as folded stacks for flamegraph.pl, inferno or speedscope:
+//   chip8-profile --folded out.folded game.ch8 && flamegraph.pl out.folded > game.svg
+// With --perf-log it also writes timestamped guest samples to join with a perf recording of the same run, which
+// attributes host time (handlers, drawing, redecoding) to guest routines:
+//   perf record -k mono -o perf.data -- chip8-profile --perf-log guest.log game.ch8
+//   tools/perf-guest-report.py guest.log perf.data
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  void printUsage(const char* program)
+  {
+    std::cerr << "Usage: " << program << " [--frames <count>] [--sample <period>] [--labels <file>] "
+      << "[--folded <file>] [--perf-log <file>] [--pairs] [--top <count>] [--quirks original|vip|schip|xochip] <ROM>\n"
+      << "  --frames    frames to run, 1800 (one minute) by default\n"
+      << "  --sample    sample the guest stack every period cycles instead of following every call and return\n"
+      << "  --labels    routine names, one \"<address> <name>\" per line\n"
+      << "  --folded    write the folded call stacks to file, - for stdout\n"
+      << "  --perf-log  write guest samples for tools/perf-guest-report.py, samples every 64 cycles by default\n"
+      << "  --pairs     also count the straight-line opcode pairs and triples, to pick superinstructions\n"
+      << "  --top       lines per table of the report, 20 by default\n";
+  }
+
+  // counts of instructions that ran right after one another without a jump, by OpcodeId
+  struct Sequences
+  {
+    std::map<std::array<uint8_t, 2>, uint64_t> pairs;
+    std::map<std::array<uint8_t, 3>, uint64_t> triples;
+    int32_t previousAddress = -1;
+    int32_t olderAddress = -1;
+    uint8_t previous = OPCODE_NULL;
+    uint8_t older = OPCODE_NULL;
+
+    void record(const uint16_t address, const uint8_t id)
+    {
+      if (address == previousAddress + 2)
+      {
+        ++pairs[{previous, id}];
+        if (previousAddress == olderAddress + 2) ++triples[{older, previous, id}];
+      }
+      olderAddress = previousAddress;
+      older = previous;
+      previousAddress = address;
+      previous = id;
+    }
+  };
+
+  // whether ids are the start of a FUSED_PATTERNS entry
+  template <size_t Length>
+  bool isFused(const std::array<uint8_t, Length>& ids)
+  {
+    for (const FusedPattern& pattern : FUSED_PATTERNS)
+    {
+      if (pattern.length == Length && std::equal(ids.begin(), ids.end(), pattern.ids)) return true;
+    }
+    return false;
+  }
+
+  template <size_t Length>
+  void printSequences(const std::map<std::array<uint8_t, Length>, uint64_t>& counts, const uint64_t total,
+                      const size_t top)
+  {
+    std::vector<std::pair<uint64_t, std::array<uint8_t, Length>>> sorted;
+    for (const auto& [ids, count] : counts) sorted.emplace_back(count, ids);
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    for (size_t i = 0; i < std::min(top, sorted.size()); ++i)
+    {
+      const auto& [count, ids] = sorted[i];
+      std::string names;
+      for (const uint8_t id : ids) names += std::string(names.empty() ? "" : " ") + OPCODE_NAMES[id];
+      std::cout << std::fixed << std::setprecision(1) << std::setw(12) << count << std::setw(8)
+        << 100.0 * static_cast<double>(count) / static_cast<double>(std::max<uint64_t>(total, 1)) << "  " << names
+        << (isFused(ids) ? "  (fused)" : "") << '\n';
+    }
+  }
+
+  void printReport(const GuestProfiler& profiler, const size_t top)
+  {
+    const uint64_t total = std::max<uint64_t>(profiler.getInstructions(), 1);
+    const auto percent = [total](const uint64_t count)
+    {
+      return 100.0 * static_cast<double>(count) / static_cast<double>(total);
+    };
+
+    std::cout << std::setw(12) << "exclusive" << std::setw(8) << "%" << std::setw(12) << "inclusive" << std::setw(8)
+      << "%" << std::setw(10) << "calls" << "  routine\n";
+    const std::vector<RoutineProfile> routines = profiler.getRoutines();
+    for (size_t i = 0; i < std::min(top, routines.size()); ++i)
+    {
+      const RoutineProfile& routine = routines[i];
+      std::cout << std::fixed << std::setprecision(1) << std::setw(12) << routine.exclusive << std::setw(8)
+        << percent(routine.exclusive) << std::setw(12) << routine.inclusive << std::setw(8)
+        << percent(routine.inclusive) << std::setw(10) << routine.calls << "  " << routine.name << '\n';
+    }
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  std::string romFilename;
+  std::string labelsFilename;
+  std::string foldedFilename;
+  std::string perfLogFilename;
+  bool countSequences = false;
+  unsigned int frames = 1800;
+  unsigned int period = 0;
+  size_t top = 20;
+  std::optional<QuirkPreset> quirks;
+
+  try
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      if (const std::string argument = argv[i]; argument == "--frames" && i + 1 < argc) frames = std::stoul(argv[++i]);
+      else if (argument == "--sample" && i + 1 < argc) period = std::max(1ul, std::stoul(argv[++i]));
+      else if (argument == "--labels" && i + 1 < argc) labelsFilename = argv[++i];
+      else if (argument == "--folded" && i + 1 < argc) foldedFilename = argv[++i];
+      else if (argument == "--perf-log" && i + 1 < argc) perfLogFilename = argv[++i];
+      else if (argument == "--pairs") countSequences = true;
+      else if (argument == "--top" && i + 1 < argc) top = std::stoul(argv[++i]);
+      else if (argument == "--quirks" && i + 1 < argc)
+      {
+        const std::string name = argv[++i];
+        for (size_t preset = 0; preset < QUIRK_PRESET_COUNT; ++preset)
+        {
+          if (name == QUIRK_PRESET_NAMES[preset]) quirks = static_cast<QuirkPreset>(preset);
+        }
+        if (!quirks) throw std::invalid_argument("Unknown quirk preset " + name);
+      }
+      else if (romFilename.empty()) romFilename = argument;
+      else throw std::invalid_argument("Unexpected argument " + argument);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (romFilename.empty())
+  {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  // the guest samples need the sampling loop
+  if (!perfLogFilename.empty() && period == 0) period = 64;
+
+  try
+  {
+    const MappedFile file(romFilename);
+    const RomImage rom(file.data(), file.size());
+    const PlatformVariant variant = RomCatalog::detectVariant(rom, romFilename);
+    Chip8 chip8(rom, nullptr, variant, quirks.value_or(quirkPresetFor(variant)));
+    chip8.seedRandom(0);
+
+    GuestProfiler profiler;
+    if (!labelsFilename.empty()) profiler.loadLabels(labelsFilename);
+    Sequences sequences;
+    const std::unique_ptr<GuestSampleLog> log =
+      perfLogFilename.empty() ? nullptr : std::make_unique<GuestSampleLog>(perfLogFilename);
+
+    const uint64_t cycles = static_cast<uint64_t>(frames) * CYCLES_PER_FRAME;
+    const Clock::time_point start = Clock::now();
+    if (period == 0)
+    {
+      chip8.setProfiler(&profiler);
+      for (uint64_t cycle = 0; cycle < cycles; ++cycle)
+      {
+        if (countSequences)
+        {
+          const uint16_t address = chip8.getProgramCounter();
+          sequences.record(address, chip8.getOpcodeId(address));
+        }
+        chip8.Cycle();
+      }
+      chip8.setProfiler(nullptr);
+    }
+    else
+    {
+      for (uint64_t cycle = 0; cycle < cycles;)
+      {
+        const uint64_t run = std::min<uint64_t>(period, cycles - cycle);
+        if (!countSequences) chip8.Run(static_cast<unsigned int>(run));
+        else
+        {
+          for (uint64_t i = 0; i < run; ++i)
+          {
+            const uint16_t address = chip8.getProgramCounter();
+            sequences.record(address, chip8.getOpcodeId(address));
+            chip8.Cycle();
+          }
+        }
+        cycle += run;
+        profiler.sample(chip8, run);
+        if (log) log->record(chip8, static_cast<uint32_t>(run));
+      }
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout << cycles << " instructions in " << frames << " frames, "
+      << (period == 0 ? "exact" : "sampled every " + std::to_string(period) + " cycles") << ", "
+      << static_cast<uint64_t>(static_cast<double>(cycles) / std::max(seconds, 1e-9)) << " instructions/s\n";
+    printReport(profiler, top);
+    if (countSequences)
+    {
+      std::cout << "\n        pairs       %\n";
+      printSequences(sequences.pairs, cycles, top);
+      std::cout << "\n      triples       %\n";
+      printSequences(sequences.triples, cycles, top);
+    }
+
+    if (log && !log->close()) throw std::runtime_error("Failed to write " + perfLogFilename);
+    if (foldedFilename == "-") profiler.writeFolded(std::cout);
+    else if (!foldedFilename.empty())
+    {
+      std::ofstream folded(foldedFilename);
+      profiler.writeFolded(folded);
+      if (!folded) throw std::runtime_error("Failed to write " + foldedFilename);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
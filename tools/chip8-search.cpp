@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Chip8.h"
+#include "InputSearch.h"
+#include "MappedFile.h"
+#include "RomCatalog.h"
+
+// Breadth-first search over the keypad from a rom's start: every level holds each key of the previous one for
+// --frames frames, and a state reached before is pruned instead of being explored again. Reports how many distinct
+// states every level found, which tells how much of the input space a rom actually reacts to, and how fast the search
+// runs:
+//   chip8-search --start 120 --depth 5 --threads 8 game.ch8
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  void printUsage(const char* program)
+  {
+    std::cerr << "Usage: " << program << " [--depth <levels>] [--frames <count>] [--start <frames>] "
+      << "[--threads <count>] [--quirks original|vip|schip|xochip] <ROM>\n"
+      << "  --depth    levels to expand, 4 by default\n"
+      << "  --frames   frames every key is held for, 6 by default\n"
+      << "  --start    frames run with no key held before the search, 0 by default\n"
+      << "  --threads  threads running the machines, one per core by default\n";
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  std::string romFilename;
+  unsigned int depth = 4;
+  unsigned int frames = 6;
+  unsigned int start = 0;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  std::optional<QuirkPreset> quirks;
+
+  try
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      if (const std::string argument = argv[i]; argument == "--depth" && i + 1 < argc) depth = std::stoul(argv[++i]);
+      else if (argument == "--frames" && i + 1 < argc) frames = std::max(1ul, std::stoul(argv[++i]));
+      else if (argument == "--start" && i + 1 < argc) start = std::stoul(argv[++i]);
+      else if (argument == "--threads" && i + 1 < argc) threads = std::max(1ul, std::stoul(argv[++i]));
+      else if (argument == "--quirks" && i + 1 < argc)
+      {
+        const std::string name = argv[++i];
+        for (size_t preset = 0; preset < QUIRK_PRESET_COUNT; ++preset)
+        {
+          if (name == QUIRK_PRESET_NAMES[preset]) quirks = static_cast<QuirkPreset>(preset);
+        }
+        if (!quirks) throw std::invalid_argument("Unknown quirk preset " + name);
+      }
+      else if (romFilename.empty()) romFilename = argument;
+      else throw std::invalid_argument("Unexpected argument " + argument);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (romFilename.empty())
+  {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    const MappedFile file(romFilename);
+    const RomImage rom(file.data(), file.size());
+    const PlatformVariant variant = RomCatalog::detectVariant(rom, romFilename);
+    Chip8 chip8(rom, nullptr, variant, quirks.value_or(quirkPresetFor(variant)));
+    chip8.seedRandom(0);
+    chip8.Run(start * CYCLES_PER_FRAME);
+
+    InputSearch search(chip8, frames, threads);
+    std::vector<size_t> level{0};
+
+    std::cout << std::setw(6) << "depth" << std::setw(12) << "nodes" << std::setw(12) << "pruned" << std::setw(12)
+      << "faulted" << std::setw(12) << "seconds" << std::setw(13) << "children/s" << '\n';
+    const Clock::time_point begin = Clock::now();
+    for (unsigned int current = 1; current <= depth && !level.empty(); ++current)
+    {
+      const uint64_t pruned = search.getPruned();
+      const uint64_t faulted = search.getFaulted();
+      const Clock::time_point levelBegin = Clock::now();
+      std::vector<size_t> next = search.expand(level);
+      const double seconds = std::chrono::duration<double>(Clock::now() - levelBegin).count();
+
+      // the states of a finished level are not needed anymore, the nodes stay for the inputs leading to the next one
+      for (const size_t node : level) search.release(node);
+      const double children = 16.0 * static_cast<double>(level.size());
+      std::cout << std::setw(6) << current << std::setw(12) << next.size() << std::setw(12)
+        << search.getPruned() - pruned << std::setw(12) << search.getFaulted() - faulted << std::fixed
+        << std::setprecision(3) << std::setw(12) << seconds << std::setprecision(0) << std::setw(13)
+        << children / std::max(seconds, 1e-9) << '\n';
+      level = std::move(next);
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    std::cout << search.getNodeCount() << " distinct states, " << search.getPruned() << " pruned in " << std::fixed
+      << std::setprecision(3) << seconds << " s on " << threads << " threads\n";
+    if (!level.empty())
+    {
+      std::cout << "keys to the last state found:";
+      for (const uint8_t key : search.getInputs(level.back())) std::cout << ' ' << std::hex << std::uppercase << +key;
+      std::cout << '\n';
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
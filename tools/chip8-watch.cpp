@@ -0,0 +1,105 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "RomCatalog.h"
+#include "SharedExport.h"
+
+// Reference reader of the shared memory export (SharedExport.h): prints the registers and the screen of an instance
+// started with --export, once or every time a new frame is published.
+
+namespace
+{
+  void printUsage(const char* program)
+  {
+    std::cerr << "Usage: " << program << " [--follow] [--interval <milliseconds>] <segment name>\n";
+  }
+
+  void printState(const SharedExportState& state)
+  {
+    std::cout << "frame " << state.frame << "  "
+      << RomCatalog::toString(static_cast<PlatformVariant>(state.variant)) << "  " << state.width << 'x'
+      << state.height << std::hex << std::setfill('0') << "\nPC " << std::setw(3) << state.programCounter
+      << "  I " << std::setw(3) << state.index << "  DT " << std::setw(2) << +state.delayTimer << "  ST "
+      << std::setw(2) << +state.soundTimer << '\n';
+    for (size_t x = 0; x < 16; ++x)
+    {
+      std::cout << 'V' << x << ' ' << std::setw(2) << +state.registers[x] << (x % 8 == 7 ? '\n' : ' ');
+    }
+    std::cout << std::dec << std::setfill(' ');
+
+    // two screen rows per line of text, so that the 128x64 screen fits a terminal
+    for (uint32_t y = 0; y < state.height; y += 2)
+    {
+      std::string line;
+      for (uint32_t x = 0; x < state.width; ++x)
+      {
+        const bool top = state.pixels[y * state.width + x] != 0;
+        const bool bottom = y + 1 < state.height && state.pixels[(y + 1) * state.width + x] != 0;
+        line += top ? (bottom ? "█" : "▀") : (bottom ? "▄" : " ");
+      }
+      std::cout << line << '\n';
+    }
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  std::string name;
+  bool follow = false;
+  unsigned long interval = 33;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (const std::string argument = argv[i]; argument == "--follow") follow = true;
+    else if (argument == "--interval" && i + 1 < argc) interval = std::stoul(argv[++i]);
+    else if (name.empty()) name = argument;
+    else
+    {
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (name.empty())
+  {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    const SharedExportReader reader(name);
+    SharedExportState state{};
+    uint64_t shown = 0;
+
+    do
+    {
+      if (reader.read(state) && state.frame != shown)
+      {
+        // back to the top left corner and clear, so that following redraws in place
+        if (follow) std::cout << "\x1b[H\x1b[2J";
+        printState(state);
+        std::cout.flush();
+        shown = state.frame;
+      }
+      else if (!follow && shown == 0)
+      {
+        std::cerr << "Nothing published to " << name << " yet\n";
+        return EXIT_FAILURE;
+      }
+
+      if (follow) std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+    }
+    while (follow && reader.isLive());
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "DaemonProtocol.h"
+#include "MappedFile.h"
+#include "PlatformVariant.h"
+
+// Test client of chip8d: creates sessions of a rom, sends step requests spread over them with a number of requests
+// always in flight, and reports the request rate and latency percentiles. Prints the screen of the first session at
+// the end and destroys the sessions.
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  struct Response
+  {
+    DaemonResponseHeader header;
+    std::vector<uint8_t> payload;
+  };
+
+  class Client
+  {
+    int descriptor = -1;
+    uint32_t nextRequest = 1;
+
+    void sendAll(const void* data, size_t size) const
+    {
+      const auto* bytes = static_cast<const uint8_t*>(data);
+      while (size > 0)
+      {
+        const ssize_t written = ::send(descriptor, bytes, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) throw std::runtime_error("chip8d-client: Connection lost");
+        bytes += written;
+        size -= static_cast<size_t>(written);
+      }
+    }
+
+    void receiveAll(void* data, size_t size) const
+    {
+      auto* bytes = static_cast<uint8_t*>(data);
+      while (size > 0)
+      {
+        const ssize_t received = ::recv(descriptor, bytes, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) throw std::runtime_error("chip8d-client: Connection lost");
+        bytes += received;
+        size -= static_cast<size_t>(received);
+      }
+    }
+
+  public:
+    explicit Client(const std::string& socketPath)
+    {
+      sockaddr_un address{};
+      if (socketPath.size() >= sizeof(address.sun_path)) throw std::runtime_error("chip8d-client: Socket path too long");
+      address.sun_family = AF_UNIX;
+      std::strcpy(address.sun_path, socketPath.c_str());
+
+      descriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (descriptor < 0 || connect(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+      {
+        if (descriptor >= 0) close(descriptor);
+        throw std::runtime_error("chip8d-client: Failed to connect to " + socketPath);
+      }
+    }
+
+    ~Client()
+    {
+      close(descriptor);
+    }
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    // returns the request id
+    uint32_t send(const DaemonCommand command, const uint32_t session, const void* payload, const size_t payloadSize,
+                  const void* extra = nullptr, const size_t extraSize = 0)
+    {
+      DaemonRequestHeader header{};
+      header.payloadSize = static_cast<uint32_t>(payloadSize + extraSize);
+      header.requestId = nextRequest++;
+      header.session = session;
+      header.command = static_cast<uint8_t>(command);
+      sendAll(&header, sizeof(header));
+      if (payloadSize > 0) sendAll(payload, payloadSize);
+      if (extraSize > 0) sendAll(extra, extraSize);
+      return header.requestId;
+    }
+
+    Response receive() const
+    {
+      Response response{};
+      receiveAll(&response.header, sizeof(response.header));
+      if (response.header.payloadSize > DAEMON_MAX_PAYLOAD) throw std::runtime_error("chip8d-client: Bad response");
+      response.payload.resize(response.header.payloadSize);
+      receiveAll(response.payload.data(), response.payload.size());
+      return response;
+    }
+
+    Response call(const DaemonCommand command, const uint32_t session, const void* payload = nullptr,
+                  const size_t payloadSize = 0, const void* extra = nullptr, const size_t extraSize = 0)
+    {
+      const uint32_t id = send(command, session, payload, payloadSize, extra, extraSize);
+      Response response = receive();
+      if (response.header.requestId != id) throw std::runtime_error("chip8d-client: Unexpected response");
+      return response;
+    }
+  };
+
+  void printUsage(const char* program)
+  {
+    std::cerr << "Usage: " << program << " [--socket <path>] [--sessions <count>] [--requests <count>] "
+      << "[--pipeline <count>] [--frames <per step>] [--variant chip8|schip|xochip] <ROM>\n";
+  }
+
+  void printSnapshot(const Response& response)
+  {
+    DaemonSnapshot snapshot{};
+    DaemonFrameHeader frame{};
+    std::memcpy(&snapshot, response.payload.data(), sizeof(snapshot));
+    std::memcpy(&frame, response.payload.data() + sizeof(snapshot), sizeof(frame));
+    const uint8_t* bitmap = response.payload.data() + sizeof(snapshot) + sizeof(frame);
+
+    std::cout << "session " << response.header.session << ": " << snapshot.frames << " frames"
+      << (snapshot.faulted ? ", faulted" : "") << std::hex << std::setfill('0') << ", PC " << std::setw(3)
+      << snapshot.programCounter << ", I " << std::setw(3) << snapshot.index << std::dec << std::setfill(' ')
+      << '\n';
+    for (size_t y = 0; y < frame.height; ++y)
+    {
+      std::string line;
+      for (size_t x = 0; x < frame.width; ++x)
+      {
+        const size_t bit = y * frame.width + x;
+        line += (bitmap[bit / 8] >> (7 - bit % 8)) & 0x1u ? '#' : ' ';
+      }
+      std::cout << line << '\n';
+    }
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  std::string socketPath = DAEMON_DEFAULT_SOCKET;
+  std::string romFilename;
+  size_t sessionCount = 1;
+  size_t requests = 10000;
+  size_t pipeline = 1;
+  uint16_t frames = 1;
+  PlatformVariant variant = PlatformVariant::Chip8;
+
+  try
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      if (const std::string argument = argv[i]; argument == "--socket" && i + 1 < argc) socketPath = argv[++i];
+      else if (argument == "--sessions" && i + 1 < argc) sessionCount = std::max(1ul, std::stoul(argv[++i]));
+      else if (argument == "--requests" && i + 1 < argc) requests = std::stoul(argv[++i]);
+      else if (argument == "--pipeline" && i + 1 < argc) pipeline = std::max(1ul, std::stoul(argv[++i]));
+      else if (argument == "--frames" && i + 1 < argc) frames = static_cast<uint16_t>(std::stoul(argv[++i]));
+      else if (argument == "--variant" && i + 1 < argc)
+      {
+        const std::string name = argv[++i];
+        if (name == "schip") variant = PlatformVariant::SuperChip;
+        else if (name == "xochip") variant = PlatformVariant::XoChip;
+        else if (name != "chip8") throw std::invalid_argument("Unknown variant " + name);
+      }
+      else if (romFilename.empty()) romFilename = argument;
+      else throw std::invalid_argument("Unexpected argument " + argument);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (romFilename.empty())
+  {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    const MappedFile rom(romFilename);
+    Client client(socketPath);
+
+    std::vector<uint32_t> sessions;
+    for (size_t i = 0; i < sessionCount; ++i)
+    {
+      DaemonCreateRequest create{};
+      create.seed = i;
+      create.variant = static_cast<uint8_t>(variant);
+      create.quirks = DAEMON_DEFAULT_QUIRKS;
+      const Response response = client.call(DaemonCommand::Create, 0, &create, sizeof(create), rom.data(), rom.size());
+      if (response.header.status != static_cast<uint8_t>(DaemonStatus::Ok))
+        throw std::runtime_error("chip8d-client: Session refused, status " + std::to_string(response.header.status));
+      sessions.push_back(response.header.session);
+    }
+
+    // the request id of every step in flight and when it was sent
+    std::unordered_map<uint32_t, Clock::time_point> inFlight;
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    size_t sent = 0;
+    size_t failed = 0;
+
+    const Clock::time_point start = Clock::now();
+    while (latencies.size() < requests)
+    {
+      while (sent < requests && inFlight.size() < pipeline)
+      {
+        // a different key each step, so the roms reading input see some
+        const DaemonStepRequest step{static_cast<uint16_t>(1u << sent % 16), frames};
+        const uint32_t id = client.send(DaemonCommand::Step, sessions[sent % sessions.size()], &step, sizeof(step));
+        inFlight.emplace(id, Clock::now());
+        ++sent;
+      }
+
+      const Response response = client.receive();
+      const auto found = inFlight.find(response.header.requestId);
+      if (found == inFlight.end()) throw std::runtime_error("chip8d-client: Unexpected response");
+      latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - found->second).count());
+      inFlight.erase(found);
+      if (response.header.status != static_cast<uint8_t>(DaemonStatus::Ok)) ++failed;
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (!latencies.empty())
+    {
+      std::sort(latencies.begin(), latencies.end());
+      const auto percentile = [&latencies](const double fraction)
+      {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()))];
+      };
+      std::cout << std::fixed << std::setprecision(1) << requests << " steps of " << frames << " frames over "
+        << sessions.size() << " sessions, " << pipeline << " in flight: " << requests / seconds << " requests/s, "
+        << "latency p50 " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, p99.9 "
+        << percentile(0.999) << " us, max " << latencies.back() << " us, " << failed << " failed\n";
+    }
+
+    printSnapshot(client.call(DaemonCommand::Snapshot, sessions.front()));
+    for (const uint32_t session : sessions)
+    {
+      client.call(DaemonCommand::Destroy, session);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
@@ -0,0 +1,658 @@
+#include <algorithm>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Chip8.h"
+#include "DaemonProtocol.h"
+
+// Hosts any number of headless Chip8 sessions for clients connecting to a Unix domain socket, see DaemonProtocol.h.
+//
+// One thread multiplexes every connection with epoll: it reads and parses requests, hands them to a pool of workers
+// and writes the responses the workers leave in the outbox. A session is run by at most one worker at a time, in the
+// order its requests arrived: each session keeps its own queue of requests and is on the shared ready queue while that
+// queue is not empty and no worker has it. Sessions belong to the connection that created them and are destroyed when
+// it closes.
+
+namespace
+{
+  struct Request
+  {
+    uint64_t connection;
+    DaemonRequestHeader header;
+    std::vector<uint8_t> payload;
+  };
+
+  struct Session
+  {
+    uint32_t id = 0;
+    uint64_t owner = 0;
+    std::unique_ptr<Chip8> chip8;
+    uint64_t frames = 0;
+    bool faulted = false;
+
+    // guarded by Daemon::mutex
+    std::deque<Request> pending;
+    bool scheduled = false;
+    bool destroyed = false;
+  };
+
+  // a session with requests to run, or a Create request when session is nullptr
+  struct Work
+  {
+    std::shared_ptr<Session> session;
+    Request create;
+  };
+
+  struct Connection
+  {
+    uint64_t id;
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> output;
+    // bytes of output already sent
+    size_t sent = 0;
+    bool waitingWritable = false;
+  };
+
+  // requests are small, reading this much at once empties the socket in one call most of the time
+  constexpr size_t READ_CHUNK = 64 * 1024;
+  constexpr int MAX_EVENTS = 64;
+
+  class Daemon
+  {
+    std::string socketPath;
+    int listener = -1;
+    int epoll = -1;
+    // written by workers when the outbox goes from empty to not empty
+    int wakeup = -1;
+    int signals = -1;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Work> queue;
+    std::unordered_map<uint32_t, std::shared_ptr<Session>> sessions;
+    std::unordered_set<uint64_t> openConnections;
+    uint32_t nextSession = 1;
+    bool stopping = false;
+
+    std::mutex outboxMutex;
+    std::vector<std::pair<uint64_t, std::vector<uint8_t>>> outbox;
+
+    // only touched by the epoll thread
+    std::unordered_map<int, Connection> connections;
+    std::unordered_map<uint64_t, int> connectionDescriptors;
+    uint64_t nextConnection = 1;
+
+    static std::vector<uint8_t> makeResponse(const DaemonRequestHeader& request, DaemonStatus status,
+                                             uint32_t session, size_t payloadSize);
+    static void appendFrame(std::vector<uint8_t>& response, const Chip8& chip8);
+
+    void work();
+    std::vector<uint8_t> create(const Request& request);
+    std::vector<uint8_t> run(Session& session, const Request& request);
+    void respond(uint64_t connection, std::vector<uint8_t> response);
+
+    void accept();
+    void receive(int descriptor);
+    void dispatch(Connection& connection, Request request);
+    void deliver();
+    void flush(int descriptor, Connection& connection);
+    void close(int descriptor);
+
+  public:
+    Daemon(std::string socketPath, size_t threads);
+    ~Daemon();
+    Daemon(const Daemon&) = delete;
+    Daemon& operator=(const Daemon&) = delete;
+
+    // until SIGINT or SIGTERM
+    void serve();
+  };
+
+  Daemon::Daemon(std::string socketPath, const size_t threads): socketPath(std::move(socketPath))
+  {
+    sockaddr_un address{};
+    if (this->socketPath.size() >= sizeof(address.sun_path)) throw std::runtime_error("chip8d: Socket path too long");
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, this->socketPath.c_str());
+
+    // the signals are read from signalfd instead, so that stopping goes through the event loop
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    signals = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    // a socket left behind by a daemon that did not exit cleanly
+    unlink(this->socketPath.c_str());
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(listener, SOMAXCONN) != 0)
+      throw std::runtime_error("chip8d: Failed to listen on " + this->socketPath);
+
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (signals < 0 || epoll < 0 || wakeup < 0) throw std::runtime_error("chip8d: Failed to set up the event loop");
+
+    for (const int descriptor : {listener, wakeup, signals})
+    {
+      epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.fd = descriptor;
+      epoll_ctl(epoll, EPOLL_CTL_ADD, descriptor, &event);
+    }
+
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+    {
+      workers.emplace_back(&Daemon::work, this);
+    }
+  }
+
+  Daemon::~Daemon()
+  {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    ready.notify_all();
+    for (std::thread& worker : workers)
+    {
+      worker.join();
+    }
+
+    for (const auto& [descriptor, connection] : connections)
+    {
+      ::close(descriptor);
+    }
+    for (const int descriptor : {listener, epoll, wakeup, signals})
+    {
+      if (descriptor >= 0) ::close(descriptor);
+    }
+    unlink(socketPath.c_str());
+  }
+
+  std::vector<uint8_t> Daemon::makeResponse(const DaemonRequestHeader& request, const DaemonStatus status,
+                                            const uint32_t session, const size_t payloadSize)
+  {
+    DaemonResponseHeader header{};
+    header.payloadSize = static_cast<uint32_t>(payloadSize);
+    header.requestId = request.requestId;
+    header.session = session;
+    header.command = request.command;
+    header.status = static_cast<uint8_t>(status);
+
+    std::vector<uint8_t> response(sizeof(header));
+    response.reserve(sizeof(header) + payloadSize);
+    std::memcpy(response.data(), &header, sizeof(header));
+    return response;
+  }
+
+  void Daemon::appendFrame(std::vector<uint8_t>& response, const Chip8& chip8)
+  {
+    const DaemonFrameHeader frame{static_cast<uint16_t>(chip8.getWidth()), static_cast<uint16_t>(chip8.getHeight())};
+    const size_t start = response.size();
+    response.resize(start + sizeof(frame) + daemonBitmapSize(frame.width, frame.height));
+    std::memcpy(response.data() + start, &frame, sizeof(frame));
+
+    const uint32_t* pixels = chip8.getBuffer();
+    uint8_t* bitmap = response.data() + start + sizeof(frame);
+    for (size_t i = 0; i < static_cast<size_t>(frame.width) * frame.height; i += 8)
+    {
+      uint8_t byte = 0;
+      for (size_t bit = 0; bit < 8; ++bit)
+      {
+        byte = static_cast<uint8_t>(byte << 1 | (pixels[i + bit] != 0));
+      }
+      bitmap[i / 8] = byte;
+    }
+  }
+
+  void Daemon::work()
+  {
+    while (true)
+    {
+      std::unique_lock lock(mutex);
+      ready.wait(lock, [this] { return stopping || !queue.empty(); });
+      if (stopping) return;
+
+      Work next = std::move(queue.front());
+      queue.pop_front();
+
+      if (!next.session)
+      {
+        lock.unlock();
+        const uint64_t connection = next.create.connection;
+        respond(connection, create(next.create));
+        continue;
+      }
+
+      const std::shared_ptr<Session> session = std::move(next.session);
+      Request request = std::move(session->pending.front());
+      session->pending.pop_front();
+      const bool destroyed = session->destroyed;
+      lock.unlock();
+
+      // nobody else runs this session until it is scheduled again below
+      std::vector<uint8_t> response = destroyed
+                                        ? makeResponse(request.header, DaemonStatus::UnknownSession, 0, 0)
+                                        : run(*session, request);
+      respond(request.connection, std::move(response));
+
+      lock.lock();
+      if (session->pending.empty()) session->scheduled = false;
+      else
+      {
+        queue.push_back(Work{session, {}});
+        ready.notify_one();
+      }
+    }
+  }
+
+  std::vector<uint8_t> Daemon::create(const Request& request)
+  {
+    DaemonCreateRequest parameters{};
+    if (request.payload.size() < sizeof(parameters))
+      return makeResponse(request.header, DaemonStatus::BadRequest, 0, 0);
+    std::memcpy(&parameters, request.payload.data(), sizeof(parameters));
+
+    if (parameters.variant > static_cast<uint8_t>(PlatformVariant::XoChip) ||
+      (parameters.quirks >= QUIRK_PRESET_COUNT && parameters.quirks != DAEMON_DEFAULT_QUIRKS))
+      return makeResponse(request.header, DaemonStatus::RomRejected, 0, 0);
+
+    const auto variant = static_cast<PlatformVariant>(parameters.variant);
+    const QuirkPreset quirks = parameters.quirks == DAEMON_DEFAULT_QUIRKS
+                                 ? quirkPresetFor(variant)
+                                 : static_cast<QuirkPreset>(parameters.quirks);
+
+    auto session = std::make_shared<Session>();
+    session->owner = request.connection;
+    try
+    {
+      const RomImage rom(request.payload.data() + sizeof(parameters), request.payload.size() - sizeof(parameters));
+      session->chip8 = std::make_unique<Chip8>(rom, nullptr, variant, quirks);
+    }
+    catch (const std::exception&)
+    {
+      return makeResponse(request.header, DaemonStatus::RomRejected, 0, 0);
+    }
+    session->chip8->seedRandom(parameters.seed);
+
+    std::lock_guard lock(mutex);
+    // the client went away while the rom was loading, nobody could ever destroy the session
+    if (!openConnections.count(request.connection))
+      return makeResponse(request.header, DaemonStatus::UnknownSession, 0, 0);
+    session->id = nextSession++;
+    sessions.emplace(session->id, session);
+    return makeResponse(request.header, DaemonStatus::Ok, session->id, 0);
+  }
+
+  std::vector<uint8_t> Daemon::run(Session& session, const Request& request)
+  {
+    const DaemonRequestHeader& header = request.header;
+    Chip8& chip8 = *session.chip8;
+
+    const auto setKeys = [&chip8](const uint16_t keys)
+    {
+      Keypad& keypad = chip8.getKeypad();
+      for (size_t key = 0; key < 16; ++key)
+      {
+        if ((keys >> key) & 0x1u) keypad.pressKey(key);
+        else keypad.releaseKey(key);
+      }
+    };
+
+    switch (static_cast<DaemonCommand>(header.command))
+    {
+    case DaemonCommand::Step:
+      {
+        DaemonStepRequest step{};
+        if (request.payload.size() != sizeof(step)) return makeResponse(header, DaemonStatus::BadRequest, session.id, 0);
+        if (session.faulted) return makeResponse(header, DaemonStatus::Faulted, session.id, 0);
+        std::memcpy(&step, request.payload.data(), sizeof(step));
+
+        setKeys(step.keys);
+        try
+        {
+          for (unsigned int frame = 0; frame < step.frames; ++frame)
+          {
+            chip8.Run(CYCLES_PER_FRAME);
+            ++session.frames;
+          }
+        }
+        catch (const std::exception&)
+        {
+          session.faulted = true;
+          return makeResponse(header, DaemonStatus::Faulted, session.id, 0);
+        }
+
+        std::vector<uint8_t> response = makeResponse(
+          header, DaemonStatus::Ok, session.id,
+          sizeof(DaemonFrameHeader) + daemonBitmapSize(chip8.getWidth(), chip8.getHeight()));
+        appendFrame(response, chip8);
+        return response;
+      }
+    case DaemonCommand::Input:
+      {
+        DaemonInputRequest input{};
+        if (request.payload.size() != sizeof(input)) return makeResponse(header, DaemonStatus::BadRequest, session.id, 0);
+        std::memcpy(&input, request.payload.data(), sizeof(input));
+        setKeys(input.keys);
+        return makeResponse(header, DaemonStatus::Ok, session.id, 0);
+      }
+    case DaemonCommand::Snapshot:
+      {
+        DaemonSnapshot snapshot{};
+        snapshot.frames = session.frames;
+        snapshot.programCounter = chip8.getProgramCounter();
+        snapshot.index = chip8.getIndex();
+        for (size_t x = 0; x < 16; ++x)
+        {
+          snapshot.registers[x] = chip8.getRegister(x);
+        }
+        snapshot.delayTimer = chip8.getDelayTimer();
+        snapshot.soundTimer = chip8.getSoundTimer();
+        snapshot.variant = static_cast<uint8_t>(chip8.getVariant());
+        snapshot.quirks = static_cast<uint8_t>(chip8.getQuirkPreset());
+        snapshot.faulted = session.faulted;
+
+        std::vector<uint8_t> response = makeResponse(
+          header, DaemonStatus::Ok, session.id,
+          sizeof(snapshot) + sizeof(DaemonFrameHeader) + daemonBitmapSize(chip8.getWidth(), chip8.getHeight()));
+        response.insert(response.end(), reinterpret_cast<const uint8_t*>(&snapshot),
+                        reinterpret_cast<const uint8_t*>(&snapshot) + sizeof(snapshot));
+        appendFrame(response, chip8);
+        return response;
+      }
+    case DaemonCommand::Destroy:
+      {
+        std::lock_guard lock(mutex);
+        session.destroyed = true;
+        sessions.erase(session.id);
+        return makeResponse(header, DaemonStatus::Ok, session.id, 0);
+      }
+    default:
+      return makeResponse(header, DaemonStatus::BadRequest, session.id, 0);
+    }
+  }
+
+  void Daemon::respond(const uint64_t connection, std::vector<uint8_t> response)
+  {
+    bool wasEmpty;
+    {
+      std::lock_guard lock(outboxMutex);
+      wasEmpty = outbox.empty();
+      outbox.emplace_back(connection, std::move(response));
+    }
+    // one wakeup per batch, the epoll thread takes everything in the outbox at once
+    if (wasEmpty)
+    {
+      constexpr uint64_t one = 1;
+      [[maybe_unused]] const ssize_t written = write(wakeup, &one, sizeof(one));
+    }
+  }
+
+  void Daemon::serve()
+  {
+    epoll_event events[MAX_EVENTS];
+
+    while (true)
+    {
+      const int count = epoll_wait(epoll, events, MAX_EVENTS, -1);
+      if (count < 0 && errno != EINTR) throw std::runtime_error("chip8d: epoll_wait failed");
+
+      for (int i = 0; i < count; ++i)
+      {
+        const int descriptor = events[i].data.fd;
+        if (descriptor == signals) return;
+        if (descriptor == listener) accept();
+        else if (descriptor == wakeup) deliver();
+        else
+        {
+          const auto found = connections.find(descriptor);
+          if (found == connections.end()) continue;
+          if (events[i].events & (EPOLLERR | EPOLLHUP)) close(descriptor);
+          else
+          {
+            if (events[i].events & EPOLLOUT) flush(descriptor, found->second);
+            // flush() closes the connection when the client is gone
+            if (events[i].events & EPOLLIN && connections.count(descriptor)) receive(descriptor);
+          }
+        }
+      }
+    }
+  }
+
+  void Daemon::accept()
+  {
+    while (true)
+    {
+      const int descriptor = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (descriptor < 0) return;
+
+      const uint64_t id = nextConnection++;
+      connections.emplace(descriptor, Connection{id, {}, {}, 0, false});
+      connectionDescriptors.emplace(id, descriptor);
+      {
+        std::lock_guard lock(mutex);
+        openConnections.insert(id);
+      }
+
+      epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.fd = descriptor;
+      epoll_ctl(epoll, EPOLL_CTL_ADD, descriptor, &event);
+    }
+  }
+
+  void Daemon::receive(const int descriptor)
+  {
+    Connection& connection = connections.at(descriptor);
+
+    while (true)
+    {
+      const size_t start = connection.input.size();
+      connection.input.resize(start + READ_CHUNK);
+      const ssize_t received = read(descriptor, connection.input.data() + start, READ_CHUNK);
+      connection.input.resize(start + std::max<ssize_t>(received, 0));
+      if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR))
+      {
+        close(descriptor);
+        return;
+      }
+      if (received < 0) break;
+    }
+
+    size_t offset = 0;
+    while (connection.input.size() - offset >= sizeof(DaemonRequestHeader))
+    {
+      DaemonRequestHeader header{};
+      std::memcpy(&header, connection.input.data() + offset, sizeof(header));
+      if (header.payloadSize > DAEMON_MAX_PAYLOAD)
+      {
+        // the stream cannot be trusted to be in sync any more
+        close(descriptor);
+        return;
+      }
+      if (connection.input.size() - offset < sizeof(header) + header.payloadSize) break;
+
+      const uint8_t* payload = connection.input.data() + offset + sizeof(header);
+      dispatch(connection, Request{connection.id, header, {payload, payload + header.payloadSize}});
+      offset += sizeof(header) + header.payloadSize;
+    }
+    connection.input.erase(connection.input.begin(), connection.input.begin() + static_cast<ptrdiff_t>(offset));
+
+    flush(descriptor, connection);
+  }
+
+  void Daemon::dispatch(Connection& connection, Request request)
+  {
+    const auto command = static_cast<DaemonCommand>(request.header.command);
+    std::unique_lock lock(mutex);
+
+    if (command == DaemonCommand::Create)
+    {
+      queue.push_back(Work{nullptr, std::move(request)});
+      ready.notify_one();
+      return;
+    }
+
+    // another connection's session is as unknown as one that does not exist, ids are easy to guess
+    const auto found = sessions.find(request.header.session);
+    const bool known = found != sessions.end() && found->second->owner == request.connection;
+    if (command < DaemonCommand::Create || command > DaemonCommand::Destroy || !known)
+    {
+      lock.unlock();
+      const DaemonStatus status = !known ? DaemonStatus::UnknownSession : DaemonStatus::BadRequest;
+      const std::vector<uint8_t> response = makeResponse(request.header, status, request.header.session, 0);
+      connection.output.insert(connection.output.end(), response.begin(), response.end());
+      return;
+    }
+
+    Session& session = *found->second;
+    session.pending.push_back(std::move(request));
+    if (!session.scheduled)
+    {
+      session.scheduled = true;
+      queue.push_back(Work{found->second, {}});
+      ready.notify_one();
+    }
+  }
+
+  void Daemon::deliver()
+  {
+    uint64_t value;
+    [[maybe_unused]] const ssize_t drained = read(wakeup, &value, sizeof(value));
+
+    std::vector<std::pair<uint64_t, std::vector<uint8_t>>> responses;
+    {
+      std::lock_guard lock(outboxMutex);
+      responses.swap(outbox);
+    }
+
+    std::vector<int> touched;
+    for (auto& [id, response] : responses)
+    {
+      // the connection closed while its request was running
+      const auto found = connectionDescriptors.find(id);
+      if (found == connectionDescriptors.end()) continue;
+      Connection& connection = connections.at(found->second);
+      if (connection.output.size() == connection.sent) touched.push_back(found->second);
+      connection.output.insert(connection.output.end(), response.begin(), response.end());
+    }
+
+    for (const int descriptor : touched)
+    {
+      if (const auto found = connections.find(descriptor); found != connections.end()) flush(descriptor, found->second);
+    }
+  }
+
+  void Daemon::flush(const int descriptor, Connection& connection)
+  {
+    while (connection.sent < connection.output.size())
+    {
+      const ssize_t written = send(descriptor, connection.output.data() + connection.sent,
+                                   connection.output.size() - connection.sent, MSG_NOSIGNAL);
+      if (written < 0)
+      {
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN)
+        {
+          close(descriptor);
+          return;
+        }
+        break;
+      }
+      connection.sent += static_cast<size_t>(written);
+    }
+
+    const bool pending = connection.sent < connection.output.size();
+    if (!pending)
+    {
+      connection.output.clear();
+      connection.sent = 0;
+    }
+
+    // only ask for EPOLLOUT while the socket buffer is full, otherwise it fires all the time
+    if (pending != connection.waitingWritable)
+    {
+      epoll_event event{};
+      event.events = EPOLLIN | (pending ? EPOLLOUT : 0u);
+      event.data.fd = descriptor;
+      epoll_ctl(epoll, EPOLL_CTL_MOD, descriptor, &event);
+      connection.waitingWritable = pending;
+    }
+  }
+
+  void Daemon::close(const int descriptor)
+  {
+    const uint64_t id = connections.at(descriptor).id;
+    epoll_ctl(epoll, EPOLL_CTL_DEL, descriptor, nullptr);
+    ::close(descriptor);
+    connections.erase(descriptor);
+    connectionDescriptors.erase(id);
+
+    // a worker still running one of them finishes first, the shared_ptr keeps the session alive until then
+    std::lock_guard lock(mutex);
+    openConnections.erase(id);
+    for (auto session = sessions.begin(); session != sessions.end();)
+    {
+      if (session->second->owner == id)
+      {
+        session->second->destroyed = true;
+        session = sessions.erase(session);
+      }
+      else ++session;
+    }
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  std::string socketPath = DAEMON_DEFAULT_SOCKET;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (const std::string argument = argv[i]; argument == "--socket" && i + 1 < argc) socketPath = argv[++i];
+    else if (argument == "--threads" && i + 1 < argc) threads = std::max(1ul, std::stoul(argv[++i]));
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [--socket <path>] [--threads <count>]\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  try
+  {
+    Daemon daemon(socketPath, threads);
+    std::cerr << "chip8d listening on " << socketPath << " with " << threads << " workers\n";
+    daemon.serve();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
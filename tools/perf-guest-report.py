@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Combined host + guest profile: joins a perf recording with the guest samples of chip8-profile --perf-log.
+
+    perf record -k mono -o perf.data -- chip8-profile --perf-log guest.log game.ch8
+    tools/perf-guest-report.py guest.log perf.data
+
+Every perf sample is attributed to the guest sample just before it (the guest is sampled every few dozen cycles, far
+more often than perf samples), which gives the guest routine and PC that host time was spent on. -k mono is needed
+for perf to use the clock of the guest samples. Instead of perf.data, the output of
+`perf script -F pid,time,ip,sym --ns -G` can be given as a text file, or - for stdin.
+"""
+
+import argparse
+import bisect
+import collections
+import re
+import struct
+import subprocess
+import sys
+
+GUEST_SAMPLE_LOG_MAGIC = 0x4C503843
+GUEST_SAMPLE_LOG_VERSION = 1
+HEADER = struct.Struct("=IIII")
+# time, programCounter, routine, cycles, see src/GuestSampleLog.h
+RECORD = struct.Struct("=QHHI")
+STARTING_ADDRESS = 0x200
+UNKNOWN_ROUTINE = 0xFFFF
+# a perf sample further than this after the last guest sample is not in the guest run
+MAX_GAP_NS = 10_000_000
+
+PERF_LINE = re.compile(r"^\s*(\d+)\s+(\d+)\.(\d+):\s+[0-9a-f]+\s+(.*?)\s*$")
+
+
+def read_guest_log(path):
+    with open(path, "rb") as file:
+        data = file.read()
+    if len(data) < HEADER.size:
+        sys.exit(f"{path}: not a guest sample log")
+    magic, version, pid, record_size = HEADER.unpack_from(data)
+    if magic != GUEST_SAMPLE_LOG_MAGIC or version != GUEST_SAMPLE_LOG_VERSION or record_size != RECORD.size:
+        sys.exit(f"{path}: not a guest sample log of this version")
+    end = HEADER.size + (len(data) - HEADER.size) // RECORD.size * RECORD.size
+    return pid, list(RECORD.iter_unpack(data[HEADER.size:end]))
+
+
+def read_labels(path):
+    labels = {}
+    if path is None:
+        return labels
+    with open(path) as file:
+        for number, line in enumerate(file, 1):
+            fields = line.split(None, 1)
+            if not fields or fields[0].startswith("#"):
+                continue
+            try:
+                labels[int(fields[0], 16)] = re.sub(r"[;\s]", "_", fields[1].strip())
+            except (ValueError, IndexError):
+                sys.exit(f"{path}: bad label on line {number}")
+    return labels
+
+
+def perf_lines(source):
+    if source == "-":
+        yield from sys.stdin
+    elif source.endswith(".txt"):
+        with open(source) as file:
+            yield from file
+    else:
+        command = ["perf", "script", "-i", source, "-F", "pid,time,ip,sym", "--ns", "-G"]
+        with subprocess.Popen(command, stdout=subprocess.PIPE, text=True) as perf:
+            yield from perf.stdout
+        if perf.returncode != 0:
+            sys.exit(f"{' '.join(command)} failed")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("guest_log")
+    parser.add_argument("perf", help="perf.data, a perf script .txt output or -")
+    parser.add_argument("--labels", help='routine names, one "<address> <name>" per line')
+    parser.add_argument("--top", type=int, default=20)
+    arguments = parser.parse_args()
+
+    pid, samples = read_guest_log(arguments.guest_log)
+    if not samples:
+        sys.exit(f"{arguments.guest_log}: no samples")
+    labels = read_labels(arguments.labels)
+    times = [sample[0] for sample in samples]
+
+    def name(routine):
+        if routine in labels:
+            return labels[routine]
+        if routine == STARTING_ADDRESS:
+            return "main"
+        if routine == UNKNOWN_ROUTINE:
+            return "unknown"
+        return f"sub_{routine:04X}"
+
+    # guest side: instructions per routine
+    instructions = collections.Counter()
+    for _, _, routine, cycles in samples:
+        instructions[routine] += cycles
+    total_instructions = max(sum(instructions.values()), 1)
+
+    # host side: perf samples of the process, joined with the guest sample before them
+    by_routine = collections.Counter()
+    by_symbol = collections.Counter()
+    by_pc = collections.Counter()
+    outside = 0
+    for line in perf_lines(arguments.perf):
+        match = PERF_LINE.match(line)
+        if match is None or int(match.group(1)) != pid:
+            continue
+        fraction = match.group(3)
+        time = int(match.group(2)) * 1_000_000_000 + int(fraction) * 10 ** (9 - len(fraction))
+        symbol = match.group(4) or "[unknown]"
+
+        index = bisect.bisect_right(times, time) - 1
+        if index < 0 or time - times[index] > MAX_GAP_NS:
+            outside += 1
+            continue
+        _, pc, routine, _ = samples[index]
+        by_routine[routine] += 1
+        by_symbol[routine, symbol] += 1
+        by_pc[pc, routine] += 1
+
+    joined = sum(by_routine.values())
+    print(f"{joined} host samples during the guest run, {outside} outside of it, "
+          f"{total_instructions} guest instructions in {len(samples)} guest samples")
+    if joined == 0:
+        print("no perf sample matches the guest log: was perf recorded with -k mono, on the same run?")
+        return
+
+    # a routine whose host share is above its instruction share costs more than average per instruction
+    print(f"\n{'host %':>8} {'instr %':>8} {'cost':>6}  guest routine")
+    for routine, count in by_routine.most_common(arguments.top):
+        host = 100 * count / joined
+        guest = 100 * instructions[routine] / total_instructions
+        cost = f"{host / guest:6.2f}" if guest > 0 else "     -"
+        print(f"{host:8.1f} {guest:8.1f} {cost}  {name(routine)}")
+
+    print(f"\n{'host %':>8}  guest routine / host symbol")
+    for (routine, symbol), count in by_symbol.most_common(arguments.top):
+        print(f"{100 * count / joined:8.1f}  {name(routine)} / {symbol}")
+
+    print(f"\n{'host %':>8}  guest pc")
+    for (pc, routine), count in by_pc.most_common(arguments.top):
+        print(f"{100 * count / joined:8.1f}  {pc:04X} in {name(routine)}")
+
+
+if __name__ == "__main__":
+    main()